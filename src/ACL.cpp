@@ -9,6 +9,7 @@
 #include "User.h"
 
 #ifdef MURMUR
+#	include "CompiledACL.h"
 #	include "ServerUser.h"
 
 #	include <QtCore/QStack>
@@ -115,15 +116,30 @@ QFlags< ChanACL::Perm > ChanACL::effectivePermissions(ServerUser *p, Channel *ch
 #	endif
 
 	if (cache) {
-		QHash< Channel *, Permissions > *h = cache->value(p);
-		if (h)
-			granted = h->value(chan);
+		granted = cache->value(p, chan);
 	}
 
 	if (granted & Cached) {
 		return granted;
 	}
 
+	if (cache) {
+		granted = cache->compiled().effectivePermissions(*p, *chan);
+
+		cache->insert(p, chan, granted | Cached);
+	} else {
+		granted = evaluatePermissions(p, chan);
+	}
+
+	return granted;
+}
+
+QFlags< ChanACL::Perm > ChanACL::evaluatePermissions(ServerUser *p, Channel *chan) {
+	// Superuser
+	if (p->iId == 0) {
+		return static_cast< Permissions >(All & ~(Speak | Whisper));
+	}
+
 	QStack< Channel * > chanstack;
 	Channel *ch = chan;
 
@@ -135,7 +151,7 @@ QFlags< ChanACL::Perm > ChanACL::effectivePermissions(ServerUser *p, Channel *ch
 	// Default permissions
 	Permissions def = Traverse | Enter | Speak | Whisper | TextMessage | Listen;
 
-	granted = def;
+	Permissions granted = def;
 
 	bool traverse = true;
 	bool write    = false;
@@ -189,14 +205,60 @@ QFlags< ChanACL::Perm > ChanACL::effectivePermissions(ServerUser *p, Channel *ch
 			granted |= Kick | Ban | ResetUserContent | Register | SelfRegister;
 	}
 
-	if (cache) {
-		if (!cache->contains(p))
-			cache->insert(p, new QHash< Channel *, Permissions >);
+	return granted;
+}
+
+ChanACL::ACLCache::ACLCache() : m_compiled(std::make_unique< CompiledACL >()) {
+}
+
+ChanACL::ACLCache::~ACLCache() = default;
 
-		cache->value(p)->insert(chan, granted | Cached);
+ChanACL::Permissions ChanACL::ACLCache::value(const User *user, const Channel *channel) const {
+	const auto it = m_permissions.constFind(user);
+	if (it == m_permissions.constEnd()) {
+		return None;
 	}
 
-	return granted;
+	const std::size_t index = static_cast< std::size_t >(channel->uiOrdinal);
+	return index < it->size() ? (*it)[index] : Permissions(None);
+}
+
+void ChanACL::ACLCache::insert(const User *user, const Channel *channel, Permissions permissions) {
+	std::vector< Permissions > &userPermissions = m_permissions[user];
+
+	const std::size_t index = static_cast< std::size_t >(channel->uiOrdinal);
+	if (index >= userPermissions.size()) {
+		userPermissions.resize(index + 1, None);
+	}
+
+	userPermissions[index] = permissions;
+}
+
+void ChanACL::ACLCache::clearUser(const User *user) {
+	m_permissions.remove(user);
+	m_compiled->clearUser(user);
+}
+
+void ChanACL::ACLCache::clearChannels(const QSet< Channel * > &channels) {
+	for (std::vector< Permissions > &userPermissions : m_permissions) {
+		for (const Channel *channel : channels) {
+			const std::size_t index = static_cast< std::size_t >(channel->uiOrdinal);
+			if (index < userPermissions.size()) {
+				userPermissions[index] = None;
+			}
+		}
+	}
+
+	m_compiled->clearChannels(channels);
+}
+
+void ChanACL::ACLCache::clear() {
+	m_permissions.clear();
+	m_compiled->clear();
+}
+
+CompiledACL &ChanACL::ACLCache::compiled() {
+	return *m_compiled;
 }
 
 #else
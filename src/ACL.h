@@ -9,9 +9,19 @@
 #include <QtCore/QHash>
 #include <QtCore/QObject>
 
+#ifdef MURMUR
+#	include <QtCore/QSet>
+
+#	include <memory>
+#	include <vector>
+#endif
+
 class Channel;
 class User;
 class ServerUser;
+#ifdef MURMUR
+class CompiledACL;
+#endif
 
 class ChanACL : public QObject {
 private:
@@ -47,8 +57,42 @@ public:
 
 	Q_DECLARE_FLAGS(Permissions, Perm)
 
+#ifdef MURMUR
+	/// The effective permissions of users. For every user, they are cached in a dense array indexed by the channels'
+	/// ordinals (see Channel::uiOrdinal), which are bounded by the amount of channels existing at the same time.
+	/// Permissions that aren't cached yet are computed from the compiled form of the ACLs (see CompiledACL), which
+	/// is kept here as well.
+	///
+	/// The permissions in a channel only depend on the ACLs and groups of that channel and its parents, so changes
+	/// to those only require dropping the permissions in the channel's subtree (see clearChannels).
+	class ACLCache {
+	public:
+		ACLCache();
+		~ACLCache();
+
+		/// @returns The cached permissions (including the Cached flag) of the given user in the given channel or
+		/// None if there are none
+		Permissions value(const User *user, const Channel *channel) const;
+		void insert(const User *user, const Channel *channel, Permissions permissions);
+
+		/// Drops everything that has been cached for the given user. This doesn't notice groups that have been
+		/// added or removed in the meantime, which requires clearChannels.
+		void clearUser(const User *user);
+		/// Drops the permissions of all users in the given channels, which have to include all of their subchannels
+		void clearChannels(const QSet< Channel * > &channels);
+		/// Drops everything
+		void clear();
+
+		CompiledACL &compiled();
+
+	private:
+		QHash< const User *, std::vector< Permissions > > m_permissions;
+		std::unique_ptr< CompiledACL > m_compiled;
+	};
+#else
 	typedef QHash< Channel *, Permissions > ChanCache;
 	typedef QHash< User *, ChanCache * > ACLCache;
+#endif
 
 	Channel *c;
 	bool bApplyHere;
@@ -73,6 +117,10 @@ public:
 #ifdef MURMUR
 	static bool hasPermission(ServerUser *p, Channel *c, QFlags< Perm > perm, ACLCache *cache);
 	static QFlags< Perm > effectivePermissions(ServerUser *p, Channel *c, ACLCache *cache);
+	/// Computes the effective permissions of the given user in the given channel by walking the ACLs from the root
+	/// channel down to that channel. This is used by effectivePermissions if no cache is given. CompiledACL has to
+	/// yield exactly the same results.
+	static QFlags< Perm > evaluatePermissions(ServerUser *p, Channel *c);
 #else
 	static QString whatsThis(Perm p);
 #endif
@@ -10,6 +10,14 @@
 
 #include <QtCore/QStack>
 
+#ifdef MURMUR
+#	include <QtCore/QMutex>
+
+#	include <functional>
+#	include <queue>
+#	include <vector>
+#endif
+
 #ifdef MUMBLE
 #	include <queue>
 #	include "PluginManager.h"
@@ -21,6 +29,34 @@ QHash< int, Channel * > Channel::c_qhChannels;
 QReadWriteLock Channel::c_qrwlChannels;
 #endif
 
+#ifdef MURMUR
+namespace {
+QMutex ordinalMutex;
+unsigned int nextOrdinal = 0;
+/// The ordinals of removed channels. The smallest one is reused first, which keeps the dense arrays indexed by them
+/// as short as possible.
+std::priority_queue< unsigned int, std::vector< unsigned int >, std::greater< unsigned int > > freeOrdinals;
+
+unsigned int acquireOrdinal() {
+	QMutexLocker lock(&ordinalMutex);
+
+	if (freeOrdinals.empty()) {
+		return nextOrdinal++;
+	}
+
+	const unsigned int ordinal = freeOrdinals.top();
+	freeOrdinals.pop();
+	return ordinal;
+}
+
+void releaseOrdinal(unsigned int ordinal) {
+	QMutexLocker lock(&ordinalMutex);
+
+	freeOrdinals.push(ordinal);
+}
+} // namespace
+#endif
+
 Channel::Channel(int id, const QString &name, QObject *p) : QObject(p) {
 	iId         = id;
 	iPosition   = 0;
@@ -31,6 +67,9 @@ Channel::Channel(int id, const QString &name, QObject *p) : QObject(p) {
 	cParent     = qobject_cast< Channel * >(p);
 	if (cParent)
 		cParent->addChannel(this);
+#ifdef MURMUR
+	uiOrdinal = acquireOrdinal();
+#endif
 #ifdef MUMBLE
 	uiPermissions = 0;
 	m_filterMode  = ChannelFilterMode::NORMAL;
@@ -56,6 +95,10 @@ Channel::~Channel() {
 
 	Q_ASSERT(qlChannels.count() == 0);
 	Q_ASSERT(children().count() == 0);
+
+#ifdef MURMUR
+	releaseOrdinal(uiOrdinal);
+#endif
 }
 
 #ifdef MUMBLE
@@ -56,6 +56,12 @@ public:
 	std::atomic< bool > localUserCanEnter;
 #endif
 
+#ifdef MURMUR
+	/// A small number identifying the channel among all existing channels. Unlike the ID, it is handed out again as
+	/// soon as the channel is gone, so that per-channel data can be kept in dense arrays (see ChanACL::ACLCache).
+	unsigned int uiOrdinal;
+#endif
+
 	QSet< Channel * > qsPermLinks;
 	QHash< Channel *, int > qhLinks;
 
@@ -10,6 +10,8 @@
 #include <QReadLocker>
 #include <QWriteLocker>
 
+#include <algorithm>
+
 std::size_t qHash(const ChannelListener &listener) {
 	return std::hash< ChannelListener >()(listener);
 };
@@ -19,64 +21,153 @@ bool operator==(const ChannelListener &lhs, const ChannelListener &rhs) {
 }
 
 ChannelListenerManager::ChannelListenerManager()
-	: QObject(nullptr), m_listenerLock(), m_listeningUsers(), m_listenedChannels(), m_volumeLock(),
+	: QObject(nullptr), m_listenerLock(), m_listeningUsers(), m_channelShards(), m_volumeLock(),
 	  m_listenerVolumeAdjustments() {
 }
 
+ChannelListenerManager::ChannelShard &ChannelListenerManager::shardFor(int channelID) {
+	return m_channelShards[static_cast< unsigned int >(channelID) % CHANNEL_SHARDS];
+}
+
+const ChannelListenerManager::ChannelShard &ChannelListenerManager::shardFor(int channelID) const {
+	return m_channelShards[static_cast< unsigned int >(channelID) % CHANNEL_SHARDS];
+}
+
+template< typename Change > void ChannelListenerManager::updateListenerList(int channelID, const Change &change) {
+	ChannelShard &shard = shardFor(channelID);
+
+	std::lock_guard< std::mutex > lock(shard.mutex);
+
+	auto it = shard.channels.find(channelID);
+
+	auto list = it != shard.channels.end() ? std::make_shared< ListenerList >(*it->second)
+										   : std::make_shared< ListenerList >();
+	change(*list);
+
+	if (list->empty()) {
+		if (it != shard.channels.end()) {
+			shard.channels.erase(it);
+		}
+	} else if (it != shard.channels.end()) {
+		it->second = std::move(list);
+	} else {
+		shard.channels.emplace(channelID, std::move(list));
+	}
+}
+
+/// @returns The position of the given session in the given list or the position it would have to be inserted at
+static ChannelListenerManager::ListenerList::iterator findListener(ChannelListenerManager::ListenerList &list,
+																	unsigned int userSession) {
+	return std::lower_bound(list.begin(), list.end(), userSession,
+							[](const ChannelListenerManager::ListenerEntry &entry, unsigned int session) {
+								return entry.userSession < session;
+							});
+}
+
 void ChannelListenerManager::addListener(unsigned int userSession, int channelID) {
-	QWriteLocker lock(&m_listenerLock);
+	{
+		QWriteLocker lock(&m_listenerLock);
+
+		m_listeningUsers[userSession] << channelID;
+	}
+	{
+		QReadLocker lock(&m_volumeLock);
 
-	m_listeningUsers[userSession] << channelID;
-	m_listenedChannels[channelID] << userSession;
+		ChannelListener key = {};
+		key.channelID       = channelID;
+		key.userSession     = userSession;
+
+		auto volumeIt                           = m_listenerVolumeAdjustments.find(key);
+		const VolumeAdjustment volumeAdjustment = volumeIt != m_listenerVolumeAdjustments.end()
+													  ? volumeIt->second
+													  : VolumeAdjustment::fromFactor(1.0f);
+
+		updateListenerList(channelID, [userSession, &volumeAdjustment](ListenerList &list) {
+			auto it = findListener(list, userSession);
+			if (it == list.end() || it->userSession != userSession) {
+				list.insert(it, ListenerEntry{ userSession, volumeAdjustment });
+			}
+		});
+	}
+
+	emit listenersChanged(channelID);
 }
 
 void ChannelListenerManager::removeListener(unsigned int userSession, int channelID) {
-	QWriteLocker lock(&m_listenerLock);
+	{
+		QWriteLocker lock(&m_listenerLock);
+
+		m_listeningUsers[userSession].remove(channelID);
+	}
 
-	m_listeningUsers[userSession].remove(channelID);
-	m_listenedChannels[channelID].remove(userSession);
+	updateListenerList(channelID, [userSession](ListenerList &list) {
+		auto it = findListener(list, userSession);
+		if (it != list.end() && it->userSession == userSession) {
+			list.erase(it);
+		}
+	});
+
+	emit listenersChanged(channelID);
 }
 
 bool ChannelListenerManager::isListening(unsigned int userSession, int channelID) const {
-	QReadLocker lock(&m_listenerLock);
+	const std::shared_ptr< const ListenerList > list = getListenerEntries(channelID);
 
-	return m_listenedChannels[channelID].contains(userSession);
+	return std::binary_search(list->begin(), list->end(), ListenerEntry{ userSession, VolumeAdjustment() },
+							  [](const ListenerEntry &lhs, const ListenerEntry &rhs) {
+								  return lhs.userSession < rhs.userSession;
+							  });
 }
 
 bool ChannelListenerManager::isListeningToAny(unsigned int userSession) const {
 	QReadLocker lock(&m_listenerLock);
 
-	return !m_listeningUsers[userSession].isEmpty();
+	return !m_listeningUsers.value(userSession).isEmpty();
 }
 
 bool ChannelListenerManager::isListenedByAny(int channelID) const {
-	QReadLocker lock(&m_listenerLock);
-
-	return !m_listenedChannels[channelID].isEmpty();
+	return !getListenerEntries(channelID)->empty();
 }
 
 const QSet< unsigned int > ChannelListenerManager::getListenersForChannel(int channelID) const {
-	QReadLocker lock(&m_listenerLock);
+	const std::shared_ptr< const ListenerList > list = getListenerEntries(channelID);
+
+	QSet< unsigned int > sessions;
+	sessions.reserve(static_cast< int >(list->size()));
+	for (const ListenerEntry &entry : *list) {
+		sessions.insert(entry.userSession);
+	}
 
-	return m_listenedChannels[channelID];
+	return sessions;
+}
+
+std::shared_ptr< const ChannelListenerManager::ListenerList >
+	ChannelListenerManager::getListenerEntries(int channelID) const {
+	static const std::shared_ptr< const ListenerList > empty = std::make_shared< const ListenerList >();
+
+	const ChannelShard &shard = shardFor(channelID);
+
+	std::lock_guard< std::mutex > lock(shard.mutex);
+
+	auto it = shard.channels.find(channelID);
+
+	return it != shard.channels.end() ? it->second : empty;
 }
 
 const QSet< int > ChannelListenerManager::getListenedChannelsForUser(unsigned int userSession) const {
 	QReadLocker lock(&m_listenerLock);
 
-	return m_listeningUsers[userSession];
+	return m_listeningUsers.value(userSession);
 }
 
 int ChannelListenerManager::getListenerCountForChannel(int channelID) const {
-	QReadLocker lock(&m_listenerLock);
-
-	return m_listenedChannels[channelID].size();
+	return static_cast< int >(getListenerEntries(channelID)->size());
 }
 
 int ChannelListenerManager::getListenedChannelCountForUser(unsigned int userSession) const {
 	QReadLocker lock(&m_listenerLock);
 
-	return m_listeningUsers[userSession].size();
+	return m_listeningUsers.value(userSession).size();
 }
 
 void ChannelListenerManager::setListenerVolumeAdjustment(unsigned int userSession, int channelID,
@@ -95,6 +186,13 @@ void ChannelListenerManager::setListenerVolumeAdjustment(unsigned int userSessio
 		}
 
 		m_listenerVolumeAdjustments[key] = volumeAdjustment;
+
+		updateListenerList(channelID, [userSession, &volumeAdjustment](ListenerList &list) {
+			auto it = findListener(list, userSession);
+			if (it != list.end() && it->userSession == userSession) {
+				it->volumeAdjustment = volumeAdjustment;
+			}
+		});
 	}
 
 	if (oldValue != volumeAdjustment.factor) {
@@ -102,10 +200,7 @@ void ChannelListenerManager::setListenerVolumeAdjustment(unsigned int userSessio
 	}
 }
 
-const VolumeAdjustment &ChannelListenerManager::getListenerVolumeAdjustment(unsigned int userSession,
-																			int channelID) const {
-	static VolumeAdjustment fallbackObj = VolumeAdjustment::fromFactor(1.0f);
-
+VolumeAdjustment ChannelListenerManager::getListenerVolumeAdjustment(unsigned int userSession, int channelID) const {
 	QReadLocker lock(&m_volumeLock);
 
 	ChannelListener key = {};
@@ -115,7 +210,7 @@ const VolumeAdjustment &ChannelListenerManager::getListenerVolumeAdjustment(unsi
 	auto it = m_listenerVolumeAdjustments.find(key);
 
 	if (it == m_listenerVolumeAdjustments.end()) {
-		return fallbackObj;
+		return VolumeAdjustment::fromFactor(1.0f);
 	} else {
 		return it->second;
 	}
@@ -123,12 +218,14 @@ const VolumeAdjustment &ChannelListenerManager::getListenerVolumeAdjustment(unsi
 
 std::unordered_map< int, VolumeAdjustment >
 	ChannelListenerManager::getAllListenerVolumeAdjustments(unsigned int userSession) const {
-	QReadLocker lock1(&m_volumeLock);
-	QReadLocker lock2(&m_listenerLock);
+	// m_listenerLock and m_volumeLock are never held at the same time, so they can't be taken in different orders
+	const QSet< int > channelIDs = getListenedChannelsForUser(userSession);
+
+	QReadLocker lock(&m_volumeLock);
 
 	std::unordered_map< int, VolumeAdjustment > adjustments;
 
-	for (int channelID : m_listeningUsers.value(userSession)) {
+	for (int channelID : channelIDs) {
 		ChannelListener listener = {};
 		listener.channelID       = channelID;
 		listener.userSession     = userSession;
@@ -144,13 +241,24 @@ std::unordered_map< int, VolumeAdjustment >
 }
 
 void ChannelListenerManager::clear() {
+	QList< int > channelIDs;
 	{
 		QWriteLocker lock(&m_listenerLock);
 		m_listeningUsers.clear();
-		m_listenedChannels.clear();
 	}
 	{
 		QWriteLocker lock(&m_volumeLock);
 		m_listenerVolumeAdjustments.clear();
 	}
+	for (ChannelShard &shard : m_channelShards) {
+		std::lock_guard< std::mutex > lock(shard.mutex);
+		for (const auto &channel : shard.channels) {
+			channelIDs << channel.first;
+		}
+		shard.channels.clear();
+	}
+
+	for (int channelID : channelIDs) {
+		emit listenersChanged(channelID);
+	}
 }
@@ -13,7 +13,11 @@
 #include <QtCore/QReadWriteLock>
 #include <QtCore/QSet>
 
+#include <array>
+#include <memory>
+#include <mutex>
 #include <unordered_map>
+#include <vector>
 
 class User;
 class Channel;
@@ -28,7 +32,16 @@ struct ChannelListener {
 // Make ChannelListener hashable and comparable
 template<> struct std::hash< ChannelListener > {
 	std::size_t operator()(const ChannelListener &val) const {
-		return std::hash< unsigned int >()(val.userSession) ^ (std::hash< int >()(val.channelID) << 2);
+		// Sessions and channel IDs are both small numbers, so they are put into separate halves before mixing them
+		// with the finalizer of MurmurHash3
+		quint64 key = (static_cast< quint64 >(val.userSession) << 32) | static_cast< quint32 >(val.channelID);
+		key ^= key >> 33;
+		key *= 0xff51afd7ed558ccdULL;
+		key ^= key >> 33;
+		key *= 0xc4ceb9fe1a85ec53ULL;
+		key ^= key >> 33;
+
+		return static_cast< std::size_t >(key);
 	}
 };
 std::size_t qHash(const ChannelListener &listener);
@@ -43,19 +56,46 @@ private:
 	Q_OBJECT
 	Q_DISABLE_COPY(ChannelListenerManager)
 
+public:
+	/// A listener of a channel along with its volume adjustment
+	struct ListenerEntry {
+		unsigned int userSession;
+		VolumeAdjustment volumeAdjustment;
+	};
+	/// The listeners of a channel, sorted by session. A list is never changed once it has been published, every
+	/// change replaces the channel's list by a changed copy instead.
+	using ListenerList = std::vector< ListenerEntry >;
+
 protected:
-	/// A lock for guarding m_listeningUsers as well as m_listenedChannels
+	/// The listener lists of some of the channels (by channel ID modulo CHANNEL_SHARDS), so that looking up the
+	/// lists of different channels rarely waits on the same lock.
+	struct ChannelShard {
+		/// Only held while a list is looked up or replaced, never while it is read
+		mutable std::mutex mutex;
+		std::unordered_map< int, std::shared_ptr< const ListenerList > > channels;
+	};
+
+	static constexpr std::size_t CHANNEL_SHARDS = 16;
+
+	/// A lock for guarding m_listeningUsers
 	mutable QReadWriteLock m_listenerLock;
 	/// A map between a user's session and a list of IDs of all channels the user is listening to
 	QHash< unsigned int, QSet< int > > m_listeningUsers;
-	/// A map between a channel's ID and a list of all user-sessions of users listening to that channel
-	QHash< int, QSet< unsigned int > > m_listenedChannels;
-	/// A lock for guarding m_listenerVolumeAdjustments
+	std::array< ChannelShard, CHANNEL_SHARDS > m_channelShards;
+	/// A lock for guarding m_listenerVolumeAdjustments. It is held while the volume adjustments in the listener
+	/// lists are updated, so that those always match m_listenerVolumeAdjustments.
 	mutable QReadWriteLock m_volumeLock;
 	/// A map between channel IDs and local volume adjustments to be made for ChannelListeners
-	/// in that channel
+	/// in that channel. Volume adjustments are kept when the listener is removed.
 	std::unordered_map< ChannelListener, VolumeAdjustment > m_listenerVolumeAdjustments;
 
+	ChannelShard &shardFor(int channelID);
+	const ChannelShard &shardFor(int channelID) const;
+	/// Replaces the listener list of the given channel by a copy that has been changed by the given function
+	///
+	/// @tparam Change A callable taking ListenerList &
+	template< typename Change > void updateListenerList(int channelID, const Change &change);
+
 public:
 	/// Constructor
 	explicit ChannelListenerManager();
@@ -89,6 +129,13 @@ public:
 	/// @returns A set of user sessions of users listening to the given channel
 	const QSet< unsigned int > getListenersForChannel(int channelID) const;
 
+	/// Meant for the audio path, which needs the listeners along with their volume adjustments for every packet.
+	/// The list may be read without any locking, it is never changed.
+	///
+	/// @param channelID The ID of the channel
+	/// @returns The current listeners of the given channel (never nullptr)
+	std::shared_ptr< const ListenerList > getListenerEntries(int channelID) const;
+
 	/// @param userSession The session ID of the user
 	/// @returns A set of channel IDs of channels the given user is listening to
 	const QSet< int > getListenedChannelsForUser(unsigned int userSession) const;
@@ -111,7 +158,7 @@ public:
 	/// @param userSession The session ID of the user
 	/// @param channelID The ID of the channel
 	/// @returns The volume adjustment for the listener of the given user in the given channel.
-	const VolumeAdjustment &getListenerVolumeAdjustment(unsigned int userSession, int channelID) const;
+	VolumeAdjustment getListenerVolumeAdjustment(unsigned int userSession, int channelID) const;
 
 	/// @param userSession The session ID of the user whose listener's volume adjustments to obtain
 	/// @returns A map between channel IDs and the currently set volume adjustment
@@ -121,6 +168,8 @@ public:
 	void clear();
 signals:
 	void localVolumeAdjustmentsChanged(int channelID, float newAdjustment, float oldAdjustment);
+	/// Emitted whenever a listener has been added to or removed from the given channel
+	void listenersChanged(int channelID);
 };
 
 #endif // MUMBLE_CHANNELLISTENERMANAGER_H_
@@ -23,6 +23,45 @@
 HANDLE Connection::hQoS = nullptr;
 #endif
 
+#ifdef MURMUR
+Connection::Connection(QObject *p, QSslSocket *qtsSock, QThread *ioThread) : QObject(p) {
+	m_io                 = new ConnectionIO(qtsSock);
+	bDisconnectedEmitted = false;
+	csCrypt              = std::make_unique< CryptStateOCB2 >();
+
+	static bool bDeclared = false;
+	if (!bDeclared) {
+		bDeclared = true;
+		qRegisterMetaType< QAbstractSocket::SocketError >("QAbstractSocket::SocketError");
+		qRegisterMetaType< Mumble::Protocol::TCPMessageType >("Mumble::Protocol::TCPMessageType");
+		qRegisterMetaType< TCPMessagePtr >("TCPMessagePtr");
+		qRegisterMetaType< QList< QSslError > >("QList<QSslError>");
+	}
+
+	int nodelay = 1;
+	setsockopt(static_cast< int >(m_io->socketDescriptor()), IPPROTO_TCP, TCP_NODELAY,
+			   reinterpret_cast< char * >(&nodelay), static_cast< socklen_t >(sizeof(nodelay)));
+
+	// These are queued connections if the I/O happens on a network thread
+	connect(m_io, SIGNAL(encrypted()), this, SIGNAL(encrypted()));
+	connect(m_io, SIGNAL(connectionClosed(QAbstractSocket::SocketError, const QString &)), this,
+			SIGNAL(connectionClosed(QAbstractSocket::SocketError, const QString &)));
+	connect(m_io, SIGNAL(message(Mumble::Protocol::TCPMessageType, const QByteArray &, const TCPMessagePtr &)), this,
+			SLOT(ioMessage(Mumble::Protocol::TCPMessageType, const QByteArray &, const TCPMessagePtr &)));
+	connect(m_io, SIGNAL(sslErrors(const QList< QSslError > &)), this,
+			SIGNAL(handleSslErrors(const QList< QSslError > &)));
+	connect(m_io, SIGNAL(drained()), this, SIGNAL(drained()));
+
+	if (ioThread) {
+		m_io->moveToThread(ioThread);
+	}
+
+	qtLastPacket.restart();
+#	ifdef Q_OS_WIN
+	dwFlow = 0;
+#	endif
+}
+#else
 Connection::Connection(QObject *p, QSslSocket *qtsSock) : QObject(p) {
 	qtsSocket = qtsSock;
 	qtsSocket->setParent(this);
@@ -48,10 +87,11 @@ Connection::Connection(QObject *p, QSslSocket *qtsSock) : QObject(p) {
 	connect(qtsSocket, SIGNAL(sslErrors(const QList< QSslError > &)), this,
 			SLOT(socketSslErrors(const QList< QSslError > &)));
 	qtLastPacket.restart();
-#ifdef Q_OS_WIN
+#	ifdef Q_OS_WIN
 	dwFlow = 0;
-#endif
+#	endif
 }
+#endif
 
 Connection::~Connection() {
 #ifdef Q_OS_WIN
@@ -60,30 +100,40 @@ Connection::~Connection() {
 			qWarning("Connection: Failed to remove flow from QoS");
 	}
 #endif
+#ifdef MURMUR
+	// The socket is closed by its own thread
+	m_io->deleteLater();
+#endif
 }
 
 void Connection::setToS() {
+#ifdef MURMUR
+	const qintptr socketDescriptor = m_io->socketDescriptor();
+#else
+	const qintptr socketDescriptor = qtsSocket->socketDescriptor();
+#endif
+
 #if defined(Q_OS_WIN)
 	if (dwFlow || !hQoS)
 		return;
 
 	dwFlow = 0;
-	if (!QOSAddSocketToFlow(hQoS, qtsSocket->socketDescriptor(), nullptr, QOSTrafficTypeAudioVideo,
-							QOS_NON_ADAPTIVE_FLOW, reinterpret_cast< PQOS_FLOWID >(&dwFlow)))
+	if (!QOSAddSocketToFlow(hQoS, socketDescriptor, nullptr, QOSTrafficTypeAudioVideo, QOS_NON_ADAPTIVE_FLOW,
+							reinterpret_cast< PQOS_FLOWID >(&dwFlow)))
 		qWarning("Connection: Failed to add flow to QOS");
 #elif defined(Q_OS_UNIX)
 	int val = 0xa0;
-	if (setsockopt(static_cast< int >(qtsSocket->socketDescriptor()), IPPROTO_IP, IP_TOS, &val, sizeof(val))) {
+	if (setsockopt(static_cast< int >(socketDescriptor), IPPROTO_IP, IP_TOS, &val, sizeof(val))) {
 		val = 0x60;
-		if (setsockopt(static_cast< int >(qtsSocket->socketDescriptor()), IPPROTO_IP, IP_TOS, &val, sizeof(val)))
+		if (setsockopt(static_cast< int >(socketDescriptor), IPPROTO_IP, IP_TOS, &val, sizeof(val)))
 			qWarning("Connection: Failed to set TOS for TCP Socket");
 	}
 #	if defined(SO_PRIORITY)
 	socklen_t optlen = sizeof(val);
-	if (getsockopt(static_cast< int >(qtsSocket->socketDescriptor()), SOL_SOCKET, SO_PRIORITY, &val, &optlen) == 0) {
+	if (getsockopt(static_cast< int >(socketDescriptor), SOL_SOCKET, SO_PRIORITY, &val, &optlen) == 0) {
 		if (val == 0) {
 			val = 6;
-			setsockopt(static_cast< int >(qtsSocket->socketDescriptor()), SOL_SOCKET, SO_PRIORITY, &val, sizeof(val));
+			setsockopt(static_cast< int >(socketDescriptor), SOL_SOCKET, SO_PRIORITY, &val, sizeof(val));
 		}
 	}
 #	endif
@@ -99,6 +149,18 @@ void Connection::resetActivityTime() {
 	qtLastPacket.restart();
 }
 
+#ifdef MURMUR
+void Connection::ioMessage(Mumble::Protocol::TCPMessageType type, const QByteArray &qbaMsg, const TCPMessagePtr &msg) {
+	// Messages that have still been in flight when the connection has been closed are dropped
+	if (!bDisconnectedEmitted) {
+		emit message(type, qbaMsg, msg);
+	}
+}
+
+void Connection::startServerEncryption() {
+	m_io->startServerEncryption();
+}
+#else
 /**
  * This function waits until a complete package is received and then emits it as a message.
  * It gets called everytime new data is available and interprets the message prefix header
@@ -157,6 +219,7 @@ void Connection::proceedAnyway() {
 void Connection::socketDisconnected() {
 	emit connectionClosed(QAbstractSocket::UnknownSocketError, QString());
 }
+#endif
 
 void Connection::messageToNetwork(const ::google::protobuf::Message &msg, Mumble::Protocol::TCPMessageType msgType,
 								  QByteArray &cache) {
@@ -173,7 +236,8 @@ void Connection::messageToNetwork(const ::google::protobuf::Message &msg, Mumble
 	qToBigEndian< quint16 >(static_cast< quint16 >(msgType), &uc[0]);
 	qToBigEndian< quint32 >(len, &uc[2]);
 
-	msg.SerializeToArray(uc + 6, len);
+	// ByteSizeLong() has cached the sizes of all (sub)messages, so they don't have to be computed again
+	msg.SerializeWithCachedSizesToArray(uc + 6);
 }
 
 void Connection::sendMessage(const ::google::protobuf::Message &msg, Mumble::Protocol::TCPMessageType msgType,
@@ -185,6 +249,55 @@ void Connection::sendMessage(const ::google::protobuf::Message &msg, Mumble::Pro
 	sendMessage(cache);
 }
 
+#ifdef MURMUR
+void Connection::sendMessage(const QByteArray &qbaMsg) {
+	m_io->send(qbaMsg);
+}
+
+void Connection::forceFlush() {
+	m_io->flush();
+}
+
+qint64 Connection::bytesToWrite() const {
+	return m_io->bytesToWrite();
+}
+
+void Connection::notifyWhenDrained() {
+	m_io->notifyWhenDrained();
+}
+
+void Connection::disconnectSocket(bool force) {
+	m_io->disconnectSocket(force);
+}
+
+QHostAddress Connection::peerAddress() const {
+	return m_io->peerAddress();
+}
+
+quint16 Connection::peerPort() const {
+	return m_io->peerPort();
+}
+
+QHostAddress Connection::localAddress() const {
+	return m_io->localAddress();
+}
+
+quint16 Connection::localPort() const {
+	return m_io->localPort();
+}
+
+QList< QSslCertificate > Connection::peerCertificateChain() const {
+	return m_io->peerCertificateChain();
+}
+
+QSslCipher Connection::sessionCipher() const {
+	return m_io->sessionCipher();
+}
+
+QSsl::SslProtocol Connection::sessionProtocol() const {
+	return m_io->sessionProtocol();
+}
+#else
 void Connection::sendMessage(const QByteArray &qbaMsg) {
 	if (!qbaMsg.isEmpty())
 		qtsSocket->write(qbaMsg);
@@ -243,12 +356,13 @@ QSslCipher Connection::sessionCipher() const {
 }
 
 QSsl::SslProtocol Connection::sessionProtocol() const {
-#if QT_VERSION >= 0x050400
+#	if QT_VERSION >= 0x050400
 	return qtsSocket->sessionProtocol();
-#else
+#	else
 	return QSsl::UnknownProtocol; // Cannot determine session cipher. We only know it's some TLS variant
-#endif
+#	endif
 }
+#endif
 
 QString Connection::sessionProtocolString() const {
 #if QT_VERSION >= 0x050400
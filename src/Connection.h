@@ -17,6 +17,10 @@
 #include "crypto/CryptState.h"
 #include "crypto/CryptStateOCB2.h"
 
+#ifdef MURMUR
+#	include "ConnectionIO.h"
+#endif
+
 #include <QtCore/QElapsedTimer>
 #include <QtCore/QList>
 #include <QtCore/QMutex>
@@ -39,29 +43,58 @@ private:
 	Q_OBJECT
 	Q_DISABLE_COPY(Connection)
 protected:
+#ifdef MURMUR
+	/// The socket and all I/O on it, which may live on a network thread
+	ConnectionIO *m_io;
+#else
 	QSslSocket *qtsSocket;
-	QElapsedTimer qtLastPacket;
 	Mumble::Protocol::TCPMessageType m_type;
 	int iPacketLength;
+#endif
+	QElapsedTimer qtLastPacket;
 #ifdef Q_OS_WIN
 	static HANDLE hQoS;
 	DWORD dwFlow;
 #endif
 protected slots:
+#ifdef MURMUR
+	void ioMessage(Mumble::Protocol::TCPMessageType type, const QByteArray &, const TCPMessagePtr &);
+#else
 	void socketRead();
 	void socketError(QAbstractSocket::SocketError);
 	void socketDisconnected();
 	void socketSslErrors(const QList< QSslError > &errors);
 public slots:
 	void proceedAnyway();
+#endif
 signals:
 	void encrypted();
 	void connectionClosed(QAbstractSocket::SocketError, const QString &reason);
+#ifdef MURMUR
+	/// The message has already been parsed into msg, except for UDPTunnel messages (see ConnectionIO::message)
+	void message(Mumble::Protocol::TCPMessageType type, const QByteArray &, const TCPMessagePtr &msg);
+	/// Emitted once the errors have been dealt with: the connection either proceeds or is being closed, depending
+	/// on ConnectionIO::classifySslError
+	void handleSslErrors(const QList< QSslError > &);
+	/// See notifyWhenDrained()
+	void drained();
+#else
 	void message(Mumble::Protocol::TCPMessageType type, const QByteArray &);
 	void handleSslErrors(const QList< QSslError > &);
+#endif
 
 public:
+#ifdef MURMUR
+	/// @param ioThread The thread all I/O on the socket shall happen on or nullptr to do it on the current thread
+	Connection(QObject *parent, QSslSocket *qtsSocket, QThread *ioThread);
+	void startServerEncryption();
+	/// @returns The amount of data that has been sent but not yet been handed to the operating system
+	qint64 bytesToWrite() const;
+	/// Makes the connection emit drained() (once) as soon as bytesToWrite() has dropped to 0
+	void notifyWhenDrained();
+#else
 	Connection(QObject *parent, QSslSocket *qtsSocket);
+#endif
 	~Connection();
 	static void messageToNetwork(const ::google::protobuf::Message &msg, Mumble::Protocol::TCPMessageType msgType,
 								 QByteArray &cache);
@@ -74,8 +107,9 @@ public:
 	void resetActivityTime();
 
 #ifdef MURMUR
-	/// qmCrypt locks access to csCrypt.
-	QMutex qmCrypt;
+	/// qmDecrypt serializes the decrypting half of csCrypt (decryption, the decrypt IV and the local packet
+	/// statistics). Encrypting and rekeying are lock-free (see CryptStateOCB2).
+	QMutex qmDecrypt;
 #endif
 	std::unique_ptr< CryptState > csCrypt;
 	/// Returns the peer's chain of digital certificates, starting with the peer's immediate certificate
@@ -65,6 +65,8 @@ namespace Protocol {
 
 	// The maximum allowed size in bytes of UDP packets (according to the Mumble protocol)
 	constexpr std::size_t MAX_UDP_PACKET_SIZE = 1024;
+	// The size in bytes of the connection token prefixing encrypted UDP packets (if the client uses one)
+	constexpr std::size_t UDP_CONNECTION_TOKEN_SIZE = 4;
 
 #define PROCESS_MUMBLE_TCP_MESSAGE(name, value) name = value,
 	/**
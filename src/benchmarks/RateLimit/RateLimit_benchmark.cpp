@@ -0,0 +1,105 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <benchmark/benchmark.h>
+
+#include "CoarseClock.h"
+#include "RateLimit.h"
+
+#include <limits>
+
+constexpr int BATCH_SIZE_BEGIN = 1;
+constexpr int BATCH_SIZE_END   = 64;
+constexpr int MULTIPLIER       = 4;
+
+// IP + UDP + Crypt + a typical Opus frame
+constexpr int FRAME_SIZE = 20 + 8 + 4 + 60;
+
+// The voice path updates the clock once per batch of received datagrams
+static void BM_addFrame(::benchmark::State &state) {
+	BandwidthRecord record;
+
+	const int batchSize = static_cast< int >(state.range(0));
+	int inBatch         = 0;
+
+	for (auto _ : state) {
+		if (++inBatch == batchSize) {
+			CoarseClock::update();
+			inBatch = 0;
+		}
+
+		benchmark::DoNotOptimize(record.addFrame(FRAME_SIZE, std::numeric_limits< int >::max()));
+	}
+
+	state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_addFrame)->RangeMultiplier(MULTIPLIER)->Range(BATCH_SIZE_BEGIN, BATCH_SIZE_END);
+
+
+// A client sending far more than the default bandwidth of 558000 bits per second, so that most frames are dropped
+static void BM_addFrameLimited(::benchmark::State &state) {
+	BandwidthRecord record;
+
+	int accepted = 0;
+	for (auto _ : state) {
+		CoarseClock::update();
+
+		if (record.addFrame(FRAME_SIZE, 558000 / 8)) {
+			accepted++;
+		}
+	}
+
+	state.SetItemsProcessed(state.iterations());
+	state.counters["accepted"] = benchmark::Counter(accepted, benchmark::Counter::kIsRate);
+}
+
+BENCHMARK(BM_addFrameLimited);
+
+
+// One voice thread adding frames while the other threads keep asking for the statistics (as the main thread and
+// the Ice threads do)
+static BandwidthRecord sharedRecord;
+
+static void BM_addFrameWithReaders(::benchmark::State &state) {
+	for (auto _ : state) {
+		if (state.thread_index() == 0) {
+			CoarseClock::update();
+			benchmark::DoNotOptimize(sharedRecord.addFrame(FRAME_SIZE, std::numeric_limits< int >::max()));
+		} else {
+			benchmark::DoNotOptimize(sharedRecord.bandwidth());
+			benchmark::DoNotOptimize(sharedRecord.idleSeconds());
+		}
+	}
+
+	state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_addFrameWithReaders)->ThreadRange(1, 4)->UseRealTime();
+
+
+static void BM_ratelimit(::benchmark::State &state) {
+	// The defaults of messagelimit and messageburst
+	LeakyBucket bucket(1, 5);
+
+	const int batchSize = static_cast< int >(state.range(0));
+	int inBatch         = 0;
+
+	for (auto _ : state) {
+		if (++inBatch == batchSize) {
+			CoarseClock::update();
+			inBatch = 0;
+		}
+
+		benchmark::DoNotOptimize(bucket.ratelimit(1));
+	}
+
+	state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_ratelimit)->RangeMultiplier(MULTIPLIER)->Range(BATCH_SIZE_BEGIN, BATCH_SIZE_END);
+
+
+BENCHMARK_MAIN();
@@ -0,0 +1,167 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <benchmark/benchmark.h>
+
+#include "crypto/CryptStateOCB2.h"
+
+#include <limits>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+std::random_device rd;
+std::mt19937 rng(rd());
+std::uniform_int_distribution< unsigned int > random_byte(0, std::numeric_limits< unsigned char >::max());
+
+constexpr int BACKEND_RANGE      = 0;
+constexpr int PAYLOAD_SIZE_RANGE = 1;
+
+constexpr int FROM_PAYLOAD_SIZE       = 8;
+constexpr int TO_PAYLOAD_SIZE         = 1024;
+constexpr int PAYLOAD_SIZE_MULTIPLIER = 2;
+
+class Fixture : public ::benchmark::Fixture {
+public:
+	CryptStateOCB2 enc;
+	CryptStateOCB2 dec;
+	std::vector< unsigned char > plain;
+	std::vector< unsigned char > encrypted;
+
+	void SetUp(::benchmark::State &state) {
+		const CryptStateOCB2::Backend backend = static_cast< CryptStateOCB2::Backend >(state.range(BACKEND_RANGE));
+
+		if (!enc.setBackend(backend) || !dec.setBackend(backend)) {
+			state.SkipWithError("Backend not supported on this machine");
+			return;
+		}
+
+		std::string key(AES_KEY_SIZE_BYTES, '\0');
+		std::string iv(AES_BLOCK_SIZE, '\0');
+		for (char &c : key) {
+			c = static_cast< char >(random_byte(rng));
+		}
+		for (char &c : iv) {
+			c = static_cast< char >(random_byte(rng));
+		}
+
+		enc.setKey(key, iv, iv);
+		dec.setKey(key, iv, iv);
+
+		plain.resize(static_cast< std::size_t >(state.range(PAYLOAD_SIZE_RANGE)));
+		for (unsigned char &c : plain) {
+			c = static_cast< unsigned char >(random_byte(rng));
+		}
+		encrypted.resize(plain.size() + 4);
+	}
+};
+
+static void backendsAndSizes(::benchmark::internal::Benchmark *benchmark) {
+	for (CryptStateOCB2::Backend backend : { CryptStateOCB2::Backend::OpenSSL, CryptStateOCB2::Backend::AESNI }) {
+		for (int size = FROM_PAYLOAD_SIZE; size <= TO_PAYLOAD_SIZE; size *= PAYLOAD_SIZE_MULTIPLIER) {
+			benchmark->Args({ static_cast< int >(backend), size });
+		}
+	}
+}
+
+BENCHMARK_DEFINE_F(Fixture, BM_encrypt)(::benchmark::State &state) {
+	for (auto _ : state) {
+		enc.encrypt(plain.data(), encrypted.data(), static_cast< unsigned int >(plain.size()));
+		benchmark::DoNotOptimize(encrypted.data());
+	}
+
+	state.SetBytesProcessed(static_cast< int64_t >(state.iterations()) * state.range(PAYLOAD_SIZE_RANGE));
+}
+
+BENCHMARK_REGISTER_F(Fixture, BM_encrypt)->Apply(backendsAndSizes);
+
+BENCHMARK_DEFINE_F(Fixture, BM_encryptDecrypt)(::benchmark::State &state) {
+	std::vector< unsigned char > decrypted(plain.size());
+
+	// Decrypting the same packet twice would be rejected as a replay, so every iteration encrypts a fresh one
+	for (auto _ : state) {
+		enc.encrypt(plain.data(), encrypted.data(), static_cast< unsigned int >(plain.size()));
+		dec.decrypt(encrypted.data(), decrypted.data(), static_cast< unsigned int >(encrypted.size()));
+		benchmark::DoNotOptimize(decrypted.data());
+	}
+
+	state.SetBytesProcessed(static_cast< int64_t >(state.iterations()) * state.range(PAYLOAD_SIZE_RANGE));
+}
+
+BENCHMARK_REGISTER_F(Fixture, BM_encryptDecrypt)->Apply(backendsAndSizes);
+
+BENCHMARK_DEFINE_F(Fixture, BM_ocbDecrypt)(::benchmark::State &state) {
+	std::vector< unsigned char > decrypted(plain.size());
+	unsigned char nonce[AES_BLOCK_SIZE] = {};
+	unsigned char tag[AES_BLOCK_SIZE];
+
+	for (auto _ : state) {
+		dec.ocb_decrypt(plain.data(), decrypted.data(), static_cast< unsigned int >(plain.size()), nonce, tag);
+		benchmark::DoNotOptimize(decrypted.data());
+	}
+
+	state.SetBytesProcessed(static_cast< int64_t >(state.iterations()) * state.range(PAYLOAD_SIZE_RANGE));
+}
+
+BENCHMARK_REGISTER_F(Fixture, BM_ocbDecrypt)->Apply(backendsAndSizes);
+
+// Encrypts the same packet for several receivers (the typical audio fan-out)
+BENCHMARK_DEFINE_F(Fixture, BM_encryptBatch)(::benchmark::State &state) {
+	constexpr std::size_t RECEIVERS = 32;
+
+	std::vector< std::unique_ptr< CryptStateOCB2 > > receivers;
+	std::vector< CryptState * > states;
+	std::vector< std::vector< unsigned char > > buffers(RECEIVERS, std::vector< unsigned char >(encrypted.size()));
+	std::vector< unsigned char * > destinations;
+	bool results[RECEIVERS];
+
+	for (std::size_t i = 0; i < RECEIVERS; ++i) {
+		receivers.push_back(std::make_unique< CryptStateOCB2 >());
+		receivers.back()->setBackend(enc.getBackend());
+		receivers.back()->setKey(enc.getRawKey(), enc.getEncryptIV(), enc.getDecryptIV());
+
+		states.push_back(receivers.back().get());
+		destinations.push_back(buffers[i].data());
+	}
+
+	for (auto _ : state) {
+		states[0]->encryptBatch(states.data(), destinations.data(), results, RECEIVERS, plain.data(),
+								static_cast< unsigned int >(plain.size()));
+		benchmark::DoNotOptimize(results);
+	}
+
+	state.SetItemsProcessed(static_cast< int64_t >(state.iterations() * RECEIVERS));
+}
+
+BENCHMARK_REGISTER_F(Fixture, BM_encryptBatch)->Apply(backendsAndSizes);
+
+// The same fan-out, encrypting for one receiver after the other
+BENCHMARK_DEFINE_F(Fixture, BM_encryptSequential)(::benchmark::State &state) {
+	constexpr std::size_t RECEIVERS = 32;
+
+	std::vector< std::unique_ptr< CryptStateOCB2 > > receivers;
+	std::vector< unsigned char > buffer(encrypted.size());
+
+	for (std::size_t i = 0; i < RECEIVERS; ++i) {
+		receivers.push_back(std::make_unique< CryptStateOCB2 >());
+		receivers.back()->setBackend(enc.getBackend());
+		receivers.back()->setKey(enc.getRawKey(), enc.getEncryptIV(), enc.getDecryptIV());
+	}
+
+	for (auto _ : state) {
+		for (std::unique_ptr< CryptStateOCB2 > &receiver : receivers) {
+			receiver->encrypt(plain.data(), buffer.data(), static_cast< unsigned int >(plain.size()));
+		}
+		benchmark::DoNotOptimize(buffer.data());
+	}
+
+	state.SetItemsProcessed(static_cast< int64_t >(state.iterations() * RECEIVERS));
+}
+
+BENCHMARK_REGISTER_F(Fixture, BM_encryptSequential)->Apply(backendsAndSizes);
+
+
+BENCHMARK_MAIN();
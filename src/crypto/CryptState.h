@@ -7,6 +7,9 @@
 #define MUMBLE_CRYPTSTATE_H_
 
 #include "Timer.h"
+
+#include <atomic>
+#include <cstddef>
 #include <string>
 
 class CryptState {
@@ -25,7 +28,7 @@ public:
 
 	Timer tLastGood;
 	Timer tLastRequest;
-	bool bInit = false;
+	std::atomic< bool > bInit{ false };
 	CryptState(){};
 	virtual ~CryptState(){};
 
@@ -41,6 +44,21 @@ public:
 
 	virtual bool decrypt(const unsigned char *source, unsigned char *dst, unsigned int crypted_length) = 0;
 	virtual bool encrypt(const unsigned char *source, unsigned char *dst, unsigned int plain_length)   = 0;
+
+	/// Encrypts the same plaintext for several states at once (e.g. an audio packet for all of its receivers).
+	/// This is equivalent to calling encrypt() on every state, but implementations may interleave the work
+	/// for the different states.
+	///
+	/// @param states The states to encrypt for. All of them have to be of the same type as this one.
+	/// @param destinations For every state, the buffer (of at least plain_length + 4 bytes) to encrypt into
+	/// @param[out] results For every state, whether the encryption succeeded
+	/// @param count The amount of states
+	virtual void encryptBatch(CryptState *const *states, unsigned char *const *destinations, bool *results,
+							  std::size_t count, const unsigned char *source, unsigned int plain_length) {
+		for (std::size_t i = 0; i < count; ++i) {
+			results[i] = states[i]->encrypt(source, destinations[i], plain_length);
+		}
+	}
 };
 
 
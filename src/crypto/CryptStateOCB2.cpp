@@ -27,24 +27,363 @@
 #include "CryptStateOCB2.h"
 #include "CryptographicRandom.h"
 
+#include <algorithm>
 #include <cstring>
 #include <openssl/rand.h>
 
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#	define OCB2_AESNI
+#	include <emmintrin.h>
+#	include <wmmintrin.h>
+#	ifdef _MSC_VER
+#		include <intrin.h>
+#		define AESNI_TARGET
+#	else
+#		include <cpuid.h>
+// Allows using the intrinsics without compiling the whole file with -maes
+#		define AESNI_TARGET __attribute__((target("aes,sse2")))
+#	endif
+#endif
+
+#ifdef OCB2_AESNI
+static bool cpuSupportsAESNI() {
+	unsigned int ecx = 0;
+	unsigned int edx = 0;
+#	ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 1);
+	ecx = static_cast< unsigned int >(info[2]);
+	edx = static_cast< unsigned int >(info[3]);
+#	else
+	unsigned int eax, ebx;
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+		return false;
+	}
+#	endif
+	// AES-NI is bit 25 of ECX, SSE2 bit 26 of EDX
+	return (ecx & (1u << 25)) && (edx & (1u << 26));
+}
+
+AESNI_TARGET static inline __m128i aesniExpandKeyStep(__m128i key, __m128i assist) {
+	assist = _mm_shuffle_epi32(assist, 0xff);
+	key    = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+	key    = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+	key    = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+	return _mm_xor_si128(key, assist);
+}
+
+// The round constant has to be an immediate, hence the macro
+#	define AESNI_EXPAND(key, rcon) aesniExpandKeyStep(key, _mm_aeskeygenassist_si128(key, rcon))
+
+AESNI_TARGET static void aesniExpandKey(const unsigned char *rawKey, unsigned char *encKeys, unsigned char *decKeys) {
+	__m128i keys[11];
+	keys[0]  = _mm_loadu_si128(reinterpret_cast< const __m128i * >(rawKey));
+	keys[1]  = AESNI_EXPAND(keys[0], 0x01);
+	keys[2]  = AESNI_EXPAND(keys[1], 0x02);
+	keys[3]  = AESNI_EXPAND(keys[2], 0x04);
+	keys[4]  = AESNI_EXPAND(keys[3], 0x08);
+	keys[5]  = AESNI_EXPAND(keys[4], 0x10);
+	keys[6]  = AESNI_EXPAND(keys[5], 0x20);
+	keys[7]  = AESNI_EXPAND(keys[6], 0x40);
+	keys[8]  = AESNI_EXPAND(keys[7], 0x80);
+	keys[9]  = AESNI_EXPAND(keys[8], 0x1b);
+	keys[10] = AESNI_EXPAND(keys[9], 0x36);
+
+	// The decryption schedule (Equivalent Inverse Cipher) uses the round keys in reverse order
+	for (int i = 0; i < 11; i++) {
+		_mm_storeu_si128(reinterpret_cast< __m128i * >(encKeys) + i, keys[i]);
+
+		__m128i decKey = keys[10 - i];
+		if (i != 0 && i != 10) {
+			decKey = _mm_aesimc_si128(decKey);
+		}
+		_mm_storeu_si128(reinterpret_cast< __m128i * >(decKeys) + i, decKey);
+	}
+}
+
+#	undef AESNI_EXPAND
+
+// Blocks are processed four at a time, so that the latency of the AES rounds of one block
+// is hidden behind the rounds of the others.
+AESNI_TARGET static void aesniEncryptBlocks(const unsigned char *roundKeys, const unsigned char *src,
+											unsigned char *dst, unsigned int blocks) {
+	__m128i keys[11];
+	for (int i = 0; i < 11; i++) {
+		keys[i] = _mm_loadu_si128(reinterpret_cast< const __m128i * >(roundKeys) + i);
+	}
+
+	const __m128i *in = reinterpret_cast< const __m128i * >(src);
+	__m128i *out      = reinterpret_cast< __m128i * >(dst);
+
+	unsigned int i = 0;
+	for (; i + 4 <= blocks; i += 4) {
+		__m128i b0 = _mm_xor_si128(_mm_loadu_si128(in + i), keys[0]);
+		__m128i b1 = _mm_xor_si128(_mm_loadu_si128(in + i + 1), keys[0]);
+		__m128i b2 = _mm_xor_si128(_mm_loadu_si128(in + i + 2), keys[0]);
+		__m128i b3 = _mm_xor_si128(_mm_loadu_si128(in + i + 3), keys[0]);
+		for (int round = 1; round < 10; round++) {
+			b0 = _mm_aesenc_si128(b0, keys[round]);
+			b1 = _mm_aesenc_si128(b1, keys[round]);
+			b2 = _mm_aesenc_si128(b2, keys[round]);
+			b3 = _mm_aesenc_si128(b3, keys[round]);
+		}
+		_mm_storeu_si128(out + i, _mm_aesenclast_si128(b0, keys[10]));
+		_mm_storeu_si128(out + i + 1, _mm_aesenclast_si128(b1, keys[10]));
+		_mm_storeu_si128(out + i + 2, _mm_aesenclast_si128(b2, keys[10]));
+		_mm_storeu_si128(out + i + 3, _mm_aesenclast_si128(b3, keys[10]));
+	}
+	for (; i < blocks; i++) {
+		__m128i b = _mm_xor_si128(_mm_loadu_si128(in + i), keys[0]);
+		for (int round = 1; round < 10; round++) {
+			b = _mm_aesenc_si128(b, keys[round]);
+		}
+		_mm_storeu_si128(out + i, _mm_aesenclast_si128(b, keys[10]));
+	}
+}
+
+AESNI_TARGET static void aesniDecryptBlocks(const unsigned char *roundKeys, const unsigned char *src,
+											unsigned char *dst, unsigned int blocks) {
+	__m128i keys[11];
+	for (int i = 0; i < 11; i++) {
+		keys[i] = _mm_loadu_si128(reinterpret_cast< const __m128i * >(roundKeys) + i);
+	}
+
+	const __m128i *in = reinterpret_cast< const __m128i * >(src);
+	__m128i *out      = reinterpret_cast< __m128i * >(dst);
+
+	unsigned int i = 0;
+	for (; i + 4 <= blocks; i += 4) {
+		__m128i b0 = _mm_xor_si128(_mm_loadu_si128(in + i), keys[0]);
+		__m128i b1 = _mm_xor_si128(_mm_loadu_si128(in + i + 1), keys[0]);
+		__m128i b2 = _mm_xor_si128(_mm_loadu_si128(in + i + 2), keys[0]);
+		__m128i b3 = _mm_xor_si128(_mm_loadu_si128(in + i + 3), keys[0]);
+		for (int round = 1; round < 10; round++) {
+			b0 = _mm_aesdec_si128(b0, keys[round]);
+			b1 = _mm_aesdec_si128(b1, keys[round]);
+			b2 = _mm_aesdec_si128(b2, keys[round]);
+			b3 = _mm_aesdec_si128(b3, keys[round]);
+		}
+		_mm_storeu_si128(out + i, _mm_aesdeclast_si128(b0, keys[10]));
+		_mm_storeu_si128(out + i + 1, _mm_aesdeclast_si128(b1, keys[10]));
+		_mm_storeu_si128(out + i + 2, _mm_aesdeclast_si128(b2, keys[10]));
+		_mm_storeu_si128(out + i + 3, _mm_aesdeclast_si128(b3, keys[10]));
+	}
+	for (; i < blocks; i++) {
+		__m128i b = _mm_xor_si128(_mm_loadu_si128(in + i), keys[0]);
+		for (int round = 1; round < 10; round++) {
+			b = _mm_aesdec_si128(b, keys[round]);
+		}
+		_mm_storeu_si128(out + i, _mm_aesdeclast_si128(b, keys[10]));
+	}
+}
+
+// The amount of keys that are processed in lockstep by encryptBatch
+#	define AESNI_LANES 4u
+
+// Encrypts one block per lane, each with its own key. The lanes are independent of each other,
+// so their rounds are interleaved just like the blocks in aesniEncryptBlocks.
+AESNI_TARGET static void aesniEncryptLanes(const unsigned char *const *roundKeys, unsigned char *blocks,
+										   unsigned int lanes) {
+	__m128i *data = reinterpret_cast< __m128i * >(blocks);
+	__m128i b[AESNI_LANES];
+
+	for (unsigned int i = 0; i < lanes; i++) {
+		const __m128i *keys = reinterpret_cast< const __m128i * >(roundKeys[i]);
+		b[i]                = _mm_xor_si128(_mm_loadu_si128(data + i), _mm_loadu_si128(keys));
+	}
+	for (int round = 1; round < 10; round++) {
+		for (unsigned int i = 0; i < lanes; i++) {
+			const __m128i *keys = reinterpret_cast< const __m128i * >(roundKeys[i]);
+			b[i]                = _mm_aesenc_si128(b[i], _mm_loadu_si128(keys + round));
+		}
+	}
+	for (unsigned int i = 0; i < lanes; i++) {
+		const __m128i *keys = reinterpret_cast< const __m128i * >(roundKeys[i]);
+		_mm_storeu_si128(data + i, _mm_aesenclast_si128(b[i], _mm_loadu_si128(keys + 10)));
+	}
+}
+#endif
+
+/// Everything that is derived from the key. Once a key has been published, only its encrypt counter changes.
+struct CryptStateOCB2::Key {
+	unsigned char raw_key[AES_KEY_SIZE_BYTES];
+	/// The encrypt IV at the time the key has been published. The current one is this plus encrypt_counter.
+	unsigned char encrypt_iv[AES_BLOCK_SIZE];
+	std::atomic< quint64 > encrypt_counter;
+
+	/// The expanded AES-NI key schedules (11 round keys each), only valid if AES-NI is supported
+	unsigned char enc_round_keys[11 * AES_BLOCK_SIZE];
+	unsigned char dec_round_keys[11 * AES_BLOCK_SIZE];
+
+	/// The contexts are keyed once, when the key is created. ocb_encrypt and ocb_decrypt use different ones,
+	/// so that encryption and decryption can happen concurrently.
+	EVP_CIPHER_CTX *enc_ctx_ocb_enc;
+	EVP_CIPHER_CTX *enc_ctx_ocb_dec;
+	EVP_CIPHER_CTX *dec_ctx_ocb_dec;
+	/// A context must not be used by several threads at once. Unlike decryption, encryption may happen on
+	/// several threads, so the OpenSSL backend has to serialize it.
+	std::mutex enc_ctx_lock;
+
+	Key(const unsigned char *rawKey, const unsigned char *encryptIV);
+	~Key();
+
+	/// Reserves the next encrypt IV. This may be called from several threads at once.
+	void nextEncryptIV(unsigned char *iv);
+	void getEncryptIV(unsigned char *iv) const;
+};
+
+/// Adds value to the little-endian 128-bit integer iv (the IV is incremented starting with its first byte)
+static void addToIV(unsigned char *iv, quint64 value) {
+	unsigned int carry = 0;
+	for (int i = 0; i < AES_BLOCK_SIZE; i++) {
+		const unsigned int sum = iv[i] + static_cast< unsigned int >(value & 0xFF) + carry;
+
+		iv[i] = static_cast< unsigned char >(sum);
+		carry = sum >> 8;
+		value >>= 8;
+	}
+}
+
+CryptStateOCB2::Key::Key(const unsigned char *rawKey, const unsigned char *encryptIV)
+	: encrypt_counter(0), enc_ctx_ocb_enc(EVP_CIPHER_CTX_new()), enc_ctx_ocb_dec(EVP_CIPHER_CTX_new()),
+	  dec_ctx_ocb_dec(EVP_CIPHER_CTX_new()) {
+	memcpy(raw_key, rawKey, AES_KEY_SIZE_BYTES);
+	memcpy(encrypt_iv, encryptIV, AES_BLOCK_SIZE);
+
+	// Keying the contexts is expensive (and with OpenSSL 3 even involves fetching the cipher), so it is
+	// done once per key instead of once per block.
+	EVP_EncryptInit_ex(enc_ctx_ocb_enc, EVP_aes_128_ecb(), nullptr, raw_key, nullptr);
+	EVP_CIPHER_CTX_set_padding(enc_ctx_ocb_enc, 0);
+	EVP_EncryptInit_ex(enc_ctx_ocb_dec, EVP_aes_128_ecb(), nullptr, raw_key, nullptr);
+	EVP_CIPHER_CTX_set_padding(enc_ctx_ocb_dec, 0);
+	EVP_DecryptInit_ex(dec_ctx_ocb_dec, EVP_aes_128_ecb(), nullptr, raw_key, nullptr);
+	EVP_CIPHER_CTX_set_padding(dec_ctx_ocb_dec, 0);
+
+#ifdef OCB2_AESNI
+	if (isBackendSupported(Backend::AESNI)) {
+		aesniExpandKey(raw_key, enc_round_keys, dec_round_keys);
+	}
+#endif
+}
+
+CryptStateOCB2::Key::~Key() {
+	EVP_CIPHER_CTX_free(enc_ctx_ocb_enc);
+	EVP_CIPHER_CTX_free(enc_ctx_ocb_dec);
+	EVP_CIPHER_CTX_free(dec_ctx_ocb_dec);
+}
+
+void CryptStateOCB2::Key::nextEncryptIV(unsigned char *iv) {
+	// Counting atomically and deriving the IV from the count is equivalent to incrementing the IV itself,
+	// but lets concurrent encryptions reserve distinct IVs without a lock.
+	const quint64 count = encrypt_counter.fetch_add(1, std::memory_order_relaxed) + 1;
+
+	memcpy(iv, encrypt_iv, AES_BLOCK_SIZE);
+	addToIV(iv, count);
+}
+
+void CryptStateOCB2::Key::getEncryptIV(unsigned char *iv) const {
+	memcpy(iv, encrypt_iv, AES_BLOCK_SIZE);
+	addToIV(iv, encrypt_counter.load(std::memory_order_relaxed));
+}
+
 CryptStateOCB2::CryptStateOCB2()
-	: CryptState(), enc_ctx_ocb_enc(EVP_CIPHER_CTX_new()), dec_ctx_ocb_enc(EVP_CIPHER_CTX_new()),
-	  enc_ctx_ocb_dec(EVP_CIPHER_CTX_new()), dec_ctx_ocb_dec(EVP_CIPHER_CTX_new()) {
+	: CryptState(), m_key(nullptr),
+	  backend(isBackendSupported(Backend::AESNI) ? Backend::AESNI : Backend::OpenSSL) {
 	for (int i = 0; i < 0x100; i++)
 		decrypt_history[i] = 0;
-	memset(raw_key, 0, AES_KEY_SIZE_BYTES);
-	memset(encrypt_iv, 0, AES_BLOCK_SIZE);
 	memset(decrypt_iv, 0, AES_BLOCK_SIZE);
+
+	const unsigned char zero[AES_BLOCK_SIZE] = {};
+	rekey(zero, zero);
 }
 
 CryptStateOCB2::~CryptStateOCB2() noexcept {
-	EVP_CIPHER_CTX_free(enc_ctx_ocb_enc);
-	EVP_CIPHER_CTX_free(dec_ctx_ocb_enc);
-	EVP_CIPHER_CTX_free(enc_ctx_ocb_dec);
-	EVP_CIPHER_CTX_free(dec_ctx_ocb_dec);
+	delete m_key.load();
+}
+
+bool CryptStateOCB2::isBackendSupported(Backend backend) {
+	switch (backend) {
+		case Backend::OpenSSL:
+			return true;
+		case Backend::AESNI:
+#ifdef OCB2_AESNI
+		{
+			static const bool supported = cpuSupportsAESNI();
+			return supported;
+		}
+#else
+			return false;
+#endif
+	}
+
+	return false;
+}
+
+bool CryptStateOCB2::setBackend(Backend backend) {
+	if (!isBackendSupported(backend)) {
+		return false;
+	}
+
+	this->backend = backend;
+	return true;
+}
+
+CryptStateOCB2::Backend CryptStateOCB2::getBackend() const {
+	return backend;
+}
+
+void CryptStateOCB2::rekey(const unsigned char *rawKey, const unsigned char *encryptIV) {
+	std::lock_guard< std::mutex > lock(m_rekeyLock);
+
+	Key *previous = m_key.load(std::memory_order_relaxed);
+
+	unsigned char currentIV[AES_BLOCK_SIZE];
+	if (!encryptIV) {
+		previous->getEncryptIV(currentIV);
+		encryptIV = currentIV;
+	}
+	if (!rawKey) {
+		rawKey = previous->raw_key;
+	}
+
+	m_key.store(new Key(rawKey, encryptIV), std::memory_order_release);
+
+	if (previous) {
+		m_retiredKeys.emplace_back(previous);
+	}
+}
+
+void CryptStateOCB2::encryptBlocks(Key &key, const void *src, void *dst, unsigned int blocks, EVP_CIPHER_CTX *ctx) {
+#ifdef OCB2_AESNI
+	if (backend == Backend::AESNI) {
+		aesniEncryptBlocks(key.enc_round_keys, static_cast< const unsigned char * >(src),
+						   static_cast< unsigned char * >(dst), blocks);
+		return;
+	}
+#else
+	Q_UNUSED(key);
+#endif
+
+	// In ECB mode without padding, the context doesn't carry any state between updates
+	int outlen = 0;
+	EVP_EncryptUpdate(ctx, static_cast< unsigned char * >(dst), &outlen, static_cast< const unsigned char * >(src),
+					  static_cast< int >(blocks * AES_BLOCK_SIZE));
+}
+
+void CryptStateOCB2::decryptBlocks(Key &key, const void *src, void *dst, unsigned int blocks, EVP_CIPHER_CTX *ctx) {
+#ifdef OCB2_AESNI
+	if (backend == Backend::AESNI) {
+		aesniDecryptBlocks(key.dec_round_keys, static_cast< const unsigned char * >(src),
+						   static_cast< unsigned char * >(dst), blocks);
+		return;
+	}
+#else
+	Q_UNUSED(key);
+#endif
+
+	int outlen = 0;
+	EVP_DecryptUpdate(ctx, static_cast< unsigned char * >(dst), &outlen, static_cast< const unsigned char * >(src),
+					  static_cast< int >(blocks * AES_BLOCK_SIZE));
 }
 
 bool CryptStateOCB2::isValid() const {
@@ -52,16 +391,20 @@ bool CryptStateOCB2::isValid() const {
 }
 
 void CryptStateOCB2::genKey() {
-	CryptographicRandom::fillBuffer(raw_key, AES_KEY_SIZE_BYTES);
-	CryptographicRandom::fillBuffer(encrypt_iv, AES_BLOCK_SIZE);
+	unsigned char rawKey[AES_KEY_SIZE_BYTES];
+	unsigned char encryptIV[AES_BLOCK_SIZE];
+
+	CryptographicRandom::fillBuffer(rawKey, AES_KEY_SIZE_BYTES);
+	CryptographicRandom::fillBuffer(encryptIV, AES_BLOCK_SIZE);
 	CryptographicRandom::fillBuffer(decrypt_iv, AES_BLOCK_SIZE);
+	rekey(rawKey, encryptIV);
 	bInit = true;
 }
 
 bool CryptStateOCB2::setKey(const std::string &rkey, const std::string &eiv, const std::string &div) {
 	if (rkey.length() == AES_KEY_SIZE_BYTES && eiv.length() == AES_BLOCK_SIZE && div.length() == AES_BLOCK_SIZE) {
-		memcpy(raw_key, rkey.data(), AES_KEY_SIZE_BYTES);
-		memcpy(encrypt_iv, eiv.data(), AES_BLOCK_SIZE);
+		rekey(reinterpret_cast< const unsigned char * >(rkey.data()),
+			  reinterpret_cast< const unsigned char * >(eiv.data()));
 		memcpy(decrypt_iv, div.data(), AES_BLOCK_SIZE);
 		bInit = true;
 		return true;
@@ -71,7 +414,7 @@ bool CryptStateOCB2::setKey(const std::string &rkey, const std::string &eiv, con
 
 bool CryptStateOCB2::setRawKey(const std::string &rkey) {
 	if (rkey.length() == AES_KEY_SIZE_BYTES) {
-		memcpy(raw_key, rkey.data(), AES_KEY_SIZE_BYTES);
+		rekey(reinterpret_cast< const unsigned char * >(rkey.data()), nullptr);
 		return true;
 	}
 	return false;
@@ -79,7 +422,7 @@ bool CryptStateOCB2::setRawKey(const std::string &rkey) {
 
 bool CryptStateOCB2::setEncryptIV(const std::string &iv) {
 	if (iv.length() == AES_BLOCK_SIZE) {
-		memcpy(encrypt_iv, iv.data(), AES_BLOCK_SIZE);
+		rekey(nullptr, reinterpret_cast< const unsigned char * >(iv.data()));
 		return true;
 	}
 	return false;
@@ -94,11 +437,15 @@ bool CryptStateOCB2::setDecryptIV(const std::string &iv) {
 }
 
 std::string CryptStateOCB2::getRawKey() {
-	return std::string(reinterpret_cast< const char * >(raw_key), AES_KEY_SIZE_BYTES);
+	return std::string(reinterpret_cast< const char * >(m_key.load(std::memory_order_acquire)->raw_key),
+					   AES_KEY_SIZE_BYTES);
 }
 
 std::string CryptStateOCB2::getEncryptIV() {
-	return std::string(reinterpret_cast< const char * >(encrypt_iv), AES_BLOCK_SIZE);
+	unsigned char iv[AES_BLOCK_SIZE];
+	m_key.load(std::memory_order_acquire)->getEncryptIV(iv);
+
+	return std::string(reinterpret_cast< const char * >(iv), AES_BLOCK_SIZE);
 }
 
 std::string CryptStateOCB2::getDecryptIV() {
@@ -106,18 +453,18 @@ std::string CryptStateOCB2::getDecryptIV() {
 }
 
 bool CryptStateOCB2::encrypt(const unsigned char *source, unsigned char *dst, unsigned int plain_length) {
+	Key &key = *m_key.load(std::memory_order_acquire);
+	unsigned char iv[AES_BLOCK_SIZE];
 	unsigned char tag[AES_BLOCK_SIZE];
 
 	// First, increase our IV.
-	for (int i = 0; i < AES_BLOCK_SIZE; i++)
-		if (++encrypt_iv[i])
-			break;
+	key.nextEncryptIV(iv);
 
-	if (!ocb_encrypt(source, dst + 4, plain_length, encrypt_iv, tag)) {
+	if (!ocb_encrypt(key, source, dst + 4, plain_length, iv, tag)) {
 		return false;
 	}
 
-	dst[0] = encrypt_iv[0];
+	dst[0] = iv[0];
 	dst[1] = tag[0];
 	dst[2] = tag[1];
 	dst[3] = tag[2];
@@ -261,83 +608,91 @@ static void inline ZERO(keyblock &block) {
 		block[i] = 0;
 }
 
-#define AESencrypt_ctx(src, dst, key, enc_ctx)                                                      \
-	{                                                                                               \
-		int outlen = 0;                                                                             \
-		EVP_EncryptInit_ex(enc_ctx, EVP_aes_128_ecb(), NULL, key, NULL);                            \
-		EVP_CIPHER_CTX_set_padding(enc_ctx, 0);                                                     \
-		EVP_EncryptUpdate(enc_ctx, reinterpret_cast< unsigned char * >(dst), &outlen,               \
-						  reinterpret_cast< const unsigned char * >(src), AES_BLOCK_SIZE);          \
-		EVP_EncryptFinal_ex(enc_ctx, reinterpret_cast< unsigned char * >((dst) + outlen), &outlen); \
-	}
-#define AESdecrypt_ctx(src, dst, key, dec_ctx)                                                      \
-	{                                                                                               \
-		int outlen = 0;                                                                             \
-		EVP_DecryptInit_ex(dec_ctx, EVP_aes_128_ecb(), NULL, key, NULL);                            \
-		EVP_CIPHER_CTX_set_padding(dec_ctx, 0);                                                     \
-		EVP_DecryptUpdate(dec_ctx, reinterpret_cast< unsigned char * >(dst), &outlen,               \
-						  reinterpret_cast< const unsigned char * >(src), AES_BLOCK_SIZE);          \
-		EVP_DecryptFinal_ex(dec_ctx, reinterpret_cast< unsigned char * >((dst) + outlen), &outlen); \
-	}
-
-#define AESencrypt(src, dst, key) AESencrypt_ctx(src, dst, key, enc_ctx_ocb_enc)
-#define AESdecrypt(src, dst, key) AESdecrypt_ctx(src, dst, key, dec_ctx_ocb_enc)
+// The amount of blocks that are handed to the block cipher at once
+#define PARALLEL_BLOCKS 8u
 
 bool CryptStateOCB2::ocb_encrypt(const unsigned char *plain, unsigned char *encrypted, unsigned int len,
 								 const unsigned char *nonce, unsigned char *tag, bool modifyPlainOnXEXStarAttack) {
+	return ocb_encrypt(*m_key.load(std::memory_order_acquire), plain, encrypted, len, nonce, tag,
+					   modifyPlainOnXEXStarAttack);
+}
+
+bool CryptStateOCB2::ocb_encrypt(Key &key, const unsigned char *plain, unsigned char *encrypted, unsigned int len,
+								 const unsigned char *nonce, unsigned char *tag, bool modifyPlainOnXEXStarAttack) {
+	std::unique_lock< std::mutex > lock(key.enc_ctx_lock, std::defer_lock);
+	if (backend == Backend::OpenSSL) {
+		lock.lock();
+	}
+
 	keyblock checksum, delta, tmp, pad;
+	keyblock deltas[PARALLEL_BLOCKS], blocks[PARALLEL_BLOCKS];
+	bool flipped[PARALLEL_BLOCKS];
 	bool success = true;
 
 	// Initialize
-	AESencrypt(nonce, delta, raw_key);
+	encryptBlocks(key, nonce, delta, 1, key.enc_ctx_ocb_enc);
 	ZERO(checksum);
 
 	while (len > AES_BLOCK_SIZE) {
-		// Counter-cryptanalysis described in section 9 of https://eprint.iacr.org/2019/311
-		// For an attack, the second to last block (i.e. the last iteration of this loop)
-		// must be all 0 except for the last byte (which may be 0 - 128).
-		bool flipABit = false; // *plain is const, so we can't directly modify it
-		if (len - AES_BLOCK_SIZE <= AES_BLOCK_SIZE) {
-			unsigned char sum = 0;
-			for (int i = 0; i < AES_BLOCK_SIZE - 1; ++i) {
-				sum |= plain[i];
-			}
-			if (sum == 0) {
-				if (modifyPlainOnXEXStarAttack) {
-					// The assumption that critical packets do not turn up by pure chance turned out to be incorrect
-					// since digital silence appears to produce them in mass.
-					// So instead we now modify the packet in a way which should not affect the audio but will
-					// prevent the attack.
-					flipABit = true;
-				} else {
-					// This option still exists but only to allow us to test ocb_decrypt's detection.
-					success = false;
+		// All full blocks but the last one are independent of each other once their delta is known, so they are
+		// encrypted in batches
+		const unsigned int count = std::min(PARALLEL_BLOCKS, (len - 1) / AES_BLOCK_SIZE);
+
+		for (unsigned int i = 0; i < count; i++) {
+			const unsigned char *block = plain + i * AES_BLOCK_SIZE;
+
+			// Counter-cryptanalysis described in section 9 of https://eprint.iacr.org/2019/311
+			// For an attack, the second to last block (i.e. the last full block that is processed here)
+			// must be all 0 except for the last byte (which may be 0 - 128).
+			bool flipABit = false; // *plain is const, so we can't directly modify it
+			if (len - (i + 1) * AES_BLOCK_SIZE <= AES_BLOCK_SIZE) {
+				unsigned char sum = 0;
+				for (int j = 0; j < AES_BLOCK_SIZE - 1; ++j) {
+					sum |= block[j];
+				}
+				if (sum == 0) {
+					if (modifyPlainOnXEXStarAttack) {
+						// The assumption that critical packets do not turn up by pure chance turned out to be
+						// incorrect since digital silence appears to produce them in mass.
+						// So instead we now modify the packet in a way which should not affect the audio but will
+						// prevent the attack.
+						flipABit = true;
+					} else {
+						// This option still exists but only to allow us to test ocb_decrypt's detection.
+						success = false;
+					}
 				}
 			}
-		}
 
-		S2(delta);
-		XOR(tmp, delta, reinterpret_cast< const subblock * >(plain));
-		if (flipABit) {
-			*reinterpret_cast< unsigned char * >(tmp) ^= 1;
-		}
-		AESencrypt(tmp, tmp, raw_key);
-		XOR(reinterpret_cast< subblock * >(encrypted), delta, tmp);
-		XOR(checksum, checksum, reinterpret_cast< const subblock * >(plain));
-		if (flipABit) {
-			*reinterpret_cast< unsigned char * >(checksum) ^= 1;
+			S2(delta);
+			memcpy(deltas[i], delta, AES_BLOCK_SIZE);
+			XOR(blocks[i], delta, reinterpret_cast< const subblock * >(block));
+			if (flipABit) {
+				*reinterpret_cast< unsigned char * >(blocks[i]) ^= 1;
+			}
+			flipped[i] = flipABit;
 		}
 
-		len -= AES_BLOCK_SIZE;
-		plain += AES_BLOCK_SIZE;
-		encrypted += AES_BLOCK_SIZE;
+		encryptBlocks(key, blocks, blocks, count, key.enc_ctx_ocb_enc);
+
+		for (unsigned int i = 0; i < count; i++) {
+			XOR(reinterpret_cast< subblock * >(encrypted), deltas[i], blocks[i]);
+			XOR(checksum, checksum, reinterpret_cast< const subblock * >(plain));
+			if (flipped[i]) {
+				*reinterpret_cast< unsigned char * >(checksum) ^= 1;
+			}
+
+			len -= AES_BLOCK_SIZE;
+			plain += AES_BLOCK_SIZE;
+			encrypted += AES_BLOCK_SIZE;
+		}
 	}
 
 	S2(delta);
 	ZERO(tmp);
 	tmp[BLOCKSIZE - 1] = SWAPPED(len * 8);
 	XOR(tmp, tmp, delta);
-	AESencrypt(tmp, pad, raw_key);
+	encryptBlocks(key, tmp, pad, 1, key.enc_ctx_ocb_enc);
 	memcpy(tmp, plain, len);
 	memcpy(reinterpret_cast< unsigned char * >(tmp) + len, reinterpret_cast< const unsigned char * >(pad) + len,
 		   AES_BLOCK_SIZE - len);
@@ -347,42 +702,199 @@ bool CryptStateOCB2::ocb_encrypt(const unsigned char *plain, unsigned char *encr
 
 	S3(delta);
 	XOR(tmp, delta, checksum);
-	AESencrypt(tmp, tag, raw_key);
+	encryptBlocks(key, tmp, tag, 1, key.enc_ctx_ocb_enc);
 
 	return success;
 }
 
-#undef AESencrypt
-#undef AESdecrypt
+#ifdef OCB2_AESNI
+// OCB-encrypts the same plaintext with several AES-NI keys in lockstep. The plaintext is only read once
+// and the rounds of the single blocks (nonce, pad and tag) are interleaved across the keys.
+static void ocbEncryptLanes(const unsigned char *const *roundKeys, unsigned char (*nonces)[AES_BLOCK_SIZE],
+							unsigned int lanes, const unsigned char *plain, unsigned char *const *encrypted,
+							unsigned int len, unsigned char *tags) {
+	// As all lanes encrypt the same plaintext, the checksum over the full blocks is shared between them
+	keyblock checksum, tmp;
+	keyblock delta[AESNI_LANES], blocks[AESNI_LANES];
+	keyblock deltas[AESNI_LANES][PARALLEL_BLOCKS], fullBlocks[AESNI_LANES][PARALLEL_BLOCKS];
+	unsigned int offset = 0;
+
+	// Initialize
+	for (unsigned int i = 0; i < lanes; i++) {
+		memcpy(delta[i], nonces[i], AES_BLOCK_SIZE);
+	}
+	aesniEncryptLanes(roundKeys, reinterpret_cast< unsigned char * >(delta), lanes);
+	ZERO(checksum);
+
+	while (len > AES_BLOCK_SIZE) {
+		const unsigned int count = std::min(PARALLEL_BLOCKS, (len - 1) / AES_BLOCK_SIZE);
+		bool flipped[PARALLEL_BLOCKS];
+
+		for (unsigned int j = 0; j < count; j++) {
+			const unsigned char *block = plain + j * AES_BLOCK_SIZE;
+
+			// Counter-cryptanalysis described in section 9 of https://eprint.iacr.org/2019/311
+			// The plaintext is modified in the same way as in ocb_encrypt.
+			flipped[j] = false;
+			if (len - (j + 1) * AES_BLOCK_SIZE <= AES_BLOCK_SIZE) {
+				unsigned char sum = 0;
+				for (int k = 0; k < AES_BLOCK_SIZE - 1; ++k) {
+					sum |= block[k];
+				}
+				flipped[j] = sum == 0;
+			}
+
+			for (unsigned int i = 0; i < lanes; i++) {
+				S2(delta[i]);
+				memcpy(deltas[i][j], delta[i], AES_BLOCK_SIZE);
+				XOR(fullBlocks[i][j], delta[i], reinterpret_cast< const subblock * >(block));
+				if (flipped[j]) {
+					*reinterpret_cast< unsigned char * >(fullBlocks[i][j]) ^= 1;
+				}
+			}
+
+			XOR(checksum, checksum, reinterpret_cast< const subblock * >(block));
+			if (flipped[j]) {
+				*reinterpret_cast< unsigned char * >(checksum) ^= 1;
+			}
+		}
+
+		// Within a lane, the blocks are already processed in parallel
+		for (unsigned int i = 0; i < lanes; i++) {
+			aesniEncryptBlocks(roundKeys[i], reinterpret_cast< const unsigned char * >(fullBlocks[i]),
+							   reinterpret_cast< unsigned char * >(fullBlocks[i]), count);
+
+			for (unsigned int j = 0; j < count; j++) {
+				XOR(reinterpret_cast< subblock * >(encrypted[i] + offset + j * AES_BLOCK_SIZE), deltas[i][j],
+					fullBlocks[i][j]);
+			}
+		}
+
+		len -= count * AES_BLOCK_SIZE;
+		plain += count * AES_BLOCK_SIZE;
+		offset += count * AES_BLOCK_SIZE;
+	}
+
+	for (unsigned int i = 0; i < lanes; i++) {
+		S2(delta[i]);
+		ZERO(blocks[i]);
+		blocks[i][BLOCKSIZE - 1] = SWAPPED(len * 8);
+		XOR(blocks[i], blocks[i], delta[i]);
+	}
+	aesniEncryptLanes(roundKeys, reinterpret_cast< unsigned char * >(blocks), lanes);
+
+	for (unsigned int i = 0; i < lanes; i++) {
+		// blocks[i] is the pad of the final block
+		memcpy(tmp, plain, len);
+		memcpy(reinterpret_cast< unsigned char * >(tmp) + len,
+			   reinterpret_cast< const unsigned char * >(blocks[i]) + len, AES_BLOCK_SIZE - len);
+		XOR(blocks[i], blocks[i], tmp);
+		memcpy(encrypted[i] + offset, blocks[i], len);
+
+		XOR(tmp, tmp, checksum);
+		S3(delta[i]);
+		XOR(blocks[i], delta[i], tmp);
+	}
+	aesniEncryptLanes(roundKeys, reinterpret_cast< unsigned char * >(blocks), lanes);
+
+	for (unsigned int i = 0; i < lanes; i++) {
+		memcpy(tags + i * AES_BLOCK_SIZE, blocks[i], AES_BLOCK_SIZE);
+	}
+}
+#endif
+
+void CryptStateOCB2::encryptBatch(CryptState *const *states, unsigned char *const *destinations, bool *results,
+								  std::size_t count, const unsigned char *source, unsigned int plain_length) {
+#ifdef OCB2_AESNI
+	for (std::size_t first = 0; first < count; first += AESNI_LANES) {
+		const unsigned int lanes = static_cast< unsigned int >(std::min< std::size_t >(AESNI_LANES, count - first));
 
-#define AESencrypt(src, dst, key) AESencrypt_ctx(src, dst, key, enc_ctx_ocb_dec)
-#define AESdecrypt(src, dst, key) AESdecrypt_ctx(src, dst, key, dec_ctx_ocb_dec)
+		Key *keys[AESNI_LANES];
+		bool interleave = true;
+		for (unsigned int i = 0; i < lanes; i++) {
+			CryptStateOCB2 *state = static_cast< CryptStateOCB2 * >(states[first + i]);
+
+			keys[i]    = state->m_key.load(std::memory_order_acquire);
+			interleave = interleave && state->backend == Backend::AESNI;
+		}
+
+		if (!interleave) {
+			// The OpenSSL backend has to serialize the encryptions per key, which doesn't mix with processing
+			// several keys at once
+			CryptState::encryptBatch(states + first, destinations + first, results + first, lanes, source,
+									 plain_length);
+			continue;
+		}
+
+		const unsigned char *roundKeys[AESNI_LANES];
+		unsigned char nonces[AESNI_LANES][AES_BLOCK_SIZE];
+		unsigned char *encrypted[AESNI_LANES];
+		unsigned char tags[AESNI_LANES * AES_BLOCK_SIZE];
+
+		for (unsigned int i = 0; i < lanes; i++) {
+			// First, increase our IV.
+			keys[i]->nextEncryptIV(nonces[i]);
+
+			roundKeys[i] = keys[i]->enc_round_keys;
+			encrypted[i] = destinations[first + i] + 4;
+		}
+
+		ocbEncryptLanes(roundKeys, nonces, lanes, source, encrypted, plain_length, tags);
+
+		for (unsigned int i = 0; i < lanes; i++) {
+			unsigned char *dst = destinations[first + i];
+
+			dst[0] = nonces[i][0];
+			dst[1] = tags[i * AES_BLOCK_SIZE];
+			dst[2] = tags[i * AES_BLOCK_SIZE + 1];
+			dst[3] = tags[i * AES_BLOCK_SIZE + 2];
+
+			// Just like encrypt(), this always modifies the plaintext on a XEX* attack and thus can't fail
+			results[first + i] = true;
+		}
+	}
+#else
+	CryptState::encryptBatch(states, destinations, results, count, source, plain_length);
+#endif
+}
 
 bool CryptStateOCB2::ocb_decrypt(const unsigned char *encrypted, unsigned char *plain, unsigned int len,
 								 const unsigned char *nonce, unsigned char *tag) {
+	Key &key = *m_key.load(std::memory_order_acquire);
 	keyblock checksum, delta, tmp, pad;
+	keyblock deltas[PARALLEL_BLOCKS], blocks[PARALLEL_BLOCKS];
 	bool success = true;
 
 	// Initialize
-	AESencrypt(nonce, delta, raw_key);
+	encryptBlocks(key, nonce, delta, 1, key.enc_ctx_ocb_dec);
 	ZERO(checksum);
 
 	while (len > AES_BLOCK_SIZE) {
-		S2(delta);
-		XOR(tmp, delta, reinterpret_cast< const subblock * >(encrypted));
-		AESdecrypt(tmp, tmp, raw_key);
-		XOR(reinterpret_cast< subblock * >(plain), delta, tmp);
-		XOR(checksum, checksum, reinterpret_cast< const subblock * >(plain));
-		len -= AES_BLOCK_SIZE;
-		plain += AES_BLOCK_SIZE;
-		encrypted += AES_BLOCK_SIZE;
+		const unsigned int count = std::min(PARALLEL_BLOCKS, (len - 1) / AES_BLOCK_SIZE);
+
+		for (unsigned int i = 0; i < count; i++) {
+			S2(delta);
+			memcpy(deltas[i], delta, AES_BLOCK_SIZE);
+			XOR(blocks[i], delta, reinterpret_cast< const subblock * >(encrypted + i * AES_BLOCK_SIZE));
+		}
+
+		decryptBlocks(key, blocks, blocks, count, key.dec_ctx_ocb_dec);
+
+		for (unsigned int i = 0; i < count; i++) {
+			XOR(reinterpret_cast< subblock * >(plain), deltas[i], blocks[i]);
+			XOR(checksum, checksum, reinterpret_cast< const subblock * >(plain));
+
+			len -= AES_BLOCK_SIZE;
+			plain += AES_BLOCK_SIZE;
+			encrypted += AES_BLOCK_SIZE;
+		}
 	}
 
 	S2(delta);
 	ZERO(tmp);
 	tmp[BLOCKSIZE - 1] = SWAPPED(len * 8);
 	XOR(tmp, tmp, delta);
-	AESencrypt(tmp, pad, raw_key);
+	encryptBlocks(key, tmp, pad, 1, key.enc_ctx_ocb_dec);
 	memset(tmp, 0, AES_BLOCK_SIZE);
 	memcpy(tmp, encrypted, len);
 	XOR(tmp, tmp, pad);
@@ -400,13 +912,15 @@ bool CryptStateOCB2::ocb_decrypt(const unsigned char *encrypted, unsigned char *
 
 	S3(delta);
 	XOR(tmp, delta, checksum);
-	AESencrypt(tmp, tag, raw_key);
+	encryptBlocks(key, tmp, tag, 1, key.enc_ctx_ocb_dec);
 
 	return success;
 }
 
-#undef AESencrypt
-#undef AESdecrypt
+#undef PARALLEL_BLOCKS
+#ifdef OCB2_AESNI
+#	undef AESNI_LANES
+#endif
 #undef BLOCKSIZE
 #undef SHIFTBITS
 #undef SWAPPED
@@ -10,13 +10,32 @@
 
 #include <openssl/evp.h>
 
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
 #define AES_BLOCK_SIZE 16
 #define AES_KEY_SIZE_BITS 128
 #define AES_KEY_SIZE_BYTES (AES_KEY_SIZE_BITS / 8)
 
 
+/// OCB2-AES128 crypt state.
+///
+/// The encrypting half (encrypt() and encryptBatch()) is lock-free and may be used from several threads at once,
+/// also concurrently with the decrypting half and with rekeying (genKey(), setKey(), setRawKey(), setEncryptIV()).
+/// The decrypting half (decrypt(), setDecryptIV(), getDecryptIV() and the local packet statistics) has to be
+/// serialized by the caller.
 class CryptStateOCB2 : public CryptState {
 public:
+	/// The implementations of the AES block cipher OCB2 can be run on
+	enum class Backend {
+		/// OpenSSL's EVP interface. This is available everywhere.
+		OpenSSL,
+		/// AES-NI instructions, processing several blocks at once. Only available on x86 CPUs supporting them.
+		AESNI
+	};
+
 	CryptStateOCB2();
 	~CryptStateOCB2() noexcept override;
 
@@ -32,22 +51,50 @@ public:
 
 	virtual bool decrypt(const unsigned char *source, unsigned char *dst, unsigned int crypted_length) Q_DECL_OVERRIDE;
 	virtual bool encrypt(const unsigned char *source, unsigned char *dst, unsigned int plain_length) Q_DECL_OVERRIDE;
+	virtual void encryptBatch(CryptState *const *states, unsigned char *const *destinations, bool *results,
+							  std::size_t count, const unsigned char *source,
+							  unsigned int plain_length) Q_DECL_OVERRIDE;
 
 	bool ocb_encrypt(const unsigned char *plain, unsigned char *encrypted, unsigned int len, const unsigned char *nonce,
 					 unsigned char *tag, bool modifyPlainOnXEXStarAttack = true);
 	bool ocb_decrypt(const unsigned char *encrypted, unsigned char *plain, unsigned int len, const unsigned char *nonce,
 					 unsigned char *tag);
 
+	/// @returns Whether the given backend can be used on this machine
+	static bool isBackendSupported(Backend backend);
+	/// Selects the backend used for all subsequent operations. By default, the fastest supported backend is used.
+	///
+	/// @returns Whether the backend has been selected (it is not if it isn't supported)
+	bool setBackend(Backend backend);
+	Backend getBackend() const;
+
 private:
-	unsigned char raw_key[AES_KEY_SIZE_BYTES];
-	unsigned char encrypt_iv[AES_BLOCK_SIZE];
+	/// Everything that is derived from the key (see the source file)
+	struct Key;
+
+	/// The current key. Rekeying publishes a new key by swapping this pointer, so that encrypting never has
+	/// to take a lock.
+	std::atomic< Key * > m_key;
+	/// Keys that have been replaced. As encryptions might still be using them, they are only freed together
+	/// with this state. Keys are only replaced when a connection is (re-)established, so this stays small.
+	std::vector< std::unique_ptr< Key > > m_retiredKeys;
+	std::mutex m_rekeyLock;
+
+	Backend backend;
+
 	unsigned char decrypt_iv[AES_BLOCK_SIZE];
 	unsigned char decrypt_history[0x100];
 
-	EVP_CIPHER_CTX *enc_ctx_ocb_enc;
-	EVP_CIPHER_CTX *dec_ctx_ocb_enc;
-	EVP_CIPHER_CTX *enc_ctx_ocb_dec;
-	EVP_CIPHER_CTX *dec_ctx_ocb_dec;
+	/// Publishes a new key
+	///
+	/// @param rawKey The raw key, or nullptr to keep the current one
+	/// @param encryptIV The encrypt IV, or nullptr to keep the current one
+	void rekey(const unsigned char *rawKey, const unsigned char *encryptIV);
+
+	bool ocb_encrypt(Key &key, const unsigned char *plain, unsigned char *encrypted, unsigned int len,
+					 const unsigned char *nonce, unsigned char *tag, bool modifyPlainOnXEXStarAttack = true);
+	void encryptBlocks(Key &key, const void *src, void *dst, unsigned int blocks, EVP_CIPHER_CTX *ctx);
+	void decryptBlocks(Key &key, const void *src, void *dst, unsigned int blocks, EVP_CIPHER_CTX *ctx);
 };
 
 
@@ -1079,6 +1079,17 @@ void MainWindow::msgCryptSetup(const MumbleProto::CryptSetup &msg) {
 		if (!c->csCrypt->setKey(key, client_nonce, server_nonce)) {
 			qWarning("Messages: Cipher resync failed: Invalid key/nonce from the server!");
 		}
+
+		if (msg.has_udp_connection_token()) {
+			// Acknowledge the token, so the server knows that all of our datagrams are going to carry it
+			Global::get().sh->setUdpConnectionToken(msg.udp_connection_token());
+
+			MumbleProto::CryptSetup mpcs;
+			mpcs.set_udp_connection_token(msg.udp_connection_token());
+			Global::get().sh->sendMessage(mpcs);
+		} else {
+			Global::get().sh->setUdpConnectionToken(0);
+		}
 	} else if (msg.has_server_nonce()) {
 		const std::string &server_nonce = msg.server_nonce();
 		if (server_nonce.size() == AES_BLOCK_SIZE) {
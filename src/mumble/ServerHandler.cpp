@@ -290,7 +290,7 @@ void ServerHandler::handleVoicePacket(const Mumble::Protocol::AudioData &audioDa
 }
 
 void ServerHandler::sendMessage(const unsigned char *data, int len, bool force) {
-	STACKVAR(unsigned char, crypto, len + 4);
+	STACKVAR(unsigned char, crypto, len + 4 + Mumble::Protocol::UDP_CONNECTION_TOKEN_SIZE);
 
 	QMutexLocker qml(&qmUdp);
 
@@ -314,10 +314,17 @@ void ServerHandler::sendMessage(const unsigned char *data, int len, bool force)
 		QApplication::postEvent(this,
 								new ServerHandlerMessageEvent(qba, Mumble::Protocol::TCPMessageType::UDPTunnel, true));
 	} else {
-		if (!connection->csCrypt->encrypt(reinterpret_cast< const unsigned char * >(data), crypto, len)) {
+		// If the server assigned a connection token to us, it goes in front of the encrypted data
+		const int offset =
+			m_udpConnectionToken != 0 ? static_cast< int >(Mumble::Protocol::UDP_CONNECTION_TOKEN_SIZE) : 0;
+		if (offset > 0) {
+			qToBigEndian(m_udpConnectionToken, crypto);
+		}
+
+		if (!connection->csCrypt->encrypt(reinterpret_cast< const unsigned char * >(data), crypto + offset, len)) {
 			return;
 		}
-		qusUdp->writeDatagram(reinterpret_cast< const char * >(crypto), len + 4, qhaRemote, usResolvedPort);
+		qusUdp->writeDatagram(reinterpret_cast< const char * >(crypto), len + 4 + offset, qhaRemote, usResolvedPort);
 	}
 }
 
@@ -351,6 +358,12 @@ void ServerHandler::setServerSynchronized(bool synchronized) {
 	serverSynchronized = synchronized;
 }
 
+void ServerHandler::setUdpConnectionToken(quint32 token) {
+	QMutexLocker qml(&qmUdp);
+
+	m_udpConnectionToken = token;
+}
+
 void ServerHandler::hostnameResolved() {
 	ServerResolver *sr                    = qobject_cast< ServerResolver * >(QObject::sender());
 	QList< ServerResolverRecord > records = sr->records();
@@ -434,7 +447,8 @@ void ServerHandler::run() {
 			connect(connection.get(), &Connection::message, this, &ServerHandler::message);
 			connect(connection.get(), &Connection::handleSslErrors, this, &ServerHandler::setSslErrors);
 		}
-		bUdp = false;
+		bUdp                 = false;
+		m_udpConnectionToken = 0;
 
 
 #if QT_VERSION >= 0x050500
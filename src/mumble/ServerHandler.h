@@ -90,6 +90,9 @@ protected:
 	QHostAddress qhaLocal;
 	QUdpSocket *qusUdp;
 	QMutex qmUdp;
+	/// The token the server assigned to our UDP connection (0 if none). If set, every encrypted
+	/// datagram we send is prefixed with it.
+	quint32 m_udpConnectionToken = 0;
 
 	void handleVoicePacket(const Mumble::Protocol::AudioData &audioData);
 
@@ -147,6 +150,9 @@ public:
 	/// @param synchronized Whether the server has finished synchronization
 	void setServerSynchronized(bool synchronized);
 
+	/// @param token The token the server assigned to our UDP connection (0 for none)
+	void setUdpConnectionToken(quint32 token);
+
 #define PROCESS_MUMBLE_TCP_MESSAGE(name, value) \
 	void sendMessage(const MumbleProto::name &msg) { sendProtoMessage(msg, Mumble::Protocol::TCPMessageType::name); }
 	MUMBLE_ALL_TCP_MESSAGES
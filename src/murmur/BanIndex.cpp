@@ -0,0 +1,306 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "BanIndex.h"
+
+#include <algorithm>
+
+BanIndex::BanIndex() {
+	clear();
+}
+
+void BanIndex::assign(const QList< Ban > &bans) {
+	clear();
+
+	for (const Ban &ban : bans) {
+		insert(ban);
+	}
+}
+
+void BanIndex::insert(const Ban &ban) {
+	const unsigned int id = m_nextID++;
+	const int node        = findOrCreate(ban.haAddress, ban.iMask);
+
+	m_nodes[static_cast< std::size_t >(node)].bans.push_back(id);
+	m_entries.insert(id, Entry{ ban, node });
+
+	if (!ban.qsHash.isEmpty()) {
+		m_hashes.insert(ban.qsHash, id);
+	}
+
+	if (ban.iDuration > 0 && ban.qdtStart.isValid()) {
+		// Ban::isExpired considers a ban expired once a full second has passed after its end
+		const qint64 end = ban.qdtStart.toMSecsSinceEpoch() + (static_cast< qint64 >(ban.iDuration) + 1) * 1000;
+		m_expiries.push(Expiry(end, id));
+	}
+}
+
+bool BanIndex::remove(const Ban &ban) {
+	const int node = find(ban.haAddress, ban.iMask);
+	if (node < 0) {
+		return false;
+	}
+
+	std::vector< unsigned int > &bans = m_nodes[static_cast< std::size_t >(node)].bans;
+	for (auto it = bans.begin(); it != bans.end(); ++it) {
+		const unsigned int id = *it;
+		if (m_entries.value(id).ban == ban) {
+			bans.erase(it);
+			m_entries.remove(id);
+			if (!ban.qsHash.isEmpty()) {
+				m_hashes.remove(ban.qsHash, id);
+			}
+			// The entry in the heap is skipped once it comes up
+
+			compact();
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void BanIndex::clear() {
+	m_nodes.clear();
+	m_nodes.emplace_back();
+	m_entries.clear();
+	m_hashes.clear();
+	m_expiries = decltype(m_expiries)();
+}
+
+const Ban *BanIndex::match(const HostAddress &address) const {
+	int index = 0;
+
+	while (index >= 0) {
+		const Node &node = m_nodes[static_cast< std::size_t >(index)];
+		if (commonLength(address, node.prefix, node.length) < node.length) {
+			// The address branches off within this node's prefix
+			return nullptr;
+		}
+
+		if (!node.bans.empty()) {
+			return &m_entries.find(node.bans.front())->ban;
+		}
+
+		if (node.length == 128) {
+			return nullptr;
+		}
+
+		index = node.children[bit(address, node.length) ? 1 : 0];
+	}
+
+	return nullptr;
+}
+
+const Ban *BanIndex::matchHash(const QString &hash) const {
+	if (hash.isEmpty()) {
+		return nullptr;
+	}
+
+	auto it = m_hashes.constFind(hash);
+	if (it == m_hashes.constEnd()) {
+		return nullptr;
+	}
+
+	return &m_entries.find(it.value())->ban;
+}
+
+QList< Ban > BanIndex::takeExpired(const QDateTime &now) {
+	QList< Ban > expired;
+
+	const qint64 msecs = now.toMSecsSinceEpoch();
+	while (!m_expiries.empty() && m_expiries.top().first <= msecs) {
+		const unsigned int id = m_expiries.top().second;
+		m_expiries.pop();
+
+		auto it = m_entries.find(id);
+		if (it == m_entries.end()) {
+			// Removed already
+			continue;
+		}
+
+		expired << it->ban;
+
+		std::vector< unsigned int > &bans = m_nodes[static_cast< std::size_t >(it->node)].bans;
+		bans.erase(std::find(bans.begin(), bans.end(), id));
+		if (!it->ban.qsHash.isEmpty()) {
+			m_hashes.remove(it->ban.qsHash, id);
+		}
+		m_entries.erase(it);
+	}
+
+	if (!expired.isEmpty()) {
+		compact();
+	}
+
+	return expired;
+}
+
+qint64 BanIndex::nextExpiry() {
+	// Drops the bans that have been removed already
+	while (!m_expiries.empty() && !m_entries.contains(m_expiries.top().second)) {
+		m_expiries.pop();
+	}
+
+	return m_expiries.empty() ? -1 : m_expiries.top().first;
+}
+
+QList< Ban > BanIndex::bans() const {
+	QList< unsigned int > ids = m_entries.keys();
+	std::sort(ids.begin(), ids.end());
+
+	QList< Ban > bans;
+	for (unsigned int id : ids) {
+		bans << m_entries.value(id).ban;
+	}
+
+	return bans;
+}
+
+std::size_t BanIndex::size() const {
+	return static_cast< std::size_t >(m_entries.size());
+}
+
+std::size_t BanIndex::nodeCount() const {
+	return m_nodes.size();
+}
+
+bool BanIndex::bit(const HostAddress &address, int index) {
+	return (address.qip6.c[index / 8] >> (7 - index % 8)) & 1;
+}
+
+int BanIndex::commonLength(const HostAddress &lhs, const HostAddress &rhs, int limit) {
+	int length = 0;
+
+	for (int i = 0; i < 16 && length < limit; ++i) {
+		const unsigned char difference = lhs.qip6.c[i] ^ rhs.qip6.c[i];
+		if (difference == 0) {
+			length += 8;
+			continue;
+		}
+
+		int bits = 0;
+		while (!(difference & (0x80 >> bits))) {
+			++bits;
+		}
+		length += bits;
+		break;
+	}
+
+	return std::min(length, limit);
+}
+
+HostAddress BanIndex::truncate(const HostAddress &address, int length) {
+	HostAddress truncated;
+
+	for (int i = 0; i < 16; ++i) {
+		const int bits = std::min(std::max(length - i * 8, 0), 8);
+		truncated.qip6.c[i] =
+			static_cast< unsigned char >(address.qip6.c[i] & static_cast< unsigned char >(0xff00 >> bits));
+	}
+
+	return truncated;
+}
+
+int BanIndex::find(const HostAddress &address, int length) const {
+	const HostAddress prefix = truncate(address, length);
+
+	int index = 0;
+	while (m_nodes[static_cast< std::size_t >(index)].length != length) {
+		const Node &node = m_nodes[static_cast< std::size_t >(index)];
+		const int child  = node.children[bit(prefix, node.length) ? 1 : 0];
+		if (child < 0) {
+			return -1;
+		}
+
+		// The prefix has to extend the child's prefix, which also means that the child is not longer than the prefix
+		const Node &next = m_nodes[static_cast< std::size_t >(child)];
+		if (commonLength(prefix, next.prefix, std::min(length, next.length)) != next.length) {
+			return -1;
+		}
+
+		index = child;
+	}
+
+	return index;
+}
+
+int BanIndex::findOrCreate(const HostAddress &address, int length) {
+	const HostAddress prefix = truncate(address, length);
+
+	int index = 0;
+	while (true) {
+		const Node &node = m_nodes[static_cast< std::size_t >(index)];
+		if (node.length == length) {
+			return index;
+		}
+
+		const int side  = bit(prefix, node.length) ? 1 : 0;
+		const int child = node.children[side];
+
+		if (child < 0) {
+			Node leaf;
+			leaf.prefix = prefix;
+			leaf.length = length;
+
+			m_nodes.push_back(leaf);
+			m_nodes[static_cast< std::size_t >(index)].children[side] = static_cast< int >(m_nodes.size() - 1);
+			return static_cast< int >(m_nodes.size() - 1);
+		}
+
+		const Node &next = m_nodes[static_cast< std::size_t >(child)];
+		const int common = commonLength(prefix, next.prefix, std::min(length, next.length));
+		if (common == next.length) {
+			index = child;
+			continue;
+		}
+
+		// The prefix branches off within the child's prefix (or ends in it), so a node for the shared part is put
+		// in between
+		Node middle;
+		middle.prefix                                     = truncate(prefix, common);
+		middle.length                                     = common;
+		middle.children[bit(next.prefix, common) ? 1 : 0] = child;
+
+		m_nodes.push_back(middle);
+		const int middleIndex = static_cast< int >(m_nodes.size() - 1);
+		m_nodes[static_cast< std::size_t >(index)].children[side] = middleIndex;
+
+		if (common == length) {
+			return middleIndex;
+		}
+
+		index = middleIndex;
+	}
+}
+
+void BanIndex::compact() {
+	// Every ban needs at most two nodes: its own and one where it branches off
+	const std::size_t entries = static_cast< std::size_t >(m_entries.size());
+	if (m_nodes.size() > 4 * entries + 64) {
+		m_nodes.clear();
+		m_nodes.emplace_back();
+
+		QList< unsigned int > ids = m_entries.keys();
+		std::sort(ids.begin(), ids.end());
+		for (unsigned int id : ids) {
+			Entry &entry = m_entries[id];
+			entry.node   = findOrCreate(entry.ban.haAddress, entry.ban.iMask);
+			m_nodes[static_cast< std::size_t >(entry.node)].bans.push_back(id);
+		}
+	}
+
+	// Removed bans stay in the heap until they come up
+	if (m_expiries.size() > 2 * entries + 64) {
+		decltype(m_expiries) expiries;
+		while (!m_expiries.empty()) {
+			if (m_entries.contains(m_expiries.top().second)) {
+				expiries.push(m_expiries.top());
+			}
+			m_expiries.pop();
+		}
+		m_expiries = std::move(expiries);
+	}
+}
@@ -0,0 +1,99 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_BANINDEX_H_
+#define MUMBLE_MURMUR_BANINDEX_H_
+
+#include "Ban.h"
+#include "HostAddress.h"
+
+#include <QtCore/QDateTime>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+
+#include <cstddef>
+#include <functional>
+#include <queue>
+#include <utility>
+#include <vector>
+
+/// The bans of a virtual server, indexed for the checks done on every new connection.
+///
+/// The address ranges are kept in a path-compressed binary trie (radix trie) over the 128 bit addresses (IPv4
+/// addresses are mapped into IPv6, see HostAddress), so that finding the bans covering an address takes at most one
+/// step per bit of the longest ban's mask instead of a look at every ban. The certificate hashes are kept in a
+/// hash table. The temporary bans are kept in a min-heap ordered by their end, so that expired bans are found
+/// without looking at the others.
+class BanIndex {
+public:
+	BanIndex();
+
+	/// Replaces all bans
+	void assign(const QList< Ban > &bans);
+	void insert(const Ban &ban);
+	/// Removes one ban equal to the given one
+	///
+	/// @returns Whether there has been such a ban
+	bool remove(const Ban &ban);
+	void clear();
+
+	/// @returns A ban whose address range covers the given address or nullptr if there is none
+	const Ban *match(const HostAddress &address) const;
+	/// @returns A ban of the given certificate hash or nullptr if there is none
+	const Ban *matchHash(const QString &hash) const;
+
+	/// Removes all bans that have expired by the given time (see Ban::isExpired)
+	///
+	/// @returns The removed bans
+	QList< Ban > takeExpired(const QDateTime &now);
+	/// @returns The time the next temporary ban expires at (in milliseconds since the epoch) or -1 if there is no
+	/// temporary ban
+	qint64 nextExpiry();
+
+	/// @returns All bans in the order they have been inserted in
+	QList< Ban > bans() const;
+	std::size_t size() const;
+
+	/// @returns The amount of nodes in the trie (including the root)
+	std::size_t nodeCount() const;
+
+protected:
+	struct Node {
+		/// The address bits shared by everything below this node. Only the first length bits are set.
+		HostAddress prefix;
+		int length = 0;
+		int children[2] = { -1, -1 };
+		/// The bans whose range is exactly this node's prefix
+		std::vector< unsigned int > bans;
+	};
+
+	struct Entry {
+		Ban ban;
+		int node;
+	};
+
+	/// The end of a temporary ban (in milliseconds since the epoch) and its ID
+	using Expiry = std::pair< qint64, unsigned int >;
+
+	static bool bit(const HostAddress &address, int index);
+	/// @returns The amount of leading bits the given addresses have in common, at most limit
+	static int commonLength(const HostAddress &lhs, const HostAddress &rhs, int limit);
+	static HostAddress truncate(const HostAddress &address, int length);
+
+	/// @returns The index of the node for the given prefix or -1 if there is none
+	int find(const HostAddress &prefix, int length) const;
+	/// @returns The index of the node for the given prefix, which is created if necessary
+	int findOrCreate(const HostAddress &prefix, int length);
+	/// Rebuilds the trie if most of its nodes no longer lead to a ban
+	void compact();
+
+	std::vector< Node > m_nodes;
+	QHash< unsigned int, Entry > m_entries;
+	QMultiHash< QString, unsigned int > m_hashes;
+	std::priority_queue< Expiry, std::vector< Expiry >, std::greater< Expiry > > m_expiries;
+	unsigned int m_nextID = 0;
+};
+
+#endif // MUMBLE_MURMUR_BANINDEX_H_
@@ -0,0 +1,43 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_CHANNELROUTINGTABLE_H_
+#define MUMBLE_MURMUR_CHANNELROUTINGTABLE_H_
+
+#include "MumbleProtocol.h"
+#include "VolumeAdjustment.h"
+
+#include <cstddef>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+class ServerUser;
+
+/// A user that receives the regular speech of a channel
+struct AudioRoute {
+	ServerUser *receiver;
+	Mumble::Protocol::audio_context_t context;
+	VolumeAdjustment volumeAdjustment;
+};
+
+/// The precomputed receivers of regular speech (Mumble::Protocol::ReservedTargetIDs::REGULAR_SPEECH) in a
+/// channel: the users in and listening to that channel and to all channels linked to it.
+///
+/// The routes are stored in a flat array. Which parts of it a speaker's audio is sent to depends on the linked
+/// channels the speaker may speak in, so this is stored per speaker as a list of (merged) ranges. In the common
+/// case this is a single range spanning the whole array.
+///
+/// A table is a snapshot: it has to be dropped whenever users move, links or ChannelListeners change or ACLs
+/// (and thus the Speak permissions) change. Whether a receiver is deafened is not part of the table.
+struct ChannelRoutingTable {
+	using Range = std::pair< std::size_t, std::size_t >;
+
+	std::vector< AudioRoute > routes;
+	/// For the session of every user in the channel, the ranges [first, second) of routes to send its audio to
+	std::unordered_map< unsigned int, std::vector< Range > > speakerRanges;
+};
+
+#endif // MUMBLE_MURMUR_CHANNELROUTINGTABLE_H_
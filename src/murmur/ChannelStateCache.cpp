@@ -0,0 +1,95 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "ChannelStateCache.h"
+#include "MumbleProtocol.h"
+#include "QtUtils.h"
+
+#include <QtCore/QtEndian>
+
+#include <cstring>
+
+bool ChannelStateCache::Properties::operator==(const Properties &other) const {
+	return id == other.id && parentID == other.parentID && position == other.position && maxUsers == other.maxUsers
+		   && name == other.name && descriptionHash == other.descriptionHash && description == other.description;
+}
+
+bool ChannelStateCache::Properties::operator!=(const Properties &other) const {
+	return !(*this == other);
+}
+
+QByteArray ChannelStateCache::get(const Properties &channel, bool hashDescription) {
+	auto it = m_entries.find(channel.id);
+	if (it == m_entries.end()) {
+		it = m_entries.emplace(channel.id, Entry{ channel, {} }).first;
+	} else if (it->second.properties != channel) {
+		it->second = Entry{ channel, {} };
+	}
+
+	QByteArray &state = it->second.states[hashDescription ? 1 : 0];
+	if (state.isEmpty()) {
+		MumbleProto::ChannelState msg;
+		build(channel, hashDescription, msg);
+
+#if GOOGLE_PROTOBUF_VERSION >= 3004000
+		state.resize(static_cast< int >(msg.ByteSizeLong()));
+#else
+		// ByteSize() has been deprecated as of protobuf v3.4
+		state.resize(msg.ByteSize());
+#endif
+		msg.SerializeWithCachedSizesToArray(reinterpret_cast< unsigned char * >(state.data()));
+	}
+
+	return state;
+}
+
+void ChannelStateCache::remove(int channelID) {
+	m_entries.erase(channelID);
+}
+
+void ChannelStateCache::clear() {
+	m_entries.clear();
+}
+
+std::size_t ChannelStateCache::size() const {
+	return m_entries.size();
+}
+
+void ChannelStateCache::build(const Properties &channel, bool hashDescription, MumbleProto::ChannelState &msg) {
+	msg.set_channel_id(static_cast< unsigned int >(channel.id));
+	if (channel.parentID >= 0)
+		msg.set_parent(static_cast< unsigned int >(channel.parentID));
+	msg.set_name(u8(channel.name));
+	msg.set_position(channel.position);
+
+	if (hashDescription && !channel.descriptionHash.isEmpty())
+		msg.set_description_hash(blob(channel.descriptionHash));
+	else if (!channel.description.isEmpty())
+		msg.set_description(u8(channel.description));
+
+	msg.set_max_users(channel.maxUsers);
+}
+
+QByteArray ChannelStateCache::frame(const QByteArray &state, const MumbleProto::ChannelState &clientState) {
+#if GOOGLE_PROTOBUF_VERSION >= 3004000
+	const int clientLength = static_cast< int >(clientState.ByteSizeLong());
+#else
+	// ByteSize() has been deprecated as of protobuf v3.4
+	const int clientLength = clientState.ByteSize();
+#endif
+	const int length = state.size() + clientLength;
+
+	QByteArray message(length + 6, Qt::Uninitialized);
+	unsigned char *uc = reinterpret_cast< unsigned char * >(message.data());
+	qToBigEndian< quint16 >(static_cast< quint16 >(Mumble::Protocol::TCPMessageType::ChannelState), &uc[0]);
+	qToBigEndian< quint32 >(static_cast< quint32 >(length), &uc[2]);
+
+	// Concatenated messages are parsed as if they had been merged, so the client specific fields simply follow the
+	// shared ones
+	memcpy(uc + 6, state.constData(), static_cast< std::size_t >(state.size()));
+	clientState.SerializeWithCachedSizesToArray(uc + 6 + state.size());
+
+	return message;
+}
@@ -0,0 +1,67 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_CHANNELSTATECACHE_H_
+#define MUMBLE_MURMUR_CHANNELSTATECACHE_H_
+
+#include "Mumble.pb.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QString>
+
+#include <cstddef>
+#include <unordered_map>
+
+/// Holds the serialized ChannelState of every channel as it is sent to clients joining the server. Only the parts
+/// that are the same for all clients are part of it, so that it can be shared between them. The parts depending on
+/// the client (see build()) are serialized separately and appended to the shared part when framing the message,
+/// which protobuf treats as if both had been merged.
+///
+/// An entry is rebuilt as soon as the channel it has been built from changes, so the cache doesn't have to be
+/// invalidated explicitly. Entries of removed channels should be dropped though (see remove()).
+class ChannelStateCache {
+public:
+	/// The properties of a channel making up the shared part of its ChannelState
+	struct Properties {
+		int id;
+		/// -1 for the root channel
+		int parentID;
+		/// The name as presented to clients (the root channel is named after the server)
+		QString name;
+		int position;
+		unsigned int maxUsers;
+		QString description;
+		QByteArray descriptionHash;
+
+		bool operator==(const Properties &other) const;
+		bool operator!=(const Properties &other) const;
+	};
+
+	/// @param hashDescription Whether the description is to be replaced by its hash (if there is one), as is done for
+	/// clients >= 1.2.2
+	/// @returns The serialized (but not framed) ChannelState describing the given channel
+	QByteArray get(const Properties &channel, bool hashDescription);
+	/// Drops the entry of the given channel (if any)
+	void remove(int channelID);
+	void clear();
+	/// @returns The amount of channels with an entry
+	std::size_t size() const;
+
+	static void build(const Properties &channel, bool hashDescription, MumbleProto::ChannelState &msg);
+	/// @returns The ChannelState framed as a control channel message, consisting of the given shared part and the
+	/// client specific part clientState
+	static QByteArray frame(const QByteArray &state, const MumbleProto::ChannelState &clientState);
+
+protected:
+	struct Entry {
+		Properties properties;
+		/// The serialized state with the full description and the one with its hash, each built when first needed
+		QByteArray states[2];
+	};
+
+	std::unordered_map< int, Entry > m_entries;
+};
+
+#endif // MUMBLE_MURMUR_CHANNELSTATECACHE_H_
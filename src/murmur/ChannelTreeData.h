@@ -0,0 +1,63 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_CHANNELTREEDATA_H_
+#define MUMBLE_MURMUR_CHANNELTREEDATA_H_
+
+#include <QtCore/QList>
+#include <QtCore/QPair>
+#include <QtCore/QSet>
+#include <QtCore/QString>
+#include <QtCore/QtGlobal>
+
+/// The persistent channels of a virtual server along with their ACLs, groups and links, as read from the database
+/// by ServerDB::readChannelTree. This only holds plain data, so that it can be read on any thread and turned into
+/// Channel objects on the main thread later on (see Server::readChannels).
+struct ChannelTreeData {
+	struct ChannelRow {
+		int id;
+		/// -1 for the root channel
+		int parentID;
+		QString name;
+		bool inheritACL;
+		/// Null if the channel has no description
+		QString description;
+		int position          = 0;
+		unsigned int maxUsers = 0;
+	};
+
+	struct GroupRow {
+		int channelID;
+		QString name;
+		bool inherit;
+		bool inheritable;
+		QSet< int > add;
+		QSet< int > remove;
+	};
+
+	struct ACLRow {
+		int channelID;
+		/// -1 if the entry applies to a group
+		int userID;
+		QString group;
+		bool applyHere;
+		bool applySubs;
+		unsigned int allow;
+		unsigned int deny;
+	};
+
+	/// Ordered by name, which is the order the channels are added to their parent in
+	QList< ChannelRow > channels;
+	QList< GroupRow > groups;
+	/// Ordered by channel and priority
+	QList< ACLRow > acls;
+	/// Pairs of channel IDs. Every link is stored in both directions.
+	QList< QPair< int, int > > links;
+
+	/// How long reading the data took (in microseconds)
+	quint64 readTime = 0;
+};
+
+#endif // MUMBLE_MURMUR_CHANNELTREEDATA_H_
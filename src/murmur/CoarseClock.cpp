@@ -0,0 +1,27 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "CoarseClock.h"
+
+#include <algorithm>
+#include <chrono>
+
+static_assert(std::chrono::steady_clock::is_steady, "The coarse clock needs a monotonic clock");
+
+std::atomic< quint64 > CoarseClock::s_now(0);
+
+quint64 CoarseClock::update() {
+	static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+	const quint64 time = static_cast< quint64 >(
+		std::chrono::duration_cast< std::chrono::microseconds >(std::chrono::steady_clock::now() - epoch).count());
+
+	// Another thread might have published a later time in the meantime
+	quint64 previous = s_now.load(std::memory_order_relaxed);
+	while (previous < time && !s_now.compare_exchange_weak(previous, time, std::memory_order_relaxed)) {
+	}
+
+	return std::max(previous, time);
+}
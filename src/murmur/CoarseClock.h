@@ -0,0 +1,32 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_COARSECLOCK_H_
+#define MUMBLE_MURMUR_COARSECLOCK_H_
+
+#include <QtCore/QtGlobal>
+
+#include <atomic>
+
+/// A monotonic clock that is read once per batch of received packets instead of once per packet.
+///
+/// The threads receiving packets call update() whenever they wake up, and everything handling those packets
+/// (rate limiting, bandwidth accounting) uses now(), which is a single relaxed atomic load. The time can thus be
+/// behind by as long as it takes to handle a batch, which is fine for everything measured in (fractions of)
+/// seconds. The time never goes backwards, even if several threads update it.
+class CoarseClock {
+public:
+	/// Reads the monotonic clock and publishes the time
+	///
+	/// @returns The current time in microseconds
+	static quint64 update();
+	/// @returns The time of the last update in microseconds
+	static quint64 now() { return s_now.load(std::memory_order_relaxed); }
+
+private:
+	static std::atomic< quint64 > s_now;
+};
+
+#endif // MUMBLE_MURMUR_COARSECLOCK_H_
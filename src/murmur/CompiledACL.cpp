@@ -0,0 +1,380 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "CompiledACL.h"
+
+#include "Channel.h"
+#include "Group.h"
+#include "ServerUser.h"
+
+#include <QtCore/QStringList>
+
+#include <algorithm>
+
+ChanACL::Permissions CompiledACL::effectivePermissions(const ServerUser &user, const Channel &channel) {
+	// Superuser
+	if (user.iId == 0) {
+		return static_cast< ChanACL::Permissions >(ChanACL::All & ~(ChanACL::Speak | ChanACL::Whisper));
+	}
+
+	const Program &prog        = program(channel);
+	MembershipBits &membership = m_memberships[&user];
+
+	// Default permissions
+	const ChanACL::Permissions def = ChanACL::Traverse | ChanACL::Enter | ChanACL::Speak | ChanACL::Whisper
+									 | ChanACL::TextMessage | ChanACL::Listen;
+
+	ChanACL::Permissions granted = def;
+	bool traverse                = true;
+	bool write                   = false;
+
+	for (const Level &level : prog.levels) {
+		if (level.resetGranted) {
+			granted = def;
+		}
+
+		for (std::size_t i = level.begin; i < level.end; ++i) {
+			const Rule &rule = prog.rules[i];
+
+			const bool matchUser  = (rule.userId != -1) && (rule.userId == user.iId);
+			const bool matchGroup = (rule.predicate != NO_PREDICATE) && appliesTo(rule.predicate, user, membership);
+			if (!matchUser && !matchGroup) {
+				continue;
+			}
+
+			if (rule.allow & ChanACL::Traverse)
+				traverse = true;
+			if (rule.deny & ChanACL::Traverse)
+				traverse = false;
+			if (rule.allow & ChanACL::Write)
+				write = true;
+			if (rule.deny & ChanACL::Write)
+				write = false;
+
+			granted = (granted | rule.grant) & ~rule.revoke;
+		}
+
+		if (!traverse && !write) {
+			granted = ChanACL::None;
+			break;
+		}
+	}
+
+	if (granted & ChanACL::Write) {
+		granted |= ChanACL::Traverse | ChanACL::Enter | ChanACL::MuteDeafen | ChanACL::Move | ChanACL::MakeChannel
+				   | ChanACL::LinkChannel | ChanACL::TextMessage | ChanACL::MakeTempChannel | ChanACL::Listen;
+		if (prog.isRoot)
+			granted |= ChanACL::Kick | ChanACL::Ban | ChanACL::ResetUserContent | ChanACL::Register
+					   | ChanACL::SelfRegister;
+	}
+
+	return granted;
+}
+
+void CompiledACL::clear() {
+	m_predicates.clear();
+	m_predicateIndices.clear();
+	m_droppedPredicates = 0;
+	m_programs.clear();
+	m_memberships.clear();
+}
+
+void CompiledACL::clearChannels(const QSet< Channel * > &channels) {
+	for (const Channel *channel : channels) {
+		m_programs.remove(channel);
+	}
+
+	// Predicates only refer to channels in the hierarchy of the channel they have been compiled for, so the
+	// programs of all other channels don't use the dropped ones. Their indices (and the bits users have for them)
+	// are only reused once everything is cleared.
+	for (auto it = m_predicateIndices.begin(); it != m_predicateIndices.end();) {
+		const Predicate &predicate = m_predicates[it->second];
+
+		if (predicate.channel && channels.contains(const_cast< Channel * >(predicate.channel))) {
+			it = m_predicateIndices.erase(it);
+			m_droppedPredicates++;
+		} else {
+			++it;
+		}
+	}
+
+	if (m_droppedPredicates > m_predicateIndices.size()) {
+		clear();
+	}
+}
+
+void CompiledACL::clearUser(const User *user) {
+	m_memberships.remove(user);
+}
+
+const CompiledACL::Program &CompiledACL::program(const Channel &channel) {
+	auto it = m_programs.constFind(&channel);
+	if (it != m_programs.constEnd()) {
+		return it.value();
+	}
+
+	std::vector< const Channel * > hierarchy;
+	for (const Channel *ch = &channel; ch; ch = ch->cParent) {
+		hierarchy.push_back(ch);
+	}
+
+	const ChanACL::Permissions rootOnly =
+		ChanACL::Kick | ChanACL::Ban | ChanACL::ResetUserContent | ChanACL::Register | ChanACL::SelfRegister;
+
+	Program prog;
+	prog.isRoot = (channel.iId == 0);
+
+	// Starting at the root channel, just like ChanACL::evaluatePermissions does
+	for (auto chIt = hierarchy.rbegin(); chIt != hierarchy.rend(); ++chIt) {
+		const Channel *ch = *chIt;
+
+		Level level;
+		level.begin        = prog.rules.size();
+		level.resetGranted = !ch->bInheritACL;
+
+		for (const ChanACL *acl : ch->qlACL) {
+			Rule rule;
+			rule.userId    = acl->iUserId;
+			rule.predicate = compilePredicate(channel, *ch, acl->qsGroup);
+
+			if (rule.userId == -1 && rule.predicate == NO_PREDICATE) {
+				// This entry can never apply to anyone
+				continue;
+			}
+
+			rule.allow  = acl->pAllow;
+			rule.deny   = acl->pDeny;
+			rule.grant  = ChanACL::None;
+			rule.revoke = ChanACL::None;
+
+			if (ch->iId == 0 && ch == &channel && acl->bApplyHere) {
+				rule.grant |= acl->pAllow & rootOnly;
+			}
+			if ((ch == &channel && acl->bApplyHere) || (ch != &channel && acl->bApplySubs)) {
+				rule.grant |= acl->pAllow & ~(rootOnly | ChanACL::Cached);
+				rule.revoke = acl->pDeny;
+			}
+
+			prog.rules.push_back(rule);
+		}
+
+		level.end = prog.rules.size();
+		prog.levels.push_back(level);
+	}
+
+	return m_programs.insert(&channel, std::move(prog)).value();
+}
+
+std::uint32_t CompiledACL::compilePredicate(const Channel &currentChannel, const Channel &aclChannel,
+											QString groupSpecification) {
+	// This has to parse group specifications exactly like Group::appliesToUser does
+	Predicate predicate;
+	predicate.type     = PredicateType::Never;
+	predicate.invert   = false;
+	predicate.channel  = nullptr;
+	predicate.minDepth = 0;
+	predicate.maxDepth = 0;
+
+	bool isAccessToken            = false;
+	bool isCertHash               = false;
+	const Channel *contextChannel = &currentChannel;
+
+	while (!groupSpecification.isEmpty()) {
+		if (groupSpecification.startsWith(QChar::fromLatin1('!'))) {
+			predicate.invert = true;
+		} else if (groupSpecification.startsWith(QChar::fromLatin1('~'))) {
+			contextChannel = &aclChannel;
+		} else if (groupSpecification.startsWith(QChar::fromLatin1('#'))) {
+			isAccessToken = true;
+		} else if (groupSpecification.startsWith(QChar::fromLatin1('$'))) {
+			isCertHash = true;
+		} else {
+			break;
+		}
+
+		groupSpecification.remove(0, 1);
+	}
+
+	if (groupSpecification.isEmpty()) {
+		// Never applies, not even if inverted
+		return NO_PREDICATE;
+	}
+
+	if (isAccessToken) {
+		predicate.type  = PredicateType::AccessToken;
+		predicate.value = groupSpecification;
+	} else if (isCertHash) {
+		predicate.type  = PredicateType::CertHash;
+		predicate.value = groupSpecification;
+	} else if (groupSpecification == QLatin1String("none")) {
+		predicate.type = PredicateType::Never;
+	} else if (groupSpecification == QLatin1String("all")) {
+		predicate.type = PredicateType::Always;
+	} else if (groupSpecification == QLatin1String("auth")) {
+		predicate.type = PredicateType::Authenticated;
+	} else if (groupSpecification == QLatin1String("strong")) {
+		predicate.type = PredicateType::Verified;
+	} else if (groupSpecification == QLatin1String("in")) {
+		predicate.type    = PredicateType::InChannel;
+		predicate.channel = contextChannel;
+	} else if (groupSpecification == QLatin1String("out")) {
+		predicate.type    = PredicateType::InChannel;
+		predicate.invert  = !predicate.invert;
+		predicate.channel = contextChannel;
+	} else if (groupSpecification == QLatin1String("sub") || groupSpecification.startsWith(QLatin1String("sub,"))) {
+		groupSpecification.remove(0, 4);
+
+		int requiredChannelOffset = 0;
+		int minDescendantLevel    = 1;
+		int maxDescendantLevel    = 1000;
+
+		QStringList args = groupSpecification.split(QLatin1String(","));
+		if (args.count() >= 1 && !args[0].isEmpty()) {
+			requiredChannelOffset = args[0].toInt();
+		}
+		if (args.count() >= 2 && !args[1].isEmpty()) {
+			minDescendantLevel = args[1].toInt();
+		}
+		if (args.count() >= 3 && !args[2].isEmpty()) {
+			maxDescendantLevel = args[2].toInt();
+		}
+
+		std::vector< const Channel * > currentChannelHierarchy;
+		for (const Channel *ch = &currentChannel; ch; ch = ch->cParent) {
+			currentChannelHierarchy.push_back(ch);
+		}
+		std::reverse(currentChannelHierarchy.begin(), currentChannelHierarchy.end());
+
+		const auto contextIt =
+			std::find(currentChannelHierarchy.begin(), currentChannelHierarchy.end(), contextChannel);
+		Q_ASSERT(contextIt != currentChannelHierarchy.end());
+
+		int requiredChannelIndex = static_cast< int >(contextIt - currentChannelHierarchy.begin());
+		requiredChannelIndex += requiredChannelOffset;
+
+		if (requiredChannelIndex >= static_cast< int >(currentChannelHierarchy.size())) {
+			// Never applies (but still gets inverted)
+			predicate.type = PredicateType::Never;
+		} else {
+			requiredChannelIndex = std::max(requiredChannelIndex, 0);
+
+			predicate.type     = PredicateType::Sub;
+			predicate.channel  = currentChannelHierarchy[static_cast< std::size_t >(requiredChannelIndex)];
+			predicate.minDepth = requiredChannelIndex + minDescendantLevel;
+			predicate.maxDepth = requiredChannelIndex + maxDescendantLevel;
+		}
+	} else {
+		predicate.type    = PredicateType::Group;
+		predicate.channel = contextChannel;
+		predicate.value   = groupSpecification;
+	}
+
+	return intern(std::move(predicate));
+}
+
+std::uint32_t CompiledACL::intern(Predicate predicate) {
+	const PredicateKey key(static_cast< int >(predicate.type), predicate.invert, predicate.channel, predicate.minDepth,
+						   predicate.maxDepth, predicate.value);
+
+	auto it = m_predicateIndices.find(key);
+	if (it != m_predicateIndices.end()) {
+		return it->second;
+	}
+
+	if (predicate.type == PredicateType::Group) {
+		// Resolve which definitions of the group along the channel tree make up its members
+		for (const Channel *ch = predicate.channel; ch; ch = ch->cParent) {
+			const Group *group = ch->qhGroups.value(predicate.value);
+
+			if (group) {
+				if ((ch != predicate.channel) && !group->bInheritable)
+					break;
+				predicate.groups.push_back(group);
+				if (!group->bInherit)
+					break;
+			}
+		}
+		std::reverse(predicate.groups.begin(), predicate.groups.end());
+	}
+
+	const std::uint32_t index = static_cast< std::uint32_t >(m_predicates.size());
+	m_predicates.push_back(std::move(predicate));
+	m_predicateIndices.emplace(key, index);
+
+	return index;
+}
+
+bool CompiledACL::appliesTo(std::uint32_t predicate, const ServerUser &user, MembershipBits &bits) const {
+	const std::size_t word   = predicate / 64;
+	const std::uint64_t mask = std::uint64_t(1) << (predicate % 64);
+
+	if (word >= bits.known.size()) {
+		const std::size_t words = (m_predicates.size() + 63) / 64;
+		bits.known.resize(words, 0);
+		bits.members.resize(words, 0);
+	}
+
+	if (!(bits.known[word] & mask)) {
+		bits.known[word] |= mask;
+		if (evaluate(m_predicates[predicate], user)) {
+			bits.members[word] |= mask;
+		}
+	}
+
+	return bits.members[word] & mask;
+}
+
+bool CompiledACL::evaluate(const Predicate &predicate, const ServerUser &user) {
+	bool matches = false;
+
+	switch (predicate.type) {
+		case PredicateType::Never:
+			matches = false;
+			break;
+		case PredicateType::Always:
+			matches = true;
+			break;
+		case PredicateType::Authenticated:
+			matches = (user.iId >= 0);
+			break;
+		case PredicateType::Verified:
+			matches = user.bVerified;
+			break;
+		case PredicateType::InChannel:
+			matches = (user.cChannel == predicate.channel);
+			break;
+		case PredicateType::AccessToken:
+			matches = user.qslAccessTokens.contains(predicate.value, Group::accessTokenCaseSensitivity);
+			break;
+		case PredicateType::CertHash:
+			matches = (user.qsHash == predicate.value);
+			break;
+		case PredicateType::Sub: {
+			// The user has to be in the required channel or below it, at a depth within the given range
+			bool inRequiredChannel = false;
+			int depth              = -1;
+			for (const Channel *ch = user.cChannel; ch; ch = ch->cParent) {
+				if (ch == predicate.channel) {
+					inRequiredChannel = true;
+				}
+				depth++;
+			}
+
+			matches = inRequiredChannel && (depth >= predicate.minDepth) && (depth <= predicate.maxDepth);
+			break;
+		}
+		case PredicateType::Group:
+			for (const Group *group : predicate.groups) {
+				if (group->qsAdd.contains(user.iId) || group->qsTemporary.contains(user.iId)
+					|| group->qsTemporary.contains(-static_cast< int >(user.uiSession)))
+					matches = true;
+				if (group->qsRemove.contains(user.iId))
+					matches = false;
+			}
+			break;
+	}
+
+	return predicate.invert ? !matches : matches;
+}
@@ -0,0 +1,127 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_COMPILEDACL_H_
+#define MUMBLE_MURMUR_COMPILEDACL_H_
+
+#include "ACL.h"
+
+#include <QtCore/QHash>
+#include <QtCore/QSet>
+#include <QtCore/QString>
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <tuple>
+#include <vector>
+
+class Channel;
+class Group;
+class ServerUser;
+class User;
+
+/// The ACLs of a server compiled into a form that is cheap to evaluate. Evaluating them yields exactly the same
+/// permissions as ChanACL::evaluatePermissions, which walks up the channel tree and parses the group specification
+/// of every ACL entry it comes across (see Group::appliesToUser).
+///
+/// For every channel, the ACL entries affecting it (those of the channel itself and of its parents) are compiled
+/// into a flat list of rules the first time permissions in that channel are requested. The group specifications
+/// of the rules are parsed into predicates, which are shared between all channels. Whether a predicate applies
+/// to a user is only evaluated once per user and then kept in that user's membership bitset, so that checking
+/// a rule boils down to testing a bit.
+///
+/// The compiled ACLs don't notice changes by themselves: clearChannels() has to be called for the subtree of a
+/// channel whose ACLs, groups or parent changed and clearUser() whenever something that group specifications
+/// depend on changes for a user (its channel, ID, certificate, access tokens or temporary group memberships).
+/// This is the same contract as for the permissions cached in a ChanACL::ACLCache, which owns the compiled ACLs.
+///
+/// This class is not thread-safe.
+class CompiledACL {
+public:
+	/// @returns The effective permissions of the given user in the given channel
+	ChanACL::Permissions effectivePermissions(const ServerUser &user, const Channel &channel);
+
+	/// Drops all compiled ACLs and membership bitsets
+	void clear();
+	/// Drops the compiled ACLs of the given channels, which have to include all of their subchannels, along with
+	/// the predicates referring to them
+	void clearChannels(const QSet< Channel * > &channels);
+	/// Drops the membership bitset of the given user. The groups predicates refer to are kept, so groups that have
+	/// been added or removed since require clearChannels().
+	void clearUser(const User *user);
+
+protected:
+	enum class PredicateType { Never, Always, Authenticated, Verified, InChannel, AccessToken, CertHash, Sub, Group };
+
+	/// A parsed group specification. Channels referenced by the specification have already been resolved.
+	struct Predicate {
+		PredicateType type;
+		bool invert;
+		/// The channel users have to be in (InChannel), the channel users have to be in or below of (Sub) or the
+		/// channel the group is looked up in (Group)
+		const Channel *channel;
+		/// The range of depths (in the channel tree) the channel of a user has to be in (Sub)
+		int minDepth;
+		int maxDepth;
+		/// The access token or certificate hash to match or the name of the group
+		QString value;
+		/// The definitions of the group along the channel tree, starting with the topmost one (Group)
+		std::vector< const Group * > groups;
+	};
+
+	/// (type, invert, channel, minDepth, maxDepth, value) identifying an interned predicate
+	using PredicateKey = std::tuple< int, bool, const Channel *, int, int, QString >;
+
+	static constexpr std::uint32_t NO_PREDICATE = UINT32_MAX;
+
+	/// A single compiled ACL entry
+	struct Rule {
+		int userId;
+		std::uint32_t predicate;
+		ChanACL::Permissions allow;
+		ChanACL::Permissions deny;
+		/// The permissions this entry grants (respectively revokes) in the channel the rule list has been compiled for
+		ChanACL::Permissions grant;
+		ChanACL::Permissions revoke;
+	};
+
+	/// The rules of a single channel in the hierarchy of the channel a program has been compiled for
+	struct Level {
+		std::size_t begin;
+		std::size_t end;
+		bool resetGranted;
+	};
+
+	struct Program {
+		std::vector< Rule > rules;
+		std::vector< Level > levels;
+		bool isRoot;
+	};
+
+	/// A bit for every predicate, telling whether the predicate applies to the user. Bits are only valid if the
+	/// corresponding bit in known is set.
+	struct MembershipBits {
+		std::vector< std::uint64_t > known;
+		std::vector< std::uint64_t > members;
+	};
+
+	std::vector< Predicate > m_predicates;
+	std::map< PredicateKey, std::uint32_t > m_predicateIndices;
+	/// The amount of predicates that have been dropped by clearChannels but still take up their index
+	std::size_t m_droppedPredicates = 0;
+	QHash< const Channel *, Program > m_programs;
+	QHash< const User *, MembershipBits > m_memberships;
+
+	const Program &program(const Channel &channel);
+	std::uint32_t compilePredicate(const Channel &currentChannel, const Channel &aclChannel,
+								   QString groupSpecification);
+	std::uint32_t intern(Predicate predicate);
+
+	bool appliesTo(std::uint32_t predicate, const ServerUser &user, MembershipBits &bits) const;
+	static bool evaluate(const Predicate &predicate, const ServerUser &user);
+};
+
+#endif // MUMBLE_MURMUR_COMPILEDACL_H_
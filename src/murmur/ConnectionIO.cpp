@@ -0,0 +1,380 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "ConnectionIO.h"
+#include "Mumble.pb.h"
+
+#include <QtCore/QDebug>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QThread>
+#include <QtCore/QtEndian>
+
+ConnectionIO::SslErrorSeverity ConnectionIO::classifySslError(const QSslError &error) {
+	switch (error.error()) {
+		case QSslError::InvalidPurpose:
+			// Allow email certificates.
+			return SslErrorSeverity::Ignorable;
+		case QSslError::NoPeerCertificate:
+		case QSslError::SelfSignedCertificate:
+		case QSslError::SelfSignedCertificateInChain:
+		case QSslError::UnableToGetLocalIssuerCertificate:
+		case QSslError::UnableToVerifyFirstCertificate:
+		case QSslError::HostNameMismatch:
+		case QSslError::CertificateNotYetValid:
+		case QSslError::CertificateExpired:
+			return SslErrorSeverity::Unverified;
+		default:
+			return SslErrorSeverity::Fatal;
+	}
+}
+
+ConnectionIO::ConnectionIO(QSslSocket *socket)
+	: QObject(), m_socket(socket), m_type(Mumble::Protocol::TCPMessageType::Version),
+	  m_socketDescriptor(socket->socketDescriptor()), m_peerAddress(socket->peerAddress()),
+	  m_peerPort(socket->peerPort()), m_localAddress(socket->localAddress()), m_localPort(socket->localPort()),
+	  m_pendingBytes(0), m_socketBytes(0), m_notifyDrained(false) {
+	m_socket->setParent(this);
+
+	connect(m_socket, SIGNAL(error(QAbstractSocket::SocketError)), this,
+			SLOT(socketError(QAbstractSocket::SocketError)));
+	connect(m_socket, SIGNAL(encrypted()), this, SLOT(socketEncrypted()));
+	connect(m_socket, SIGNAL(readyRead()), this, SLOT(socketRead()));
+	connect(m_socket, SIGNAL(disconnected()), this, SLOT(socketDisconnected()));
+	connect(m_socket, SIGNAL(sslErrors(const QList< QSslError > &)), this,
+			SLOT(socketSslErrors(const QList< QSslError > &)));
+	connect(m_socket, SIGNAL(bytesWritten(qint64)), this, SLOT(socketBytesWritten()));
+	connect(m_socket, SIGNAL(encryptedBytesWritten(qint64)), this, SLOT(socketBytesWritten()));
+}
+
+void ConnectionIO::send(const QByteArray &data) {
+	if (data.isEmpty()) {
+		return;
+	}
+
+	bool schedule;
+	{
+		QMutexLocker l(&m_mutex);
+		schedule = m_pending.isEmpty();
+		// QByteArray is implicitly shared, so a message broadcast to many connections is only referenced here
+		m_pending.append(data);
+		m_pendingBytes += data.size();
+	}
+
+	// Whatever is queued until the network thread gets to it (at least until the current event loop pass is over)
+	// is written in one go
+	if (schedule) {
+		QMetaObject::invokeMethod(this, "writePending", Qt::QueuedConnection);
+	}
+}
+
+void ConnectionIO::flush() {
+	if (isOwnThread()) {
+		flushPending();
+	} else {
+		QMetaObject::invokeMethod(this, "flushPending", Qt::QueuedConnection);
+	}
+}
+
+void ConnectionIO::disconnectSocket(bool force) {
+	if (isOwnThread()) {
+		closeSocket(force);
+	} else {
+		QMetaObject::invokeMethod(this, "closeSocket", Qt::QueuedConnection, Q_ARG(bool, force));
+	}
+}
+
+void ConnectionIO::startServerEncryption() {
+	if (isOwnThread()) {
+		startHandshake();
+	} else {
+		QMetaObject::invokeMethod(this, "startHandshake", Qt::QueuedConnection);
+	}
+}
+
+qintptr ConnectionIO::socketDescriptor() const {
+	return m_socketDescriptor;
+}
+
+qint64 ConnectionIO::bytesToWrite() const {
+	return m_pendingBytes + m_socketBytes;
+}
+
+void ConnectionIO::notifyWhenDrained() {
+	m_notifyDrained = true;
+
+	if (isOwnThread()) {
+		checkDrained();
+	} else {
+		QMetaObject::invokeMethod(this, "checkDrained", Qt::QueuedConnection);
+	}
+}
+
+QHostAddress ConnectionIO::peerAddress() const {
+	return m_peerAddress;
+}
+
+quint16 ConnectionIO::peerPort() const {
+	return m_peerPort;
+}
+
+QHostAddress ConnectionIO::localAddress() const {
+	return m_localAddress;
+}
+
+quint16 ConnectionIO::localPort() const {
+	return m_localPort;
+}
+
+QList< QSslCertificate > ConnectionIO::peerCertificateChain() const {
+	QMutexLocker l(&m_mutex);
+	return m_peerCertificateChain;
+}
+
+QSslCipher ConnectionIO::sessionCipher() const {
+	QMutexLocker l(&m_mutex);
+	return m_sessionCipher;
+}
+
+QSsl::SslProtocol ConnectionIO::sessionProtocol() const {
+	QMutexLocker l(&m_mutex);
+	return m_sessionProtocol;
+}
+
+/**
+ * Reads all complete messages from the socket, parses them and hands them on. The 6 byte prefix of every
+ * message holds its type and length.
+ *
+ * @see void Connection::socketRead()
+ */
+void ConnectionIO::socketRead() {
+	while (true) {
+		qint64 available = m_socket->bytesAvailable();
+		if (m_packetLength == -1) {
+			if (available < 6)
+				return;
+
+			unsigned char header[6];
+
+			m_socket->read(reinterpret_cast< char * >(header), 6);
+			m_type         = static_cast< Mumble::Protocol::TCPMessageType >(qFromBigEndian< quint16 >(&header[0]));
+			m_packetLength = qFromBigEndian< quint32 >(&header[2]);
+			available -= 6;
+		}
+
+		if (m_packetLength > 0x7fffff) {
+			qWarning() << "Host tried to send huge packet";
+			closeSocket(true);
+			return;
+		}
+
+		if (available < m_packetLength)
+			return;
+
+		QByteArray payload = m_socket->read(m_packetLength);
+		m_packetLength     = -1;
+
+		if (m_type == Mumble::Protocol::TCPMessageType::UDPTunnel) {
+			emit message(m_type, payload, nullptr);
+		} else {
+			TCPMessagePtr msg = parse(m_type, payload);
+			if (msg) {
+				emit message(m_type, payload, msg);
+			}
+		}
+	}
+}
+
+void ConnectionIO::socketError(QAbstractSocket::SocketError err) {
+	emit connectionClosed(err, m_socket->errorString());
+}
+
+void ConnectionIO::socketDisconnected() {
+	emit connectionClosed(QAbstractSocket::UnknownSocketError, QString());
+}
+
+void ConnectionIO::socketEncrypted() {
+	{
+		QMutexLocker l(&m_mutex);
+		// The documentation of QSslSocket::peerCertificateChain() actually says nothing
+		// about the order of the certificates in the chain. Through tests and by looking
+		// into Qt's source code it was validated, that it starts with the peer's immediate
+		// certificate (like QSslConfiguration::peerCertificateChain()).
+		// See mumble-voip/mumble#5280 for more information.
+		m_peerCertificateChain = m_socket->peerCertificateChain();
+		m_sessionCipher        = m_socket->sessionCipher();
+#if QT_VERSION >= 0x050400
+		m_sessionProtocol = m_socket->sessionProtocol();
+#endif
+	}
+
+	emit encrypted();
+}
+
+void ConnectionIO::socketSslErrors(const QList< QSslError > &errors) {
+	// The handshake only continues if the errors are ignored right away, so this can't wait for the main thread
+	bool ok = true;
+	for (const QSslError &error : errors) {
+		if (classifySslError(error) == SslErrorSeverity::Fatal) {
+			ok = false;
+		}
+	}
+
+	if (ok) {
+		m_socket->ignoreSslErrors();
+	} else {
+		// Due to a regression in Qt 5 (QTBUG-53906),
+		// we can't 'force' disconnect (which calls
+		// QAbstractSocket->abort()) when built against Qt 5.
+		//
+		// The bug is that Qt doesn't update the
+		// QSslSocket's socket state when QSslSocket->abort()
+		// is called.
+		//
+		// Our call to abort() happens when QSslSocket is inside
+		// startHandshake(). That is, a handshake is in progress.
+		//
+		// After emitting the peerVerifyError/sslErrors signals,
+		// startHandshake() checks whether the connection is still
+		// in QAbstractSocket::ConectedState.
+		//
+		// Unfortunately, because abort() doesn't update the socket's
+		// state to signal that it is no longer connected, startHandshake()
+		// still thinks the socket is connected and will continue to
+		// attempt to finish the handshake.
+		//
+		// Because abort() tears down a lot of internal state
+		// of the QSslSocket, including the 'SSL *' object
+		// associated with the socket, this is fatal and leads
+		// to crashes, such as attempting to derefernce a nullptr
+		// 'SSL *' object.
+		//
+		// To avoid this, we use a non-forceful disconnect
+		// until this is fixed upstream.
+		//
+		// See
+		// https://bugreports.qt.io/browse/QTBUG-53906
+		// https://github.com/mumble-voip/mumble/issues/2334
+		closeSocket(false);
+	}
+
+	emit sslErrors(errors);
+}
+
+void ConnectionIO::socketBytesWritten() {
+	m_socketBytes = m_socket->bytesToWrite() + m_socket->encryptedBytesToWrite();
+
+	checkDrained();
+}
+
+void ConnectionIO::writePending() {
+	QList< QByteArray > pending;
+	{
+		QMutexLocker l(&m_mutex);
+		pending.swap(m_pending);
+	}
+
+	if (pending.isEmpty()) {
+		return;
+	}
+
+	qint64 pendingBytes = 0;
+	for (const QByteArray &data : pending) {
+		pendingBytes += data.size();
+	}
+
+	// Each write to the socket ends up as (at least) one TLS record that is encrypted on its own, so small messages
+	// are gathered into chunks of up to MAX_GATHER_SIZE bytes first
+	QByteArray chunk;
+	for (const QByteArray &data : pending) {
+		if (!chunk.isEmpty() && chunk.size() + data.size() > MAX_GATHER_SIZE) {
+			m_socket->write(chunk);
+			chunk.clear();
+		}
+
+		if (chunk.isEmpty() && data.size() >= MAX_GATHER_SIZE / 2) {
+			m_socket->write(data);
+		} else {
+			if (chunk.isEmpty()) {
+				chunk.reserve(MAX_GATHER_SIZE);
+			}
+			chunk.append(data);
+		}
+	}
+
+	if (!chunk.isEmpty()) {
+		m_socket->write(chunk);
+	}
+
+	// The data is accounted to the socket before it's taken off the queue, so that bytesToWrite() never
+	// underestimates the backlog
+	m_socketBytes = m_socket->bytesToWrite() + m_socket->encryptedBytesToWrite();
+	m_pendingBytes -= pendingBytes;
+
+	checkDrained();
+}
+
+void ConnectionIO::flushPending() {
+	writePending();
+
+	if (m_socket->state() != QAbstractSocket::ConnectedState)
+		return;
+
+	if (!m_socket->isEncrypted())
+		return;
+
+	m_socket->flush();
+}
+
+void ConnectionIO::closeSocket(bool force) {
+	if (m_socket->state() == QAbstractSocket::UnconnectedState) {
+		emit connectionClosed(QAbstractSocket::UnknownSocketError, QString());
+		return;
+	}
+
+	if (force) {
+		m_socket->abort();
+	} else {
+		writePending();
+		m_socket->disconnectFromHost();
+	}
+}
+
+void ConnectionIO::startHandshake() {
+	m_socket->startServerEncryption();
+}
+
+void ConnectionIO::checkDrained() {
+	if (m_notifyDrained && bytesToWrite() == 0 && m_notifyDrained.exchange(false)) {
+		emit drained();
+	}
+}
+
+bool ConnectionIO::isOwnThread() const {
+	return QThread::currentThread() == thread();
+}
+
+TCPMessagePtr ConnectionIO::parse(Mumble::Protocol::TCPMessageType type, const QByteArray &payload) {
+	TCPMessagePtr msg;
+
+#define PROCESS_MUMBLE_TCP_MESSAGE(name, value)        \
+	case Mumble::Protocol::TCPMessageType::name:       \
+		msg = std::make_shared< MumbleProto::name >(); \
+		break;
+
+	switch (type) {
+		MUMBLE_ALL_TCP_MESSAGES
+		default:
+			return nullptr;
+	}
+
+#undef PROCESS_MUMBLE_TCP_MESSAGE
+
+	if (!msg->ParseFromArray(payload.constData(), payload.size())) {
+		return nullptr;
+	}
+	msg->DiscardUnknownFields();
+
+	return msg;
+}
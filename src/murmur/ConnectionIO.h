@@ -0,0 +1,142 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_CONNECTIONIO_H_
+#define MUMBLE_MURMUR_CONNECTIONIO_H_
+
+#include "MumbleProtocol.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QObject>
+#include <QtNetwork/QHostAddress>
+#include <QtNetwork/QSslCertificate>
+#include <QtNetwork/QSslCipher>
+#include <QtNetwork/QSslError>
+#include <QtNetwork/QSslSocket>
+
+#include <atomic>
+#include <memory>
+
+namespace google {
+namespace protobuf {
+	class Message;
+}
+} // namespace google
+
+/// A parsed control channel message
+using TCPMessagePtr = std::shared_ptr< ::google::protobuf::Message >;
+
+/// The socket of a client connection along with everything that has to be done on it before a message can be
+/// handled: the TLS handshake, decryption, framing and parsing the protobuf message. A ConnectionIO lives on the
+/// network thread its connection has been assigned to (see NetworkThreadPool) and only hands decoded messages to
+/// the Connection it belongs to, which lives on the main thread.
+///
+/// The functions that are not slots are thread-safe. Outgoing data is queued without being copied and written by
+/// the network thread once per event loop pass (or when flush() is called), gathered into as few writes as possible.
+class ConnectionIO : public QObject {
+private:
+	Q_OBJECT
+	Q_DISABLE_COPY(ConnectionIO)
+public:
+	enum class SslErrorSeverity {
+		/// The error doesn't matter
+		Ignorable,
+		/// The connection may proceed, but the client's certificate is not to be considered verified
+		Unverified,
+		/// The connection has to be closed
+		Fatal
+	};
+
+	static SslErrorSeverity classifySslError(const QSslError &error);
+
+	/// @param socket The (connected) socket, which is taken ownership of
+	explicit ConnectionIO(QSslSocket *socket);
+
+	/// Queues the given (already framed) data for sending
+	void send(const QByteArray &data);
+	/// Writes all queued data to the network right away
+	void flush();
+	void disconnectSocket(bool force);
+	void startServerEncryption();
+
+	/// @returns The amount of data that has been queued for sending but hasn't been handed to the operating system
+	/// yet (this includes data buffered by the socket itself)
+	qint64 bytesToWrite() const;
+	/// Makes the connection emit drained() once everything that has been queued has been handed to the operating
+	/// system (right away if that's already the case). The notification is only sent once per call.
+	void notifyWhenDrained();
+
+	qintptr socketDescriptor() const;
+	QHostAddress peerAddress() const;
+	quint16 peerPort() const;
+	QHostAddress localAddress() const;
+	quint16 localPort() const;
+
+	/// The following are only known once encrypted() has been emitted
+	QList< QSslCertificate > peerCertificateChain() const;
+	QSslCipher sessionCipher() const;
+	QSsl::SslProtocol sessionProtocol() const;
+
+signals:
+	void encrypted();
+	void connectionClosed(QAbstractSocket::SocketError, const QString &reason);
+	/// Emitted for every message received. UDPTunnel messages are passed on as they are, all others are parsed
+	/// into msg. Messages that can't be parsed are dropped.
+	void message(Mumble::Protocol::TCPMessageType type, const QByteArray &payload, const TCPMessagePtr &msg);
+	/// Emitted after the errors have been dealt with: the handshake either continues or the socket is being closed
+	void sslErrors(const QList< QSslError > &);
+	/// See notifyWhenDrained()
+	void drained();
+
+protected slots:
+	void socketRead();
+	void socketError(QAbstractSocket::SocketError);
+	void socketDisconnected();
+	void socketEncrypted();
+	void socketSslErrors(const QList< QSslError > &errors);
+	void socketBytesWritten();
+
+	void writePending();
+	void flushPending();
+	void closeSocket(bool force);
+	void startHandshake();
+	void checkDrained();
+
+protected:
+	/// The maximum amount of data written to the socket at once when gathering queued messages. This is the
+	/// maximum payload of a TLS record.
+	static constexpr int MAX_GATHER_SIZE = 16384;
+
+	QSslSocket *m_socket;
+	Mumble::Protocol::TCPMessageType m_type;
+	qint64 m_packetLength = -1;
+
+	const qintptr m_socketDescriptor;
+	const QHostAddress m_peerAddress;
+	const quint16 m_peerPort;
+	const QHostAddress m_localAddress;
+	const quint16 m_localPort;
+
+	/// Protects the session snapshot and the queue of outgoing data
+	mutable QMutex m_mutex;
+	QList< QSslCertificate > m_peerCertificateChain;
+	QSslCipher m_sessionCipher;
+	QSsl::SslProtocol m_sessionProtocol = QSsl::UnknownProtocol;
+	QList< QByteArray > m_pending;
+
+	/// The amount of data in m_pending
+	std::atomic< qint64 > m_pendingBytes;
+	/// The amount of data buffered by the socket (plain and encrypted) as of the last write
+	std::atomic< qint64 > m_socketBytes;
+	std::atomic< bool > m_notifyDrained;
+
+	bool isOwnThread() const;
+
+	static TCPMessagePtr parse(Mumble::Protocol::TCPMessageType type, const QByteArray &payload);
+};
+
+#endif // MUMBLE_MURMUR_CONNECTIONIO_H_
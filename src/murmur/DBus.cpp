@@ -555,7 +555,7 @@ void MurmurDBus::setACL(int id, const QList< ACLInfo > &acls, const QList< Group
 		a->pAllow     = static_cast< ChanACL::Permissions >(ai.allow) & ChanACL::All;
 	}
 
-	server->clearACLCache();
+	server->clearACLCache(cChannel);
 	server->updateChannel(cChannel);
 }
 
@@ -0,0 +1,45 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_INITIALSYNC_H_
+#define MUMBLE_MURMUR_INITIALSYNC_H_
+
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+#include <QtCore/QQueue>
+#include <QtCore/QtGlobal>
+
+/// The progress of sending the channel tree and the other users to a client that has just authenticated. This is
+/// done a page at a time, whenever the client's connection has caught up with the previous page (see
+/// Server::continueInitialSync), so that neither the main thread nor the connection's buffers are monopolized by
+/// clients joining large servers.
+struct InitialSync {
+	/// The amount of data that may be waiting to be written to the client before the production of a page stops
+	static constexpr qint64 MAX_BACKLOG = 64 * 1024;
+
+	enum class Phase {
+		/// The channel tree is sent. The client is not authenticated yet and thus doesn't receive any broadcasts, so
+		/// the tree is checked for changes once it has been sent completely.
+		Channels,
+		/// The other users are sent. The client is authenticated and is sent all changes to users as they happen,
+		/// so each user is sent as they are when it is their turn.
+		Users
+	};
+
+	Phase phase = Phase::Channels;
+	/// The IDs of the channels that are yet to be sent, in breadth-first order. The subchannels of a channel are
+	/// added once it has been sent.
+	QQueue< int > channels;
+	/// The shared state (see ChannelStateCache) every channel has been sent with
+	QHash< int, QByteArray > sentChannels;
+	/// The sessions of the users that are yet to be sent
+	QQueue< unsigned int > users;
+	/// The channel the client is put into once the channel tree has been sent
+	int channelID = 0;
+	/// The ClientType the client has announced
+	int clientType = 0;
+};
+
+#endif // MUMBLE_MURMUR_INITIALSYNC_H_
@@ -11,6 +11,7 @@
 #include "Group.h"
 #include "Meta.h"
 #include "MumbleConstants.h"
+#include "PasswordHashPool.h"
 #include "ProtoUtils.h"
 #include "QtUtils.h"
 #include "Server.h"
@@ -19,11 +20,13 @@
 #include "User.h"
 #include "Version.h"
 #include "crypto/CryptState.h"
+#include "crypto/CryptographicRandom.h"
 
 #include <QtCore/QStack>
 #include <QtCore/QtEndian>
 
 #include <cassert>
+#include <memory>
 #include <unordered_map>
 
 #include <tracy/Tracy.hpp>
@@ -193,6 +196,16 @@ void Server::msgAuthenticate(ServerUser *uSource, MumbleProto::Authenticate &msg
 	}
 	MSG_SETUP(ServerUser::Connected);
 
+	if (uSource->m_initialSync) {
+		// The client has authenticated already and is being sent the channel tree
+		return;
+	}
+
+	if (uSource->m_pendingAuthentication) {
+		// The client's password is still being hashed
+		return;
+	}
+
 	// As the first thing, assign a session ID to this client. Given that the client initiated
 	// the authentication procedure we can be sure that this is not just a random TCP connection.
 	// Thus it is about time we assign the ID to this client in order to be able to reference it
@@ -201,23 +214,96 @@ void Server::msgAuthenticate(ServerUser *uSource, MumbleProto::Authenticate &msg
 		QWriteLocker wl(&qrwlVoiceThread);
 		uSource->uiSession = qqIds.dequeue();
 		qhUsers.insert(uSource->uiSession, uSource);
+		scheduleTimeout(uSource);
 		qhHostUsers[uSource->haAddress].insert(uSource);
-	}
 
-	Channel *root = qhChannels.value(0);
-	Channel *c;
+		// Assign a unique token identifying the client's UDP connection (0 is reserved for "no token")
+		quint32 token;
+		do {
+			token = CryptographicRandom::uint32();
+		} while (token == 0 || qhTokenUsers.contains(token));
+
+		uSource->uiUdpConnectionToken = token;
+		qhTokenUsers.insert(token, uSource);
+	}
 
 	uSource->qsName = u8(msg.username()).trimmed();
 
-	bool ok     = false;
-	bool nameok = validateUserName(uSource->qsName);
-	QString pw  = u8(msg.password());
+	QString pw = u8(msg.password());
+
+	std::unique_ptr< PendingAuthentication > pending;
+	if (meta->passwordHashPool->size() > 0) {
+		pending = std::make_unique< PendingAuthentication >();
+	}
 
 	// Fetch ID and stored username.
 	// Since this may call DBus, which may recall our dbus messages, this function needs
 	// to support re-entrancy, and also to support the fact that sessions may go away.
 	int id = authenticate(uSource->qsName, pw, uSource->uiSession, uSource->qslEmail, uSource->qsHash,
-						  uSource->bVerified, uSource->peerCertificateChain());
+						  uSource->bVerified, uSource->peerCertificateChain(), pending.get());
+
+	if (id == -4) {
+		// The password has to be hashed, which is done without holding up everyone else
+		static quint64 nextPendingAuthentication = 0;
+
+		pending->id  = ++nextPendingAuthentication;
+		pending->msg = msg;
+
+		uSource->m_pendingAuthentication = std::move(pending);
+		hashPassword(uSource);
+		return;
+	}
+
+	completeAuthenticate(uSource, msg, id);
+}
+
+void Server::hashPassword(ServerUser *uSource) {
+	const PendingAuthentication &pending = *uSource->m_pendingAuthentication;
+
+	const int serverNum        = iServerNum;
+	const unsigned int session = uSource->uiSession;
+	const quint64 id           = pending.id;
+
+	PasswordHashPool::Callback done = [serverNum, session, id](const QString &hash) {
+		// The server might have been stopped in the meantime
+		Server *server = meta->qhServers.value(serverNum);
+		if (server) {
+			server->passwordHashed(session, id, hash);
+		}
+	};
+
+	meta->passwordHashPool->hash(pending.salt, u8(pending.msg.password()), pending.iterations, std::move(done));
+}
+
+void Server::passwordHashed(unsigned int session, quint64 id, const QString &hash) {
+	ServerUser *uSource = qhUsers.value(session);
+	if (!uSource || !uSource->m_pendingAuthentication || uSource->m_pendingAuthentication->id != id) {
+		// The client has gone
+		return;
+	}
+
+	PendingAuthentication &pending = *uSource->m_pendingAuthentication;
+	pending.hash                   = hash;
+
+	int res = authenticate(uSource->qsName, u8(pending.msg.password()), uSource->uiSession, uSource->qslEmail,
+						   uSource->qsHash, uSource->bVerified, uSource->peerCertificateChain(), &pending);
+
+	if (res == -4) {
+		// The password has been changed while it has been hashed
+		hashPassword(uSource);
+		return;
+	}
+
+	std::unique_ptr< PendingAuthentication > done = std::move(uSource->m_pendingAuthentication);
+	completeAuthenticate(uSource, done->msg, res);
+}
+
+void Server::completeAuthenticate(ServerUser *uSource, const MumbleProto::Authenticate &msg, int id) {
+	Channel *root = qhChannels.value(0);
+
+	bool ok     = false;
+	bool nameok = validateUserName(uSource->qsName);
+	QString pw  = u8(msg.password());
 
 	uSource->iId = id >= 0 ? id : -1;
 
@@ -335,7 +421,7 @@ void Server::msgAuthenticate(ServerUser *uSource, MumbleProto::Authenticate &msg
 
 	// Setup UDP encryption
 	{
-		QMutexLocker l(&uSource->qmCrypt);
+		QMutexLocker l(&uSource->qmDecrypt);
 
 		uSource->csCrypt->genKey();
 
@@ -343,6 +429,7 @@ void Server::msgAuthenticate(ServerUser *uSource, MumbleProto::Authenticate &msg
 		mpcrypt.set_key(uSource->csCrypt->getRawKey());
 		mpcrypt.set_server_nonce(uSource->csCrypt->getEncryptIV());
 		mpcrypt.set_client_nonce(uSource->csCrypt->getDecryptIV());
+		mpcrypt.set_udp_connection_token(uSource->uiUdpConnectionToken);
 		sendMessage(uSource, mpcrypt);
 	}
 
@@ -371,47 +458,120 @@ void Server::msgAuthenticate(ServerUser *uSource, MumbleProto::Authenticate &msg
 						  "talk to or hear most clients. Please make sure your client was built with CELT support."));
 	}
 
-	// Transmit channel tree
-	QQueue< Channel * > q;
-	QSet< Channel * > chans;
-	q << root;
-	MumbleProto::ChannelState mpcs;
+	// The channel tree and the other users are sent a page at a time whenever the client's connection has caught up
+	// with the previous one. The authentication is completed once everything has been sent (see
+	// completeInitialSync).
+	uSource->m_initialSync = std::make_unique< InitialSync >();
+	uSource->m_initialSync->channels.enqueue(root->iId);
+	uSource->m_initialSync->channelID  = lc->iId;
+	uSource->m_initialSync->clientType = msg.client_type();
 
-	while (!q.isEmpty()) {
-		c = q.dequeue();
-		chans.insert(c);
+	continueInitialSync(uSource);
+}
 
-		mpcs.Clear();
+void Server::continueInitialSync(ServerUser *u) {
+	ZoneScoped;
 
-		mpcs.set_channel_id(c->iId);
-		if (c->cParent)
-			mpcs.set_parent(c->cParent->iId);
-		if (c->iId == 0)
-			mpcs.set_name(u8(qsRegName.isEmpty() ? QLatin1String("Root") : qsRegName));
-		else
-			mpcs.set_name(u8(c->qsName));
+	InitialSync *sync = u->m_initialSync.get();
+	if (!sync || u->bDisconnectedEmitted)
+		return;
 
-		mpcs.set_position(c->iPosition);
+	while (u->bytesToWrite() < InitialSync::MAX_BACKLOG) {
+		if (sync->phase == InitialSync::Phase::Channels) {
+			if (sync->channels.isEmpty()) {
+				completeChannelSync(u, *sync);
+				continue;
+			}
 
-		if ((uSource->m_version >= Version::fromComponents(1, 2, 2)) && !c->qbaDescHash.isEmpty())
-			mpcs.set_description_hash(blob(c->qbaDescHash));
-		else if (!c->qsDesc.isEmpty())
-			mpcs.set_description(u8(c->qsDesc));
+			// Channels that have been removed in the meantime are skipped
+			Channel *c = qhChannels.value(sync->channels.dequeue());
+			if (!c)
+				continue;
 
-		mpcs.set_max_users(c->uiMaxUsers);
+			sendInitialChannelState(u, *sync, c);
 
-		// Include info about enter restrictions of this channel
-		mpcs.set_is_enter_restricted(isChannelEnterRestricted(c));
-		mpcs.set_can_enter(hasPermission(uSource, c, ChanACL::Enter));
+			foreach (Channel *child, c->qlChannels)
+				sync->channels.enqueue(child->iId);
+		} else {
+			if (sync->users.isEmpty()) {
+				completeInitialSync(u);
+				return;
+			}
 
-		sendMessage(uSource, mpcs);
+			// Users that have left in the meantime are skipped (the client has been told about that already)
+			ServerUser *other = qhUsers.value(sync->users.dequeue());
+			if (other && other != u && other->sState == ServerUser::Authenticated)
+				sendInitialUserState(u, other);
+		}
+	}
+
+	u->notifyWhenDrained();
+}
 
-		foreach (c, c->qlChannels)
-			q.enqueue(c);
+ChannelStateCache::Properties Server::channelStateProperties(const Channel *c) const {
+	ChannelStateCache::Properties properties;
+	properties.id       = c->iId;
+	properties.parentID = c->cParent ? c->cParent->iId : -1;
+	if (c->iId == 0)
+		properties.name = qsRegName.isEmpty() ? QLatin1String("Root") : qsRegName;
+	else
+		properties.name = c->qsName;
+	properties.position        = c->iPosition;
+	properties.maxUsers        = c->uiMaxUsers;
+	properties.description     = c->qsDesc;
+	properties.descriptionHash = c->qbaDescHash;
+
+	return properties;
+}
+
+void Server::sendInitialChannelState(ServerUser *u, InitialSync &sync, Channel *c) {
+	const QByteArray state =
+		m_channelStateCache.get(channelStateProperties(c), u->m_version >= Version::fromComponents(1, 2, 2));
+
+	// Include info about enter restrictions of this channel
+	MumbleProto::ChannelState mpcs;
+	mpcs.set_is_enter_restricted(isChannelEnterRestricted(c));
+	mpcs.set_can_enter(hasPermission(u, c, ChanACL::Enter));
+
+	u->sendMessage(ChannelStateCache::frame(state, mpcs));
+	sync.sentChannels.insert(c->iId, state);
+}
+
+void Server::completeChannelSync(ServerUser *uSource, InitialSync &sync) {
+	ZoneScoped;
+
+	const bool hashDescription = uSource->m_version >= Version::fromComponents(1, 2, 2);
+
+	// The client hasn't received the broadcasts about channels that have changed after they have been sent, so
+	// these are sent again. This is done in one go along with authenticating the client, so that the client
+	// doesn't miss anything in between.
+	QQueue< Channel * > q;
+	QList< Channel * > chans;
+	q << qhChannels.value(0);
+	MumbleProto::ChannelState mpcs;
+
+	while (!q.isEmpty()) {
+		Channel *c = q.dequeue();
+		chans << c;
+
+		if (m_channelStateCache.get(channelStateProperties(c), hashDescription) != sync.sentChannels.value(c->iId))
+			sendInitialChannelState(uSource, sync, c);
+
+		foreach (Channel *child, c->qlChannels)
+			q.enqueue(child);
 	}
 
+	for (auto it = sync.sentChannels.cbegin(); it != sync.sentChannels.cend(); ++it) {
+		if (!qhChannels.contains(static_cast< unsigned int >(it.key()))) {
+			MumbleProto::ChannelRemove mpcr;
+			mpcr.set_channel_id(static_cast< unsigned int >(it.key()));
+			sendMessage(uSource, mpcr);
+		}
+	}
+	sync.sentChannels.clear();
+
 	// Transmit links
-	foreach (c, chans) {
+	foreach (Channel *c, chans) {
 		if (c->qhLinks.count() > 0) {
 			mpcs.Clear();
 			mpcs.set_channel_id(c->iId);
@@ -424,6 +584,11 @@ void Server::msgAuthenticate(ServerUser *uSource, MumbleProto::Authenticate &msg
 
 	loadChannelListenersOf(*uSource);
 
+	// The channel chosen when authenticating might have been removed in the meantime
+	Channel *lc = qhChannels.value(sync.channelID);
+	if (!lc)
+		lc = qhChannels.value(0);
+
 	// Transmit user profile
 	MumbleProto::UserState mpus;
 
@@ -470,68 +635,75 @@ void Server::msgAuthenticate(ServerUser *uSource, MumbleProto::Authenticate &msg
 		mpus.set_comment(u8(uSource->qsComment));
 	sendAll(mpus, Version::fromComponents(1, 2, 2), Version::CompareMode::LessThan);
 
-	// Transmit other users profiles
+	// Users authenticating from now on announce themselves to the client, just like uSource did above
 	foreach (ServerUser *u, qhUsers) {
-		if (u->sState != ServerUser::Authenticated)
-			continue;
+		if (u->sState == ServerUser::Authenticated && u != uSource)
+			sync.users.enqueue(u->uiSession);
+	}
 
-		if (u == uSource)
-			continue;
+	sync.phase = InitialSync::Phase::Users;
+}
 
-		mpus.Clear();
-		mpus.set_session(u->uiSession);
-		mpus.set_name(u8(u->qsName));
-		if (u->iId >= 0)
-			mpus.set_user_id(u->iId);
-		if (uSource->m_version >= Version::fromComponents(1, 2, 2)) {
-			if (!u->qbaTextureHash.isEmpty())
-				mpus.set_texture_hash(blob(u->qbaTextureHash));
-			else if (!u->qbaTexture.isEmpty())
-				mpus.set_texture(blob(u->qbaTexture));
-		} else if ((uSource->qbaTexture.length() >= 4)
-				   && (qFromBigEndian< unsigned int >(
-						   reinterpret_cast< const unsigned char * >(uSource->qbaTexture.constData()))
-					   == 600 * 60 * 4)) {
+void Server::sendInitialUserState(ServerUser *uSource, ServerUser *u) {
+	MumbleProto::UserState mpus;
+	mpus.set_session(u->uiSession);
+	mpus.set_name(u8(u->qsName));
+	if (u->iId >= 0)
+		mpus.set_user_id(u->iId);
+	if (uSource->m_version >= Version::fromComponents(1, 2, 2)) {
+		if (!u->qbaTextureHash.isEmpty())
+			mpus.set_texture_hash(blob(u->qbaTextureHash));
+		else if (!u->qbaTexture.isEmpty())
 			mpus.set_texture(blob(u->qbaTexture));
-		}
-		if (u->cChannel->iId != 0)
-			mpus.set_channel_id(u->cChannel->iId);
-		if (u->bDeaf)
-			mpus.set_deaf(true);
-		else if (u->bMute)
-			mpus.set_mute(true);
-		if (u->bSuppress)
-			mpus.set_suppress(true);
-		if (u->bPrioritySpeaker)
-			mpus.set_priority_speaker(true);
-		if (u->bRecording)
-			mpus.set_recording(true);
-		if (u->bSelfDeaf)
-			mpus.set_self_deaf(true);
-		else if (u->bSelfMute)
-			mpus.set_self_mute(true);
-		if ((uSource->m_version >= Version::fromComponents(1, 2, 2)) && !u->qbaCommentHash.isEmpty())
-			mpus.set_comment_hash(blob(u->qbaCommentHash));
-		else if (!u->qsComment.isEmpty())
-			mpus.set_comment(u8(u->qsComment));
-		if (!u->qsHash.isEmpty())
-			mpus.set_hash(u8(u->qsHash));
-
-
-		for (int channelID : m_channelListenerManager.getListenedChannelsForUser(u->uiSession)) {
-			mpus.add_listening_channel_add(channelID);
-
-			if (broadcastListenerVolumeAdjustments) {
-				VolumeAdjustment volume = m_channelListenerManager.getListenerVolumeAdjustment(u->uiSession, channelID);
-				MumbleProto::UserState::VolumeAdjustment *adjustment = mpus.add_listening_volume_adjustment();
-				adjustment->set_listening_channel(channelID);
-				adjustment->set_volume_adjustment(volume.factor);
-			}
-		}
+	} else if ((uSource->qbaTexture.length() >= 4)
+			   && (qFromBigEndian< unsigned int >(
+					   reinterpret_cast< const unsigned char * >(uSource->qbaTexture.constData()))
+				   == 600 * 60 * 4)) {
+		mpus.set_texture(blob(u->qbaTexture));
+	}
+	if (u->cChannel->iId != 0)
+		mpus.set_channel_id(u->cChannel->iId);
+	if (u->bDeaf)
+		mpus.set_deaf(true);
+	else if (u->bMute)
+		mpus.set_mute(true);
+	if (u->bSuppress)
+		mpus.set_suppress(true);
+	if (u->bPrioritySpeaker)
+		mpus.set_priority_speaker(true);
+	if (u->bRecording)
+		mpus.set_recording(true);
+	if (u->bSelfDeaf)
+		mpus.set_self_deaf(true);
+	else if (u->bSelfMute)
+		mpus.set_self_mute(true);
+	if ((uSource->m_version >= Version::fromComponents(1, 2, 2)) && !u->qbaCommentHash.isEmpty())
+		mpus.set_comment_hash(blob(u->qbaCommentHash));
+	else if (!u->qsComment.isEmpty())
+		mpus.set_comment(u8(u->qsComment));
+	if (!u->qsHash.isEmpty())
+		mpus.set_hash(u8(u->qsHash));
+
+
+	for (int channelID : m_channelListenerManager.getListenedChannelsForUser(u->uiSession)) {
+		mpus.add_listening_channel_add(channelID);
 
-		sendMessage(uSource, mpus);
+		if (broadcastListenerVolumeAdjustments) {
+			VolumeAdjustment volume = m_channelListenerManager.getListenerVolumeAdjustment(u->uiSession, channelID);
+			MumbleProto::UserState::VolumeAdjustment *adjustment = mpus.add_listening_volume_adjustment();
+			adjustment->set_listening_channel(channelID);
+			adjustment->set_volume_adjustment(volume.factor);
+		}
 	}
 
+	sendMessage(uSource, mpus);
+}
+
+void Server::completeInitialSync(ServerUser *uSource) {
+	ZoneScoped;
+
+	std::unique_ptr< InitialSync > sync = std::move(uSource->m_initialSync);
+
 	// Send syncronisation packet
 	MumbleProto::ServerSync mpss;
 	mpss.set_session(uSource->uiSession);
@@ -544,14 +716,14 @@ void Server::msgAuthenticate(ServerUser *uSource, MumbleProto::Authenticate &msg
 	} else {
 		QMutexLocker qml(&qmCache);
 		ChanACL::hasPermission(uSource, root, ChanACL::Enter, &acCache);
-		mpss.set_permissions(acCache.value(uSource)->value(root));
+		mpss.set_permissions(acCache.value(uSource, root));
 	}
 
 	sendMessage(uSource, mpss);
 
 	// Transmit user's listeners - this has to be done AFTER the server-sync message has been sent to uSource as the
 	// client may require its own session ID for processing the listeners properly.
-	mpus.Clear();
+	MumbleProto::UserState mpus;
 	mpus.set_session(uSource->uiSession);
 	for (int channelID : m_channelListenerManager.getListenedChannelsForUser(uSource->uiSession)) {
 		mpus.add_listening_channel_add(channelID);
@@ -631,7 +803,7 @@ void Server::msgAuthenticate(ServerUser *uSource, MumbleProto::Authenticate &msg
 		sendMessage(uSource, mptm);
 	}
 
-	switch (msg.client_type()) {
+	switch (sync->clientType) {
 		case static_cast< int >(ClientType::BOT):
 			uSource->m_clientType = ClientType::BOT;
 			m_botCount++;
@@ -1108,13 +1280,6 @@ void Server::msgUserState(ServerUser *uSource, MumbleProto::UserState &msg) {
 	bool broadcastingBecauseOfVolumeChange = !bBroadcast && listenerVolumeChanged;
 	bBroadcast                             = bBroadcast || listenerChanged || listenerVolumeChanged;
 
-	if (listenerChanged || listenerVolumeChanged) {
-		// As whisper targets also contain information about ChannelListeners and
-		// their associated volume adjustment, we have to clear the target cache
-		clearWhisperTargetCache();
-	}
-
-
 	bool bDstAclChanged = false;
 	if (msg.has_user_id()) {
 		// Handle user (Self-)Registration
@@ -1174,15 +1339,11 @@ void Server::msgUserState(ServerUser *uSource, MumbleProto::UserState &msg) {
 		}
 
 		if (broadcastListenerVolumeAdjustments || !broadcastingBecauseOfVolumeChange) {
-			sendExcept(uSource, msg, Version::fromComponents(1, 2, 2), Version::CompareMode::AtLeast);
+			queueUserState(uSource, msg);
 		}
 
 		if (bDstAclChanged) {
 			clearACLCache(pDstServerUser);
-		} else if (listenerChanged || listenerVolumeChanged) {
-			// We only have to do this if the ACLs didn't change as
-			// clearACLCache calls clearWhisperTargetChache anyways
-			clearWhisperTargetCache();
 		}
 	}
 
@@ -1351,7 +1512,7 @@ void Server::msgChannelState(ServerUser *uSource, MumbleProto::ChannelState &msg
 			a->pDeny  = ChanACL::None;
 			a->pAllow = ChanACL::Write | ChanACL::Traverse;
 
-			clearACLCache();
+			clearACLCache(c);
 		}
 		updateChannel(c);
 
@@ -1483,6 +1644,9 @@ void Server::msgChannelState(ServerUser *uSource, MumbleProto::ChannelState &msg
 				c->cParent->removeChannel(c);
 				p->addChannel(c);
 			}
+
+			// The channel (and its subchannels) inherit ACLs and groups from different channels now
+			clearACLCache(c, true);
 		}
 		if (!qsName.isNull()) {
 			log(uSource, QString("Renamed channel %1 to %2").arg(QString(*c), QString(qsName)));
@@ -1917,7 +2081,7 @@ void Server::msgACL(ServerUser *uSource, MumbleProto::ACL &msg) {
 			}
 		}
 
-		clearACLCache();
+		clearACLCache(c);
 
 		if (!hasPermission(uSource, c, ChanACL::Write) && ((uSource->iId >= 0) || !uSource->qsHash.isEmpty())) {
 			{
@@ -1935,7 +2099,7 @@ void Server::msgACL(ServerUser *uSource, MumbleProto::ACL &msg) {
 				a->pAllow  = ChanACL::Write | ChanACL::Traverse;
 			}
 
-			clearACLCache();
+			clearACLCache(c);
 		}
 
 
@@ -1991,7 +2155,7 @@ void Server::msgPing(ServerUser *uSource, MumbleProto::Ping &msg) {
 
 	MSG_SETUP_NO_UNIDLE(ServerUser::Authenticated);
 
-	QMutexLocker l(&uSource->qmCrypt);
+	QMutexLocker l(&uSource->qmDecrypt);
 
 	uSource->csCrypt->uiRemoteGood   = msg.good();
 	uSource->csCrypt->uiRemoteLate   = msg.late();
@@ -2022,7 +2186,17 @@ void Server::msgCryptSetup(ServerUser *uSource, MumbleProto::CryptSetup &msg) {
 
 	MSG_SETUP_NO_UNIDLE(ServerUser::Authenticated);
 
-	QMutexLocker l(&uSource->qmCrypt);
+	if (msg.has_udp_connection_token()) {
+		// The client acknowledges its connection token, which means that all of its UDP datagrams are going
+		// to carry it from now on.
+		if (uSource->uiUdpConnectionToken != 0 && msg.udp_connection_token() == uSource->uiUdpConnectionToken) {
+			QWriteLocker wl(&qrwlVoiceThread);
+			uSource->bUdpConnectionTokenAcked = true;
+		}
+		return;
+	}
+
+	QMutexLocker l(&uSource->qmDecrypt);
 
 	if (!msg.has_client_nonce()) {
 		log(uSource, "Requested crypt-nonce resync");
@@ -2178,39 +2352,42 @@ void Server::msgVoiceTarget(ServerUser *uSource, MumbleProto::VoiceTarget &msg)
 	if ((target < 1) || (target >= 0x1f))
 		return;
 
-	QWriteLocker lock(&qrwlVoiceThread);
+	WhisperTarget wt;
+	for (int i = 0; i < msg.targets_size(); ++i) {
+		const MumbleProto::VoiceTarget_Target &t = msg.targets(i);
+		for (int j = 0; j < t.session_size(); ++j) {
+			unsigned int s = t.session(j);
+			if (qhUsers.contains(s))
+				wt.qlSessions << s;
+		}
+		if (t.has_channel_id()) {
+			unsigned int id = t.channel_id();
+			if (qhChannels.contains(id)) {
+				WhisperTarget::Channel wtc;
+				wtc.iId       = id;
+				wtc.bChildren = t.children();
+				wtc.bLinks    = t.links();
+				if (t.has_group())
+					wtc.qsGroup = u8(t.group());
+				wt.qlChannels << wtc;
+			}
+		}
+	}
+
+	// Build the target's cache right away (and before locking out the voice threads), so that they never
+	// have to compute the receivers themselves
+	std::shared_ptr< const WhisperTargetCache > cache;
+	if (!wt.qlSessions.isEmpty() || !wt.qlChannels.isEmpty())
+		cache = buildWhisperTargetCache(uSource, wt);
 
-	uSource->qmTargetCache.remove(target);
+	QWriteLocker lock(&qrwlVoiceThread);
 
-	int count = msg.targets_size();
-	if (count == 0) {
+	if (!cache) {
 		uSource->qmTargets.remove(target);
+		uSource->qmTargetCache.remove(target);
 	} else {
-		WhisperTarget wt;
-		for (int i = 0; i < count; ++i) {
-			const MumbleProto::VoiceTarget_Target &t = msg.targets(i);
-			for (int j = 0; j < t.session_size(); ++j) {
-				unsigned int s = t.session(j);
-				if (qhUsers.contains(s))
-					wt.qlSessions << s;
-			}
-			if (t.has_channel_id()) {
-				unsigned int id = t.channel_id();
-				if (qhChannels.contains(id)) {
-					WhisperTarget::Channel wtc;
-					wtc.iId       = id;
-					wtc.bChildren = t.children();
-					wtc.bLinks    = t.links();
-					if (t.has_group())
-						wtc.qsGroup = u8(t.group());
-					wt.qlChannels << wtc;
-				}
-			}
-		}
-		if (wt.qlSessions.isEmpty() && wt.qlChannels.isEmpty())
-			uSource->qmTargets.remove(target);
-		else
-			uSource->qmTargets.insert(target, wt);
+		uSource->qmTargets.insert(target, wt);
+		uSource->qmTargetCache.insert(target, cache);
 	}
 }
 
@@ -2264,7 +2441,7 @@ void Server::msgUserStats(ServerUser *uSource, MumbleProto::UserStats &msg) {
 	if (local) {
 		MumbleProto::UserStats_Stats *mpusss;
 
-		QMutexLocker l(&pDstServerUser->qmCrypt);
+		QMutexLocker l(&pDstServerUser->qmDecrypt);
 
 		mpusss = msg.mutable_from_client();
 		mpusss->set_good(pDstServerUser->csCrypt->uiGood);
@@ -9,10 +9,13 @@
 #include "EnvUtils.h"
 #include "FFDHE.h"
 #include "Net.h"
+#include "NetworkThreadPool.h"
 #include "OSInfo.h"
+#include "PasswordHashPool.h"
 #include "SSL.h"
 #include "Server.h"
 #include "ServerDB.h"
+#include "TimingWheel.h"
 #include "Version.h"
 
 #include <QtCore/QCoreApplication>
@@ -106,8 +109,19 @@ MetaParams::MetaParams() {
 	iPluginMessageLimit = 4;
 	iPluginMessageBurst = 15;
 
+	pingLimit = 10;
+	pingBurst = 20;
+
 	broadcastListenerVolumeAdjustments = false;
 
+	userStateTick = 20;
+
+	udpReceiveBatchSize = 32;
+	voiceThreads        = 1;
+	networkThreads      = 2;
+	kdfThreads          = 2;
+	bootThreads         = 4;
+
 	qsCiphers = MumbleSSL::defaultOpenSSLCipherString();
 
 	bLogGroupChanges = false;
@@ -372,8 +386,27 @@ void MetaParams::read(QString fname) {
 	iPluginMessageLimit = typeCheckedFromSettings("pluginmessagelimit", 4);
 	iPluginMessageBurst = typeCheckedFromSettings("pluginmessageburst", 15);
 
+	pingLimit = typeCheckedFromSettings("pinglimit", pingLimit);
+	pingBurst = typeCheckedFromSettings("pingburst", pingBurst);
+
 	broadcastListenerVolumeAdjustments = typeCheckedFromSettings("broadcastlistenervolumeadjustments", false);
 
+	userStateTick = typeCheckedFromSettings("userstatetick", userStateTick);
+
+	udpReceiveBatchSize = typeCheckedFromSettings("udpreceivebatchsize", udpReceiveBatchSize);
+	if (udpReceiveBatchSize < 1) {
+		udpReceiveBatchSize = 1;
+	}
+
+	voiceThreads = typeCheckedFromSettings("voicethreads", voiceThreads);
+	if (voiceThreads < 1) {
+		voiceThreads = 1;
+	}
+
+	networkThreads = typeCheckedFromSettings("networkthreads", networkThreads);
+	kdfThreads     = typeCheckedFromSettings("kdfthreads", kdfThreads);
+	bootThreads    = typeCheckedFromSettings("bootthreads", bootThreads);
+
 	bool bObfuscate = typeCheckedFromSettings("obfuscate", false);
 	if (bObfuscate) {
 		qWarning("IP address obfuscation enabled.");
@@ -431,6 +464,14 @@ void MetaParams::read(QString fname) {
 	qmConfig.insert(QLatin1String("opusthreshold"), QString::number(iOpusThreshold));
 	qmConfig.insert(QLatin1String("channelnestinglimit"), QString::number(iChannelNestingLimit));
 	qmConfig.insert(QLatin1String("channelcountlimit"), QString::number(iChannelCountLimit));
+	qmConfig.insert(QLatin1String("pinglimit"), QString::number(pingLimit));
+	qmConfig.insert(QLatin1String("pingburst"), QString::number(pingBurst));
+	qmConfig.insert(QLatin1String("userstatetick"), QString::number(userStateTick));
+	qmConfig.insert(QLatin1String("udpreceivebatchsize"), QString::number(udpReceiveBatchSize));
+	qmConfig.insert(QLatin1String("voicethreads"), QString::number(voiceThreads));
+	qmConfig.insert(QLatin1String("networkthreads"), QString::number(networkThreads));
+	qmConfig.insert(QLatin1String("kdfthreads"), QString::number(kdfThreads));
+	qmConfig.insert(QLatin1String("bootthreads"), QString::number(bootThreads));
 	qmConfig.insert(QLatin1String("sslCiphers"), qsCiphers);
 	qmConfig.insert(QLatin1String("sslDHParams"), QString::fromLatin1(qbaDHParams.constData()));
 }
@@ -650,6 +691,14 @@ Meta::Meta() {
 			Connection::setQoS(hQoS);
 	}
 #endif
+
+	networkThreadPool = std::make_unique< NetworkThreadPool >(mp.networkThreads);
+	passwordHashPool  = std::make_unique< PasswordHashPool >(mp.kdfThreads);
+
+	// Precise enough for timeouts, while the wheel barely costs anything as long as nothing is due
+	timingWheel = std::make_unique< TimingWheel >(100);
+	timingWheel->start();
+	timingWheel->schedulePeriodic(ServerDB::LOG_CLEAN_INTERVAL, &ServerDB::cleanExpiredLog);
 }
 
 Meta::~Meta() {
@@ -688,17 +737,33 @@ void Meta::getOSInfo() {
 }
 
 void Meta::bootAll() {
+	Timer timer;
+
 	QList< int > ql = ServerDB::getBootServers();
-	foreach (int snum, ql)
-		boot(snum);
+
+	// Reading the channels is what takes longest for large servers. It is done for all servers at once, while the
+	// servers themselves are created on the main thread.
+	QHash< int, ChannelTreeData > trees = ServerDB::readChannelTrees(ql, mp.bootThreads);
+	const quint64 readTime              = timer.elapsed();
+
+	int booted = 0;
+	foreach (int snum, ql) {
+		auto it = trees.constFind(snum);
+		if (boot(snum, it != trees.constEnd() ? &it.value() : nullptr))
+			booted++;
+	}
+
+	qWarning("Meta: Booted %d of %d virtual servers in %llu ms (reading channels took %llu ms)", booted, ql.count(),
+			 static_cast< unsigned long long >(timer.elapsed() / 1000),
+			 static_cast< unsigned long long >(readTime / 1000));
 }
 
-bool Meta::boot(int srvnum) {
+bool Meta::boot(int srvnum, const ChannelTreeData *channelTree) {
 	if (qhServers.contains(srvnum))
 		return false;
 	if (!ServerDB::serverExists(srvnum))
 		return false;
-	Server *s = new Server(srvnum, this);
+	Server *s = new Server(srvnum, this, channelTree);
 	if (!s->bValid) {
 		delete s;
 		return false;
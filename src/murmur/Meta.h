@@ -23,6 +23,12 @@
 #include <QtNetwork/QSslCipher>
 #include <QtNetwork/QSslKey>
 
+#include <memory>
+
+struct ChannelTreeData;
+class NetworkThreadPool;
+class PasswordHashPool;
+class TimingWheel;
 class Server;
 class QSettings;
 
@@ -104,8 +110,38 @@ public:
 	unsigned int iPluginMessageLimit;
 	unsigned int iPluginMessageBurst;
 
+	/// The amount of pings requesting the server's details a single address may send per second (0 for no limit)
+	unsigned int pingLimit;
+	/// The amount of such pings a single address may send at once
+	unsigned int pingBurst;
+
 	bool broadcastListenerVolumeAdjustments;
 
+	/// The time (in milliseconds) UserState changes are collected for before they are broadcast
+	unsigned int userStateTick;
+
+	/// The maximum amount of datagrams the voice thread pulls from a UDP socket
+	/// per wakeup (using recvmmsg). A value of 1 disables batched receiving.
+	/// Only has an effect on Linux.
+	unsigned int udpReceiveBatchSize;
+
+	/// The amount of voice threads per virtual server. If this is larger than 1, every bind
+	/// address gets one UDP socket (opened with SO_REUSEPORT) per voice thread and the kernel
+	/// distributes the incoming datagrams among them. Only has an effect on Linux.
+	unsigned int voiceThreads;
+
+	/// The amount of threads the TCP connections of all virtual servers are spread across. These threads do
+	/// the TLS handshakes, the encryption and the parsing of messages. 0 keeps all of it on the main thread.
+	unsigned int networkThreads;
+
+	/// The maximum amount of password hashes computed at the same time (see PasswordHashPool). 0 computes them on
+	/// the main thread.
+	unsigned int kdfThreads;
+
+	/// The amount of threads reading the channels of the virtual servers at the same time while booting all of them
+	/// (each with a database connection of its own). 0 reads them on the main thread.
+	unsigned int bootThreads;
+
 	QSslCertificate qscCert;
 	QSslKey qskKey;
 
@@ -182,6 +218,10 @@ public:
 	QHash< int, Server * > qhServers;
 	QHash< QHostAddress, QList< Timer > > qhAttempts;
 	QHash< QHostAddress, Timer > qhBans;
+	std::unique_ptr< NetworkThreadPool > networkThreadPool;
+	std::unique_ptr< PasswordHashPool > passwordHashPool;
+	/// Runs the timeouts and the periodic housekeeping of all virtual servers
+	std::unique_ptr< TimingWheel > timingWheel;
 	QString qsOS, qsOSVersion;
 	Timer tUptime;
 
@@ -199,7 +239,8 @@ public:
 	bool reloadSSLSettings();
 
 	void bootAll();
-	bool boot(int);
+	/// @param channelTree The server's channels if they have been read already
+	bool boot(int, const ChannelTreeData *channelTree = nullptr);
 	bool banCheck(const QHostAddress &);
 
 	/// Called whenever we get a successful connection from a client.
@@ -1509,7 +1509,7 @@ static void impl_Server_setACL(const ::MumbleServer::AMD_Server_setACLPtr cb, in
 		}
 	}
 
-	server->clearACLCache();
+	server->clearACLCache(channel);
 	server->updateChannel(channel);
 	cb->ice_response();
 }
@@ -1843,16 +1843,22 @@ static void impl_Server_addUserToGroup(const ::MumbleServer::AMD_Server_addUserT
 		return;
 	}
 
+	bool groupCreated = false;
 	{
 		QWriteLocker wl(&server->qrwlVoiceThread);
 
 		::Group *g = channel->qhGroups.value(qsgroup);
-		if (!g)
-			g = new ::Group(channel, qsgroup);
+		if (!g) {
+			g            = new ::Group(channel, qsgroup);
+			groupCreated = true;
+		}
 
 		g->qsTemporary.insert(-session);
 	}
 
+	// A new group changes which groups ACLs in the channel's subtree refer to
+	if (groupCreated)
+		server->clearACLCache(channel);
 	server->clearACLCache(user);
 
 	cb->ice_response();
@@ -1870,16 +1876,22 @@ static void impl_Server_removeUserFromGroup(const ::MumbleServer::AMD_Server_rem
 		return;
 	}
 
+	bool groupCreated = false;
 	{
 		QWriteLocker qrwl(&server->qrwlVoiceThread);
 
 		::Group *g = channel->qhGroups.value(qsgroup);
-		if (!g)
-			g = new ::Group(channel, qsgroup);
+		if (!g) {
+			g            = new ::Group(channel, qsgroup);
+			groupCreated = true;
+		}
 
 		g->qsTemporary.remove(-session);
 	}
 
+	// A new group changes which groups ACLs in the channel's subtree refer to
+	if (groupCreated)
+		server->clearACLCache(channel);
 	server->clearACLCache(user);
 
 	cb->ice_response();
@@ -0,0 +1,55 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "NetworkThreadPool.h"
+
+#include <QtCore/QThread>
+
+#include <algorithm>
+
+NetworkThreadPool::NetworkThreadPool(unsigned int threadCount) {
+	m_workers.resize(threadCount);
+
+	for (std::size_t i = 0; i < m_workers.size(); ++i) {
+		m_workers[i].thread = std::make_unique< QThread >();
+		m_workers[i].thread->setObjectName(QString::fromLatin1("Network %1").arg(i));
+		m_workers[i].thread->start();
+	}
+}
+
+NetworkThreadPool::~NetworkThreadPool() {
+	for (Worker &worker : m_workers) {
+		worker.thread->quit();
+	}
+	for (Worker &worker : m_workers) {
+		worker.thread->wait();
+	}
+}
+
+QThread *NetworkThreadPool::acquire() {
+	if (m_workers.empty()) {
+		return nullptr;
+	}
+
+	auto it = std::min_element(m_workers.begin(), m_workers.end(), [](const Worker &lhs, const Worker &rhs) {
+		return lhs.connections < rhs.connections;
+	});
+	it->connections++;
+
+	return it->thread.get();
+}
+
+void NetworkThreadPool::release(QThread *thread) {
+	for (Worker &worker : m_workers) {
+		if (worker.thread.get() == thread) {
+			worker.connections--;
+			return;
+		}
+	}
+}
+
+std::size_t NetworkThreadPool::size() const {
+	return m_workers.size();
+}
@@ -0,0 +1,50 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_NETWORKTHREADPOOL_H_
+#define MUMBLE_MURMUR_NETWORKTHREADPOOL_H_
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+class QThread;
+
+/// The threads serving the TCP connections of all virtual servers. Every connection is assigned to one of them
+/// and its socket (see ConnectionIO) is moved there, so that TLS handshakes, encryption, framing and parsing of
+/// the control channel don't compete with the main thread, which owns the server state.
+///
+/// A pool without threads is valid: connections are then served by the main thread, as they used to be.
+///
+/// This class must only be used from the main thread.
+class NetworkThreadPool {
+public:
+	explicit NetworkThreadPool(unsigned int threadCount);
+	/// Stops all threads. Connections still assigned to them are deleted by their threads before they finish.
+	~NetworkThreadPool();
+
+	NetworkThreadPool(const NetworkThreadPool &) = delete;
+	NetworkThreadPool &operator=(const NetworkThreadPool &) = delete;
+
+	/// Assigns a new connection to the thread currently serving the fewest connections.
+	///
+	/// @returns The thread the connection shall be moved to or nullptr if the pool has no threads
+	QThread *acquire();
+	/// Tells the pool that a connection acquired for the given thread has been closed
+	void release(QThread *thread);
+
+	/// @returns The amount of threads in this pool
+	std::size_t size() const;
+
+protected:
+	struct Worker {
+		std::unique_ptr< QThread > thread;
+		std::size_t connections = 0;
+	};
+
+	std::vector< Worker > m_workers;
+};
+
+#endif // MUMBLE_MURMUR_NETWORKTHREADPOOL_H_
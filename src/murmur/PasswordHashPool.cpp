@@ -0,0 +1,76 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "PasswordHashPool.h"
+#include "PBKDF2.h"
+#include "Server.h"
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QRunnable>
+
+#include <boost/bind/bind.hpp>
+
+#include "TracyConstants.h"
+#include <tracy/Tracy.hpp>
+
+namespace {
+class HashTask : public QRunnable {
+public:
+	HashTask(PasswordHashPool *pool, std::atomic< std::size_t > &queueDepth, const QString &salt,
+			 const QString &password, int iterations, PasswordHashPool::Callback done)
+		: m_pool(pool), m_queueDepth(queueDepth), m_salt(salt), m_password(password), m_iterations(iterations),
+		  m_done(std::move(done)) {}
+
+	void run() override {
+		ZoneScopedN(TracyConstants::PASSWORD_HASH_ZONE);
+
+		const QString hash = PBKDF2::getHash(m_salt, m_password, m_iterations);
+
+		TracyPlot(TracyConstants::PASSWORD_HASH_QUEUE_DEPTH, static_cast< int64_t >(--m_queueDepth));
+
+		QCoreApplication::postEvent(m_pool, new ExecEvent(boost::bind(m_done, hash)));
+	}
+
+protected:
+	PasswordHashPool *m_pool;
+	std::atomic< std::size_t > &m_queueDepth;
+	QString m_salt;
+	QString m_password;
+	int m_iterations;
+	PasswordHashPool::Callback m_done;
+};
+} // namespace
+
+PasswordHashPool::PasswordHashPool(unsigned int threadCount) : QObject(), m_size(threadCount), m_queueDepth(0) {
+	if (m_size > 0) {
+		m_pool.setMaxThreadCount(static_cast< int >(m_size));
+	}
+}
+
+PasswordHashPool::~PasswordHashPool() {
+	m_pool.clear();
+	m_pool.waitForDone();
+}
+
+void PasswordHashPool::hash(const QString &salt, const QString &password, int iterations, Callback done) {
+	Q_ASSERT(size() > 0);
+
+	TracyPlot(TracyConstants::PASSWORD_HASH_QUEUE_DEPTH, static_cast< int64_t >(++m_queueDepth));
+
+	m_pool.start(new HashTask(this, m_queueDepth, salt, password, iterations, std::move(done)));
+}
+
+std::size_t PasswordHashPool::queueDepth() const {
+	return m_queueDepth;
+}
+
+std::size_t PasswordHashPool::size() const {
+	return m_size;
+}
+
+void PasswordHashPool::customEvent(QEvent *evt) {
+	if (evt->type() == EXEC_QEVENT)
+		static_cast< ExecEvent * >(evt)->execute();
+}
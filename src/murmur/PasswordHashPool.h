@@ -0,0 +1,56 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_PASSWORDHASHPOOL_H_
+#define MUMBLE_MURMUR_PASSWORDHASHPOOL_H_
+
+#include <QtCore/QObject>
+#include <QtCore/QString>
+#include <QtCore/QThreadPool>
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+
+/// The threads computing the PBKDF2 hashes of the passwords clients authenticate with. PBKDF2::benchmark tunes the
+/// iteration count to make hashing expensive on purpose, so doing it on the main thread would stall all virtual
+/// servers whenever a few clients log in at once.
+///
+/// The amount of hashes computed at the same time is capped by the amount of threads. Further requests wait in a
+/// queue, the depth of which is reported to the profiler.
+///
+/// This class must only be used from the main thread.
+class PasswordHashPool : public QObject {
+private:
+	Q_OBJECT
+	Q_DISABLE_COPY(PasswordHashPool)
+public:
+	using Callback = std::function< void(const QString &hash) >;
+
+	/// @param threadCount The maximum amount of hashes computed at the same time. A pool without threads is valid,
+	/// but must not be asked for hashes (see size()).
+	explicit PasswordHashPool(unsigned int threadCount);
+	/// Drops the queued requests and waits for the ones being computed
+	~PasswordHashPool() override;
+
+	/// Computes the hash on one of the pool's threads (see PBKDF2::getHash)
+	///
+	/// @param done Called on the main thread once the hash has been computed
+	void hash(const QString &salt, const QString &password, int iterations, Callback done);
+
+	/// @returns The amount of requested hashes that have not been computed yet
+	std::size_t queueDepth() const;
+	/// @returns The amount of threads in this pool
+	std::size_t size() const;
+
+protected:
+	void customEvent(QEvent *evt) override;
+
+	QThreadPool m_pool;
+	std::size_t m_size;
+	std::atomic< std::size_t > m_queueDepth;
+};
+
+#endif // MUMBLE_MURMUR_PASSWORDHASHPOOL_H_
@@ -0,0 +1,293 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "PeerTable.h"
+
+#include "HostAddress.h"
+
+#ifdef Q_OS_WIN
+#	include "win.h"
+#	include <winsock2.h>
+#	include <ws2tcpip.h>
+#else
+#	include <netinet/in.h>
+#	include <sys/socket.h>
+#endif
+
+#include <cstring>
+
+PeerKey::PeerKey() : port(0) {
+	address.fill(0);
+}
+
+PeerKey::PeerKey(const HostAddress &host, quint16 peerPort) : port(peerPort) {
+	static_assert(sizeof(host.qip6.c) == sizeof(address), "Unexpected address size");
+
+	memcpy(address.data(), host.qip6.c, address.size());
+}
+
+PeerKey::PeerKey(const struct sockaddr_storage &addr)
+	: PeerKey(HostAddress(addr), (addr.ss_family == AF_INET6)
+									 ? reinterpret_cast< const struct sockaddr_in6 * >(&addr)->sin6_port
+									 : reinterpret_cast< const struct sockaddr_in * >(&addr)->sin_port) {
+}
+
+bool PeerKey::operator==(const PeerKey &other) const {
+	return port == other.port && address == other.address;
+}
+
+bool PeerKey::operator!=(const PeerKey &other) const {
+	return !(*this == other);
+}
+
+std::size_t PeerKey::hash() const {
+	std::uint64_t high;
+	std::uint64_t low;
+	memcpy(&high, address.data(), sizeof(high));
+	memcpy(&low, address.data() + sizeof(high), sizeof(low));
+
+	// Mix the key with the finalizer of MurmurHash3. Linear probing needs the low bits to be well distributed.
+	std::uint64_t h = high ^ (low * 0x9e3779b97f4a7c15ULL) ^ (static_cast< std::uint64_t >(port) << 48);
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+
+	return static_cast< std::size_t >(h);
+}
+
+
+const PeerTable::Entry PeerTable::s_tombstone = { PeerKey(), 0 };
+
+PeerTable::Table::Table(std::size_t capacity)
+	: mask(capacity - 1), slots(new std::atomic< const Entry * >[capacity]) {
+	for (std::size_t i = 0; i < capacity; ++i) {
+		slots[i].store(nullptr, std::memory_order_relaxed);
+	}
+}
+
+PeerTable::PeerTable() : m_table(new Table(MIN_CAPACITY)), m_epoch(0) {
+	m_readers[0].store(0);
+	m_readers[1].store(0);
+}
+
+PeerTable::~PeerTable() {
+	clear();
+
+	for (const auto &current : m_retiredEntries) {
+		delete current.second;
+	}
+	for (const auto &current : m_retiredTables) {
+		delete current.second;
+	}
+
+	delete m_table.load();
+}
+
+std::uint64_t PeerTable::enterReader() const {
+	while (true) {
+		const std::uint64_t epoch = m_epoch.load();
+		m_readers[epoch & 1].fetch_add(1);
+
+		// If the epoch has been advanced in the meantime, the writer might not have seen our registration
+		if (m_epoch.load() == epoch) {
+			return epoch;
+		}
+
+		m_readers[epoch & 1].fetch_sub(1);
+	}
+}
+
+void PeerTable::leaveReader(std::uint64_t epoch) const {
+	m_readers[epoch & 1].fetch_sub(1, std::memory_order_release);
+}
+
+bool PeerTable::find(const PeerKey &key, unsigned int &session) const {
+	const std::uint64_t epoch = enterReader();
+
+	const Table *table = m_table.load(std::memory_order_acquire);
+	bool found         = false;
+
+	for (std::size_t i = key.hash() & table->mask;; i = (i + 1) & table->mask) {
+		const Entry *entry = table->slots[i].load(std::memory_order_acquire);
+
+		if (!entry) {
+			break;
+		}
+
+		if (entry != &s_tombstone && entry->key == key) {
+			session = entry->session;
+			found   = true;
+			break;
+		}
+	}
+
+	leaveReader(epoch);
+
+	return found;
+}
+
+std::size_t PeerTable::findSlot(const Table &table, const PeerKey &key) const {
+	for (std::size_t i = key.hash() & table.mask;; i = (i + 1) & table.mask) {
+		const Entry *entry = table.slots[i].load(std::memory_order_relaxed);
+
+		if (!entry) {
+			return table.mask + 1;
+		}
+
+		if (entry != &s_tombstone && entry->key == key) {
+			return i;
+		}
+	}
+}
+
+void PeerTable::insert(const PeerKey &key, unsigned int session) {
+	std::lock_guard< std::mutex > lock(m_writeLock);
+
+	Table *table = m_table.load(std::memory_order_relaxed);
+
+	std::size_t slot = findSlot(*table, key);
+	if (slot <= table->mask) {
+		const Entry *previous = table->slots[slot].load(std::memory_order_relaxed);
+		if (previous->session != session) {
+			table->slots[slot].store(new Entry{ key, session }, std::memory_order_release);
+			m_retiredEntries.emplace_back(m_epoch.load(), previous);
+		}
+	} else {
+		// Keep at least half of the slots empty, so that probe sequences stay short and always terminate
+		if ((m_size + m_tombstones + 1) * 2 > table->mask + 1) {
+			std::size_t capacity = MIN_CAPACITY;
+			while (capacity < (m_size + 1) * 4) {
+				capacity *= 2;
+			}
+
+			rebuild(capacity);
+			table = m_table.load(std::memory_order_relaxed);
+		}
+
+		for (slot = key.hash() & table->mask;; slot = (slot + 1) & table->mask) {
+			const Entry *entry = table->slots[slot].load(std::memory_order_relaxed);
+
+			if (!entry || entry == &s_tombstone) {
+				if (entry) {
+					m_tombstones--;
+				}
+				break;
+			}
+		}
+
+		table->slots[slot].store(new Entry{ key, session }, std::memory_order_release);
+		m_size++;
+	}
+
+	reclaim();
+}
+
+void PeerTable::remove(const PeerKey &key) {
+	std::lock_guard< std::mutex > lock(m_writeLock);
+
+	Table *table           = m_table.load(std::memory_order_relaxed);
+	const std::size_t slot = findSlot(*table, key);
+
+	if (slot <= table->mask) {
+		m_retiredEntries.emplace_back(m_epoch.load(), table->slots[slot].load(std::memory_order_relaxed));
+		table->slots[slot].store(&s_tombstone, std::memory_order_release);
+
+		m_size--;
+		m_tombstones++;
+	}
+
+	reclaim();
+}
+
+void PeerTable::clear() {
+	std::lock_guard< std::mutex > lock(m_writeLock);
+
+	Table *table = m_table.load(std::memory_order_relaxed);
+	for (std::size_t i = 0; i <= table->mask; ++i) {
+		const Entry *entry = table->slots[i].load(std::memory_order_relaxed);
+
+		if (entry && entry != &s_tombstone) {
+			m_retiredEntries.emplace_back(m_epoch.load(), entry);
+		}
+	}
+
+	m_retiredTables.emplace_back(m_epoch.load(), table);
+	m_table.store(new Table(MIN_CAPACITY), std::memory_order_release);
+	m_size       = 0;
+	m_tombstones = 0;
+
+	reclaim();
+}
+
+std::size_t PeerTable::size() const {
+	std::lock_guard< std::mutex > lock(m_writeLock);
+
+	return m_size;
+}
+
+void PeerTable::rebuild(std::size_t capacity) {
+	Table *previous = m_table.load(std::memory_order_relaxed);
+	Table *table    = new Table(capacity);
+
+	for (std::size_t i = 0; i <= previous->mask; ++i) {
+		const Entry *entry = previous->slots[i].load(std::memory_order_relaxed);
+
+		if (!entry || entry == &s_tombstone) {
+			continue;
+		}
+
+		std::size_t slot = entry->key.hash() & table->mask;
+		while (table->slots[slot].load(std::memory_order_relaxed)) {
+			slot = (slot + 1) & table->mask;
+		}
+
+		// The entries are shared between both tables, so only the table itself has to be retired
+		table->slots[slot].store(entry, std::memory_order_relaxed);
+	}
+
+	m_table.store(table, std::memory_order_release);
+	m_retiredTables.emplace_back(m_epoch.load(), previous);
+	m_tombstones = 0;
+}
+
+void PeerTable::reclaim() {
+	if (m_retiredEntries.empty() && m_retiredTables.empty()) {
+		return;
+	}
+
+	std::uint64_t epoch = m_epoch.load();
+
+	// We may only advance the epoch if no reader of the previous epoch is left. This never waits for the readers:
+	// if there still are some, the retired objects are freed during one of the next modifications instead.
+	if (m_readers[(epoch + 1) & 1].load() == 0) {
+		m_epoch.store(++epoch);
+	}
+
+	// Only readers of the current and of the previous epoch can be active
+	auto isUnreachable = [epoch](std::uint64_t retiredIn) { return retiredIn + 2 <= epoch; };
+
+	for (std::size_t i = 0; i < m_retiredEntries.size();) {
+		if (isUnreachable(m_retiredEntries[i].first)) {
+			delete m_retiredEntries[i].second;
+
+			m_retiredEntries[i] = m_retiredEntries.back();
+			m_retiredEntries.pop_back();
+		} else {
+			++i;
+		}
+	}
+	for (std::size_t i = 0; i < m_retiredTables.size();) {
+		if (isUnreachable(m_retiredTables[i].first)) {
+			delete m_retiredTables[i].second;
+
+			m_retiredTables[i] = m_retiredTables.back();
+			m_retiredTables.pop_back();
+		} else {
+			++i;
+		}
+	}
+}
@@ -0,0 +1,115 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_PEERTABLE_H_
+#define MUMBLE_MURMUR_PEERTABLE_H_
+
+#include <QtCore/QtGlobal>
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+struct HostAddress;
+struct sockaddr_storage;
+
+/// The compact (18 byte) key identifying a UDP peer: its IPv6 (or IPv4-mapped) address followed by
+/// its port (in network byte order).
+struct PeerKey {
+	std::array< unsigned char, 16 > address;
+	quint16 port;
+
+	PeerKey();
+	PeerKey(const HostAddress &address, quint16 port);
+	explicit PeerKey(const struct sockaddr_storage &address);
+
+	bool operator==(const PeerKey &other) const;
+	bool operator!=(const PeerKey &other) const;
+
+	std::size_t hash() const;
+};
+
+static_assert(sizeof(PeerKey) == 18, "PeerKey is expected to be packed into 18 bytes");
+
+/// A hash table (using open addressing) mapping UDP peers to the session of the user they belong to.
+///
+/// Lookups are lock-free and never block, not even while the table is modified concurrently. This is achieved
+/// by never modifying entries in place: entries are immutable and slots are swapped atomically. Entries and
+/// tables that have been replaced are only freed once no reader can still be accessing them (epoch-based
+/// reclamation).
+///
+/// Modifications are serialized internally, so they are safe to do from any thread.
+class PeerTable {
+public:
+	PeerTable();
+	~PeerTable();
+
+	PeerTable(const PeerTable &) = delete;
+	PeerTable &operator=(const PeerTable &) = delete;
+
+	/// Looks up the given peer. This function is lock-free.
+	///
+	/// @param key The peer to look up
+	/// @param[out] session The session of the user the peer belongs to (only written if the peer is known)
+	/// @returns Whether the peer is known
+	bool find(const PeerKey &key, unsigned int &session) const;
+
+	/// Associates the given peer with the given session, replacing a previous association of that peer.
+	void insert(const PeerKey &key, unsigned int session);
+	/// Forgets about the given peer
+	void remove(const PeerKey &key);
+	/// Forgets about all peers
+	void clear();
+
+	/// @returns The amount of known peers
+	std::size_t size() const;
+
+protected:
+	struct Entry {
+		PeerKey key;
+		unsigned int session;
+	};
+
+	struct Table {
+		std::size_t mask;
+		std::unique_ptr< std::atomic< const Entry * >[] > slots;
+
+		explicit Table(std::size_t capacity);
+	};
+
+	/// Marks a slot whose entry has been removed. Lookups have to continue probing past it.
+	static const Entry s_tombstone;
+	static constexpr std::size_t MIN_CAPACITY = 64;
+
+	std::atomic< Table * > m_table;
+
+	/// The epoch-based reclamation works with a global epoch and two reader counters. A reader registers in the
+	/// counter belonging to the parity of the current epoch. The epoch is only advanced once all readers that
+	/// registered in the epoch before the current one are gone, so at any time there can only be readers of the
+	/// current and of the previous epoch. Everything that has been retired two epochs ago can thus be freed.
+	std::atomic< std::uint64_t > m_epoch;
+	mutable std::array< std::atomic< std::size_t >, 2 > m_readers;
+
+	mutable std::mutex m_writeLock;
+	std::size_t m_size       = 0;
+	std::size_t m_tombstones = 0;
+	std::vector< std::pair< std::uint64_t, const Entry * > > m_retiredEntries;
+	std::vector< std::pair< std::uint64_t, Table * > > m_retiredTables;
+
+	std::uint64_t enterReader() const;
+	void leaveReader(std::uint64_t epoch) const;
+
+	/// @returns The slot the given key is stored in, or the capacity of the table if it isn't
+	std::size_t findSlot(const Table &table, const PeerKey &key) const;
+	void rebuild(std::size_t capacity);
+	void reclaim();
+};
+
+#endif // MUMBLE_MURMUR_PEERTABLE_H_
@@ -0,0 +1,33 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_PENDINGAUTHENTICATION_H_
+#define MUMBLE_MURMUR_PENDINGAUTHENTICATION_H_
+
+#include <QtCore/QString>
+#include <QtCore/QtGlobal>
+
+#include "Mumble.pb.h"
+
+/// The state of an authentication that waits for the client's password to be hashed by the PasswordHashPool.
+/// Server::authenticate asks for the hash by filling in the salt and the iteration count and returning -4. Once
+/// the hash is known, it is called again with it.
+struct PendingAuthentication {
+	/// Identifies the request, so that a hash arriving after the client has gone (and its session has been handed
+	/// to another client) is dropped
+	quint64 id = 0;
+	/// The message the client has authenticated with
+	MumbleProto::Authenticate msg;
+	/// Whether Server::authenticate has asked for the hash already. The external authenticators (which have left
+	/// the authentication to the database back then) are not asked again.
+	bool requested = false;
+	/// The stored salt and iteration count the hash is to be computed with
+	QString salt;
+	int iterations = 0;
+	/// The hash of the client's password. Empty until it has been computed.
+	QString hash;
+};
+
+#endif // MUMBLE_MURMUR_PENDINGAUTHENTICATION_H_
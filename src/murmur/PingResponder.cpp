@@ -0,0 +1,109 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "PingResponder.h"
+
+#include "CoarseClock.h"
+#include "PeerTable.h"
+#include "Version.h"
+
+#include <algorithm>
+
+PingResponder::PingResponder()
+	: m_allowPing(false), m_userCount(0), m_maxUserCount(0), m_maxBandwidthPerUser(0), m_interval(0),
+	  m_tolerance(0), m_answeredPings(0), m_limitedPings(0) {
+	for (std::atomic< quint64 > &nextPing : m_nextPing) {
+		nextPing.store(0, std::memory_order_relaxed);
+	}
+}
+
+void PingResponder::update(bool allowPing, unsigned int userCount, unsigned int maxUserCount,
+						   unsigned int maxBandwidthPerUser) {
+	m_userCount.store(userCount, std::memory_order_relaxed);
+	m_maxUserCount.store(maxUserCount, std::memory_order_relaxed);
+	m_maxBandwidthPerUser.store(maxBandwidthPerUser, std::memory_order_relaxed);
+	m_allowPing.store(allowPing, std::memory_order_relaxed);
+}
+
+void PingResponder::setRateLimit(unsigned int pingsPerSec, unsigned int burst) {
+	const quint64 interval = pingsPerSec > 0 ? 1000000ULL / pingsPerSec : 0;
+
+	m_tolerance.store(interval * (std::max(burst, 1U) - 1), std::memory_order_relaxed);
+	m_interval.store(interval, std::memory_order_relaxed);
+}
+
+bool PingResponder::respond(gsl::span< const Mumble::Protocol::byte > data, const sockaddr_storage &from,
+							Mumble::Protocol::UDPDecoder< Mumble::Protocol::Role::Server > &decoder,
+							Mumble::Protocol::UDPPingEncoder< Mumble::Protocol::Role::Server > &encoder,
+							gsl::span< const Mumble::Protocol::byte > &reply) {
+	reply = {};
+
+	if (!m_allowPing.load(std::memory_order_relaxed)) {
+		return false;
+	}
+
+	// The sender is not looked up, so the ping may be in either format
+	decoder.setProtocolVersion(Version::UNKNOWN);
+	if (!decoder.decodePing(data) || decoder.getMessageType() != Mumble::Protocol::UDPMessageType::Ping) {
+		return false;
+	}
+
+	Mumble::Protocol::PingData pingData = decoder.getPingData();
+	if (!pingData.requestAdditionalInformation) {
+		// Only extended pings are answered here. Connected users send their connectivity pings encrypted.
+		return true;
+	}
+
+	if (!admit(from, CoarseClock::now())) {
+		m_limitedPings.fetch_add(1, std::memory_order_relaxed);
+		return true;
+	}
+
+	pingData.requestAdditionalInformation  = false;
+	pingData.serverVersion                 = Version::get();
+	pingData.userCount                     = m_userCount.load(std::memory_order_relaxed);
+	pingData.maxUserCount                  = m_maxUserCount.load(std::memory_order_relaxed);
+	pingData.maxBandwidthPerUser           = m_maxBandwidthPerUser.load(std::memory_order_relaxed);
+	pingData.containsAdditionalInformation = true;
+
+	// Encode in the same protocol version that we decoded with
+	encoder.setProtocolVersion(decoder.getProtocolVersion());
+	reply = encoder.encodePingPacket(pingData);
+
+	m_answeredPings.fetch_add(1, std::memory_order_relaxed);
+
+	return true;
+}
+
+bool PingResponder::admit(const sockaddr_storage &from, quint64 now) {
+	const quint64 interval = m_interval.load(std::memory_order_relaxed);
+	if (interval == 0) {
+		return true;
+	}
+	const quint64 tolerance = m_tolerance.load(std::memory_order_relaxed);
+
+	// Senders are identified by their address only, as they could pick a different port for every ping
+	PeerKey key(from);
+	key.port = 0;
+
+	std::atomic< quint64 > &nextPing = m_nextPing[key.hash() % RATE_LIMIT_SLOTS];
+
+	quint64 expected = nextPing.load(std::memory_order_relaxed);
+	do {
+		if (expected > now + tolerance) {
+			return false;
+		}
+	} while (!nextPing.compare_exchange_weak(expected, std::max(expected, now) + interval, std::memory_order_relaxed));
+
+	return true;
+}
+
+quint64 PingResponder::answeredPings() const {
+	return m_answeredPings.load(std::memory_order_relaxed);
+}
+
+quint64 PingResponder::limitedPings() const {
+	return m_limitedPings.load(std::memory_order_relaxed);
+}
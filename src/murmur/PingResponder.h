@@ -0,0 +1,82 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_PINGRESPONDER_H_
+#define MUMBLE_MURMUR_PINGRESPONDER_H_
+
+#include "MumbleProtocol.h"
+
+#include <QtCore/QtGlobal>
+
+#include <array>
+#include <atomic>
+
+struct sockaddr_storage;
+
+/// Answers the unauthenticated pings server lists (and the connect dialog) send in order to find out about the
+/// latency and the state of a server.
+///
+/// These pings arrive on the voice sockets and are answered right away by the thread that has received them:
+/// without locking, without looking up the sender and without reading any of the server's state. The details
+/// extended pings ask for are taken from a snapshot the main thread refreshes periodically (see update()).
+///
+/// Every sender (identified by its address, regardless of the port) may only send pingsPerSec pings per second,
+/// with bursts of up to burst pings. Pings exceeding that are dropped without a reply, so that the server can't be
+/// used for amplifying traffic towards a spoofed address. The limit is enforced with the generic cell rate algorithm
+/// on a fixed number of slots the senders are hashed onto, which may make senders sharing a slot limit each other.
+class PingResponder {
+public:
+	/// The amount of slots the senders are hashed onto
+	static constexpr std::size_t RATE_LIMIT_SLOTS = 4096;
+
+	PingResponder();
+
+	/// Publishes the details extended pings are answered with.
+	///
+	/// @param allowPing Whether pings should be answered at all. If not, they are treated as any other datagram.
+	void update(bool allowPing, unsigned int userCount, unsigned int maxUserCount, unsigned int maxBandwidthPerUser);
+	/// @param pingsPerSec The amount of pings a single sender may send per second. 0 disables the limit.
+	/// @param burst The amount of pings a single sender may send at once
+	void setRateLimit(unsigned int pingsPerSec, unsigned int burst);
+
+	/// Checks whether the given datagram is a ping requesting the server's details and if so, builds the reply to
+	/// it. This function may be called from any thread, as long as the decoder and the encoder belong to that thread.
+	/// The time is taken from the CoarseClock.
+	///
+	/// @param data The received datagram
+	/// @param from The address the datagram has been received from
+	/// @param[out] reply The reply that has to be sent back. It is empty if the ping must not be answered.
+	/// @returns Whether the datagram has been such a ping, in which case it must not be processed any further
+	bool respond(gsl::span< const Mumble::Protocol::byte > data, const sockaddr_storage &from,
+				 Mumble::Protocol::UDPDecoder< Mumble::Protocol::Role::Server > &decoder,
+				 Mumble::Protocol::UDPPingEncoder< Mumble::Protocol::Role::Server > &encoder,
+				 gsl::span< const Mumble::Protocol::byte > &reply);
+
+	/// @returns The amount of pings that have been answered so far
+	quint64 answeredPings() const;
+	/// @returns The amount of pings that have been dropped due to the rate limit so far
+	quint64 limitedPings() const;
+
+protected:
+	/// @returns Whether the given sender may send another ping at the given time (see CoarseClock)
+	bool admit(const sockaddr_storage &from, quint64 now);
+
+	std::atomic< bool > m_allowPing;
+	std::atomic< quint32 > m_userCount;
+	std::atomic< quint32 > m_maxUserCount;
+	std::atomic< quint32 > m_maxBandwidthPerUser;
+
+	/// The time (in microseconds) between two pings of a sender, 0 if pings are not limited
+	std::atomic< quint64 > m_interval;
+	/// How much earlier than after m_interval a sender may send a ping, which allows for bursts
+	std::atomic< quint64 > m_tolerance;
+	/// The time (see CoarseClock) at which the next ping of the senders of a slot is expected
+	std::array< std::atomic< quint64 >, RATE_LIMIT_SLOTS > m_nextPing;
+
+	std::atomic< quint64 > m_answeredPings;
+	std::atomic< quint64 > m_limitedPings;
+};
+
+#endif // MUMBLE_MURMUR_PINGRESPONDER_H_
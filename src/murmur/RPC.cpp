@@ -126,6 +126,9 @@ bool Server::setChannelState(Channel *cChannel, Channel *cParent, const QString
 			cParent->addChannel(cChannel);
 		}
 
+		// The channel (and its subchannels) inherit ACLs and groups from different channels now
+		clearACLCache(cChannel, true);
+
 		mpcs.set_parent(cParent->iId);
 
 		updated = true;
@@ -227,6 +230,7 @@ void Server::setTempGroups(int userid, int sessionId, Channel *cChannel, const Q
 	if (!cChannel)
 		cChannel = qhChannels.value(0);
 
+	bool groupCreated = false;
 	{
 		QWriteLocker wl(&qrwlVoiceThread);
 
@@ -241,7 +245,8 @@ void Server::setTempGroups(int userid, int sessionId, Channel *cChannel, const Q
 		foreach (gname, groups) {
 			g = cChannel->qhGroups.value(gname);
 			if (!g) {
-				g = new Group(cChannel, gname);
+				g            = new Group(cChannel, gname);
+				groupCreated = true;
 			}
 			g->qsTemporary.insert(userid);
 			if (sessionId != 0)
@@ -249,6 +254,10 @@ void Server::setTempGroups(int userid, int sessionId, Channel *cChannel, const Q
 		}
 	}
 
+	// A new group changes which groups ACLs in the channel's subtree refer to
+	if (groupCreated)
+		clearACLCache(cChannel);
+
 	User *p = qhUsers.value(userid);
 	if (p)
 		clearACLCache(p);
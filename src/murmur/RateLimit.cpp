@@ -0,0 +1,144 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "RateLimit.h"
+
+#include "CoarseClock.h"
+
+#include <algorithm>
+
+/// @returns The time passed since the given time (see CoarseClock)
+static quint64 elapsedSince(quint64 now, quint64 time) {
+	return now > time ? now - time : 0;
+}
+
+BandwidthRecord::BandwidthRecord() : iRecNum(0), iSum(0) {
+	const quint64 now = CoarseClock::update();
+
+	uiFirst = now;
+	uiIdleControl.store(now, std::memory_order_relaxed);
+	for (int i = 0; i < N_BANDWIDTH_SLOTS; i++) {
+		a_iBW[i].store(0, std::memory_order_relaxed);
+		a_uiWhen[i].store(now, std::memory_order_relaxed);
+	}
+}
+
+bool BandwidthRecord::addFrame(int size, int maxpersec) {
+	while (afWriting.test_and_set(std::memory_order_acquire)) {
+	}
+
+	const int recNum      = iRecNum.load(std::memory_order_relaxed);
+	const quint64 now     = CoarseClock::now();
+	const quint64 elapsed = elapsedSince(now, a_uiWhen[recNum].load(std::memory_order_relaxed));
+
+	bool accepted = false;
+	if (elapsed > 0) {
+		int nsum = iSum - a_iBW[recNum].load(std::memory_order_relaxed) + size;
+		int bw   = static_cast< int >((nsum * 1000000LL) / static_cast< qint64 >(elapsed));
+
+		if (bw <= maxpersec) {
+			a_iBW[recNum].store(static_cast< unsigned short >(size), std::memory_order_relaxed);
+			a_uiWhen[recNum].store(now, std::memory_order_relaxed);
+
+			iSum = nsum;
+
+			// Publishes the frame to the readers
+			iRecNum.store(recNum + 1 == N_BANDWIDTH_SLOTS ? 0 : recNum + 1, std::memory_order_release);
+
+			accepted = true;
+		}
+	}
+
+	afWriting.clear(std::memory_order_release);
+
+	return accepted;
+}
+
+int BandwidthRecord::onlineSeconds() const {
+	return static_cast< int >(elapsedSince(CoarseClock::update(), uiFirst) / 1000000LL);
+}
+
+int BandwidthRecord::idleSeconds() const {
+	const quint64 now  = CoarseClock::update();
+	const int lastSlot = (iRecNum.load(std::memory_order_acquire) + N_BANDWIDTH_SLOTS - 1) % N_BANDWIDTH_SLOTS;
+
+	const quint64 iIdle = std::min(elapsedSince(now, a_uiWhen[lastSlot].load(std::memory_order_relaxed)),
+								   elapsedSince(now, uiIdleControl.load(std::memory_order_relaxed)));
+
+	return static_cast< int >(iIdle / 1000000LL);
+}
+
+void BandwidthRecord::resetIdleSeconds() {
+	uiIdleControl.store(CoarseClock::now(), std::memory_order_relaxed);
+}
+
+int BandwidthRecord::bandwidth() const {
+	const quint64 now = CoarseClock::update();
+	const int recNum  = iRecNum.load(std::memory_order_acquire);
+
+	int sum         = 0;
+	quint64 elapsed = 0ULL;
+
+	for (int i = 1; i < N_BANDWIDTH_SLOTS; ++i) {
+		int idx   = (recNum + N_BANDWIDTH_SLOTS - i) % N_BANDWIDTH_SLOTS;
+		quint64 e = elapsedSince(now, a_uiWhen[idx].load(std::memory_order_relaxed));
+		if (e > 1000000ULL) {
+			break;
+		} else {
+			sum += a_iBW[idx].load(std::memory_order_relaxed);
+			elapsed = e;
+		}
+	}
+
+	if (elapsed < 250000ULL)
+		return 0;
+
+	return static_cast< int >((sum * 1000000ULL) / elapsed);
+}
+
+LeakyBucket::LeakyBucket(unsigned int tokensPerSec, unsigned int maxTokens)
+	: m_tokensPerSec(tokensPerSec), m_maxTokens(maxTokens), m_currentTokens(0), m_lastDrain(CoarseClock::update()) {
+}
+
+bool LeakyBucket::ratelimit(int tokens) {
+	// First remove tokens we leaked over time. The clock is monotonic, so the elapsed time can't be negative.
+	const quint64 now        = CoarseClock::now();
+	const quint64 lastDrain  = m_lastDrain.load(std::memory_order_relaxed);
+	const qint64 drainTokens = static_cast< qint64 >((elapsedSince(now, lastDrain) * m_tokensPerSec) / 1000000ULL);
+
+	// Only restart the timer if enough time has elapsed so whe drain at least
+	// a single token. If we were to restart the timer every time, even if the
+	// interval between the calls to this function is so small that we don't
+	// drain a token, we can end up in a situation in which we will never drain
+	// a token even if let's say by the time this function is called the second
+	// time we would have to drain a single token (over the course of both function
+	// calls, but each function call individually wouldn't drain a token).
+	if (drainTokens > 0) {
+		m_lastDrain.store(now, std::memory_order_relaxed);
+	}
+
+	// Make sure that m_currentTokens never gets less than 0 by draining
+	long currentTokens = m_currentTokens.load(std::memory_order_relaxed);
+	if (static_cast< qint64 >(currentTokens) < drainTokens) {
+		currentTokens = 0;
+	} else {
+		currentTokens -= static_cast< long >(drainTokens);
+	}
+
+	// Now that the tokens have been updated to reflect the constant drain caused by
+	// the imaginary leaking bucket, we can check whether the given amount of tokens
+	// still fit in this imaginary bucket (and thus the corresponding message may pass)
+	// or if it doesn't (and thus the message will be limited (rejected))
+	bool limit = currentTokens > ((static_cast< long >(m_maxTokens)) - tokens);
+
+	// If the bucket is not overflowed, allow message and add tokens
+	if (!limit) {
+		currentTokens += tokens;
+	}
+
+	m_currentTokens.store(currentTokens, std::memory_order_relaxed);
+
+	return limit;
+}
@@ -0,0 +1,82 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_RATELIMIT_H_
+#define MUMBLE_MURMUR_RATELIMIT_H_
+
+#include <QtCore/QtGlobal>
+
+#include <atomic>
+
+// Unfortunately, this needs to be "large enough" to hold
+// enough frames to account for both short-term and
+// long-term "maladjustments".
+
+#define N_BANDWIDTH_SLOTS 360
+
+/// Limits the voice bandwidth of a user and keeps track of the user's online and idle time.
+///
+/// Frames are added on the voice path for every single voice packet, so addFrame() only does a few atomic
+/// operations and takes the time from the CoarseClock. All other functions may be called from any thread at any
+/// time. They read the precise time and may see a frame that is being added only partially, which only affects
+/// the statistics by a single frame.
+struct BandwidthRecord {
+	/// The slot the next frame is stored in
+	std::atomic< int > iRecNum;
+	/// The sum of all frames in a_iBW. Only accessed by addFrame().
+	int iSum;
+	/// The time (see CoarseClock) the user has connected at
+	quint64 uiFirst;
+	/// The time the user has last done anything besides talking at
+	std::atomic< quint64 > uiIdleControl;
+	/// The sizes of the last frames
+	std::atomic< unsigned short > a_iBW[N_BANDWIDTH_SLOTS];
+	/// The times the last frames have been added at
+	std::atomic< quint64 > a_uiWhen[N_BANDWIDTH_SLOTS];
+	/// Set while a frame is being added. The frames of a user are added by a single voice thread, unless the
+	/// client switches between sending its voice via UDP and tunneling it through TCP.
+	std::atomic_flag afWriting = ATOMIC_FLAG_INIT;
+
+	BandwidthRecord();
+	/// @returns Whether the frame fits into the given bandwidth (in bytes per second). Frames that don't are
+	/// 	not recorded and have to be dropped.
+	bool addFrame(int size, int maxpersec);
+	int onlineSeconds() const;
+	int idleSeconds() const;
+	void resetIdleSeconds();
+	/// @returns The bandwidth (in bytes per second) used during the last second
+	int bandwidth() const;
+};
+
+/// A simple implementation for rate-limiting.
+/// See https://en.wikipedia.org/wiki/Leaky_bucket
+///
+/// A bucket is only ever changed by the thread handling its user's messages. The state is kept in atomics
+/// nonetheless, so that it can be read from other threads. The time is taken from the CoarseClock.
+class LeakyBucket {
+private:
+	/// The amount of tokens that are drained per second.
+	/// (The size of the whole in the bucket)
+	unsigned int m_tokensPerSec;
+	/// The maximum amount of tokens that may be encountered.
+	/// (The capacity of the bucket)
+	unsigned int m_maxTokens;
+	/// The amount of tokens currently stored
+	/// (The amount of whater currently in the bucket)
+	std::atomic< long > m_currentTokens;
+	/// The time (see CoarseClock) the tokens have last been drained at
+	std::atomic< quint64 > m_lastDrain;
+
+public:
+	/// @param tokens The amount of tokens that should be added.
+	/// @returns Whether adding this amount of tokens triggers rate
+	/// 	limiting (true means the corresponding packet has to be
+	/// 	discared and false means the packet may be processed)
+	bool ratelimit(int tokens);
+
+	LeakyBucket(unsigned int tokensPerSec, unsigned int maxTokens);
+};
+
+#endif // MUMBLE_MURMUR_RATELIMIT_H_
@@ -6,6 +6,7 @@
 #include "Meta.h"
 #include "OSInfo.h"
 #include "Server.h"
+#include "TimingWheel.h"
 #include "Version.h"
 
 #include <QtNetwork/QNetworkAccessManager>
@@ -17,16 +18,15 @@
 #endif
 
 void Server::initRegister() {
-	connect(&qtTick, SIGNAL(timeout()), this, SLOT(update()));
-
 	if (!qsRegName.isEmpty()) {
 		if (!qsRegName.isEmpty() && !qsRegPassword.isEmpty() && qurlRegWeb.isValid() && qsPassword.isEmpty()
 			&& bAllowPing)
 #if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
-			qtTick.start((60 + (QRandomGenerator::global()->generate() % 120)) * 1000);
+			m_registerTimer = meta->timingWheel->schedule((60 + (QRandomGenerator::global()->generate() % 120)) * 1000,
+														  [this]() { update(); });
 #else
 			// Qt 5.10 introduces the QRandomGenerator class and in Qt 5.15 qrand got deprecated in its favor
-			qtTick.start((60 + (qrand() % 120)) * 1000);
+			m_registerTimer = meta->timingWheel->schedule((60 + (qrand() % 120)) * 1000, [this]() { update(); });
 #endif
 		else
 			log("Registration needs nonempty 'registername', 'registerpassword' and 'registerurl', must have an empty "
@@ -37,6 +37,17 @@ void Server::initRegister() {
 }
 
 void Server::update() {
+	// Checks again later, as the settings might change in the meantime
+#if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
+	const qint64 delay = 1000 * (60 * 60 + (QRandomGenerator::global()->generate() % 300));
+#else
+	// Qt 5.10 introduces the QRandomGenerator class and in Qt 5.15 qrand got deprecated in its favor
+	const qint64 delay = 1000 * (60 * 60 + (qrand() % 300));
+#endif
+	if (!meta->timingWheel->reschedule(m_registerTimer, delay)) {
+		m_registerTimer = meta->timingWheel->schedule(delay, [this]() { update(); });
+	}
+
 	if (qsRegName.isEmpty() || qsRegPassword.isEmpty() || !qurlRegWeb.isValid() || !qsPassword.isEmpty() || !bAllowPing)
 		return;
 
@@ -44,13 +55,6 @@ void Server::update() {
 	if (!qnamNetwork)
 		qnamNetwork = new QNetworkAccessManager(this);
 
-#if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
-	qtTick.start(1000 * (60 * 60 + (QRandomGenerator::global()->generate() % 300)));
-#else
-	// Qt 5.10 introduces the QRandomGenerator class and in Qt 5.15 qrand got deprecated in its favor
-	qtTick.start(1000 * (60 * 60 + (qrand() % 300)));
-#endif
-
 	QDomDocument doc;
 	QDomElement root = doc.createElement(QLatin1String("server"));
 	doc.appendChild(root);
@@ -8,6 +8,7 @@
 #include "ACL.h"
 #include "Channel.h"
 #include "ClientType.h"
+#include "CoarseClock.h"
 #include "Connection.h"
 #include "EnvUtils.h"
 #include "Group.h"
@@ -15,9 +16,11 @@
 #include "HostAddress.h"
 #include "Meta.h"
 #include "MumbleProtocol.h"
+#include "NetworkThreadPool.h"
 #include "ProtoUtils.h"
 #include "QtUtils.h"
 #include "ServerDB.h"
+#include "ServerDBWriter.h"
 #include "ServerUser.h"
 #include "User.h"
 #include "Version.h"
@@ -43,6 +46,7 @@
 
 #include <algorithm>
 #include <cassert>
+#include <memory>
 #include <vector>
 
 #ifdef Q_OS_WIN
@@ -77,9 +81,13 @@ QSslSocket *SslServer::nextPendingSSLConnection() {
 }
 
 
-Server::Server(int snum, QObject *p) : QThread(p) {
+Server::Server(int snum, QObject *p, const ChannelTreeData *channelTree) : QThread(p) {
 	tracy::SetThreadName("Main");
 
+	// The time spent in the phases of booting, which is logged once the server is up (in microseconds)
+	Timer bootTimer;
+	quint64 configTime, socketTime, banTime, channelTime, certTime;
+
 	bValid     = true;
 	iServerNum = snum;
 #ifdef USE_ZEROCONF
@@ -92,7 +100,8 @@ Server::Server(int snum, QObject *p) : QThread(p) {
 #else
 	hNotify = nullptr;
 #endif
-	qtTimeout = new QTimer(this);
+	m_userStateTimer = new QTimer(this);
+	m_userStateTimer->setSingleShot(true);
 
 	iCodecAlpha = iCodecBeta = 0;
 	bPreferAlpha             = false;
@@ -102,6 +111,7 @@ Server::Server(int snum, QObject *p) : QThread(p) {
 
 	readParams();
 	initialize();
+	configTime = bootTimer.restart();
 
 	foreach (const QHostAddress &qha, qlBind) {
 		SslServer *ss = new SslServer(this);
@@ -131,80 +141,95 @@ Server::Server(int snum, QObject *p) : QThread(p) {
 #endif
 		memset(&addr, 0, sizeof(addr));
 		getsockname(tcpsock, reinterpret_cast< struct sockaddr * >(&addr), &len);
+		// One socket per voice thread
+		for (unsigned int i = 0; i < voiceThreads; ++i) {
 #ifdef Q_OS_UNIX
-		int sock = ::socket(addr.ss_family, SOCK_DGRAM, 0);
+			int sock = ::socket(addr.ss_family, SOCK_DGRAM, 0);
 #	ifdef Q_OS_LINUX
-		int sockopt = 1;
-		if (setsockopt(sock, IPPROTO_IP, IP_PKTINFO, &sockopt, sizeof(sockopt)))
-			log(QString("Failed to set IP_PKTINFO for %1").arg(addressToString(ss->serverAddress(), usPort)));
-		sockopt = 1;
-		if (setsockopt(sock, IPPROTO_IPV6, IPV6_RECVPKTINFO, &sockopt, sizeof(sockopt)))
-			log(QString("Failed to set IPV6_RECVPKTINFO for %1").arg(addressToString(ss->serverAddress(), usPort)));
+			int sockopt = 1;
+			if (setsockopt(sock, IPPROTO_IP, IP_PKTINFO, &sockopt, sizeof(sockopt)))
+				log(QString("Failed to set IP_PKTINFO for %1").arg(addressToString(ss->serverAddress(), usPort)));
+			sockopt = 1;
+			if (setsockopt(sock, IPPROTO_IPV6, IPV6_RECVPKTINFO, &sockopt, sizeof(sockopt)))
+				log(QString("Failed to set IPV6_RECVPKTINFO for %1").arg(addressToString(ss->serverAddress(), usPort)));
 #	endif
 #else
 #	ifndef SIO_UDP_CONNRESET
 #		define SIO_UDP_CONNRESET _WSAIOW(IOC_VENDOR, 12)
 #	endif
-		SOCKET sock           = ::WSASocket(addr.ss_family, SOCK_DGRAM, IPPROTO_UDP, nullptr, 0, WSA_FLAG_OVERLAPPED);
-		DWORD dwBytesReturned = 0;
-		BOOL bNewBehaviour    = FALSE;
-		if (WSAIoctl(sock, SIO_UDP_CONNRESET, &bNewBehaviour, sizeof(bNewBehaviour), nullptr, 0, &dwBytesReturned,
-					 nullptr, nullptr)
-			== SOCKET_ERROR) {
-			log(QString("Failed to set SIO_UDP_CONNRESET: %1").arg(WSAGetLastError()));
-		}
+			SOCKET sock           = ::WSASocket(addr.ss_family, SOCK_DGRAM, IPPROTO_UDP, nullptr, 0,
+												WSA_FLAG_OVERLAPPED);
+			DWORD dwBytesReturned = 0;
+			BOOL bNewBehaviour    = FALSE;
+			if (WSAIoctl(sock, SIO_UDP_CONNRESET, &bNewBehaviour, sizeof(bNewBehaviour), nullptr, 0, &dwBytesReturned,
+						 nullptr, nullptr)
+				== SOCKET_ERROR) {
+				log(QString("Failed to set SIO_UDP_CONNRESET: %1").arg(WSAGetLastError()));
+			}
 #endif
-		if (sock == INVALID_SOCKET) {
-			log("Failed to create UDP Socket");
-			bValid = false;
-			return;
-		} else {
-			if (addr.ss_family == AF_INET6) {
-				// Copy IPV6_V6ONLY attribute from tcp socket, it defaults to nonzero on Windows
-				// See https://msdn.microsoft.com/en-us/library/windows/desktop/ms738574%28v=vs.85%29.aspx
-				// This will fail for WindowsXP which is ok. Our TCP code will have split that up
-				// into two sockets.
-				int ipv6only     = 0;
-				socklen_t optlen = sizeof(ipv6only);
-				if (::getsockopt(tcpsock, IPPROTO_IPV6, IPV6_V6ONLY, reinterpret_cast< char * >(&ipv6only), &optlen)
-					== 0) {
-					if (::setsockopt(sock, IPPROTO_IPV6, IPV6_V6ONLY, reinterpret_cast< const char * >(&ipv6only),
-									 optlen)
-						== SOCKET_ERROR) {
-						log(QString("Failed to copy IPV6_V6ONLY socket attribute from tcp to udp socket"));
+			if (sock == INVALID_SOCKET) {
+				log("Failed to create UDP Socket");
+				bValid = false;
+				return;
+			} else {
+				if (addr.ss_family == AF_INET6) {
+					// Copy IPV6_V6ONLY attribute from tcp socket, it defaults to nonzero on Windows
+					// See https://msdn.microsoft.com/en-us/library/windows/desktop/ms738574%28v=vs.85%29.aspx
+					// This will fail for WindowsXP which is ok. Our TCP code will have split that up
+					// into two sockets.
+					int ipv6only     = 0;
+					socklen_t optlen = sizeof(ipv6only);
+					if (::getsockopt(tcpsock, IPPROTO_IPV6, IPV6_V6ONLY, reinterpret_cast< char * >(&ipv6only), &optlen)
+						== 0) {
+						if (::setsockopt(sock, IPPROTO_IPV6, IPV6_V6ONLY, reinterpret_cast< const char * >(&ipv6only),
+										 optlen)
+							== SOCKET_ERROR) {
+							log(QString("Failed to copy IPV6_V6ONLY socket attribute from tcp to udp socket"));
+						}
 					}
 				}
-			}
 
-			if (::bind(sock, reinterpret_cast< sockaddr * >(&addr), len) == SOCKET_ERROR) {
-				log(QString("Failed to bind UDP Socket to %1").arg(addressToString(ss->serverAddress(), usPort)));
-			} else {
-#ifdef Q_OS_UNIX
-				int val = 0xe0;
-				if (setsockopt(sock, IPPROTO_IP, IP_TOS, &val, sizeof(val))) {
-					val = 0x80;
-					if (setsockopt(sock, IPPROTO_IP, IP_TOS, &val, sizeof(val)))
-						log("Server: Failed to set TOS for UDP Socket");
+#ifdef Q_OS_LINUX
+				if (voiceThreads > 1) {
+					// Every voice thread gets its own socket bound to the same address. The kernel then
+					// distributes the clients among these sockets (based on a hash of their address).
+					int reuseport = 1;
+					if (setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &reuseport, sizeof(reuseport)))
+						log(QString("Failed to set SO_REUSEPORT for %1")
+								.arg(addressToString(ss->serverAddress(), usPort)));
 				}
+#endif
+				if (::bind(sock, reinterpret_cast< sockaddr * >(&addr), len) == SOCKET_ERROR) {
+					log(QString("Failed to bind UDP Socket to %1").arg(addressToString(ss->serverAddress(), usPort)));
+				} else {
+#ifdef Q_OS_UNIX
+					int val = 0xe0;
+					if (setsockopt(sock, IPPROTO_IP, IP_TOS, &val, sizeof(val))) {
+						val = 0x80;
+						if (setsockopt(sock, IPPROTO_IP, IP_TOS, &val, sizeof(val)))
+							log("Server: Failed to set TOS for UDP Socket");
+					}
 #	if defined(SO_PRIORITY)
-				socklen_t optlen = sizeof(val);
-				if (getsockopt(sock, SOL_SOCKET, SO_PRIORITY, &val, &optlen) == 0) {
-					if (val == 0) {
-						val = 6;
-						setsockopt(sock, SOL_SOCKET, SO_PRIORITY, &val, sizeof(val));
+					socklen_t optlen = sizeof(val);
+					if (getsockopt(sock, SOL_SOCKET, SO_PRIORITY, &val, &optlen) == 0) {
+						if (val == 0) {
+							val = 6;
+							setsockopt(sock, SOL_SOCKET, SO_PRIORITY, &val, sizeof(val));
+						}
 					}
-				}
 #	endif
 #endif
+				}
+				QSocketNotifier *qsn = new QSocketNotifier(sock, QSocketNotifier::Read, this);
+				connect(qsn, SIGNAL(activated(int)), this, SLOT(udpActivated(int)));
+				qlUdpSocket << sock;
+				qlUdpNotifier << qsn;
 			}
-			QSocketNotifier *qsn = new QSocketNotifier(sock, QSocketNotifier::Read, this);
-			connect(qsn, SIGNAL(activated(int)), this, SLOT(udpActivated(int)));
-			qlUdpSocket << sock;
-			qlUdpNotifier << qsn;
 		}
 	}
 
-	bValid = bValid && (qlServer.count() == qlBind.count()) && (qlUdpSocket.count() == qlBind.count());
+	bValid = bValid && (qlServer.count() == qlBind.count())
+			 && (qlUdpSocket.count() == qlBind.count() * static_cast< int >(voiceThreads));
 	if (!bValid)
 		return;
 
@@ -218,19 +243,52 @@ Server::Server(int snum, QObject *p) : QThread(p) {
 	hNotify = CreateEvent(nullptr, FALSE, FALSE, nullptr);
 #endif
 
+	// Distribute the UDP sockets among the voice threads, such that every voice thread polls one socket per
+	// bind address. The sockets have been created in groups of voiceThreads sockets per bind address.
+	for (unsigned int i = 1; i < voiceThreads; ++i) {
+		qlVoiceWorkers << new VoiceWorker(*this, i);
+	}
+	for (int i = 0; i < qlUdpSocket.count(); ++i) {
+		const unsigned int thread = static_cast< unsigned int >(i) % voiceThreads;
+
+		if (thread == 0) {
+			m_voiceContext.qlUdpSocket << qlUdpSocket.at(i);
+		} else {
+			qlVoiceWorkers.at(static_cast< int >(thread) - 1)->context.qlUdpSocket << qlUdpSocket.at(i);
+		}
+	}
+
 	connect(this, SIGNAL(tcpTransmit(QByteArray, unsigned int)), this, SLOT(tcpTransmitData(QByteArray, unsigned int)),
 			Qt::QueuedConnection);
 	connect(this, SIGNAL(reqSync(unsigned int)), this, SLOT(doSync(unsigned int)));
+	connect(&m_channelListenerManager, &ChannelListenerManager::listenersChanged, this,
+			&Server::channelListenersChanged);
+	connect(&m_channelListenerManager, &ChannelListenerManager::localVolumeAdjustmentsChanged, this,
+			&Server::channelListenersChanged);
 
 	for (int i = 1; i < iMaxUsers * 2; ++i)
 		qqIds.enqueue(i);
 
-	connect(qtTimeout, SIGNAL(timeout()), this, SLOT(checkTimeout()));
+	connect(m_userStateTimer, &QTimer::timeout, this, &Server::flushUserStates);
+
+	socketTime = bootTimer.restart();
 
 	getBans();
-	readChannels();
-	readLinks();
+	banTime = bootTimer.restart();
+
+	quint64 channelReadTime;
+	if (channelTree) {
+		channelReadTime = channelTree->readTime;
+		readChannels(*channelTree);
+	} else {
+		const ChannelTreeData tree = ServerDB::readChannelTree(iServerNum);
+		channelReadTime            = tree.readTime;
+		readChannels(tree);
+	}
+	channelTime = bootTimer.restart();
+
 	initializeCert();
+	certTime = bootTimer.restart();
 
 	if (bValid) {
 #ifdef USE_ZEROCONF
@@ -239,6 +297,22 @@ Server::Server(int snum, QObject *p) : QThread(p) {
 #endif
 		initRegister();
 	}
+
+	updatePingResponder();
+	m_pingRefreshTimer =
+		meta->timingWheel->schedulePeriodic(PING_REFRESH_INTERVAL, [this]() { refreshPingResponder(); });
+
+	log(QString("Booted in %1 ms (configuration %2 ms, sockets %3 ms, bans %4 ms, %5 channels %6 ms (reading %7 ms), "
+				"certificate %8 ms, registration %9 ms)")
+			.arg((configTime + socketTime + banTime + channelTime + certTime + bootTimer.elapsed()) / 1000)
+			.arg(configTime / 1000)
+			.arg(socketTime / 1000)
+			.arg(banTime / 1000)
+			.arg(qhChannels.count())
+			.arg(channelTime / 1000)
+			.arg(channelReadTime / 1000)
+			.arg(certTime / 1000)
+			.arg(bootTimer.elapsed() / 1000));
 }
 
 void Server::startThread() {
@@ -262,8 +336,6 @@ void Server::startThread() {
 		}
 #endif
 	}
-	if (!qtTimeout->isActive())
-		qtTimeout->start(15500);
 }
 
 void Server::stopThread() {
@@ -280,10 +352,22 @@ void Server::stopThread() {
 #endif
 		wait();
 
+#ifdef Q_OS_LINUX
+		std::uint64_t sentDatagrams = m_voiceContext.sendBatch.getSentDatagrams() + m_tcpSendBatch.getSentDatagrams();
+		std::uint64_t syscalls      = m_voiceContext.sendBatch.getSyscalls() + m_tcpSendBatch.getSyscalls();
+		foreach (VoiceWorker *worker, qlVoiceWorkers) {
+			sentDatagrams += worker->context.sendBatch.getSentDatagrams();
+			syscalls += worker->context.sendBatch.getSyscalls();
+		}
+		log(QString("Sent %1 audio datagrams using %2 sendmmsg calls (%3 syscalls saved)")
+				.arg(sentDatagrams)
+				.arg(syscalls)
+				.arg(sentDatagrams - syscalls));
+#endif
+
 		foreach (QSocketNotifier *qsn, qlUdpNotifier)
 			qsn->setEnabled(true);
 	}
-	qtTimeout->stop();
 }
 
 Server::~Server() {
@@ -293,6 +377,16 @@ Server::~Server() {
 
 	stopThread();
 
+	// The callbacks refer to this server and its users
+	foreach (ServerUser *u, qhUsers)
+		meta->timingWheel->cancel(u->m_timeoutTimer);
+	meta->timingWheel->cancel(m_banExpiryTimer);
+	meta->timingWheel->cancel(m_registerTimer);
+	meta->timingWheel->cancel(m_pingRefreshTimer);
+
+	foreach (VoiceWorker *worker, qlVoiceWorkers)
+		delete worker;
+
 	foreach (QSocketNotifier *qsn, qlUdpNotifier)
 		delete qsn;
 
@@ -313,6 +407,10 @@ Server::~Server() {
 	clearACLCache();
 
 	log("Stopped");
+
+	// A server that is started again reads its state from the database
+	ServerDB::flushLog();
+	ServerDB::writer->flush();
 }
 
 void Server::readParams() {
@@ -347,7 +445,12 @@ void Server::readParams() {
 	iMessageBurst                      = Meta::mp.iMessageBurst;
 	iPluginMessageLimit                = Meta::mp.iPluginMessageLimit;
 	iPluginMessageBurst                = Meta::mp.iPluginMessageBurst;
+	pingLimit                          = Meta::mp.pingLimit;
+	pingBurst                          = Meta::mp.pingBurst;
 	broadcastListenerVolumeAdjustments = Meta::mp.broadcastListenerVolumeAdjustments;
+	userStateTick                      = Meta::mp.userStateTick;
+	udpReceiveBatchSize                = Meta::mp.udpReceiveBatchSize;
+	voiceThreads                       = Meta::mp.voiceThreads;
 	m_suggestVersion                   = Meta::mp.m_suggestVersion;
 	qvSuggestPositional                = Meta::mp.qvSuggestPositional;
 	qvSuggestPushToTalk                = Meta::mp.qvSuggestPushToTalk;
@@ -464,8 +567,27 @@ void Server::readParams() {
 	if (iPluginMessageBurst < 1) { // Prevent disabling messages entirely
 		iPluginMessageBurst = 1;
 	}
+
+	pingLimit = getConf("pinglimit", pingLimit).toUInt();
+	pingBurst = getConf("pingburst", pingBurst).toUInt();
 	broadcastListenerVolumeAdjustments =
 		getConf("broadcastlistenervolumeadjustments", broadcastListenerVolumeAdjustments).toBool();
+
+	userStateTick = getConf("userstatetick", userStateTick).toUInt();
+
+	udpReceiveBatchSize = getConf("udpreceivebatchsize", udpReceiveBatchSize).toUInt();
+	if (udpReceiveBatchSize < 1) {
+		udpReceiveBatchSize = 1;
+	}
+
+	voiceThreads = getConf("voicethreads", voiceThreads).toUInt();
+	if (voiceThreads < 1) {
+		voiceThreads = 1;
+	}
+#ifndef Q_OS_LINUX
+	// Only Linux distributes the datagrams arriving at an address among all sockets bound to it
+	voiceThreads = 1;
+#endif
 }
 
 void Server::setLiveConf(const QString &key, const QString &value) {
@@ -473,9 +595,11 @@ void Server::setLiveConf(const QString &key, const QString &value) {
 	int i     = v.toInt();
 	if ((key == "password") || (key == "serverpassword"))
 		qsPassword = !v.isNull() ? v : Meta::mp.qsPassword;
-	else if (key == "timeout")
+	else if (key == "timeout") {
 		iTimeout = i ? i : Meta::mp.iTimeout;
-	else if (key == "bandwidth") {
+		foreach (ServerUser *u, qhUsers)
+			scheduleTimeout(u);
+	} else if (key == "bandwidth") {
 		int length = i ? i : Meta::mp.iMaxBandwidth;
 		if (length != iMaxBandwidth) {
 			iMaxBandwidth = length;
@@ -569,9 +693,10 @@ void Server::setLiveConf(const QString &key, const QString &value) {
 			removeZeroconf();
 		}
 #endif
-	} else if (key == "allowping")
+	} else if (key == "allowping") {
 		bAllowPing = !v.isNull() ? QVariant(v).toBool() : Meta::mp.bAllowPing;
-	else if (key == "allowrecording")
+		updatePingResponder();
+	} else if (key == "allowrecording")
 		allowRecording = !v.isNull() ? QVariant(v).toBool() : Meta::mp.allowRecording;
 	else if (key == "username")
 		qrUserName = !v.isNull() ? QRegExp(v) : Meta::mp.qrUserName;
@@ -599,9 +724,20 @@ void Server::setLiveConf(const QString &key, const QString &value) {
 		if (iMessageBurst < 1) {
 			iMessageBurst = 1;
 		}
+	} else if (key == "pinglimit") {
+		pingLimit = (!v.isNull()) ? v.toUInt() : Meta::mp.pingLimit;
+		updatePingResponder();
+	} else if (key == "pingburst") {
+		pingBurst = (!v.isNull()) ? v.toUInt() : Meta::mp.pingBurst;
+		updatePingResponder();
 	} else if (key == "broadcastlistenervolumeadjustments") {
 		broadcastListenerVolumeAdjustments =
 			(!v.isNull() ? QVariant(v).toBool() : Meta::mp.broadcastListenerVolumeAdjustments);
+	} else if (key == "userstatetick") {
+		userStateTick = (!v.isNull()) ? v.toUInt() : Meta::mp.userStateTick;
+		if (userStateTick == 0) {
+			flushUserStates();
+		}
 	}
 }
 
@@ -634,29 +770,37 @@ void Server::removeZeroconf() {
 
 gsl::span< const Mumble::Protocol::byte >
 	Server::handlePing(const Mumble::Protocol::UDPDecoder< Mumble::Protocol::Role::Server > &decoder,
-					   Mumble::Protocol::UDPPingEncoder< Mumble::Protocol::Role::Server > &encoder,
-					   bool expectExtended) {
+					   Mumble::Protocol::UDPPingEncoder< Mumble::Protocol::Role::Server > &encoder) {
+	// Connectivity pings are simply echoed back. Pings requesting the server's details are answered by the
+	// PingResponder.
 	Mumble::Protocol::PingData pingData = decoder.getPingData();
 
-	if (pingData.requestAdditionalInformation) {
-		pingData.requestAdditionalInformation = false;
-
-		pingData.serverVersion                 = Version::get();
-		pingData.userCount                     = qhUsers.size() - m_botCount;
-		pingData.maxUserCount                  = iMaxUsers;
-		pingData.maxBandwidthPerUser           = iMaxBandwidth;
-		pingData.containsAdditionalInformation = true;
-	} else if (expectExtended) {
-		// Return zero-length span
-		return {};
-	}
-
 	// Encode in the same protocol version that we decoded with
 	encoder.setProtocolVersion(decoder.getProtocolVersion());
 
 	return encoder.encodePingPacket(pingData);
 }
 
+void Server::updatePingResponder() {
+	m_pingResponder.update(bAllowPing, static_cast< unsigned int >(qhUsers.size() - m_botCount),
+						   static_cast< unsigned int >(iMaxUsers), static_cast< unsigned int >(iMaxBandwidth));
+	m_pingResponder.setRateLimit(pingLimit, pingBurst);
+}
+
+void Server::refreshPingResponder() {
+	updatePingResponder();
+
+	const quint64 answered = m_pingResponder.answeredPings();
+	const quint64 limited  = m_pingResponder.limitedPings();
+
+	// The responder is refreshed once per second, which makes these the rates per second
+	TracyPlot(TracyConstants::UDP_PINGS_ANSWERED, static_cast< int64_t >(answered - m_lastAnsweredPings));
+	TracyPlot(TracyConstants::UDP_PINGS_LIMITED, static_cast< int64_t >(limited - m_lastLimitedPings));
+
+	m_lastAnsweredPings = answered;
+	m_lastLimitedPings  = limited;
+}
+
 
 void Server::customEvent(QEvent *evt) {
 	if (evt->type() == EXEC_QEVENT)
@@ -664,9 +808,9 @@ void Server::customEvent(QEvent *evt) {
 }
 
 void Server::udpActivated(int socket) {
-	// At this part we are only expecting pings of clients we don't know yet -> thus we also don't know which protocol
-	// version they are using.
-	m_udpDecoder.setProtocolVersion(Version::UNKNOWN);
+	// At this part we are only expecting pings of clients we don't know yet.
+	// As the voice thread isn't running while the socket notifiers are enabled, we can borrow its decoder.
+	Mumble::Protocol::UDPDecoder< Mumble::Protocol::Role::Server > &decoder = m_voiceContext.decoder;
 
 	qint32 len;
 
@@ -676,8 +820,8 @@ void Server::udpActivated(int socket) {
 	struct msghdr msg;
 	struct iovec iov[1];
 
-	iov[0].iov_base = m_udpDecoder.getBuffer().data();
-	iov[0].iov_len  = m_udpDecoder.getBuffer().size();
+	iov[0].iov_base = decoder.getBuffer().data();
+	iov[0].iov_len  = decoder.getBuffer().size();
 
 	uint8_t controldata[CMSG_SPACE(std::max(sizeof(struct in6_pktinfo), sizeof(struct in_pktinfo)))];
 
@@ -694,40 +838,120 @@ void Server::udpActivated(int socket) {
 #	else
 	socklen_t fromlen = sizeof(from);
 	int &sock         = socket;
-	len = static_cast< qint32 >(::recvfrom(sock, m_udpDecoder.getBuffer().data(), m_udpDecoder.getBuffer().size(),
-										   MSG_TRUNC, reinterpret_cast< struct sockaddr * >(&from), &fromlen));
+	len = static_cast< qint32 >(::recvfrom(sock, decoder.getBuffer().data(), decoder.getBuffer().size(), MSG_TRUNC,
+										   reinterpret_cast< struct sockaddr * >(&from), &fromlen));
 #	endif
 #else
 	int fromlen = sizeof(from);
 	SOCKET sock = static_cast< SOCKET >(socket);
-	len = ::recvfrom(sock, reinterpret_cast< char * >(m_udpDecoder.getBuffer().data()), m_udpDecoder.getBuffer().size(),
-					 0, reinterpret_cast< struct sockaddr * >(&from), &fromlen);
+	len = ::recvfrom(sock, reinterpret_cast< char * >(decoder.getBuffer().data()), decoder.getBuffer().size(), 0,
+					 reinterpret_cast< struct sockaddr * >(&from), &fromlen);
 #endif
 
-	gsl::span< Mumble::Protocol::byte > inputData(&m_udpDecoder.getBuffer()[0], len);
+	gsl::span< Mumble::Protocol::byte > inputData(&decoder.getBuffer()[0], len);
 
-	if (bAllowPing && m_udpDecoder.decodePing(inputData)
-		&& m_udpDecoder.getMessageType() == Mumble::Protocol::UDPMessageType::Ping) {
-		gsl::span< const Mumble::Protocol::byte > encodedPing = handlePing(m_udpDecoder, m_udpPingEncoder, true);
+	CoarseClock::update();
 
-		if (!encodedPing.empty()) {
+	gsl::span< const Mumble::Protocol::byte > encodedPing;
+	if (m_pingResponder.respond(inputData, from, decoder, m_voiceContext.pingEncoder, encodedPing)
+		&& !encodedPing.empty()) {
 #ifdef Q_OS_LINUX
-			// There will be space for only one header, and the only data we have asked for is the incoming
-			// address. So we can reuse most of the same msg and control data.
-			iov[0].iov_len  = encodedPing.size();
-			iov[0].iov_base = const_cast< Mumble::Protocol::byte * >(encodedPing.data());
-			::sendmsg(sock, &msg, 0);
+		// There will be space for only one header, and the only data we have asked for is the incoming
+		// address. So we can reuse most of the same msg and control data.
+		iov[0].iov_len  = encodedPing.size();
+		iov[0].iov_base = const_cast< Mumble::Protocol::byte * >(encodedPing.data());
+		::sendmsg(sock, &msg, 0);
 #else
-			::sendto(sock, reinterpret_cast< const char * >(encodedPing.data()), encodedPing.size(), 0,
-					 reinterpret_cast< struct sockaddr * >(&from), fromlen);
+		::sendto(sock, reinterpret_cast< const char * >(encodedPing.data()), encodedPing.size(), 0,
+				 reinterpret_cast< struct sockaddr * >(&from), fromlen);
 #endif
-		}
 	}
 }
 
+/// Describes a single datagram that has been received on one of the voice sockets, including everything
+/// that is needed in order to send a reply back to where it came from.
+struct UDPDatagram {
+#ifdef Q_OS_UNIX
+	int sock;
+	socklen_t fromlen;
+#else
+	SOCKET sock;
+	int fromlen;
+#endif
+	sockaddr_storage *from;
+	unsigned char *data;
+	qint32 len;
+#ifdef Q_OS_LINUX
+	/// The header the datagram has been received with. It holds the local address the datagram has been sent
+	/// to, which makes sure that replies originate from that very same address.
+	struct msghdr *msg;
+#endif
+};
+
+#ifdef Q_OS_LINUX
+/// A preallocated slot used for receiving datagrams in batches (via recvmmsg)
+struct UDPReceiveSlot {
+	sockaddr_storage from;
+	struct iovec iov;
+	uint8_t controldata[CMSG_SPACE(std::max(sizeof(struct in6_pktinfo), sizeof(struct in_pktinfo)))];
+	// The data is received at an offset of 4 bytes (see Server::run)
+	alignas(8) unsigned char encbuff[Mumble::Protocol::MAX_UDP_PACKET_SIZE + 8];
+};
+#endif
+
+static void sendUDPReply(UDPDatagram &datagram, gsl::span< const Mumble::Protocol::byte > reply) {
+#ifdef Q_OS_LINUX
+	// There will be space for only one header, and the only data we have asked for is the incoming
+	// address. So we can reuse most of the same msg and control data.
+	// We are only reading from the buffer and thus the const_cast should be fine
+	datagram.msg->msg_iov[0].iov_base = const_cast< Mumble::Protocol::byte * >(reply.data());
+	datagram.msg->msg_iov[0].iov_len  = reply.size();
+	::sendmsg(datagram.sock, datagram.msg, 0);
+#else
+	::sendto(datagram.sock, reinterpret_cast< const char * >(reply.data()), reply.size(), 0,
+			 reinterpret_cast< struct sockaddr * >(datagram.from), datagram.fromlen);
+#endif
+}
+
+VoiceWorker::VoiceWorker(Server &server, unsigned int index) : QThread(&server), m_server(server), m_index(index) {
+}
+
+void VoiceWorker::run() {
+	tracy::SetThreadName(QString::fromLatin1("Audio %1").arg(m_index).toLatin1().constData());
+
+	m_server.runVoiceLoop(context);
+}
+
 void Server::run() {
 	tracy::SetThreadName("Audio");
 
+	foreach (VoiceWorker *worker, qlVoiceWorkers)
+		worker->start(QThread::HighestPriority);
+
+	runVoiceLoop(m_voiceContext);
+
+#ifdef Q_OS_UNIX
+	if (!qlVoiceWorkers.isEmpty()) {
+		// Usually we got here because stopThread() signalled us, which the additional voice threads see as
+		// well (the pipe is only drained below). But this thread may also have stopped due to an error, so
+		// make sure the other ones are told to stop in any case.
+		bRunning          = false;
+		unsigned char val = 0;
+		if (::write(aiNotify[1], &val, 1) != 1)
+			qCritical("Failed to signal voice threads");
+
+		foreach (VoiceWorker *worker, qlVoiceWorkers)
+			worker->wait();
+	}
+
+	// Drain pipe
+	unsigned char val;
+	while (::recv(aiNotify[0], &val, 1, MSG_DONTWAIT) == 1) {
+	};
+#endif
+}
+
+void Server::runVoiceLoop(VoiceThreadContext &context) {
 	qint32 len;
 #if defined(__LP64__)
 	unsigned char encbuff[Mumble::Protocol::MAX_UDP_PACKET_SIZE + 8];
@@ -738,14 +962,14 @@ void Server::run() {
 	unsigned char buffer[Mumble::Protocol::MAX_UDP_PACKET_SIZE];
 
 	sockaddr_storage from;
-	int nfds = qlUdpSocket.count();
+	int nfds = context.qlUdpSocket.count();
 
 #ifdef Q_OS_UNIX
 	socklen_t fromlen;
 	STACKVAR(struct pollfd, fds, nfds + 1);
 
 	for (int i = 0; i < nfds; ++i) {
-		fds[i].fd      = qlUdpSocket.at(i);
+		fds[i].fd      = context.qlUdpSocket.at(i);
 		fds[i].events  = POLLIN;
 		fds[i].revents = 0;
 	}
@@ -758,7 +982,7 @@ void Server::run() {
 	STACKVAR(SOCKET, fds, nfds);
 	STACKVAR(HANDLE, events, nfds + 1);
 	for (int i = 0; i < nfds; ++i) {
-		fds[i]    = qlUdpSocket.at(i);
+		fds[i]    = context.qlUdpSocket.at(i);
 		events[i] = CreateEvent(nullptr, FALSE, FALSE, nullptr);
 		::WSAEventSelect(fds[i], events[i], FD_READ);
 	}
@@ -767,6 +991,14 @@ void Server::run() {
 
 	++nfds;
 
+#ifdef Q_OS_LINUX
+	// The slots for batched receiving are allocated once per thread start. Each slot has room for a
+	// single datagram including its source address and the packet info of the local address it was sent to.
+	const unsigned int batchSize = udpReceiveBatchSize;
+	std::vector< UDPReceiveSlot > receiveSlots(batchSize > 1 ? batchSize : 0);
+	std::vector< struct mmsghdr > receiveHeaders(receiveSlots.size());
+#endif
+
 	while (bRunning) {
 		FrameMarkNamed(TracyConstants::UDP_FRAME);
 
@@ -781,13 +1013,13 @@ void Server::run() {
 		}
 
 		if (fds[nfds - 1].revents) {
-			// Drain pipe
-			unsigned char val;
-			while (::recv(aiNotify[0], &val, 1, MSG_DONTWAIT) == 1) {
-			};
+			// The pipe is drained in Server::run
 			break;
 		}
 
+		// Everything received in this wakeup is handled with the same time (see CoarseClock)
+		CoarseClock::update();
+
 		for (int i = 0; i < nfds - 1; ++i) {
 			if (fds[i].revents) {
 				if (fds[i].revents & (POLLHUP | POLLERR | POLLNVAL)) {
@@ -809,9 +1041,65 @@ void Server::run() {
 					bRunning = false;
 					break;
 				}
+				CoarseClock::update();
 				SOCKET sock = fds[ret - WAIT_OBJECT_0];
 #endif
 
+#ifdef Q_OS_LINUX
+				if (!receiveSlots.empty()) {
+					for (std::size_t j = 0; j < receiveSlots.size(); ++j) {
+						UDPReceiveSlot &slot = receiveSlots[j];
+						// Offset the buffer, such that the data following the 4 byte crypt header is 8 byte aligned
+						slot.iov.iov_base = slot.encbuff + 4;
+						slot.iov.iov_len  = Mumble::Protocol::MAX_UDP_PACKET_SIZE;
+
+						struct msghdr &hdr = receiveHeaders[j].msg_hdr;
+						memset(&hdr, 0, sizeof(hdr));
+						hdr.msg_name       = reinterpret_cast< struct sockaddr * >(&slot.from);
+						hdr.msg_namelen    = sizeof(slot.from);
+						hdr.msg_iov        = &slot.iov;
+						hdr.msg_iovlen     = 1;
+						hdr.msg_control    = slot.controldata;
+						hdr.msg_controllen = sizeof(slot.controldata);
+
+						receiveHeaders[j].msg_len = 0;
+					}
+
+					int received = ::recvmmsg(sock, receiveHeaders.data(), static_cast< unsigned int >(batchSize),
+											  MSG_DONTWAIT | MSG_TRUNC, nullptr);
+
+					if (received > 0) {
+						// Capture only the processing without the polling
+						ZoneScopedN(TracyConstants::UDP_PACKET_PROCESSING_ZONE);
+						ZoneValue(static_cast< uint64_t >(received));
+						TracyPlot(TracyConstants::UDP_PACKETS_PER_WAKEUP, static_cast< int64_t >(received));
+
+						for (int j = 0; j < received; ++j) {
+							UDPReceiveSlot &slot = receiveSlots[j];
+
+							UDPDatagram datagram;
+							datagram.sock    = sock;
+							datagram.fromlen = receiveHeaders[j].msg_hdr.msg_namelen;
+							datagram.from    = &slot.from;
+							datagram.data    = slot.encbuff + 4;
+							datagram.len     = static_cast< qint32 >(receiveHeaders[j].msg_len);
+							datagram.msg     = &receiveHeaders[j].msg_hdr;
+
+							if (datagram.len < 5
+								|| static_cast< unsigned int >(datagram.len) > Mumble::Protocol::MAX_UDP_PACKET_SIZE) {
+								// 4 bytes crypt header + type + session or truncated datagram
+								continue;
+							}
+
+							processUDPDatagram(datagram, buffer, context);
+						}
+					}
+
+					fds[i].revents = 0;
+					continue;
+				}
+#endif
+
 				fromlen = sizeof(from);
 #ifdef Q_OS_WIN
 				len = ::recvfrom(sock, reinterpret_cast< char * >(encrypt), Mumble::Protocol::MAX_UDP_PACKET_SIZE, 0,
@@ -835,7 +1123,6 @@ void Server::run() {
 				msg.msg_controllen = sizeof(controldata);
 
 				len = static_cast< quint32 >(::recvmsg(sock, &msg, MSG_TRUNC));
-				Q_UNUSED(fromlen);
 #	else
 				len = static_cast< qint32 >(::recvfrom(sock, encrypt, Mumble::Protocol::MAX_UDP_PACKET_SIZE, MSG_TRUNC,
 													   reinterpret_cast< struct sockaddr * >(&from), &fromlen));
@@ -859,136 +1146,188 @@ void Server::run() {
 					continue;
 				}
 
-				QReadLocker rl(&qrwlVoiceThread);
+				UDPDatagram datagram;
+				datagram.sock    = sock;
+				datagram.fromlen = fromlen;
+				datagram.from    = &from;
+				datagram.data    = encrypt;
+				datagram.len     = len;
+#ifdef Q_OS_LINUX
+				datagram.msg = &msg;
+#endif
 
-				quint16 port = (from.ss_family == AF_INET6) ? (reinterpret_cast< sockaddr_in6 * >(&from)->sin6_port)
-															: (reinterpret_cast< sockaddr_in * >(&from)->sin_port);
-				const HostAddress &ha = HostAddress(from);
+				processUDPDatagram(datagram, buffer, context);
+#ifdef Q_OS_UNIX
+				fds[i].revents = 0;
+#endif
+			}
+		}
+	}
+#ifdef Q_OS_WIN
+	for (int i = 0; i < nfds - 1; ++i) {
+		::WSAEventSelect(fds[i], nullptr, 0);
+		CloseHandle(events[i]);
+	}
+#endif
+}
 
-				const QPair< HostAddress, quint16 > &key = QPair< HostAddress, quint16 >(ha, port);
+void Server::processUDPDatagram(UDPDatagram &datagram, unsigned char *buffer, VoiceThreadContext &context) {
+	unsigned char *encrypt = datagram.data;
+	qint32 len             = datagram.len;
+	sockaddr_storage &from = *datagram.from;
 
-				ServerUser *u = qhPeerUsers.value(key);
+	// This may be a general ping requesting server details, unencrypted. These are answered right away, without
+	// looking at (and locking) anything else.
+	gsl::span< const Mumble::Protocol::byte > pingReply;
+	if (m_pingResponder.respond(gsl::span< const Mumble::Protocol::byte >(encrypt, len), from, context.decoder,
+								context.pingEncoder, pingReply)) {
+		ZoneScopedN(TracyConstants::PING_PROCESSING_ZONE);
 
-				if (u) {
-					m_udpDecoder.setProtocolVersion(u->m_version);
-				} else {
-					m_udpDecoder.setProtocolVersion(Version::UNKNOWN);
-				}
-				// This may be a general ping requesting server details, unencrypted.
-				if (bAllowPing && m_udpDecoder.decodePing(gsl::span< Mumble::Protocol::byte >(encrypt, len))
-					&& m_udpDecoder.getMessageType() == Mumble::Protocol::UDPMessageType::Ping) {
-					ZoneScopedN(TracyConstants::PING_PROCESSING_ZONE);
+		if (!pingReply.empty()) {
+			sendUDPReply(datagram, pingReply);
+		}
 
-					gsl::span< const Mumble::Protocol::byte > encodedPing =
-						handlePing(m_udpDecoder, m_udpPingEncoder, true);
+		return;
+	}
 
-					if (!encodedPing.empty()) {
-#ifdef Q_OS_LINUX
-						// We are only reading from the buffer and thus the const_cast should be fine
-						iov[0].iov_base = const_cast< Mumble::Protocol::byte * >(encodedPing.data());
-						iov[0].iov_len  = encodedPing.size();
-						::sendmsg(sock, &msg, 0);
-#else
-						::sendto(sock, reinterpret_cast< const char * >(encodedPing.data()), encodedPing.size(), 0,
-								 reinterpret_cast< struct sockaddr * >(&from), fromlen);
-#endif
-					}
+	// The peer table is lock-free, so the sender can be looked up before taking the lock
+	const PeerKey key(from);
+	unsigned int session = 0;
+	const bool knownPeer = m_peerTable.find(key, session);
+
+	QReadLocker rl(&qrwlVoiceThread);
+
+	const HostAddress &ha = HostAddress(from);
+
+	ServerUser *u = knownPeer ? qhUsers.value(session) : nullptr;
+	if (u && PeerKey(u->saiUdpAddress) != key) {
+		// The user has disconnected after the lookup and the session has been reused in the meantime
+		u = nullptr;
+	}
+
+	if (u) {
+		context.decoder.setProtocolVersion(u->m_version);
+	} else {
+		context.decoder.setProtocolVersion(Version::UNKNOWN);
+	}
+
+
+	// Clients supporting connection tokens prefix their datagrams with them
+	constexpr qint32 tokenSize = static_cast< qint32 >(Mumble::Protocol::UDP_CONNECTION_TOKEN_SIZE);
+	const quint32 token        = (len >= tokenSize + 5) ? qFromBigEndian< quint32 >(encrypt) : 0;
+
+	if (u) {
+		if (token != 0 && token == u->uiUdpConnectionToken
+			&& checkDecrypt(u, encrypt + tokenSize, buffer, len - tokenSize)) {
+			len -= tokenSize;
+		} else if (u->bUdpConnectionTokenAcked || !checkDecrypt(u, encrypt, buffer, len)) {
+			// A client that acknowledged its token always sends it. Before that, the datagram may also have been
+			// sent without one.
+			return;
+		}
+	} else {
+		ZoneScopedN(TracyConstants::DECRYPT_UNKNOWN_PEER_ZONE);
 
+		// Unknown peer
+		ServerUser *candidate = nullptr;
+
+		// If the datagram carries a connection token, we know right away whom it belongs to. As with trial
+		// decryption, the datagram has to originate from the same host as the user's TCP connection.
+		ServerUser *tokenUser = token != 0 ? qhTokenUsers.value(token) : nullptr;
+		if (tokenUser && tokenUser->haAddress == ha
+			&& checkDecrypt(tokenUser, encrypt + tokenSize, buffer, len - tokenSize)) {
+			candidate = tokenUser;
+			len -= tokenSize;
+		}
+
+		// Otherwise fall back to trying the keys of all legacy clients on that host
+		if (!candidate) {
+			foreach (ServerUser *usr, qhHostUsers.value(ha)) {
+				if (usr->bUdpConnectionTokenAcked) {
 					continue;
 				}
 
+				if (checkDecrypt(usr, encrypt, buffer, len)) { // checkDecrypt takes the User's qmDecrypt lock.
+					candidate = usr;
+					break;
+				}
+			}
+		}
 
-				if (u) {
-					if (!checkDecrypt(u, encrypt, buffer, len)) {
-						continue;
-					}
-				} else {
-					ZoneScopedN(TracyConstants::DECRYPT_UNKNOWN_PEER_ZONE);
-
-					// Unknown peer
-					foreach (ServerUser *usr, qhHostUsers.value(ha)) {
-						if (checkDecrypt(usr, encrypt, buffer, len)) { // checkDecrypt takes the User's qrwlCrypt lock.
-							// Every time we relock, reverify users' existence.
-							// The main thread might delete the user while the lock isn't held.
-							unsigned int uiSession = usr->uiSession;
-							rl.unlock();
-							qrwlVoiceThread.lockForWrite();
-							if (qhUsers.contains(uiSession)) {
-								u             = usr;
-								u->sUdpSocket = sock;
-								memcpy(&u->saiUdpAddress, &from, sizeof(from));
-								qhHostUsers[from].remove(u);
-								qhPeerUsers.insert(key, u);
-							}
-							qrwlVoiceThread.unlock();
-							rl.relock();
-							if (u && !qhUsers.contains(uiSession))
-								u = nullptr;
-							break;
-						}
-					}
-					if (!u) {
-						continue;
-					}
+		if (!candidate) {
+			return;
+		}
+
+		// Every time we relock, reverify users' existence.
+		// The main thread might delete the user while the lock isn't held.
+		unsigned int uiSession = candidate->uiSession;
+		rl.unlock();
+		qrwlVoiceThread.lockForWrite();
+		if (qhUsers.contains(uiSession)) {
+			u             = candidate;
+			u->sUdpSocket = datagram.sock;
+			memcpy(&u->saiUdpAddress, &from, sizeof(from));
+			qhHostUsers[from].remove(u);
+			m_peerTable.insert(key, uiSession);
+		}
+		qrwlVoiceThread.unlock();
+		rl.relock();
+		if (u && !qhUsers.contains(uiSession))
+			u = nullptr;
+		if (!u) {
+			return;
+		}
+	}
+	len -= 4;
+
+	if (context.decoder.decode(gsl::span< Mumble::Protocol::byte >(buffer, len))) {
+		switch (context.decoder.getMessageType()) {
+			case Mumble::Protocol::UDPMessageType::Audio: {
+				Mumble::Protocol::AudioData audioData = context.decoder.getAudioData();
+
+				// Allow all voice packets through by default.
+				bool ok = true;
+				// ...Unless we're in Opus mode. In Opus mode, only Opus packets are allowed.
+				if (bOpus && audioData.usedCodec != Mumble::Protocol::AudioCodec::Opus) {
+					ok = false;
 				}
-				len -= 4;
-
-				if (m_udpDecoder.decode(gsl::span< Mumble::Protocol::byte >(buffer, len))) {
-					switch (m_udpDecoder.getMessageType()) {
-						case Mumble::Protocol::UDPMessageType::Audio: {
-							Mumble::Protocol::AudioData audioData = m_udpDecoder.getAudioData();
-
-							// Allow all voice packets through by default.
-							bool ok = true;
-							// ...Unless we're in Opus mode. In Opus mode, only Opus packets are allowed.
-							if (bOpus && audioData.usedCodec != Mumble::Protocol::AudioCodec::Opus) {
-								ok = false;
-							}
 
-							if (ok) {
-								u->aiUdpFlag = 1;
+				if (ok) {
+					u->aiUdpFlag = 1;
 
-								// Add session id
-								audioData.senderSession = u->uiSession;
+					// Add session id
+					audioData.senderSession = u->uiSession;
 
-								processMsg(u, audioData, m_udpAudioReceivers, m_udpAudioEncoder);
-							}
-							break;
-						}
-						case Mumble::Protocol::UDPMessageType::Ping: {
-							ZoneScopedN(TracyConstants::UDP_PING_PROCESSING_ZONE);
+#ifdef Q_OS_LINUX
+					processMsg(u, audioData, context.audioReceivers, context.audioEncoder, &context.sendBatch);
+#else
+					processMsg(u, audioData, context.audioReceivers, context.audioEncoder, nullptr);
+#endif
+				}
+				break;
+			}
+			case Mumble::Protocol::UDPMessageType::Ping: {
+				ZoneScopedN(TracyConstants::UDP_PING_PROCESSING_ZONE);
 
-							Mumble::Protocol::PingData pingData = m_udpDecoder.getPingData();
-							if (!pingData.requestAdditionalInformation && !pingData.containsAdditionalInformation) {
-								// At this point here, we only want to handle connectivity pings
-								gsl::span< const Mumble::Protocol::byte > encodedPing =
-									handlePing(m_udpDecoder, m_udpPingEncoder, false);
+				Mumble::Protocol::PingData pingData = context.decoder.getPingData();
+				if (!pingData.requestAdditionalInformation && !pingData.containsAdditionalInformation) {
+					// At this point here, we only want to handle connectivity pings
+					gsl::span< const Mumble::Protocol::byte > encodedPing =
+						handlePing(context.decoder, context.pingEncoder);
 
-								QByteArray cache;
-								sendMessage(*u, encodedPing.data(), encodedPing.size(), cache, true);
-							}
-							break;
-						}
-					}
+					QByteArray cache;
+					sendMessage(*u, encodedPing.data(), encodedPing.size(), cache, true);
 				}
-#ifdef Q_OS_UNIX
-				fds[i].revents = 0;
-#endif
+				break;
 			}
 		}
 	}
-#ifdef Q_OS_WIN
-	for (int i = 0; i < nfds - 1; ++i) {
-		::WSAEventSelect(fds[i], nullptr, 0);
-		CloseHandle(events[i]);
-	}
-#endif
 }
 
 bool Server::checkDecrypt(ServerUser *u, const unsigned char *encrypt, unsigned char *plain, unsigned int len) {
 	ZoneScoped;
 
-	QMutexLocker l(&u->qmCrypt);
+	QMutexLocker l(&u->qmDecrypt);
 
 	if (u->csCrypt->isValid() && u->csCrypt->decrypt(encrypt, plain, len)) {
 		return true;
@@ -1003,7 +1342,8 @@ bool Server::checkDecrypt(ServerUser *u, const unsigned char *encrypt, unsigned
 	return false;
 }
 
-void Server::sendMessage(ServerUser &u, const unsigned char *data, int len, QByteArray &cache, bool force) {
+void Server::sendMessage(ServerUser &u, const unsigned char *data, int len, QByteArray &cache, bool force,
+						 UDPSendBatch *sendBatch) {
 	ZoneScoped;
 
 #if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
@@ -1012,23 +1352,35 @@ void Server::sendMessage(ServerUser &u, const unsigned char *data, int len, QByt
 	// Qt 5.14 introduced QAtomicInteger::loadRelaxed() which deprecates QAtomicInteger::load()
 	if ((u.aiUdpFlag.load() == 1 || force) && (u.sUdpSocket != INVALID_SOCKET)) {
 #endif
+#ifdef Q_OS_LINUX
+		if (sendBatch) {
+			// Encrypt right into the batch's buffer and let the batch send it together with the
+			// datagrams for the other receivers of this packet.
+			unsigned char *buffer = sendBatch->nextBuffer();
+			if (!u.csCrypt->isValid() || !u.csCrypt->encrypt(data, buffer, static_cast< unsigned int >(len))) {
+				return;
+			}
+
+			sendBatch->commit(u.sUdpSocket, u.saiUdpAddress, HostAddress(u.saiTcpLocalAddress),
+							  static_cast< std::size_t >(len + 4));
+			return;
+		}
+#else
+		Q_UNUSED(sendBatch);
+#endif
 #if defined(__LP64__)
 		STACKVAR(char, ebuffer, len + 4 + 16);
 		char *buffer = reinterpret_cast< char * >(((reinterpret_cast< quint64 >(ebuffer) + 8) & ~7) + 4);
 #else
 		STACKVAR(char, buffer, len + 4);
 #endif
-		{
-			QMutexLocker wl(&u.qmCrypt);
-
-			if (!u.csCrypt->isValid()) {
-				return;
-			}
+		if (!u.csCrypt->isValid()) {
+			return;
+		}
 
-			if (!u.csCrypt->encrypt(reinterpret_cast< const unsigned char * >(data),
-									reinterpret_cast< unsigned char * >(buffer), len)) {
-				return;
-			}
+		if (!u.csCrypt->encrypt(reinterpret_cast< const unsigned char * >(data),
+								reinterpret_cast< unsigned char * >(buffer), len)) {
+			return;
 		}
 #ifdef Q_OS_WIN
 		DWORD dwFlow = 0;
@@ -1094,10 +1446,8 @@ void Server::sendMessage(ServerUser &u, const unsigned char *data, int len, QByt
 	}
 }
 
-void Server::addListener(QHash< ServerUser *, VolumeAdjustment > &listeners, ServerUser &user, const Channel &channel) {
-	const VolumeAdjustment &volumeAdjustment =
-		m_channelListenerManager.getListenerVolumeAdjustment(user.uiSession, channel.iId);
-
+void Server::addListener(QHash< ServerUser *, VolumeAdjustment > &listeners, ServerUser &user,
+						 const VolumeAdjustment &volumeAdjustment) {
 	auto it = listeners.find(&user);
 
 	if (it == listeners.end() || it->factor < volumeAdjustment.factor) {
@@ -1105,198 +1455,376 @@ void Server::addListener(QHash< ServerUser *, VolumeAdjustment > &listeners, Ser
 	}
 }
 
-void Server::processMsg(ServerUser *u, Mumble::Protocol::AudioData audioData, AudioReceiverBuffer &buffer,
-						Mumble::Protocol::UDPAudioEncoder< Mumble::Protocol::Role::Server > &encoder) {
-	ZoneScoped;
-
-	// Note that in this function we never have to acquire a read-lock on qrwlVoiceThread
-	// as all places that call this function will hold that lock at the point of calling
-	// this function.
-	// This function is currently called from Server::msgUDPTunnel, Server::run and
-	// Server::message
-	if (u->sState != ServerUser::Authenticated || u->bMute || u->bSuppress || u->bSelfMute)
-		return;
-
-	// Check the voice data rate limit.
-	{
-		BandwidthRecord *bw = &u->bwr;
-
-		// IP + UDP + Crypt + Data
-		const int packetsize = 20 + 8 + 4 + audioData.payload.size();
-
-		if (!bw->addFrame(packetsize, iMaxBandwidth / 8)) {
-			// Suppress packet.
-			return;
-		}
-	}
-
-	buffer.clear();
+std::shared_ptr< const WhisperTargetCache > Server::buildWhisperTargetCache(ServerUser *u, const WhisperTarget &wt) {
+	ZoneScopedN(TracyConstants::AUDIO_WHISPER_CACHE_CREATE);
 
-	if (audioData.targetOrContext == Mumble::Protocol::ReservedTargetIDs::SERVER_LOOPBACK) {
-		buffer.forceAddReceiver(*u, Mumble::Protocol::AudioContext::NORMAL, audioData.containsPositionalData);
-	} else if (audioData.targetOrContext == Mumble::Protocol::ReservedTargetIDs::REGULAR_SPEECH) {
-		Channel *c = u->cChannel;
+	auto cache = std::make_shared< WhisperTargetCache >();
 
-		// Send audio to all users that are listening to the channel
-		foreach (unsigned int currentSession, m_channelListenerManager.getListenersForChannel(c->iId)) {
-			ServerUser *pDst = static_cast< ServerUser * >(qhUsers.value(currentSession));
-			if (pDst) {
-				buffer.addReceiver(*u, *pDst, Mumble::Protocol::AudioContext::LISTEN, audioData.containsPositionalData,
-								   m_channelListenerManager.getListenerVolumeAdjustment(pDst->uiSession, c->iId));
-			}
-		}
+	QSet< ServerUser * > channel;
+	QSet< ServerUser * > direct;
+	QHash< ServerUser *, VolumeAdjustment > cachedListeners;
 
-		// Send audio to all users in the same channel
-		for (User *p : c->qlUsers) {
-			ServerUser *pDst = static_cast< ServerUser * >(p);
+	if (!wt.qlChannels.isEmpty()) {
+		QMutexLocker qml(&qmCache);
 
-			buffer.addReceiver(*u, *pDst, Mumble::Protocol::AudioContext::NORMAL, audioData.containsPositionalData);
-		}
+		foreach (const WhisperTarget::Channel &wtc, wt.qlChannels) {
+			Channel *wc = qhChannels.value(wtc.iId);
+			if (wc) {
+				bool link       = wtc.bLinks && !wc->qhLinks.isEmpty();
+				bool dochildren = wtc.bChildren && !wc->qlChannels.isEmpty();
+				bool group      = !wtc.qsGroup.isEmpty();
+
+				cache->channels.push_back(wc->iId);
+				if (link) {
+					for (Channel *l : wc->allLinks()) {
+						cache->channels.push_back(l->iId);
+					}
+				}
+				// Channels added to the subtree later on are part of the target as well
+				if (wtc.bChildren) {
+					cache->subtrees.push_back(wc->iId);
+				}
+				cache->usesGroups = cache->usesGroups || group;
 
-		// Send audio to all linked channels the user has speak-permission
-		if (!c->qhLinks.isEmpty()) {
-			QSet< Channel * > chans = c->allLinks();
-			chans.remove(c);
+				if (!link && !dochildren && !group) {
+					// Common case
+					if (ChanACL::hasPermission(u, wc, ChanACL::Whisper, &acCache)) {
+						foreach (User *p, wc->qlUsers) { channel.insert(static_cast< ServerUser * >(p)); }
 
-			QMutexLocker qml(&qmCache);
+						const std::shared_ptr< const ChannelListenerManager::ListenerList > listeners =
+							m_channelListenerManager.getListenerEntries(wc->iId);
+						for (const ChannelListenerManager::ListenerEntry &listener : *listeners) {
+							ServerUser *pDst = qhUsers.value(listener.userSession);
 
-			for (Channel *l : chans) {
-				if (ChanACL::hasPermission(u, l, ChanACL::Speak, &acCache)) {
-					// Send the audio stream to all users that are listening to the linked channel
-					for (unsigned int currentSession : m_channelListenerManager.getListenersForChannel(l->iId)) {
-						ServerUser *pDst = static_cast< ServerUser * >(qhUsers.value(currentSession));
-						if (pDst) {
-							buffer.addReceiver(
-								*u, *pDst, Mumble::Protocol::AudioContext::LISTEN, audioData.containsPositionalData,
-								m_channelListenerManager.getListenerVolumeAdjustment(pDst->uiSession, l->iId));
+							if (pDst) {
+								addListener(cachedListeners, *pDst, listener.volumeAdjustment);
+							}
 						}
 					}
+				} else {
+					QSet< Channel * > channels;
+					if (link)
+						channels = wc->allLinks();
+					else
+						channels.insert(wc);
+					if (dochildren)
+						channels.unite(wc->allChildren());
+					const QString &redirect = u->qmWhisperRedirect.value(wtc.qsGroup);
+					const QString &qsg      = redirect.isEmpty() ? wtc.qsGroup : redirect;
+					foreach (Channel *tc, channels) {
+						if (ChanACL::hasPermission(u, tc, ChanACL::Whisper, &acCache)) {
+							foreach (User *p, tc->qlUsers) {
+								ServerUser *su = static_cast< ServerUser * >(p);
+
+								if (!group || Group::appliesToUser(*tc, *tc, qsg, *su)) {
+									channel.insert(su);
+								}
+							}
 
-					// Send audio to users in the linked channel
-					for (User *p : l->qlUsers) {
-						ServerUser *pDst = static_cast< ServerUser * >(p);
-
-						buffer.addReceiver(*u, *pDst, Mumble::Protocol::AudioContext::NORMAL,
-										   audioData.containsPositionalData);
+							const std::shared_ptr< const ChannelListenerManager::ListenerList > listeners =
+								m_channelListenerManager.getListenerEntries(tc->iId);
+							for (const ChannelListenerManager::ListenerEntry &listener : *listeners) {
+								ServerUser *pDst = qhUsers.value(listener.userSession);
+
+								if (pDst && (!group || Group::appliesToUser(*tc, *tc, qsg, *pDst))) {
+									// Only send audio to listener if the user exists and it is in the group the
+									// speech is directed at (if any)
+									addListener(cachedListeners, *pDst, listener.volumeAdjustment);
+								}
+							}
+						}
 					}
 				}
 			}
 		}
-	} else if (u->qmTargets.contains(audioData.targetOrContext)) { // Whisper/Shout
-		QSet< ServerUser * > channel;
-		QSet< ServerUser * > direct;
-		QHash< ServerUser *, VolumeAdjustment > cachedListeners;
+	}
 
-		if (u->qmTargetCache.contains(audioData.targetOrContext)) {
-			ZoneScopedN(TracyConstants::AUDIO_WHISPER_CACHE_STORE);
+	{
+		QMutexLocker qml(&qmCache);
+
+		foreach (unsigned int id, wt.qlSessions) {
+			ServerUser *pDst = qhUsers.value(id);
+			if (!pDst)
+				continue;
+
+			cache->channels.push_back(pDst->cChannel->iId);
+			if (ChanACL::hasPermission(u, pDst->cChannel, ChanACL::Whisper, &acCache) && !channel.contains(pDst))
+				direct.insert(pDst);
+		}
+	}
+
+	std::sort(cache->channels.begin(), cache->channels.end());
+	cache->channels.erase(std::unique(cache->channels.begin(), cache->channels.end()), cache->channels.end());
+	std::sort(cache->subtrees.begin(), cache->subtrees.end());
+
+	std::vector< AudioRoute > &receivers = cache->receivers;
+	receivers.reserve(static_cast< std::size_t >(channel.size() + direct.size() + cachedListeners.size()));
+
+	// These users receive the audio because someone is shouting to their channel
+	for (ServerUser *pDst : channel) {
+		receivers.push_back({ pDst, Mumble::Protocol::AudioContext::SHOUT, VolumeAdjustment::fromFactor(1.0f) });
+	}
+	// These users receive audio because someone is whispering to them
+	for (ServerUser *pDst : direct) {
+		receivers.push_back({ pDst, Mumble::Protocol::AudioContext::WHISPER, VolumeAdjustment::fromFactor(1.0f) });
+	}
+	// These users receive audio because someone is sending audio to one of their listeners
+	for (auto it = cachedListeners.cbegin(); it != cachedListeners.cend(); ++it) {
+		receivers.push_back({ it.key(), Mumble::Protocol::AudioContext::LISTEN, it.value() });
+	}
 
-			const WhisperTargetCache &cache = u->qmTargetCache.value(audioData.targetOrContext);
-			channel                         = cache.channelTargets;
-			direct                          = cache.directTargets;
-			cachedListeners                 = cache.listeningTargets;
+	// Merge the entries of users that are reached in several ways the same way AudioReceiverBuffer would: the
+	// smallest context and the largest volume adjustment win.
+	std::sort(receivers.begin(), receivers.end(), [](const AudioRoute &lhs, const AudioRoute &rhs) {
+		return lhs.receiver->uiSession < rhs.receiver->uiSession;
+	});
+
+	std::size_t merged = 0;
+	for (std::size_t i = 0; i < receivers.size(); ++i) {
+		if (merged > 0 && receivers[merged - 1].receiver == receivers[i].receiver) {
+			AudioRoute &route = receivers[merged - 1];
+
+			route.context = std::min(route.context, receivers[i].context);
+			if (route.volumeAdjustment.factor < receivers[i].volumeAdjustment.factor) {
+				route.volumeAdjustment = receivers[i].volumeAdjustment;
+			}
 		} else {
-			ZoneScopedN(TracyConstants::AUDIO_WHISPER_CACHE_CREATE);
-
-			const WhisperTarget &wt = u->qmTargets.value(audioData.targetOrContext);
-			if (!wt.qlChannels.isEmpty()) {
-				QMutexLocker qml(&qmCache);
-
-				foreach (const WhisperTarget::Channel &wtc, wt.qlChannels) {
-					Channel *wc = qhChannels.value(wtc.iId);
-					if (wc) {
-						bool link       = wtc.bLinks && !wc->qhLinks.isEmpty();
-						bool dochildren = wtc.bChildren && !wc->qlChannels.isEmpty();
-						bool group      = !wtc.qsGroup.isEmpty();
-						if (!link && !dochildren && !group) {
-							// Common case
-							if (ChanACL::hasPermission(u, wc, ChanACL::Whisper, &acCache)) {
-								foreach (User *p, wc->qlUsers) { channel.insert(static_cast< ServerUser * >(p)); }
-
-								foreach (unsigned int currentSession,
-										 m_channelListenerManager.getListenersForChannel(wc->iId)) {
-									ServerUser *pDst = static_cast< ServerUser * >(qhUsers.value(currentSession));
-
-									if (pDst) {
-										addListener(cachedListeners, *pDst, *wc);
-									}
-								}
-							}
-						} else {
-							QSet< Channel * > channels;
-							if (link)
-								channels = wc->allLinks();
-							else
-								channels.insert(wc);
-							if (dochildren)
-								channels.unite(wc->allChildren());
-							const QString &redirect = u->qmWhisperRedirect.value(wtc.qsGroup);
-							const QString &qsg      = redirect.isEmpty() ? wtc.qsGroup : redirect;
-							foreach (Channel *tc, channels) {
-								if (ChanACL::hasPermission(u, tc, ChanACL::Whisper, &acCache)) {
-									foreach (User *p, tc->qlUsers) {
-										ServerUser *su = static_cast< ServerUser * >(p);
-
-										if (!group || Group::appliesToUser(*tc, *tc, qsg, *su)) {
-											channel.insert(su);
-										}
-									}
-
-									foreach (unsigned int currentSession,
-											 m_channelListenerManager.getListenersForChannel(tc->iId)) {
-										ServerUser *pDst = static_cast< ServerUser * >(qhUsers.value(currentSession));
-
-										if (pDst && (!group || Group::appliesToUser(*tc, *tc, qsg, *pDst))) {
-											// Only send audio to listener if the user exists and it is in the group the
-											// speech is directed at (if any)
-											addListener(cachedListeners, *pDst, *tc);
-										}
-									}
-								}
-							}
-						}
-					}
+			receivers[merged++] = receivers[i];
+		}
+	}
+	receivers.erase(receivers.begin() + static_cast< std::ptrdiff_t >(merged), receivers.end());
+
+	return cache;
+}
+
+void Server::buildRoutingTable(Channel *c, ServerUser *speaker, ChannelRoutingTable &table) {
+	ZoneScoped;
+
+	auto addChannel = [&](const Channel &channel) {
+		// Users that are listening to the channel, along with their volume adjustments in a single pass
+		const std::shared_ptr< const ChannelListenerManager::ListenerList > listeners =
+			m_channelListenerManager.getListenerEntries(channel.iId);
+		for (const ChannelListenerManager::ListenerEntry &listener : *listeners) {
+			ServerUser *pDst = qhUsers.value(listener.userSession);
+			if (pDst) {
+				table.routes.push_back({ pDst, Mumble::Protocol::AudioContext::LISTEN, listener.volumeAdjustment });
+			}
+		}
+
+		// Users in the channel
+		for (User *p : channel.qlUsers) {
+			table.routes.push_back({ static_cast< ServerUser * >(p), Mumble::Protocol::AudioContext::NORMAL,
+									 VolumeAdjustment::fromFactor(1.0f) });
+		}
+	};
+
+	addChannel(*c);
+	const ChannelRoutingTable::Range ownRange(0, table.routes.size());
+
+	// Linked channels are only reached by those speakers that have speak-permission in them
+	std::vector< std::pair< Channel *, ChannelRoutingTable::Range > > linkedRanges;
+	if (!c->qhLinks.isEmpty()) {
+		QSet< Channel * > chans = c->allLinks();
+		chans.remove(c);
+
+		for (Channel *l : chans) {
+			const std::size_t begin = table.routes.size();
+			addChannel(*l);
+			linkedRanges.emplace_back(l, ChannelRoutingTable::Range(begin, table.routes.size()));
+		}
+	}
+
+	QList< User * > speakers = c->qlUsers;
+	if (!speakers.contains(speaker)) {
+		speakers.append(speaker);
+	}
+
+	QMutexLocker qml(&qmCache);
+
+	for (User *p : speakers) {
+		std::vector< ChannelRoutingTable::Range > &ranges = table.speakerRanges[p->uiSession];
+		ranges.push_back(ownRange);
+
+		for (const auto &linked : linkedRanges) {
+			if (ChanACL::hasPermission(static_cast< ServerUser * >(p), linked.first, ChanACL::Speak, &acCache)) {
+				// Merge adjacent ranges, so that usually only a single range has to be walked
+				if (ranges.back().second == linked.second.first) {
+					ranges.back().second = linked.second.second;
+				} else {
+					ranges.push_back(linked.second);
 				}
 			}
+		}
+	}
+}
 
-			{
-				QMutexLocker qml(&qmCache);
+void Server::sendMessageBatch(ReceiverRange< std::vector< AudioReceiver >::iterator > range,
+							  const unsigned char *data, int len, QByteArray &cache, UDPSendBatch *sendBatch) {
+	ZoneScoped;
+
+#ifdef Q_OS_LINUX
+	if (sendBatch) {
+		// The amount of receivers that are encrypted for at once
+		constexpr std::size_t GROUP_SIZE = 16;
+
+		auto it = range.begin;
+		while (it != range.end) {
+			ServerUser *users[GROUP_SIZE];
+			ServerUser *deferred[GROUP_SIZE];
+			CryptState *states[GROUP_SIZE];
+			unsigned char *buffers[GROUP_SIZE];
+			bool results[GROUP_SIZE];
+			std::size_t count         = 0;
+			std::size_t deferredCount = 0;
+
+			// Never reserve more buffers than the batch has left, so that it doesn't flush in the middle of a group
+			const std::size_t groupSize = std::min(GROUP_SIZE, sendBatch->getFreeSlots());
+
+			for (; it != range.end && count < groupSize && deferredCount < GROUP_SIZE; ++it) {
+				ServerUser &u = it->getReceiver();
+
+#	if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+				const bool usesUDP = u.aiUdpFlag.loadRelaxed() == 1 && u.sUdpSocket != INVALID_SOCKET;
+#	else
+				// Qt 5.14 introduced QAtomicInteger::loadRelaxed() which deprecates QAtomicInteger::load()
+				const bool usesUDP = u.aiUdpFlag.load() == 1 && u.sUdpSocket != INVALID_SOCKET;
+#	endif
 
-				foreach (unsigned int id, wt.qlSessions) {
-					ServerUser *pDst = qhUsers.value(id);
-					if (pDst && ChanACL::hasPermission(u, pDst->cChannel, ChanACL::Whisper, &acCache)
-						&& !channel.contains(pDst))
-						direct.insert(pDst);
+				// Users that don't use UDP get their audio tunneled through TCP, which is handled on its own
+				if (!usesUDP) {
+					deferred[deferredCount++] = &u;
+					continue;
+				}
+
+				if (!u.csCrypt->isValid()) {
+					continue;
 				}
+
+				users[count]   = &u;
+				states[count]  = u.csCrypt.get();
+				buffers[count] = sendBatch->nextBuffer(count);
+				count++;
 			}
 
-			int uiSession = u->uiSession;
+			if (count > 0) {
+				states[0]->encryptBatch(states, buffers, results, count, data, static_cast< unsigned int >(len));
+			}
+
+			for (std::size_t i = 0; i < count; ++i) {
+				if (!results[i]) {
+					continue;
+				}
+
+				// If a previous datagram of this group has not been queued, the following ones have to move up
+				unsigned char *buffer = sendBatch->nextBuffer();
+				if (buffer != buffers[i]) {
+					memcpy(buffer, buffers[i], static_cast< std::size_t >(len + 4));
+				}
+
+				sendBatch->commit(users[i]->sUdpSocket, users[i]->saiUdpAddress,
+								  HostAddress(users[i]->saiTcpLocalAddress), static_cast< std::size_t >(len + 4));
+			}
+
+			for (std::size_t i = 0; i < deferredCount; ++i) {
+				sendMessage(*deferred[i], data, len, cache, false, sendBatch);
+			}
+		}
+
+		return;
+	}
+#endif
+
+	for (auto it = range.begin; it != range.end; ++it) {
+		sendMessage(it->getReceiver(), data, len, cache, false, sendBatch);
+	}
+}
+
+void Server::processMsg(ServerUser *u, Mumble::Protocol::AudioData audioData, AudioReceiverBuffer &buffer,
+						Mumble::Protocol::UDPAudioEncoder< Mumble::Protocol::Role::Server > &encoder,
+						UDPSendBatch *sendBatch) {
+	ZoneScoped;
+
+	// Note that in this function we never have to acquire a read-lock on qrwlVoiceThread
+	// as all places that call this function will hold that lock at the point of calling
+	// this function.
+	// This function is currently called from Server::msgUDPTunnel, Server::run and
+	// Server::message
+	if (u->sState != ServerUser::Authenticated || u->bMute || u->bSuppress || u->bSelfMute)
+		return;
+
+	// Check the voice data rate limit.
+	{
+		BandwidthRecord *bw = &u->bwr;
+
+		// IP + UDP + Crypt + Data
+		const int packetsize = 20 + 8 + 4 + audioData.payload.size();
+
+		if (!bw->addFrame(packetsize, iMaxBandwidth / 8)) {
+			// Suppress packet.
+			return;
+		}
+	}
+
+	buffer.clear();
+
+	if (audioData.targetOrContext == Mumble::Protocol::ReservedTargetIDs::SERVER_LOOPBACK) {
+		buffer.forceAddReceiver(*u, Mumble::Protocol::AudioContext::NORMAL, audioData.containsPositionalData);
+	} else if (audioData.targetOrContext == Mumble::Protocol::ReservedTargetIDs::REGULAR_SPEECH) {
+		const ChannelRoutingTable *table                       = nullptr;
+		const std::vector< ChannelRoutingTable::Range > *ranges = nullptr;
+		ChannelRoutingTable builtTable;
+
+		auto tableIt = m_routingTables.find(u->cChannel->iId);
+		if (tableIt != m_routingTables.end()) {
+			auto rangesIt = tableIt->second.speakerRanges.find(u->uiSession);
+			if (rangesIt != tableIt->second.speakerRanges.end()) {
+				table  = &tableIt->second;
+				ranges = &rangesIt->second;
+			}
+		}
+
+		if (!ranges) {
+			ZoneScopedN(TracyConstants::AUDIO_ROUTING_TABLE_CREATE);
+
+			buildRoutingTable(u->cChannel, u, builtTable);
+
+			const unsigned int uiSession = u->uiSession;
+			const int channelID          = u->cChannel->iId;
+			const quint64 epoch          = m_routingTableEpoch;
 			qrwlVoiceThread.unlock();
 			qrwlVoiceThread.lockForWrite();
 
-			if (qhUsers.contains(uiSession))
-				u->qmTargetCache.insert(audioData.targetOrContext, { channel, direct, cachedListeners });
+			// If the tables have been dropped in the meantime, ours might be outdated already
+			if (qhUsers.contains(uiSession) && m_routingTableEpoch == epoch)
+				m_routingTables[channelID] = builtTable;
 			qrwlVoiceThread.unlock();
 			qrwlVoiceThread.lockForRead();
 			if (!qhUsers.contains(uiSession))
 				return;
+
+			table  = &builtTable;
+			ranges = &builtTable.speakerRanges[uiSession];
 		}
-		// These users receive the audio because someone is shouting to their channel
-		for (ServerUser *pDst : channel) {
-			buffer.addReceiver(*u, *pDst, Mumble::Protocol::AudioContext::SHOUT, audioData.containsPositionalData);
-		}
-		// These users receive audio because someone is whispering to them
-		for (ServerUser *pDst : direct) {
-			buffer.addReceiver(*u, *pDst, Mumble::Protocol::AudioContext::WHISPER, audioData.containsPositionalData);
+
+		for (const ChannelRoutingTable::Range &range : *ranges) {
+			for (std::size_t i = range.first; i < range.second; ++i) {
+				const AudioRoute &route = table->routes[i];
+
+				buffer.addReceiver(*u, *route.receiver, route.context, audioData.containsPositionalData,
+								   route.volumeAdjustment);
+			}
 		}
-		// These users receive audio because someone is sending audio to one of their listeners
-		QHashIterator< ServerUser *, VolumeAdjustment > it(cachedListeners);
-		while (it.hasNext()) {
-			it.next();
-			ServerUser *user                         = it.key();
-			const VolumeAdjustment &volumeAdjustment = it.value();
+	} else { // Whisper/Shout
+		// The main thread stores the cache of every target along with the target itself and only ever replaces it
+		// (see clearWhisperTargetCache), so a missing cache means that the target is not set
+		auto cacheIt = u->qmTargetCache.constFind(audioData.targetOrContext);
+		if (cacheIt != u->qmTargetCache.constEnd()) {
+			ZoneScopedN(TracyConstants::AUDIO_WHISPER_CACHE_STORE);
 
-			buffer.addReceiver(*u, *user, Mumble::Protocol::AudioContext::LISTEN, audioData.containsPositionalData,
-							   volumeAdjustment);
+			for (const AudioRoute &route : (*cacheIt)->receivers) {
+				buffer.addReceiver(*u, *route.receiver, route.context, audioData.containsPositionalData,
+								   route.volumeAdjustment);
+			}
 		}
 	}
 
@@ -1351,14 +1879,21 @@ void Server::processMsg(ServerUser *u, Mumble::Protocol::AudioData audioData, Au
 			tcpCache.clear();
 
 			// Send encoded packet to all receivers of this range
-			for (auto it = currentRange.begin; it != currentRange.end; ++it) {
-				sendMessage(it->getReceiver(), encodedPacket.data(), encodedPacket.size(), tcpCache);
-			}
+			sendMessageBatch(currentRange, encodedPacket.data(), static_cast< int >(encodedPacket.size()), tcpCache,
+							 sendBatch);
 
 			// Find next range
 			currentRange = AudioReceiverBuffer::getReceiverRange(currentRange.end, receiverList.end());
 		}
 	}
+
+#ifdef Q_OS_LINUX
+	if (sendBatch) {
+		sendBatch->flush();
+
+		TracyPlot(TracyConstants::UDP_SEND_SYSCALLS_SAVED, static_cast< int64_t >(sendBatch->getSavedSyscalls()));
+	}
+#endif
 }
 
 void Server::log(ServerUser *u, const QString &str) const {
@@ -1392,25 +1927,13 @@ void Server::newClient() {
 
 		HostAddress ha(adr);
 
-		QList< Ban > tmpBans = qlBans;
-		foreach (const Ban &ban, qlBans) {
-			if (ban.isExpired())
-				tmpBans.removeOne(ban);
-		}
-		if (qlBans.count() != tmpBans.count()) {
-			qlBans = tmpBans;
-			saveBans();
-		}
-
-		foreach (const Ban &ban, qlBans) {
-			if (ban.haAddress.match(ha, ban.iMask)) {
-				log(QString("Ignoring connection: %1, Reason: %2, Username: %3, Hash: %4 (Server ban)")
-						.arg(addressToString(sock->peerAddress(), sock->peerPort()), ban.qsReason, ban.qsUsername,
-							 ban.qsHash));
-				sock->disconnectFromHost();
-				sock->deleteLater();
-				return;
-			}
+		if (const Ban *ban = m_banIndex.match(ha)) {
+			log(QString("Ignoring connection: %1, Reason: %2, Username: %3, Hash: %4 (Server ban)")
+					.arg(addressToString(sock->peerAddress(), sock->peerPort()), ban->qsReason, ban->qsUsername,
+						 ban->qsHash));
+			sock->disconnectFromHost();
+			sock->deleteLater();
+			return;
 		}
 
 #ifdef Q_OS_MAC
@@ -1473,6 +1996,16 @@ void Server::newClient() {
 #endif
 		sock->setSslConfiguration(config);
 
+#if QT_VERSION >= 0x050500
+		sock->setProtocol(QSsl::TlsV1_0OrLater);
+#elif QT_VERSION >= 0x050400
+		// In Qt 5.4, QSsl::SecureProtocols is equivalent
+		// to "TLSv1.0 or later", which we require.
+		sock->setProtocol(QSsl::SecureProtocols);
+#else
+		sock->setProtocol(QSsl::TlsV1_0);
+#endif
+
 		if (qqIds.isEmpty()) {
 			log(QString("Session ID pool (%1) empty, rejecting connection").arg(iMaxUsers));
 			sock->disconnectFromHost();
@@ -1480,30 +2013,27 @@ void Server::newClient() {
 			return;
 		}
 
-		ServerUser *u = new ServerUser(this, sock);
-		u->haAddress  = ha;
-		HostAddress(sock->localAddress()).toSockaddr(&u->saiTcpLocalAddress);
+		// From here on, the socket belongs to the network thread serving the connection. The handshake,
+		// decryption and parsing of messages happen there.
+		QThread *ioThread = meta->networkThreadPool->acquire();
+		ServerUser *u     = new ServerUser(this, sock, ioThread);
+		u->haAddress      = ha;
+		HostAddress(u->localAddress()).toSockaddr(&u->saiTcpLocalAddress);
 
+		connect(u, &QObject::destroyed, [ioThread]() { meta->networkThreadPool->release(ioThread); });
 		connect(u, &ServerUser::connectionClosed, this, &Server::connectionClosed);
-		connect(u, SIGNAL(message(Mumble::Protocol::TCPMessageType, const QByteArray &)), this,
-				SLOT(message(Mumble::Protocol::TCPMessageType, const QByteArray &)));
+		connect(u, &ServerUser::message, this,
+				[this, u](Mumble::Protocol::TCPMessageType type, const QByteArray &qbaMsg, const TCPMessagePtr &msg) {
+					message(type, qbaMsg, msg, u);
+				});
 		connect(u, &ServerUser::handleSslErrors, this, &Server::sslError);
 		connect(u, &ServerUser::encrypted, this, &Server::encrypted);
+		connect(u, &ServerUser::drained, this, [this, u]() { continueInitialSync(u); });
 
-		log(u, QString("New connection: %1").arg(addressToString(sock->peerAddress(), sock->peerPort())));
+		log(u, QString("New connection: %1").arg(addressToString(u->peerAddress(), u->peerPort())));
 
 		u->setToS();
-
-#if QT_VERSION >= 0x050500
-		sock->setProtocol(QSsl::TlsV1_0OrLater);
-#elif QT_VERSION >= 0x050400
-		// In Qt 5.4, QSsl::SecureProtocols is equivalent
-		// to "TLSv1.0 or later", which we require.
-		sock->setProtocol(QSsl::SecureProtocols);
-#else
-		sock->setProtocol(QSsl::TlsV1_0);
-#endif
-		sock->startServerEncryption();
+		u->startServerEncryption();
 
 		meta->successfulConnectionFrom(adr);
 	}
@@ -1547,12 +2077,10 @@ void Server::encrypted() {
 							 .arg(issuer));
 		}
 
-		foreach (const Ban &ban, qlBans) {
-			if (ban.qsHash == uSource->qsHash) {
-				log(uSource, QString("Certificate hash is banned: %1, Username: %2, Reason: %3.")
-								 .arg(ban.qsHash, ban.qsUsername, ban.qsReason));
-				uSource->disconnectSocket();
-			}
+		if (const Ban *ban = m_banIndex.matchHash(uSource->qsHash)) {
+			log(uSource, QString("Certificate hash is banned: %1, Username: %2, Reason: %3.")
+							 .arg(ban->qsHash, ban->qsUsername, ban->qsReason));
+			uSource->disconnectSocket();
 		}
 	}
 }
@@ -1562,66 +2090,20 @@ void Server::sslError(const QList< QSslError > &errors) {
 	if (!u)
 		return;
 
-	bool ok = true;
+	// Whether the handshake proceeds has already been decided on the network thread (the errors have to be ignored
+	// while the handshake is still waiting for it). This only records the outcome.
 	foreach (QSslError e, errors) {
-		switch (e.error()) {
-			case QSslError::InvalidPurpose:
-				// Allow email certificates.
+		switch (ConnectionIO::classifySslError(e)) {
+			case ConnectionIO::SslErrorSeverity::Ignorable:
 				break;
-			case QSslError::NoPeerCertificate:
-			case QSslError::SelfSignedCertificate:
-			case QSslError::SelfSignedCertificateInChain:
-			case QSslError::UnableToGetLocalIssuerCertificate:
-			case QSslError::UnableToVerifyFirstCertificate:
-			case QSslError::HostNameMismatch:
-			case QSslError::CertificateNotYetValid:
-			case QSslError::CertificateExpired:
+			case ConnectionIO::SslErrorSeverity::Unverified:
 				u->bVerified = false;
 				break;
-			default:
+			case ConnectionIO::SslErrorSeverity::Fatal:
 				log(u, QString("SSL Error: %1").arg(e.errorString()));
-				ok = false;
+				break;
 		}
 	}
-
-	if (ok) {
-		u->proceedAnyway();
-	} else {
-		// Due to a regression in Qt 5 (QTBUG-53906),
-		// we can't 'force' disconnect (which calls
-		// QAbstractSocket->abort()) when built against Qt 5.
-		//
-		// The bug is that Qt doesn't update the
-		// QSslSocket's socket state when QSslSocket->abort()
-		// is called.
-		//
-		// Our call to abort() happens when QSslSocket is inside
-		// startHandshake(). That is, a handshake is in progress.
-		//
-		// After emitting the peerVerifyError/sslErrors signals,
-		// startHandshake() checks whether the connection is still
-		// in QAbstractSocket::ConectedState.
-		//
-		// Unfortunately, because abort() doesn't update the socket's
-		// state to signal that it is no longer connected, startHandshake()
-		// still thinks the socket is connected and will continue to
-		// attempt to finish the handshake.
-		//
-		// Because abort() tears down a lot of internal state
-		// of the QSslSocket, including the 'SSL *' object
-		// associated with the socket, this is fatal and leads
-		// to crashes, such as attempting to derefernce a nullptr
-		// 'SSL *' object.
-		//
-		// To avoid this, we use a non-forceful disconnect
-		// until this is fixed upstream.
-		//
-		// See
-		// https://bugreports.qt.io/browse/QTBUG-53906
-		// https://github.com/mumble-voip/mumble/issues/2334
-
-		u->disconnectSocket();
-	}
 }
 
 void Server::connectionClosed(QAbstractSocket::SocketError err, const QString &reason) {
@@ -1667,27 +2149,38 @@ void Server::connectionClosed(QAbstractSocket::SocketError err, const QString &r
 			m_botCount--;
 		}
 
-		emit userDisconnected(u);
+		// Users whose initial synchronization hasn't been completed have not been announced as connected yet
+		if (!u->m_initialSync) {
+			emit userDisconnected(u);
+		}
 	}
 
 	Channel *old = u->cChannel;
 
+	meta->timingWheel->cancel(u->m_timeoutTimer);
+	u->m_timeoutTimer = 0;
+
 	{
 		QWriteLocker wl(&qrwlVoiceThread);
 
 		qhUsers.remove(u->uiSession);
 		qhHostUsers[u->haAddress].remove(u);
+		qhTokenUsers.remove(u->uiUdpConnectionToken);
 
 		quint16 port = (u->saiUdpAddress.ss_family == AF_INET6)
 						   ? (reinterpret_cast< sockaddr_in6 * >(&u->saiUdpAddress)->sin6_port)
 						   : (reinterpret_cast< sockaddr_in * >(&u->saiUdpAddress)->sin_port);
-		const QPair< HostAddress, quint16 > &key = QPair< HostAddress, quint16 >(u->haAddress, port);
-		qhPeerUsers.remove(key);
+		m_peerTable.remove(PeerKey(u->haAddress, port));
 
-		if (old)
+		if (old) {
 			old->removeUser(u);
+			clearRoutingTablesLocked(old);
+		}
 	}
 
+	// Other users' whisper targets must not refer to the user anymore
+	clearWhisperTargetCache(u);
+
 	if (old && old->bTemporary && old->qlUsers.isEmpty())
 		QCoreApplication::instance()->postEvent(this,
 												new ExecEvent(boost::bind(&Server::removeChannel, this, old->iId)));
@@ -1706,12 +2199,12 @@ void Server::connectionClosed(QAbstractSocket::SocketError err, const QString &r
 		stopThread();
 }
 
-void Server::message(Mumble::Protocol::TCPMessageType type, const QByteArray &qbaMsg, ServerUser *u) {
+void Server::message(Mumble::Protocol::TCPMessageType type, const QByteArray &qbaMsg, const TCPMessagePtr &msg,
+					 ServerUser *u) {
 	ZoneScopedN(TracyConstants::TCP_PACKET_PROCESSING_ZONE);
 
-	if (!u) {
-		u = static_cast< ServerUser * >(sender());
-	}
+	// Used by the rate limiting of the message
+	CoarseClock::update();
 
 	if (u->sState == ServerUser::Authenticated) {
 		u->resetActivityTime();
@@ -1745,7 +2238,11 @@ void Server::message(Mumble::Protocol::TCPMessageType type, const QByteArray &qb
 					// Add session id
 					audioData.senderSession = u->uiSession;
 
-					processMsg(u, std::move(audioData), m_tcpAudioReceivers, m_tcpAudioEncoder);
+#ifdef Q_OS_LINUX
+					processMsg(u, std::move(audioData), m_tcpAudioReceivers, m_tcpAudioEncoder, &m_tcpSendBatch);
+#else
+					processMsg(u, std::move(audioData), m_tcpAudioReceivers, m_tcpAudioEncoder, nullptr);
+#endif
 				}
 			}
 		}
@@ -1753,30 +2250,25 @@ void Server::message(Mumble::Protocol::TCPMessageType type, const QByteArray &qb
 		return;
 	}
 
+	// All other messages have already been parsed by the network thread (see ConnectionIO)
+	if (!msg) {
+		return;
+	}
+
 #ifdef QT_NO_DEBUG
-#	define PROCESS_MUMBLE_TCP_MESSAGE(name, value)                      \
-		case Mumble::Protocol::TCPMessageType::name: {                   \
-			MumbleProto::name msg;                                       \
-			if (msg.ParseFromArray(qbaMsg.constData(), qbaMsg.size())) { \
-				msg.DiscardUnknownFields();                              \
-				msg##name(u, msg);                                       \
-			}                                                            \
-			break;                                                       \
-		}
+#	define PROCESS_MUMBLE_TCP_MESSAGE(name, value)                  \
+		case Mumble::Protocol::TCPMessageType::name:                \
+			msg##name(u, static_cast< MumbleProto::name & >(*msg)); \
+			break;
 #else
-#	define PROCESS_MUMBLE_TCP_MESSAGE(name, value)                      \
-		case Mumble::Protocol::TCPMessageType::name: {                   \
-			MumbleProto::name msg;                                       \
-			if (msg.ParseFromArray(qbaMsg.constData(), qbaMsg.size())) { \
-				if (type != Mumble::Protocol::TCPMessageType::Ping) {    \
-					printf("== %s:\n", #name);                           \
-					msg.PrintDebugString();                              \
-				}                                                        \
-				msg.DiscardUnknownFields();                              \
-				msg##name(u, msg);                                       \
-			}                                                            \
-			break;                                                       \
-		}
+#	define PROCESS_MUMBLE_TCP_MESSAGE(name, value)                  \
+		case Mumble::Protocol::TCPMessageType::name:                \
+			if (type != Mumble::Protocol::TCPMessageType::Ping) {   \
+				printf("== %s:\n", #name);                          \
+				msg->PrintDebugString();                            \
+			}                                                       \
+			msg##name(u, static_cast< MumbleProto::name & >(*msg)); \
+			break;
 #endif
 
 	switch (type) { MUMBLE_ALL_TCP_MESSAGES }
@@ -1784,19 +2276,62 @@ void Server::message(Mumble::Protocol::TCPMessageType type, const QByteArray &qb
 #undef PROCESS_MUMBLE_TCP_MESSAGE
 }
 
-void Server::checkTimeout() {
-	QList< ServerUser * > qlClose;
+void Server::checkTimeout(ServerUser *u) {
+	if (u->activityTime() > (iTimeout * 1000)) {
+		log(u, "Timeout");
 
-	qrwlVoiceThread.lockForRead();
-	foreach (ServerUser *u, qhUsers) {
-		if (u->activityTime() > (iTimeout * 1000)) {
-			log(u, "Timeout");
-			qlClose.append(u);
+		// Disconnecting ends in connectionClosed, which cancels this. Should the socket not get there, the
+		// disconnect is retried. This is scheduled first, as connectionClosed may run right away.
+		u->m_timeoutTimer = meta->timingWheel->schedule(TIMEOUT_RETRY_INTERVAL, [this, u]() {
+			u->m_timeoutTimer = 0;
+			checkTimeout(u);
+		});
+
+		u->disconnectSocket(true);
+	} else {
+		scheduleTimeout(u);
+	}
+}
+
+void Server::scheduleTimeout(ServerUser *u) {
+	// Checked a little after the timeout has passed, as the user has to be inactive for longer than that
+	const qint64 delay = static_cast< qint64 >(iTimeout) * 1000 - u->activityTime() + 1;
+
+	if (!meta->timingWheel->reschedule(u->m_timeoutTimer, delay)) {
+		u->m_timeoutTimer = meta->timingWheel->schedule(delay, [this, u]() {
+			u->m_timeoutTimer = 0;
+			checkTimeout(u);
+		});
+	}
+}
+
+void Server::scheduleBanExpiry() {
+	const qint64 expiry = m_banIndex.nextExpiry();
+	if (expiry < 0) {
+		meta->timingWheel->cancel(m_banExpiryTimer);
+		m_banExpiryTimer = 0;
+		return;
+	}
+
+	const qint64 delay = expiry - QDateTime::currentMSecsSinceEpoch();
+	if (!meta->timingWheel->reschedule(m_banExpiryTimer, delay)) {
+		m_banExpiryTimer = meta->timingWheel->schedule(delay, [this]() {
+			m_banExpiryTimer = 0;
+			expireBans();
+		});
+	}
+}
+
+void Server::expireBans() {
+	const QList< Ban > expired = m_banIndex.takeExpired(QDateTime::currentDateTimeUTC());
+	if (!expired.isEmpty()) {
+		for (const Ban &ban : expired) {
+			qlBans.removeOne(ban);
 		}
+		saveBans();
 	}
-	qrwlVoiceThread.unlock();
-	foreach (ServerUser *u, qlClose)
-		u->disconnectSocket(true);
+
+	scheduleBanExpiry();
 }
 
 void Server::tcpTransmitData(QByteArray a, unsigned int id) {
@@ -1826,6 +2361,45 @@ void Server::doSync(unsigned int id) {
 	}
 }
 
+void Server::queueUserState(ServerUser *source, const MumbleProto::UserState &msg) {
+	if (userStateTick == 0) {
+		sendExcept(source, msg, Version::fromComponents(1, 2, 2), Version::CompareMode::AtLeast);
+		return;
+	}
+
+	const unsigned int excludedSession = source ? source->uiSession : 0;
+	if (!m_userStateAggregator.add(msg, excludedSession)) {
+		flushUserState(msg.session());
+		m_userStateAggregator.add(msg, excludedSession);
+	}
+
+	if (!m_userStateTimer->isActive()) {
+		m_userStateTimer->start(static_cast< int >(userStateTick));
+	}
+}
+
+void Server::flushUserStates() {
+	m_userStateTimer->stop();
+
+	for (const UserStateAggregator::Update &update : m_userStateAggregator.takeAll()) {
+		sendUserStateUpdate(update);
+	}
+}
+
+void Server::flushUserState(unsigned int session) {
+	UserStateAggregator::Update update;
+	if (m_userStateAggregator.take(session, update)) {
+		sendUserStateUpdate(update);
+	}
+}
+
+void Server::sendUserStateUpdate(const UserStateAggregator::Update &update) {
+	// The excluded user may have disconnected in the meantime, in which case the message goes to everyone
+	ServerUser *excluded = update.excludedSession ? qhUsers.value(update.excludedSession) : nullptr;
+
+	sendExcept(excluded, update.message, Version::fromComponents(1, 2, 2), Version::CompareMode::AtLeast);
+}
+
 void Server::sendProtoMessage(ServerUser *u, const ::google::protobuf::Message &msg,
 							  Mumble::Protocol::TCPMessageType msgType) {
 	QByteArray cache;
@@ -1840,6 +2414,23 @@ void Server::sendProtoAll(const ::google::protobuf::Message &msg, Mumble::Protoc
 void Server::sendProtoExcept(ServerUser *u, const ::google::protobuf::Message &msg,
 							 Mumble::Protocol::TCPMessageType msgType, Version::full_t version,
 							 Version::CompareMode mode) {
+	if (!m_userStateAggregator.isEmpty()) {
+		// Pending UserStates only go to clients >= 1.2.2, so broadcasts to older clients don't overtake them
+		const bool reachesPendingReceivers = mode != Version::CompareMode::LessThan || version == Version::UNKNOWN
+											 || version > Version::fromComponents(1, 2, 2);
+
+		if (reachesPendingReceivers) {
+			if (msgType == Mumble::Protocol::TCPMessageType::UserState) {
+				// Only the pending state of the same user could be overwritten with an outdated one
+				flushUserState(static_cast< const MumbleProto::UserState & >(msg).session());
+			} else {
+				flushUserStates();
+			}
+		}
+	}
+
+	// The message is serialized (by the first receiver) into cache only once. All receivers then queue that very
+	// buffer, which is implicitly shared, so it isn't copied per receiver either.
 	QByteArray cache;
 	foreach (ServerUser *usr, qhUsers)
 		if ((usr != u) && (usr->sState == ServerUser::Authenticated)) {
@@ -1870,8 +2461,13 @@ void Server::removeChannel(Channel *chan, Channel *dest) {
 	{
 		QWriteLocker wl(&qrwlVoiceThread);
 		chan->unlink(nullptr);
+
+		// The channel's former links might not be linked to each other anymore
+		clearRoutingTablesLocked();
 	}
 
+	clearWhisperTargetCache(QSet< Channel * >{ chan });
+
 	foreach (c, chan->qlChannels) { removeChannel(c, dest); }
 
 	foreach (p, chan->qlUsers) {
@@ -1922,6 +2518,13 @@ void Server::removeChannel(Channel *chan, Channel *dest) {
 		chan->cParent->removeChannel(chan);
 	}
 
+	{
+		// The channel's ID might be reused by a new channel. Its subchannels have been removed already.
+		QMutexLocker qml(&qmCache);
+		acCache.clearChannels(QSet< Channel * >{ chan });
+	}
+	m_channelStateCache.remove(chan->iId);
+
 	delete chan;
 }
 
@@ -1932,6 +2535,7 @@ bool Server::unregisterUser(int id) {
 	{
 		QMutexLocker lock(&qmCache);
 
+		QSet< Channel * > changed;
 		foreach (Channel *c, qhChannels) {
 			bool write            = false;
 			QList< ChanACL * > ql = c->qlACL;
@@ -1947,9 +2551,15 @@ bool Server::unregisterUser(int id) {
 				bool remrem = g->qsRemove.remove(id);
 				write       = write || addrem || remrem;
 			}
-			if (write)
+			if (write) {
 				updateChannel(c);
+
+				changed.insert(c);
+				changed.unite(c->allChildren());
+			}
 		}
+
+		acCache.clearChannels(changed);
 	}
 
 	foreach (ServerUser *u, qhUsers) {
@@ -1991,6 +2601,11 @@ void Server::userEnterChannel(User *p, Channel *c, MumbleProto::UserState &mpus)
 			p->bPrioritySpeaker = false;
 			mpus.set_priority_speaker(p->bPrioritySpeaker);
 		}
+
+		if (old) {
+			clearRoutingTablesLocked(old);
+		}
+		clearRoutingTablesLocked(c);
 	}
 
 	clearACLCache(p);
@@ -2027,7 +2642,7 @@ void Server::sendClientPermission(ServerUser *u, Channel *c, bool explicitlyRequ
 		// Abuse that hasPermission will update acCache with the latest permissions (all of them,
 		// not only the requested one) so that we can pull this information out of it afterwards.
 		ChanACL::hasPermission(u, c, ChanACL::Enter, &acCache);
-		perm = acCache.value(u)->value(c);
+		perm = acCache.value(u, c);
 	}
 
 	if (explicitlyRequested) {
@@ -2066,7 +2681,7 @@ void Server::flushClientPermissionCache(ServerUser *u, MumbleProto::PermissionQu
 			match = false;
 		} else {
 			ChanACL::hasPermission(u, c, ChanACL::Enter, &acCache);
-			unsigned int perm = acCache.value(u)->value(c);
+			unsigned int perm = acCache.value(u, c);
 			if (perm != i.value())
 				match = false;
 		}
@@ -2084,7 +2699,7 @@ void Server::flushClientPermissionCache(ServerUser *u, MumbleProto::PermissionQu
 	}
 
 	ChanACL::hasPermission(u, c, ChanACL::Enter, &acCache);
-	unsigned int perm = acCache.value(u)->value(c);
+	unsigned int perm = acCache.value(u, c);
 	u->qmPermissionSent.insert(c->iId, perm);
 
 	mppq.Clear();
@@ -2102,13 +2717,10 @@ void Server::clearACLCache(User *p) {
 		QMutexLocker qml(&qmCache);
 
 		if (p) {
-			ChanACL::ChanCache *h = acCache.take(p);
-			delete h;
+			acCache.clearUser(p);
 
 			flushClientPermissionCache(static_cast< ServerUser * >(p), mppq);
 		} else {
-			foreach (ChanACL::ChanCache *h, acCache)
-				delete h;
 			acCache.clear();
 
 			foreach (ServerUser *u, qhUsers)
@@ -2117,40 +2729,206 @@ void Server::clearACLCache(User *p) {
 		}
 
 		// A change in ACLs could also change a user's suppression state
-		MumbleProto::UserState mpus;
-		auto processingFunction = [&](ServerUser *user) {
-			bool maySpeak = ChanACL::hasPermission(user, user->cChannel, ChanACL::Speak, &acCache);
-
-			if (maySpeak == user->bSuppress) {
-				// Mirror a user's ability to speak in the current channel (by means of the ACLs) in the suppress
-				// property (not being allowed to speak -> suppressed and vice versa)
-				user->bSuppress = !maySpeak;
-
-				mpus.Clear();
-				mpus.set_session(user->uiSession);
-				mpus.set_suppress(true);
-				sendAll(mpus);
-			}
-		};
-
 		if (p) {
-			processingFunction(static_cast< ServerUser * >(p));
+			updateSuppression(static_cast< ServerUser * >(p));
 		} else {
 			for (ServerUser *currentUser : qhUsers) {
-				processingFunction(currentUser);
+				updateSuppression(currentUser);
 			}
 		}
 	}
 
 	// A change in ACLs means that the user might be able to whisper
 	// to users it didn't have permission to do before (or vice versa)
-	clearWhisperTargetCache();
+	if (!p) {
+		clearWhisperTargetCache();
+	} else {
+		clearWhisperTargetCache(static_cast< ServerUser * >(p));
+	}
+
+	// The same goes for speaking in linked channels
+	if (!p) {
+		clearRoutingTables();
+	} else if (p->cChannel) {
+		clearRoutingTables(p->cChannel);
+	}
+}
+
+void Server::clearACLCache(Channel *c, bool hierarchyChanged) {
+	if (!c->cParent) {
+		// Everything is below the root channel
+		clearACLCache();
+		return;
+	}
+
+	QSet< Channel * > subtree = c->allChildren();
+	subtree.insert(c);
+
+	QList< ServerUser * > usersInSubtree;
+	foreach (ServerUser *u, qhUsers) {
+		if (subtree.contains(u->cChannel)) {
+			usersInSubtree << u;
+		}
+	}
+
+	MumbleProto::PermissionQuery mppq;
+
+	{
+		QMutexLocker qml(&qmCache);
+
+		acCache.clearChannels(subtree);
+
+		if (hierarchyChanged) {
+			// Whether a group specification like "sub" applies to these users has changed in every channel
+			for (ServerUser *u : usersInSubtree) {
+				acCache.clearUser(u);
+			}
+		}
+
+		// This only recomputes the permissions of channels in the subtree, as all others are still cached
+		foreach (ServerUser *u, qhUsers)
+			if (u->sState == ServerUser::Authenticated)
+				flushClientPermissionCache(u, mppq);
+
+		for (ServerUser *u : usersInSubtree) {
+			updateSuppression(u);
+		}
+	}
+
+	if (hierarchyChanged) {
+		// Targets including the children of a channel outside of the subtree may have gained or lost channels
+		clearWhisperTargetCache();
+	} else {
+		clearWhisperTargetCache(subtree);
+	}
+
+	for (Channel *current : subtree) {
+		clearRoutingTables(current);
+	}
+}
+
+void Server::updateSuppression(ServerUser *u) {
+	bool maySpeak = ChanACL::hasPermission(u, u->cChannel, ChanACL::Speak, &acCache);
+
+	if (maySpeak == u->bSuppress) {
+		// Mirror a user's ability to speak in the current channel (by means of the ACLs) in the suppress
+		// property (not being allowed to speak -> suppressed and vice versa)
+		u->bSuppress = !maySpeak;
+
+		MumbleProto::UserState mpus;
+		mpus.set_session(u->uiSession);
+		mpus.set_suppress(true);
+		sendAll(mpus);
+	}
+}
+
+/// @returns Whether the receivers of the given cache depend on the users, listeners or ACLs of the given channel
+static bool whisperTargetCacheDependsOn(const WhisperTargetCache &cache, const Channel *c) {
+	if (std::binary_search(cache.channels.begin(), cache.channels.end(), c->iId)) {
+		return true;
+	}
+
+	for (const Channel *current = c; current; current = current->cParent) {
+		if (std::binary_search(cache.subtrees.begin(), cache.subtrees.end(), current->iId)) {
+			return true;
+		}
+	}
+
+	return false;
 }
 
 void Server::clearWhisperTargetCache() {
+	rebuildWhisperTargetCaches([](ServerUser *, const WhisperTarget &, const WhisperTargetCache &) { return true; });
+}
+
+void Server::clearWhisperTargetCache(ServerUser *u) {
+	rebuildWhisperTargetCaches([u](ServerUser *speaker, const WhisperTarget &target, const WhisperTargetCache &cache) {
+		if (speaker == u || cache.usesGroups || target.qlSessions.contains(u->uiSession)) {
+			return true;
+		}
+		if (u->cChannel && whisperTargetCacheDependsOn(cache, u->cChannel)) {
+			return true;
+		}
+
+		auto it = std::lower_bound(cache.receivers.begin(), cache.receivers.end(), u->uiSession,
+								   [](const AudioRoute &route, unsigned int session) {
+									   return route.receiver->uiSession < session;
+								   });
+		return it != cache.receivers.end() && it->receiver == u;
+	});
+}
+
+void Server::clearWhisperTargetCache(const QSet< Channel * > &channels) {
+	rebuildWhisperTargetCaches([&channels](ServerUser *, const WhisperTarget &, const WhisperTargetCache &cache) {
+		for (const Channel *c : channels) {
+			if (whisperTargetCacheDependsOn(cache, c)) {
+				return true;
+			}
+		}
+		return false;
+	});
+}
+
+void Server::rebuildWhisperTargetCaches(
+	const std::function< bool(ServerUser *, const WhisperTarget &, const WhisperTargetCache &) > &isOutdated) {
+	ZoneScoped;
+
+	struct BuiltCache {
+		ServerUser *user;
+		int target;
+		std::shared_ptr< const WhisperTargetCache > cache;
+	};
+
+	// Everything the caches are built from is owned by the main thread, so voice threads are only locked out while
+	// the new caches are swapped in. That way, they always find a cache for every target.
+	std::vector< BuiltCache > caches;
+	foreach (ServerUser *u, qhUsers) {
+		for (auto it = u->qmTargets.cbegin(); it != u->qmTargets.cend(); ++it) {
+			const std::shared_ptr< const WhisperTargetCache > current = u->qmTargetCache.value(it.key());
+			if (!current || isOutdated(u, it.value(), *current)) {
+				caches.push_back({ u, it.key(), buildWhisperTargetCache(u, it.value()) });
+			}
+		}
+	}
+
+	if (caches.empty()) {
+		return;
+	}
+
 	QWriteLocker lock(&qrwlVoiceThread);
 
-	foreach (ServerUser *u, qhUsers) { u->qmTargetCache.clear(); }
+	for (const BuiltCache &current : caches) {
+		current.user->qmTargetCache.insert(current.target, current.cache);
+	}
+}
+
+void Server::channelListenersChanged(int channelID) {
+	// The routing tables contain the listeners of channels along with their volume adjustments
+	Channel *c = qhChannels.value(channelID);
+	if (c) {
+		clearRoutingTables(c);
+		clearWhisperTargetCache(QSet< Channel * >{ c });
+	}
+}
+
+void Server::clearRoutingTables(Channel *c) {
+	QWriteLocker lock(&qrwlVoiceThread);
+
+	clearRoutingTablesLocked(c);
+}
+
+void Server::clearRoutingTablesLocked(Channel *c) {
+	m_routingTableEpoch++;
+
+	if (!c) {
+		m_routingTables.clear();
+		return;
+	}
+
+	// The table of every channel in a group of linked channels contains the receivers of the whole group
+	for (Channel *l : c->allLinks()) {
+		m_routingTables.erase(l->iId);
+	}
 }
 
 QString Server::addressToString(const QHostAddress &adr, unsigned short port) {
@@ -15,15 +15,27 @@
 #include "ACL.h"
 #include "AudioReceiverBuffer.h"
 #include "Ban.h"
+#include "BanIndex.h"
 #include "ChannelListenerManager.h"
+#include "ChannelRoutingTable.h"
+#include "ChannelStateCache.h"
+#include "ConnectionIO.h"
 #include "HostAddress.h"
 #include "Mumble.pb.h"
 #include "MumbleProtocol.h"
+#include "PeerTable.h"
+#include "PingResponder.h"
 #include "Timer.h"
+#include "TimingWheel.h"
 #include "User.h"
+#include "UserStateAggregator.h"
 #include "Version.h"
 #include "VolumeAdjustment.h"
 
+#ifdef Q_OS_LINUX
+#	include "UDPSendBatch.h"
+#endif
+
 #ifndef Q_MOC_RUN
 #	include <boost/function.hpp>
 #endif
@@ -41,6 +53,9 @@
 #include <QtNetwork/QSslKey>
 #include <QtNetwork/QSslSocket>
 #include <QtNetwork/QTcpServer>
+
+#include <functional>
+
 #if defined(USE_QSSLDIFFIEHELLMANPARAMETERS)
 #	include <QtNetwork/QSslDiffieHellmanParameters>
 #endif
@@ -51,9 +66,17 @@
 
 class Zeroconf;
 class Channel;
+struct ChannelTreeData;
+class Server;
+struct UDPDatagram;
+class UDPSendBatch;
+struct InitialSync;
+struct PendingAuthentication;
 class PacketDataStream;
 class ServerUser;
 class User;
+struct WhisperTarget;
+struct WhisperTargetCache;
 class QNetworkAccessManager;
 
 struct TextMessage {
@@ -89,6 +112,44 @@ public:
 	void execute();
 };
 
+/// The state a voice thread needs for processing UDP datagrams. Every voice thread owns its own
+/// instance, so that no decoding or encoding buffers are shared between threads.
+struct VoiceThreadContext {
+	Mumble::Protocol::UDPDecoder< Mumble::Protocol::Role::Server > decoder;
+	Mumble::Protocol::UDPPingEncoder< Mumble::Protocol::Role::Server > pingEncoder;
+	Mumble::Protocol::UDPAudioEncoder< Mumble::Protocol::Role::Server > audioEncoder;
+	AudioReceiverBuffer audioReceivers;
+#ifdef Q_OS_LINUX
+	UDPSendBatch sendBatch;
+#endif
+
+	/// The UDP sockets polled by this thread (one per bind address)
+#ifdef Q_OS_UNIX
+	QList< int > qlUdpSocket;
+#else
+	QList< SOCKET > qlUdpSocket;
+#endif
+};
+
+/// An additional voice thread of a virtual server. The Server's own thread is the first voice thread, all
+/// further ones (see Server::voiceThreads) are VoiceWorkers. They are started and stopped by the Server's thread.
+class VoiceWorker : public QThread {
+private:
+	Q_OBJECT;
+	Q_DISABLE_COPY(VoiceWorker);
+
+protected:
+	Server &m_server;
+	unsigned int m_index;
+
+	void run() Q_DECL_OVERRIDE;
+
+public:
+	VoiceThreadContext context;
+
+	VoiceWorker(Server &server, unsigned int index);
+};
+
 class Server : public QThread {
 private:
 	Q_OBJECT;
@@ -146,8 +207,20 @@ public:
 	unsigned int iPluginMessageLimit;
 	unsigned int iPluginMessageBurst;
 
+	unsigned int pingLimit;
+	unsigned int pingBurst;
+
 	bool broadcastListenerVolumeAdjustments;
 
+	/// The time (in milliseconds) UserState broadcasts caused by clients are collected for before they are sent,
+	/// merging all changes to the same user into one message. 0 sends them right away.
+	unsigned int userStateTick;
+
+	unsigned int udpReceiveBatchSize;
+	/// The amount of voice threads. Only read when the server is created, as the amount of
+	/// UDP sockets depends on it.
+	unsigned int voiceThreads;
+
 	Version::full_t m_suggestVersion;
 
 	QVariant qvSuggestPositional;
@@ -177,15 +250,28 @@ public:
 	ChannelListenerManager m_channelListenerManager;
 
 
-	Mumble::Protocol::UDPDecoder< Mumble::Protocol::Role::Server > m_udpDecoder;
+	/// The state of the Server's own voice thread. The additional voice threads keep theirs in qlVoiceWorkers.
+	VoiceThreadContext m_voiceContext;
 	Mumble::Protocol::UDPDecoder< Mumble::Protocol::Role::Server > m_tcpTunnelDecoder;
-	Mumble::Protocol::UDPPingEncoder< Mumble::Protocol::Role::Server > m_udpPingEncoder;
-	Mumble::Protocol::UDPAudioEncoder< Mumble::Protocol::Role::Server > m_udpAudioEncoder;
 	Mumble::Protocol::UDPAudioEncoder< Mumble::Protocol::Role::Server > m_tcpAudioEncoder;
 
+	/// Answers pings requesting the server's details before anything else is done with a datagram
+	PingResponder m_pingResponder;
+	/// How often (in milliseconds) the details m_pingResponder answers with are refreshed
+	static constexpr qint64 PING_REFRESH_INTERVAL = 1000;
+	TimingWheel::TimerID m_pingRefreshTimer = 0;
+	/// The amount of pings m_pingResponder had answered and limited at the last refresh
+	quint64 m_lastAnsweredPings = 0;
+	quint64 m_lastLimitedPings  = 0;
+	/// Passes the current user count and configuration on to m_pingResponder
+	void updatePingResponder();
+	/// Runs every PING_REFRESH_INTERVAL milliseconds. Updates m_pingResponder and plots the rates of pings.
+	void refreshPingResponder();
+
+	/// Answers a connectivity ping of a connected user
 	gsl::span< const Mumble::Protocol::byte >
 		handlePing(const Mumble::Protocol::UDPDecoder< Mumble::Protocol::Role::Server > &decoder,
-				   Mumble::Protocol::UDPPingEncoder< Mumble::Protocol::Role::Server > &encoder, bool expectExtended);
+				   Mumble::Protocol::UDPPingEncoder< Mumble::Protocol::Role::Server > &encoder);
 
 	void readParams();
 
@@ -200,16 +286,19 @@ public:
 	void removeZeroconf();
 #endif
 	// Registration, implementation in Register.cpp
-	QTimer qtTick;
+	TimingWheel::TimerID m_registerTimer = 0;
 	void initRegister();
 
 private:
 	int iChannelNestingLimit;
 	int iChannelCountLimit;
 
-	AudioReceiverBuffer m_udpAudioReceivers;
 	AudioReceiverBuffer m_tcpAudioReceivers;
 
+#ifdef Q_OS_LINUX
+	UDPSendBatch m_tcpSendBatch;
+#endif
+
 public slots:
 	void regSslError(const QList< QSslError > &);
 	void finished();
@@ -230,12 +319,13 @@ public slots:
 	void newClient();
 	void connectionClosed(QAbstractSocket::SocketError, const QString &);
 	void sslError(const QList< QSslError > &);
-	void message(Mumble::Protocol::TCPMessageType, const QByteArray &, ServerUser *cCon = nullptr);
-	void checkTimeout();
+	/// Handles a message received from u. All messages but UDPTunnel messages have already been parsed into msg.
+	void message(Mumble::Protocol::TCPMessageType, const QByteArray &, const TCPMessagePtr &msg, ServerUser *u);
 	void tcpTransmitData(QByteArray, unsigned int);
 	void doSync(unsigned int);
 	void encrypted();
 	void udpActivated(int);
+	void channelListenersChanged(int channelID);
 signals:
 	void reqSync(unsigned int);
 	void tcpTransmit(QByteArray, unsigned int id);
@@ -244,7 +334,9 @@ public:
 	int iServerNum;
 	QQueue< int > qqIds;
 	QList< SslServer * > qlServer;
-	QTimer *qtTimeout;
+	/// Fires once the current UserState tick is over (see userStateTick)
+	QTimer *m_userStateTimer;
+	UserStateAggregator m_userStateAggregator;
 
 #ifdef Q_OS_UNIX
 	int aiNotify[2];
@@ -254,6 +346,8 @@ public:
 	QList< SOCKET > qlUdpSocket;
 #endif
 	QList< QSocketNotifier * > qlUdpNotifier;
+	/// The additional voice threads (if voiceThreads > 1)
+	QList< VoiceWorker * > qlVoiceWorkers;
 
 	/// This lock provides synchronization between the
 	/// main thread (where control channel messages and
@@ -302,22 +396,77 @@ public:
 	///    other thread can write to that data.
 	QReadWriteLock qrwlVoiceThread;
 	QHash< unsigned int, ServerUser * > qhUsers;
-	QHash< QPair< HostAddress, quint16 >, ServerUser * > qhPeerUsers;
+	/// Maps the UDP address of every user whose UDP connection is established to its session.
+	/// Lookups are lock-free and don't require holding qrwlVoiceThread. The user that is returned
+	/// still has to be resolved via qhUsers, which does require the lock.
+	PeerTable m_peerTable;
 	QHash< HostAddress, QSet< ServerUser * > > qhHostUsers;
+	/// Maps UDP connection tokens to the user they have been assigned to
+	QHash< quint32, ServerUser * > qhTokenUsers;
 	QHash< unsigned int, Channel * > qhChannels;
 
 	QMutex qmCache;
 	ChanACL::ACLCache acCache;
 
+	/// The shared parts of the ChannelStates sent to joining clients
+	ChannelStateCache m_channelStateCache;
+
+	/// The routing tables for regular speech, keyed by the ID of the speaker's channel. They are built lazily
+	/// by processMsg and dropped by clearRoutingTables whenever something they were built from changes.
+	/// Both are guarded by qrwlVoiceThread.
+	std::unordered_map< int, ChannelRoutingTable > m_routingTables;
+	/// Incremented whenever routing tables are dropped, so that a table built from an outdated state is not stored
+	quint64 m_routingTableEpoch = 0;
+
 	QHash< int, QString > qhUserNameCache;
 	QHash< QString, int > qhUserIDCache;
 
 	QList< Ban > qlBans;
-
-	void addListener(QHash< ServerUser *, VolumeAdjustment > &listeners, ServerUser &user, const Channel &channel);
+	/// The bans of qlBans as they have been saved last, indexed for the checks on new connections
+	BanIndex m_banIndex;
+	/// The bans as they are stored in the database, so that saveBans only has to write what has changed
+	QList< Ban > m_persistedBans;
+	/// Removes the bans that have expired once the next one does (see scheduleBanExpiry)
+	TimingWheel::TimerID m_banExpiryTimer = 0;
+
+	/// How long (in milliseconds) after disconnecting a user that has timed out the check is repeated, in case the
+	/// connection hasn't been closed by then
+	static constexpr qint64 TIMEOUT_RETRY_INTERVAL = 15500;
+	/// Disconnects the given user if it has been inactive for longer than the timeout. Otherwise, the check is
+	/// scheduled for when the user would time out.
+	void checkTimeout(ServerUser *u);
+	/// Schedules the timeout check of the given user for when it would time out if it stayed inactive. Activity
+	/// doesn't move the check, which only looks at the time of the last activity once it runs.
+	void scheduleTimeout(ServerUser *u);
+	/// Schedules the removal of expired bans for when the next ban expires
+	void scheduleBanExpiry();
+	void expireBans();
+
+	void addListener(QHash< ServerUser *, VolumeAdjustment > &listeners, ServerUser &user,
+					 const VolumeAdjustment &volumeAdjustment);
 	void processMsg(ServerUser *u, Mumble::Protocol::AudioData audioData, AudioReceiverBuffer &buffer,
-					Mumble::Protocol::UDPAudioEncoder< Mumble::Protocol::Role::Server > &encoder);
-	void sendMessage(ServerUser &u, const unsigned char *data, int len, QByteArray &cache, bool force = false);
+					Mumble::Protocol::UDPAudioEncoder< Mumble::Protocol::Role::Server > &encoder,
+					UDPSendBatch *sendBatch);
+	/// Encrypts the given message and sends it to the given user via UDP (or via the TCP tunnel if the
+	/// user doesn't use UDP). If sendBatch is not null, UDP datagrams are only queued in that batch and
+	/// the caller is responsible for flushing it.
+	void sendMessage(ServerUser &u, const unsigned char *data, int len, QByteArray &cache, bool force = false,
+					 UDPSendBatch *sendBatch = nullptr);
+	/// Sends the given message to all receivers in the given range, just like calling sendMessage for each of
+	/// them would. If sendBatch is not null, the message is encrypted for several receivers at once (see
+	/// CryptState::encryptBatch) and the datagrams are queued in that batch.
+	void sendMessageBatch(ReceiverRange< std::vector< AudioReceiver >::iterator > range, const unsigned char *data,
+						  int len, QByteArray &cache, UDPSendBatch *sendBatch);
+	/// Processes a single (still encrypted) datagram that has been received on one of the voice sockets.
+	/// Must be called from a voice thread without holding a lock on qrwlVoiceThread.
+	///
+	/// @param datagram The received datagram
+	/// @param buffer A buffer of at least MAX_UDP_PACKET_SIZE bytes that is used to hold the decrypted data
+	/// @param context The state of the calling voice thread
+	void processUDPDatagram(UDPDatagram &datagram, unsigned char *buffer, VoiceThreadContext &context);
+	/// Receives and processes datagrams on the sockets of the given context until the voice threads
+	/// are told to stop. This is the main loop of every voice thread.
+	void runVoiceLoop(VoiceThreadContext &context);
 	void run();
 
 	bool validateChannelName(const QString &name);
@@ -329,8 +478,46 @@ public:
 	QFlags< ChanACL::Perm > effectivePermissions(ServerUser *p, Channel *c);
 	void sendClientPermission(ServerUser *u, Channel *c, bool explicitlyRequested = false);
 	void flushClientPermissionCache(ServerUser *u, MumbleProto::PermissionQuery &mpqq);
+	/// Drops the cached permissions of the given user or of all users if p is nullptr
+	///
+	/// Dropping a single user's permissions only suffices if nothing but that user's properties changed (its
+	/// channel, ID, certificate, access tokens or its memberships in existing groups). Adding or removing groups or
+	/// ACLs requires clearACLCache(Channel *) for the channel they belong to, as the compiled ACLs of its subtree
+	/// refer to the groups that existed when they have been compiled.
 	void clearACLCache(User *p = nullptr);
+	/// Drops the cached permissions in the given channel and all channels below it for all users. This is all that
+	/// is needed after the ACLs or groups of a channel changed, as these don't affect permissions elsewhere.
+	///
+	/// @param c The channel whose ACLs, groups or parent changed
+	/// @param hierarchyChanged Whether c has been moved to another parent. Whether group specifications such as
+	/// "sub" apply to the users in the subtree may have changed in any channel, so their permissions are dropped
+	/// entirely.
+	void clearACLCache(Channel *c, bool hierarchyChanged = false);
+	/// Updates whether the given user is suppressed according to its Speak permission. Requires a lock on qmCache.
+	void updateSuppression(ServerUser *u);
+	/// Replaces the whisper target caches of all users with rebuilt ones
 	void clearWhisperTargetCache();
+	/// Replaces the whisper target caches that may have changed because of a change to the given user: the user's
+	/// own ones and the ones the user is (or may have become) a receiver of
+	void clearWhisperTargetCache(ServerUser *u);
+	/// Replaces the whisper target caches that depend on the users, listeners or ACLs of any of the given channels
+	void clearWhisperTargetCache(const QSet< Channel * > &channels);
+	/// Builds the missing whisper target caches and the ones the given predicate considers outdated on the main
+	/// thread and then swaps them in with a lock on qrwlVoiceThread, so that voice threads never miss a cache.
+	void rebuildWhisperTargetCaches(
+		const std::function< bool(ServerUser *, const WhisperTarget &, const WhisperTargetCache &) > &isOutdated);
+	/// Computes the receivers of the given whisper target of the given user. Must be called on the main thread.
+	std::shared_ptr< const WhisperTargetCache > buildWhisperTargetCache(ServerUser *u, const WhisperTarget &wt);
+	/// Builds the routing table for regular speech in the given channel. Requires a lock on qrwlVoiceThread.
+	///
+	/// @param c The channel to build the table for
+	/// @param speaker A speaker to include in the table even if it is not (yet) part of the channel's users
+	void buildRoutingTable(Channel *c, ServerUser *speaker, ChannelRoutingTable &table);
+	/// Drops the routing tables that could contain the given channel or all of them if c is nullptr
+	void clearRoutingTables(Channel *c = nullptr);
+	/// Same as clearRoutingTables, but requires a write lock on qrwlVoiceThread. Dropping the tables in the same
+	/// locked section as the change they depend on keeps voice threads from using outdated tables in between.
+	void clearRoutingTablesLocked(Channel *c = nullptr);
 
 	void sendProtoAll(const ::google::protobuf::Message &msg, Mumble::Protocol::TCPMessageType type,
 					  Version::full_t version, Version::CompareMode mode);
@@ -338,6 +525,36 @@ public:
 						 Version::full_t version, Version::CompareMode mode);
 	void sendProtoMessage(ServerUser *, const ::google::protobuf::Message &msg, Mumble::Protocol::TCPMessageType type);
 
+	/// Broadcasts the given UserState to all clients >= 1.2.2 but source once the current tick is over, merged with
+	/// all other changes to the same user within that tick. Any other broadcast sends the pending UserStates
+	/// first, so that clients still see all changes in order.
+	void queueUserState(ServerUser *source, const MumbleProto::UserState &msg);
+	/// Sends all pending UserStates
+	void flushUserStates();
+	/// Sends the pending UserState of the given user (if any)
+	void flushUserState(unsigned int session);
+	void sendUserStateUpdate(const UserStateAggregator::Update &update);
+
+	/// Sends the next pages of the given user's initial synchronization (see InitialSync) until its connection
+	/// falls behind or the synchronization is complete. Called again once the connection has caught up.
+	void continueInitialSync(ServerUser *u);
+	ChannelStateCache::Properties channelStateProperties(const Channel *c) const;
+	void sendInitialChannelState(ServerUser *u, InitialSync &sync, Channel *c);
+	void sendInitialUserState(ServerUser *uSource, ServerUser *u);
+	/// Catches the client up on the changes to the channel tree that happened while it has been sent, sends the
+	/// links and authenticates the client
+	void completeChannelSync(ServerUser *uSource, InitialSync &sync);
+	/// Sends the ServerSync message and the rest of the information that concludes the client's authentication
+	void completeInitialSync(ServerUser *uSource);
+
+	/// Hands the password of the given user's pending authentication to the PasswordHashPool
+	void hashPassword(ServerUser *uSource);
+	/// Resumes the authentication the hash has been computed for, unless the client has gone in the meantime
+	void passwordHashed(unsigned int session, quint64 id, const QString &hash);
+	/// Accepts or rejects the client according to the result of authenticate() and starts the initial
+	/// synchronization if it has been accepted
+	void completeAuthenticate(ServerUser *uSource, const MumbleProto::Authenticate &msg, int id);
+
 	// sendAll sends a protobuf message to all users on the server whose version is either bigger than v or
 	// lower than ~v. If v == 0 the message is sent to everyone.
 #define PROCESS_MUMBLE_TCP_MESSAGE(name, value)                                                        \
@@ -372,7 +589,8 @@ public:
 	void userEnterChannel(User *u, Channel *c, MumbleProto::UserState &mpus);
 	bool unregisterUser(int id);
 
-	Server(int snum, QObject *parent = nullptr);
+	/// @param channelTree The server's channels if they have been read already (see ServerDB::readChannelTrees)
+	Server(int snum, QObject *parent = nullptr, const ChannelTreeData *channelTree = nullptr);
 	~Server();
 
 	bool canNest(Channel *newParent, Channel *channel = nullptr) const;
@@ -429,16 +647,18 @@ public:
 
 	// Database / DBus functions. Implementation in ServerDB.cpp
 	void initialize();
+	/// @param pending If given, a password that has to be hashed with PBKDF2 is not hashed right away. Instead, the
+	/// hash is asked for by returning -4 (see PendingAuthentication).
 	int authenticate(QString &name, const QString &pw, int sessionId = 0, const QStringList &emails = QStringList(),
 					 const QString &certhash = QString(), bool bStrongCert = false,
-					 const QList< QSslCertificate > & = QList< QSslCertificate >());
+					 const QList< QSslCertificate > & = QList< QSslCertificate >(),
+					 PendingAuthentication *pending = nullptr);
 	Channel *addChannel(Channel *c, const QString &name, bool temporary = false, int position = 0,
 						unsigned int maxUsers = 0);
 	void removeChannelDB(const Channel *c);
-	void readChannels(Channel *p = nullptr);
-	void readLinks();
+	/// Creates the channels (along with their ACLs, groups and links) as read by ServerDB::readChannelTree
+	void readChannels(const ChannelTreeData &tree);
 	void updateChannel(const Channel *c);
-	void readChannelPrivs(Channel *c);
 	void setLastChannel(const User *u);
 	int readLastChannel(int id);
 
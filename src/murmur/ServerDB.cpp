@@ -19,14 +19,21 @@
 #include "PBKDF2.h"
 #include "PasswordGenerator.h"
 #include "Server.h"
+#include "ServerDBWriter.h"
 #include "ServerUser.h"
 #include "User.h"
 
 #include <QtCore/QCoreApplication>
+#include <QtCore/QRunnable>
+#include <QtCore/QThread>
+#include <QtCore/QThreadPool>
 #include <QtSql/QSqlError>
 #include <QtSql/QSqlQuery>
 
+#include <algorithm>
+#include <atomic>
 #include <cstdint>
+#include <memory>
 
 #ifdef Q_OS_WIN
 #	include <winsock2.h>
@@ -44,28 +51,99 @@
 #define SOFTEXEC() ServerDB::exec(query, QString(), false)
 
 
+/// Runs a transaction on the main thread's connection. May only be used on the main thread; the writer's tasks are
+/// run in transactions of its own.
 class TransactionHolder {
 public:
 	QSqlQuery *qsqQuery;
+	/// The amount of nested holders. On SQLite, ServerDB::transactionMutex is held from the outermost holder's
+	/// construction to its destruction.
+	static int depth;
+
 	TransactionHolder() {
-		ServerDB::db->transaction();
+		acquire();
 		qsqQuery = new QSqlQuery();
 	}
 
 	~TransactionHolder() {
+		// Makes the statement available for reuse (see ServerDB::prepare)
+		qsqQuery->finish();
 		qsqQuery->clear();
 		delete qsqQuery;
 		ServerDB::db->commit();
+		if (--depth == 0 && serialized()) {
+			ServerDB::transactionMutex.unlock();
+		}
 	}
 	TransactionHolder(const TransactionHolder &other) {
-		ServerDB::db->transaction();
+		acquire();
 		qsqQuery = other.qsqQuery ? new QSqlQuery(*other.qsqQuery) : 0;
 	}
+
+private:
+	static bool serialized() { return Meta::mp.qsDBDriver == "QSQLITE"; }
+
+	static void acquire() {
+		if (depth++ == 0 && serialized()) {
+			ServerDB::transactionMutex.lock();
+		}
+		ServerDB::db->transaction();
+	}
 };
 
+int TransactionHolder::depth = 0;
+
 QSqlDatabase *ServerDB::db = nullptr;
-Timer ServerDB::tLogClean;
 QString ServerDB::qsUpgradeSuffix;
+ServerDBWriter *ServerDB::writer = nullptr;
+QMutex ServerDB::transactionMutex;
+
+/// The prepared statements of the main thread's connection
+static QHash< QString, QSqlQuery > mainStatements;
+
+namespace {
+/// The connection of a thread reading channel trees (see ServerDB::readChannelTrees)
+struct ReaderConnection {
+	QSqlDatabase database;
+	QHash< QString, QSqlQuery > statements;
+};
+} // namespace
+
+/// The connection of the calling thread if it is reading channel trees
+static thread_local ReaderConnection *readerConnection = nullptr;
+/// The log messages that are yet to be written, along with their server
+static QList< QPair< int, QString > > logBuffer;
+
+/// @returns The key writes to the row of the given user in the users table are queued with (see
+/// ServerDBWriter::waitFor)
+static QString userRowKey(int serverID, int userID) {
+	return QString::fromLatin1("users/%1/%2").arg(serverID).arg(userID);
+}
+
+/// @returns The key writes to the channel listeners of the given user are queued with
+static QString channelListenersKey(int serverID, int userID) {
+	return QString::fromLatin1("channel_listeners/%1/%2").arg(serverID).arg(userID);
+}
+
+QSqlDatabase &ServerDB::database() {
+	if (readerConnection) {
+		return readerConnection->database;
+	}
+	if (writer && QThread::currentThread() == writer) {
+		return writer->database();
+	}
+	return *db;
+}
+
+QHash< QString, QSqlQuery > &ServerDB::statements() {
+	if (readerConnection) {
+		return readerConnection->statements;
+	}
+	if (writer && QThread::currentThread() == writer) {
+		return writer->statements();
+	}
+	return mainStatements;
+}
 
 void ServerDB::loadOrSetupMetaPBKDF2IterationCount(QSqlQuery &query) {
 	if (!Meta::mp.legacyPasswordHash) {
@@ -873,16 +951,37 @@ ServerDB::ServerDB() {
 		}
 	}
 	query.clear();
+
+	QString sqliteSynchronous;
+	if (Meta::mp.qsDBDriver == "QSQLITE") {
+		if (Meta::mp.iSQLiteWAL == 1) {
+			sqliteSynchronous = QLatin1String("NORMAL");
+		} else if (Meta::mp.iSQLiteWAL == 2) {
+			sqliteSynchronous = QLatin1String("FULL");
+		}
+	}
+	writer = new ServerDBWriter(*db, sqliteSynchronous);
+
+	connect(&qtLogFlush, &QTimer::timeout, &ServerDB::flushLog);
+	qtLogFlush.start(LOG_FLUSH_INTERVAL);
 }
 
 ServerDB::~ServerDB() {
+	qtLogFlush.stop();
+	flushLog();
+
+	// Commits everything that is still queued
+	delete writer;
+	writer = nullptr;
+
+	mainStatements.clear();
 	db->close();
 	delete db;
 	db = nullptr;
 }
 
 bool ServerDB::prepare(QSqlQuery &query, const QString &str, bool fatal, bool warn) {
-	if (!db->isValid()) {
+	if (!database().isValid()) {
 		qWarning("SQL [%s] rejected: Database is gone", qPrintable(str));
 		return false;
 	}
@@ -900,21 +999,38 @@ bool ServerDB::prepare(QSqlQuery &query, const QString &str, bool fatal, bool wa
 		q.replace("`", "\"");
 	}
 
+	// Whatever the query has been used for before is done with, which allows the statement to be reused
+	query.finish();
+
+	QHash< QString, QSqlQuery > &cache = statements();
+	auto it                            = cache.find(q);
+	if (it != cache.end() && !it->isActive()) {
+		// Shares the statement, so that it doesn't have to be parsed and planned again
+		query = *it;
+		return true;
+	}
+
+	// Preparing a query that shares its statement with another one creates a new statement. If the cached statement
+	// is still in use, it is replaced, as it might never be finished.
 	if (query.prepare(q)) {
+		cache.insert(q, query);
 		return true;
 	} else {
-		db->close();
-		if (!db->open()) {
-			qFatal("Lost connection to SQL Database: Reconnect: %s", qPrintable(db->lastError().text()));
+		QSqlDatabase &connection = database();
+		connection.close();
+		if (!connection.open()) {
+			qFatal("Lost connection to SQL Database: Reconnect: %s", qPrintable(connection.lastError().text()));
 		}
-		query = QSqlQuery();
+		// The statements of the previous connection are gone
+		cache.clear();
+		query = QSqlQuery(connection);
 		if (query.prepare(q)) {
 			qWarning("SQL Connection lost, reconnection OK");
 			return true;
 		}
 
 		if (fatal) {
-			*db = QSqlDatabase();
+			database() = QSqlDatabase();
 			qFatal("SQL Prepare Error [%s]: %s", qPrintable(q), qPrintable(query.lastError().text()));
 		} else if (warn) {
 			qDebug("SQL Prepare Error [%s]: %s", qPrintable(q), qPrintable(query.lastError().text()));
@@ -925,7 +1041,7 @@ bool ServerDB::prepare(QSqlQuery &query, const QString &str, bool fatal, bool wa
 
 bool ServerDB::query(QSqlQuery &query, const QString &str, bool fatal, bool warn) {
 	if (!str.isEmpty()) {
-		if (!db->isValid()) {
+		if (!database().isValid()) {
 			qWarning("SQL [%s] rejected: Database is gone", qPrintable(str));
 			return false;
 		}
@@ -947,7 +1063,7 @@ bool ServerDB::query(QSqlQuery &query, const QString &str, bool fatal, bool warn
 			return true;
 		} else {
 			if (fatal) {
-				*db = QSqlDatabase();
+				database() = QSqlDatabase();
 				qFatal("SQL Error [%s]: %s", qPrintable(query.lastQuery()), qPrintable(query.lastError().text()));
 			} else if (warn) {
 				qDebug("SQL Error [%s]: %s", qPrintable(query.lastQuery()), qPrintable(query.lastError().text()));
@@ -966,7 +1082,7 @@ bool ServerDB::exec(QSqlQuery &query, const QString &str, bool fatal, bool warn)
 		return true;
 	} else {
 		if (fatal) {
-			*db = QSqlDatabase();
+			database() = QSqlDatabase();
 			qFatal("SQL Error [%s]: %s", qPrintable(query.lastQuery()), qPrintable(query.lastError().text()));
 		} else if (warn) {
 			qDebug("SQL Error [%s]: %s", qPrintable(query.lastQuery()), qPrintable(query.lastError().text()));
@@ -982,7 +1098,7 @@ bool ServerDB::execBatch(QSqlQuery &query, const QString &str, bool fatal) {
 		return true;
 	} else {
 		if (fatal) {
-			*db = QSqlDatabase();
+			database() = QSqlDatabase();
 			qFatal("SQL Error [%s]: %s", qPrintable(query.lastQuery()), qPrintable(query.lastError().text()));
 		} else
 			qDebug("SQL Error [%s]: %s", qPrintable(query.lastQuery()), qPrintable(query.lastError().text()));
@@ -1175,6 +1291,9 @@ bool Server::unregisterUserDB(int id) {
 		return false;
 	}
 
+	// Queued writes concerning the user must not recreate any of the rows deleted here
+	ServerDB::writer->flush();
+
 	TransactionHolder th;
 
 	QSqlQuery &query = *th.qsqQuery;
@@ -1302,21 +1421,28 @@ QMap< int, QString > Server::getRegistration(int id) {
 /// @return UserID of authenticated user, -1 for authentication failures, -2 for unknown user (fallthrough),
 ///         -3 for authentication failures where the data could (temporarily) not be verified.
 int Server::authenticate(QString &name, const QString &password, int sessionId, const QStringList &emails,
-						 const QString &certhash, bool bStrongCert, const QList< QSslCertificate > &certs) {
+						 const QString &certhash, bool bStrongCert, const QList< QSslCertificate > &certs,
+						 PendingAuthentication *pending) {
 	int res = bForceExternalAuth ? -3 : -2;
 
-	emit authenticateSig(res, name, sessionId, certs, certhash, bStrongCert, password);
+	if (pending && pending->requested) {
+		// The external authenticators have left this one to us before
+		res = -2;
+	} else {
+		emit authenticateSig(res, name, sessionId, certs, certhash, bStrongCert, password);
+	}
 
 	if (res != -2) {
 		// External authentication handled it. Ignore certificate completely.
 		if (res != -1) {
-			TransactionHolder th;
-			QSqlQuery &query = *th.qsqQuery;
-
+			// May wait for the writer, which must not happen within a transaction on this connection
 			int lchan = readLastChannel(res);
 			if (lchan < 0)
 				lchan = 0;
 
+			TransactionHolder th;
+			QSqlQuery &query = *th.qsqQuery;
+
 			if (Meta::mp.qsDBDriver == "QPSQL") {
 				SQLPREP("INSERT INTO `%1users` (`server_id`, `user_id`, `name`, `lastchannel`) VALUES "
 						"(:server_id,:user_id,:name,:lastchannel) ON CONFLICT (`server_id`, `user_id`) DO UPDATE SET "
@@ -1385,7 +1511,20 @@ int Server::authenticate(QString &name, const QString &password, int sessionId,
 					}
 				}
 			} else {
-				if (PBKDF2::getHash(storedSalt, password, storedKdfIterations) == storedPasswordHash) {
+				if (pending
+					&& (pending->hash.isEmpty() || pending->salt != storedSalt
+						|| pending->iterations != storedKdfIterations)) {
+					// Ask for the hash, which is computed by the PasswordHashPool
+					pending->requested  = true;
+					pending->salt       = storedSalt;
+					pending->iterations = storedKdfIterations;
+					pending->hash.clear();
+					return -4;
+				}
+
+				const QString passwordHash =
+					pending ? pending->hash : PBKDF2::getHash(storedSalt, password, storedKdfIterations);
+				if (passwordHash == storedPasswordHash) {
 					name = query.value(1).toString();
 					res  = query.value(0).toInt();
 
@@ -1772,50 +1911,68 @@ void Server::addLink(Channel *c, Channel *l) {
 	{
 		QWriteLocker wl(&qrwlVoiceThread);
 		c->link(l);
+
+		clearRoutingTablesLocked(c);
+		clearRoutingTablesLocked(l);
 	}
 
+	clearWhisperTargetCache(QSet< Channel * >{ c, l });
+
 	if (c->bTemporary || l->bTemporary)
 		return;
-	TransactionHolder th;
 
-	QSqlQuery &query = *th.qsqQuery;
-	SQLPREP("INSERT INTO `%1channel_links` (`server_id`, `channel_id`, `link_id`) VALUES (?,?,?)");
-	query.addBindValue(iServerNum);
-	query.addBindValue(c->iId);
-	query.addBindValue(l->iId);
-	SQLEXEC();
+	const int serverID  = iServerNum;
+	const int channelID = c->iId;
+	const int linkID    = l->iId;
+	ServerDB::writer->enqueue([serverID, channelID, linkID](QSqlQuery &query) {
+		SQLPREP("INSERT INTO `%1channel_links` (`server_id`, `channel_id`, `link_id`) VALUES (?,?,?)");
+		query.addBindValue(serverID);
+		query.addBindValue(channelID);
+		query.addBindValue(linkID);
+		SQLEXEC();
 
-	query.addBindValue(iServerNum);
-	query.addBindValue(l->iId);
-	query.addBindValue(c->iId);
-	SQLEXEC();
+		query.addBindValue(serverID);
+		query.addBindValue(linkID);
+		query.addBindValue(channelID);
+		SQLEXEC();
+	});
 }
 
 void Server::removeLink(Channel *c, Channel *l) {
 	{
 		QWriteLocker wl(&qrwlVoiceThread);
 		c->unlink(l);
+
+		clearRoutingTablesLocked(c);
+		clearRoutingTablesLocked(l);
 	}
 
+	clearWhisperTargetCache(QSet< Channel * >{ c, l });
+
 	if (c->bTemporary || l->bTemporary)
 		return;
-	TransactionHolder th;
-
-	QSqlQuery &query = *th.qsqQuery;
 
-	SQLPREP("DELETE FROM `%1channel_links` WHERE `server_id` = ? AND `channel_id` = ? AND `link_id` = ?");
-	query.addBindValue(iServerNum);
-	query.addBindValue(c->iId);
-	query.addBindValue(l->iId);
-	SQLEXEC();
+	const int serverID  = iServerNum;
+	const int channelID = c->iId;
+	const int linkID    = l->iId;
+	ServerDB::writer->enqueue([serverID, channelID, linkID](QSqlQuery &query) {
+		SQLPREP("DELETE FROM `%1channel_links` WHERE `server_id` = ? AND `channel_id` = ? AND `link_id` = ?");
+		query.addBindValue(serverID);
+		query.addBindValue(channelID);
+		query.addBindValue(linkID);
+		SQLEXEC();
 
-	query.addBindValue(iServerNum);
-	query.addBindValue(l->iId);
-	query.addBindValue(c->iId);
-	SQLEXEC();
+		query.addBindValue(serverID);
+		query.addBindValue(linkID);
+		query.addBindValue(channelID);
+		SQLEXEC();
+	});
 }
 
 Channel *Server::addChannel(Channel *p, const QString &name, bool temporary, int position, unsigned int maxUsers) {
+	// The ID of a removed channel may be reused, so its rows have to be gone
+	ServerDB::writer->flush();
+
 	TransactionHolder th;
 
 	QSqlQuery &query = *th.qsqQuery;
@@ -1871,13 +2028,14 @@ Channel *Server::addChannel(Channel *p, const QString &name, bool temporary, int
 
 void Server::removeChannelDB(const Channel *c) {
 	if (!c->bTemporary) {
-		TransactionHolder th;
-
-		QSqlQuery &query = *th.qsqQuery;
-		SQLPREP("DELETE FROM `%1channels` WHERE `server_id` = ? AND `channel_id` = ?");
-		query.addBindValue(iServerNum);
-		query.addBindValue(c->iId);
-		SQLEXEC();
+		const int serverID  = iServerNum;
+		const int channelID = c->iId;
+		ServerDB::writer->enqueue([serverID, channelID](QSqlQuery &query) {
+			SQLPREP("DELETE FROM `%1channels` WHERE `server_id` = ? AND `channel_id` = ?");
+			query.addBindValue(serverID);
+			query.addBindValue(channelID);
+			SQLEXEC();
+		});
 	}
 	qhChannels.remove(c->iId);
 }
@@ -1885,285 +2043,438 @@ void Server::removeChannelDB(const Channel *c) {
 void Server::updateChannel(const Channel *c) {
 	if (c->bTemporary)
 		return;
-	TransactionHolder th;
-	Group *g;
-	ChanACL *acl;
 
-	QSqlQuery &query = *th.qsqQuery;
-	SQLPREP("UPDATE `%1channels` SET `name` = ?, `parent_id` = ?, `inheritacl` = ? WHERE `server_id` = ? AND "
-			"`channel_id` = ?");
-	query.addBindValue(c->qsName);
-	query.addBindValue(c->cParent ? c->cParent->iId : QVariant());
-	query.addBindValue(c->bInheritACL ? 1 : 0);
-	query.addBindValue(iServerNum);
-	query.addBindValue(c->iId);
-	SQLEXEC();
-
-	// Update channel description information
-	if (Meta::mp.qsDBDriver == "QPSQL") {
-		SQLPREP("INSERT INTO `%1channel_info` (`server_id`, `channel_id`, `key`, `value`) VALUES (:server_id, "
-				":channel_id, :key, :value) ON CONFLICT (`server_id`, `channel_id`, `key`) DO UPDATE SET `value` = "
-				":u_value WHERE `%1channel_info`.`server_id` = :u_server_id AND `%1channel_info`.`channel_id` = "
-				":u_channel_id AND `%1channel_info`.`key` = :u_key");
-		query.bindValue(":server_id", iServerNum);
-		query.bindValue(":channel_id", c->iId);
-		query.bindValue(":key", ServerDB::Channel_Description);
-		query.bindValue(":value", c->qsDesc);
-		query.bindValue(":u_server_id", iServerNum);
-		query.bindValue(":u_channel_id", c->iId);
-		query.bindValue(":u_key", ServerDB::Channel_Description);
-		query.bindValue(":u_value", c->qsDesc);
-		SQLEXEC();
-	} else {
-		SQLPREP("REPLACE INTO `%1channel_info` (`server_id`, `channel_id`, `key`, `value`) VALUES (?, ?, ?, ?)");
-		query.addBindValue(iServerNum);
-		query.addBindValue(c->iId);
-		query.addBindValue(ServerDB::Channel_Description);
-		query.addBindValue(c->qsDesc);
-		SQLEXEC();
-	}
-	// Update channel position information
-	if (Meta::mp.qsDBDriver == "QPSQL") {
-		query.bindValue(":server_id", iServerNum);
-		query.bindValue(":channel_id", c->iId);
-		query.bindValue(":key", ServerDB::Channel_Position);
-		query.bindValue(":value", QVariant(c->iPosition).toString());
-		query.bindValue(":u_server_id", iServerNum);
-		query.bindValue(":u_channel_id", c->iId);
-		query.bindValue(":u_key", ServerDB::Channel_Position);
-		query.bindValue(":u_value", QVariant(c->iPosition).toString());
-		SQLEXEC();
-	} else {
-		query.addBindValue(iServerNum);
-		query.addBindValue(c->iId);
-		query.addBindValue(ServerDB::Channel_Position);
-		query.addBindValue(QVariant(c->iPosition).toString());
-		SQLEXEC();
-	}
-	// Update channel maximum channels
-	if (Meta::mp.qsDBDriver == "QPSQL") {
-		query.bindValue(":server_id", iServerNum);
-		query.bindValue(":channel_id", c->iId);
-		query.bindValue(":key", ServerDB::Channel_Max_Users);
-		query.bindValue(":value", QVariant(c->uiMaxUsers).toString());
-		query.bindValue(":u_server_id", iServerNum);
-		query.bindValue(":u_channel_id", c->iId);
-		query.bindValue(":u_key", ServerDB::Channel_Max_Users);
-		query.bindValue(":u_value", QVariant(c->uiMaxUsers).toString());
-		SQLEXEC();
-	} else {
-		query.addBindValue(iServerNum);
-		query.addBindValue(c->iId);
-		query.addBindValue(ServerDB::Channel_Max_Users);
-		query.addBindValue(QVariant(c->uiMaxUsers).toString());
+	/// The state of a group at the time the channel has been updated
+	struct GroupRecord {
+		QString name;
+		bool inherit;
+		bool inheritable;
+		QSet< int > add;
+		QSet< int > remove;
+	};
+	/// The state of an ACL entry at the time the channel has been updated
+	struct ACLRecord {
+		int userID;
+		QString group;
+		bool applyHere;
+		bool applySubs;
+		int allow;
+		int deny;
+	};
+
+	const int serverID      = iServerNum;
+	const int channelID     = c->iId;
+	const QVariant parentID = c->cParent ? c->cParent->iId : QVariant();
+	const bool inheritACL   = c->bInheritACL;
+	const QString name      = c->qsName;
+	const QString desc      = c->qsDesc;
+	const QString position  = QVariant(c->iPosition).toString();
+	const QString maxUsers  = QVariant(c->uiMaxUsers).toString();
+	QList< GroupRecord > groups;
+	QList< ACLRecord > acls;
+
+	for (const Group *g : c->qhGroups) {
+		groups << GroupRecord{ g->qsName, g->bInherit, g->bInheritable, g->qsAdd, g->qsRemove };
+	}
+	for (const ChanACL *acl : c->qlACL) {
+		acls << ACLRecord{ acl->iUserId,
+						   acl->qsGroup,
+						   acl->bApplyHere,
+						   acl->bApplySubs,
+						   static_cast< int >(acl->pAllow),
+						   static_cast< int >(acl->pDeny) };
+	}
+
+	ServerDB::writer->enqueue([serverID, channelID, parentID, inheritACL, name, desc, position, maxUsers, groups,
+							   acls](QSqlQuery &query) {
+		SQLPREP("UPDATE `%1channels` SET `name` = ?, `parent_id` = ?, `inheritacl` = ? WHERE `server_id` = ? AND "
+				"`channel_id` = ?");
+		query.addBindValue(name);
+		query.addBindValue(parentID);
+		query.addBindValue(inheritACL ? 1 : 0);
+		query.addBindValue(serverID);
+		query.addBindValue(channelID);
 		SQLEXEC();
-	}
 
-	SQLPREP("DELETE FROM `%1groups` WHERE `server_id` = ? AND `channel_id` = ?");
-	query.addBindValue(iServerNum);
-	query.addBindValue(c->iId);
-	SQLEXEC();
+		const QList< QPair< int, QString > > info = { { ServerDB::Channel_Description, desc },
+													  { ServerDB::Channel_Position, position },
+													  { ServerDB::Channel_Max_Users, maxUsers } };
 
-	SQLPREP("DELETE FROM `%1acl` WHERE `server_id` = ? AND `channel_id` = ?");
-	query.addBindValue(iServerNum);
-	query.addBindValue(c->iId);
-	SQLEXEC();
+		// Update channel description, position and maximum users information
+		if (Meta::mp.qsDBDriver == "QPSQL") {
+			SQLPREP("INSERT INTO `%1channel_info` (`server_id`, `channel_id`, `key`, `value`) VALUES (:server_id, "
+					":channel_id, :key, :value) ON CONFLICT (`server_id`, `channel_id`, `key`) DO UPDATE SET `value` = "
+					":u_value WHERE `%1channel_info`.`server_id` = :u_server_id AND `%1channel_info`.`channel_id` = "
+					":u_channel_id AND `%1channel_info`.`key` = :u_key");
+			for (const QPair< int, QString > &entry : info) {
+				query.bindValue(":server_id", serverID);
+				query.bindValue(":channel_id", channelID);
+				query.bindValue(":key", entry.first);
+				query.bindValue(":value", entry.second);
+				query.bindValue(":u_server_id", serverID);
+				query.bindValue(":u_channel_id", channelID);
+				query.bindValue(":u_key", entry.first);
+				query.bindValue(":u_value", entry.second);
+				SQLEXEC();
+			}
+		} else {
+			SQLPREP("REPLACE INTO `%1channel_info` (`server_id`, `channel_id`, `key`, `value`) VALUES (?, ?, ?, ?)");
+			for (const QPair< int, QString > &entry : info) {
+				query.addBindValue(serverID);
+				query.addBindValue(channelID);
+				query.addBindValue(entry.first);
+				query.addBindValue(entry.second);
+				SQLEXEC();
+			}
+		}
 
-	foreach (g, c->qhGroups) {
-		int id = 0;
-		int pid;
+		SQLPREP("DELETE FROM `%1groups` WHERE `server_id` = ? AND `channel_id` = ?");
+		query.addBindValue(serverID);
+		query.addBindValue(channelID);
+		SQLEXEC();
 
-		if (Meta::mp.qsDBDriver == "QPSQL") {
-			SQLPREP("INSERT INTO `%1groups` (`server_id`, `channel_id`, `name`, `inherit`, `inheritable`) VALUES "
-					"(?,?,?,?,?) RETURNING group_id");
-			query.addBindValue(iServerNum);
-			query.addBindValue(g->c->iId);
-			query.addBindValue(g->qsName);
-			query.addBindValue(g->bInherit ? 1 : 0);
-			query.addBindValue(g->bInheritable ? 1 : 0);
-			SQLEXEC();
+		SQLPREP("DELETE FROM `%1acl` WHERE `server_id` = ? AND `channel_id` = ?");
+		query.addBindValue(serverID);
+		query.addBindValue(channelID);
+		SQLEXEC();
 
-			if (query.next()) {
-				id = query.value(0).toInt();
+		for (const GroupRecord &g : groups) {
+			int id = 0;
+
+			if (Meta::mp.qsDBDriver == "QPSQL") {
+				SQLPREP("INSERT INTO `%1groups` (`server_id`, `channel_id`, `name`, `inherit`, `inheritable`) VALUES "
+						"(?,?,?,?,?) RETURNING group_id");
+				query.addBindValue(serverID);
+				query.addBindValue(channelID);
+				query.addBindValue(g.name);
+				query.addBindValue(g.inherit ? 1 : 0);
+				query.addBindValue(g.inheritable ? 1 : 0);
+				SQLEXEC();
+
+				if (query.next()) {
+					id = query.value(0).toInt();
+				} else {
+					qFatal("ServerDB: internal query failure: PostgreSQL query did not return the inserted group's "
+						   "group_id");
+				}
 			} else {
-				qFatal(
-					"ServerDB: internal query failure: PostgreSQL query did not return the inserted group's group_id");
+				SQLPREP("REPLACE INTO `%1groups` (`server_id`, `channel_id`, `name`, `inherit`, `inheritable`) VALUES "
+						"(?,?,?,?,?)");
+				query.addBindValue(serverID);
+				query.addBindValue(channelID);
+				query.addBindValue(g.name);
+				query.addBindValue(g.inherit ? 1 : 0);
+				query.addBindValue(g.inheritable ? 1 : 0);
+				SQLEXEC();
+
+				id = query.lastInsertId().toInt();
 			}
-		} else {
-			SQLPREP("REPLACE INTO `%1groups` (`server_id`, `channel_id`, `name`, `inherit`, `inheritable`) VALUES "
-					"(?,?,?,?,?)");
-			query.addBindValue(iServerNum);
-			query.addBindValue(g->c->iId);
-			query.addBindValue(g->qsName);
-			query.addBindValue(g->bInherit ? 1 : 0);
-			query.addBindValue(g->bInheritable ? 1 : 0);
-			SQLEXEC();
 
-			id = query.lastInsertId().toInt();
+			foreach (int pid, g.add) {
+				SQLPREP(
+					"INSERT INTO `%1group_members` (`group_id`, `server_id`, `user_id`, `addit`) VALUES (?, ?, ?, ?)");
+				query.addBindValue(id);
+				query.addBindValue(serverID);
+				query.addBindValue(pid);
+				query.addBindValue(1);
+				SQLEXEC();
+			}
+			foreach (int pid, g.remove) {
+				SQLPREP(
+					"INSERT INTO `%1group_members` (`group_id`, `server_id`, `user_id`, `addit`) VALUES (?, ?, ?, ?)");
+				query.addBindValue(id);
+				query.addBindValue(serverID);
+				query.addBindValue(pid);
+				query.addBindValue(0);
+				SQLEXEC();
+			}
 		}
 
-		foreach (pid, g->qsAdd) {
-			SQLPREP("INSERT INTO `%1group_members` (`group_id`, `server_id`, `user_id`, `addit`) VALUES (?, ?, ?, ?)");
-			query.addBindValue(id);
-			query.addBindValue(iServerNum);
-			query.addBindValue(pid);
-			query.addBindValue(1);
+		int pri = 5;
+
+		for (const ACLRecord &acl : acls) {
+			SQLPREP("INSERT INTO `%1acl` (`server_id`, `channel_id`, `priority`, `user_id`, `group_name`, "
+					"`apply_here`, `apply_sub`, `grantpriv`, `revokepriv`) VALUES (?,?,?,?,?,?,?,?,?)");
+			query.addBindValue(serverID);
+			query.addBindValue(channelID);
+			query.addBindValue(pri++);
+
+			query.addBindValue((acl.userID == -1) ? QVariant() : acl.userID);
+			query.addBindValue((acl.group.isEmpty()) ? QVariant() : acl.group);
+			query.addBindValue(acl.applyHere ? 1 : 0);
+			query.addBindValue(acl.applySubs ? 1 : 0);
+			query.addBindValue(acl.allow);
+			query.addBindValue(acl.deny);
 			SQLEXEC();
 		}
-		foreach (pid, g->qsRemove) {
-			SQLPREP("INSERT INTO `%1group_members` (`group_id`, `server_id`, `user_id`, `addit`) VALUES (?, ?, ?, ?)");
-			query.addBindValue(id);
-			query.addBindValue(iServerNum);
-			query.addBindValue(pid);
-			query.addBindValue(0);
-			SQLEXEC();
-		}
-	}
+	});
+}
 
-	int pri = 5;
+ChannelTreeData ServerDB::readChannelTree(int server_id) {
+	Timer timer;
 
-	foreach (acl, c->qlACL) {
-		SQLPREP("INSERT INTO `%1acl` (`server_id`, `channel_id`, `priority`, `user_id`, `group_name`, `apply_here`, "
-				"`apply_sub`, `grantpriv`, `revokepriv`) VALUES (?,?,?,?,?,?,?,?,?)");
-		query.addBindValue(iServerNum);
-		query.addBindValue(acl->c->iId);
-		query.addBindValue(pri++);
-
-		query.addBindValue((acl->iUserId == -1) ? QVariant() : acl->iUserId);
-		query.addBindValue((acl->qsGroup.isEmpty()) ? QVariant() : acl->qsGroup);
-		query.addBindValue(acl->bApplyHere ? 1 : 0);
-		query.addBindValue(acl->bApplySubs ? 1 : 0);
-		query.addBindValue(static_cast< int >(acl->pAllow));
-		query.addBindValue(static_cast< int >(acl->pDeny));
-		SQLEXEC();
+	// The threads of readChannelTrees run transactions of their own
+	std::unique_ptr< TransactionHolder > th;
+	if (!readerConnection) {
+		th = std::make_unique< TransactionHolder >();
 	}
-}
 
-/** Reads the channel privileges (group and acl) as well as the channel information key/value pairs from the database.
- * @param c Channel to fetch information for
- */
-void Server::readChannelPrivs(Channel *c) {
-	TransactionHolder th;
+	ChannelTreeData tree;
+	QSqlQuery query(database());
 
-	int cid = c->iId;
+	// The position of each channel and group in the tree's lists by their ID
+	QHash< int, int > channels;
+	QHash< int, int > groups;
 
-	QSqlQuery &query = *th.qsqQuery;
+	SQLPREP("SELECT `channel_id`, `parent_id`, `name`, `inheritacl` FROM `%1channels` WHERE `server_id` = ? ORDER BY "
+			"`name`");
+	query.addBindValue(server_id);
+	SQLEXEC();
+	while (query.next()) {
+		ChannelTreeData::ChannelRow channel;
+		channel.id         = query.value(0).toInt();
+		channel.parentID   = query.value(1).isNull() ? -1 : query.value(1).toInt();
+		channel.name       = query.value(2).toString();
+		channel.inheritACL = query.value(3).toBool();
 
-	SQLPREP("SELECT `key`, `value` FROM `%1channel_info` WHERE `server_id` = ? AND `channel_id` = ?");
-	query.addBindValue(iServerNum);
-	query.addBindValue(cid);
+		channels.insert(channel.id, tree.channels.size());
+		tree.channels << channel;
+	}
+
+	SQLPREP("SELECT `channel_id`, `key`, `value` FROM `%1channel_info` WHERE `server_id` = ?");
+	query.addBindValue(server_id);
 	SQLEXEC();
 	while (query.next()) {
-		int key              = query.value(0).toInt();
-		const QString &value = query.value(1).toString();
+		const int index = channels.value(query.value(0).toInt(), -1);
+		if (index < 0) {
+			continue;
+		}
+
+		ChannelTreeData::ChannelRow &channel = tree.channels[index];
+		const int key                        = query.value(1).toInt();
+		const QString value                  = query.value(2).toString();
 		if (key == ServerDB::Channel_Description) {
-			hashAssign(c->qsDesc, c->qbaDescHash, value);
+			channel.description = value;
 		} else if (key == ServerDB::Channel_Position) {
-			c->iPosition = QVariant(value).toInt(); // If the conversion fails it'll return the default value 0
+			channel.position = QVariant(value).toInt(); // If the conversion fails it'll return the default value 0
 		} else if (key == ServerDB::Channel_Max_Users) {
-			c->uiMaxUsers = QVariant(value).toUInt(); // If the conversion fails it'll return the default value 0
+			channel.maxUsers = QVariant(value).toUInt(); // If the conversion fails it'll return the default value 0
 		}
 	}
 
-	SQLPREP("SELECT `group_id`, `name`, `inherit`, `inheritable` FROM `%1groups` WHERE `server_id` = ? AND "
-			"`channel_id` = ?");
-	query.addBindValue(iServerNum);
-	query.addBindValue(cid);
+	SQLPREP("SELECT `group_id`, `channel_id`, `name`, `inherit`, `inheritable` FROM `%1groups` WHERE `server_id` = ?");
+	query.addBindValue(server_id);
 	SQLEXEC();
 	while (query.next()) {
-		int gid         = query.value(0).toInt();
-		QString name    = query.value(1).toString();
-		Group *g        = new Group(c, name);
-		g->bInherit     = query.value(2).toBool();
-		g->bInheritable = query.value(3).toBool();
-
-		QSqlQuery mem;
-		mem.prepare(QString::fromLatin1("SELECT user_id, addit FROM %1group_members WHERE group_id = ?")
-						.arg(Meta::mp.qsDBPrefix));
-		mem.addBindValue(gid);
-		mem.exec();
-		while (mem.next()) {
-			int uid = mem.value(0).toInt();
-			if (mem.value(1).toBool())
-				g->qsAdd << uid;
-			else
-				g->qsRemove << uid;
+		ChannelTreeData::GroupRow group;
+		group.channelID   = query.value(1).toInt();
+		group.name        = query.value(2).toString();
+		group.inherit     = query.value(3).toBool();
+		group.inheritable = query.value(4).toBool();
+
+		groups.insert(query.value(0).toInt(), tree.groups.size());
+		tree.groups << group;
+	}
+
+	SQLPREP("SELECT `group_id`, `user_id`, `addit` FROM `%1group_members` WHERE `server_id` = ?");
+	query.addBindValue(server_id);
+	SQLEXEC();
+	while (query.next()) {
+		const int index = groups.value(query.value(0).toInt(), -1);
+		if (index < 0) {
+			continue;
+		}
+
+		ChannelTreeData::GroupRow &group = tree.groups[index];
+		if (query.value(2).toBool()) {
+			group.add << query.value(1).toInt();
+		} else {
+			group.remove << query.value(1).toInt();
 		}
 	}
 
-	SQLPREP("SELECT `user_id`, `group_name`, `apply_here`, `apply_sub`, `grantpriv`, `revokepriv` FROM `%1acl` WHERE "
-			"`server_id` = ? AND `channel_id` = ? ORDER BY `priority`");
-	query.addBindValue(iServerNum);
-	query.addBindValue(cid);
+	SQLPREP("SELECT `channel_id`, `user_id`, `group_name`, `apply_here`, `apply_sub`, `grantpriv`, `revokepriv` FROM "
+			"`%1acl` WHERE `server_id` = ? ORDER BY `channel_id`, `priority`");
+	query.addBindValue(server_id);
 	SQLEXEC();
 	while (query.next()) {
-		ChanACL *acl    = new ChanACL(c);
-		acl->iUserId    = query.value(0).isNull() ? -1 : query.value(0).toInt();
-		acl->qsGroup    = query.value(1).toString();
-		acl->bApplyHere = query.value(2).toBool();
-		acl->bApplySubs = query.value(3).toBool();
-		acl->pAllow     = static_cast< ChanACL::Permissions >(query.value(4).toInt());
-		acl->pDeny      = static_cast< ChanACL::Permissions >(query.value(5).toInt());
+		ChannelTreeData::ACLRow acl;
+		acl.channelID = query.value(0).toInt();
+		acl.userID    = query.value(1).isNull() ? -1 : query.value(1).toInt();
+		acl.group     = query.value(2).toString();
+		acl.applyHere = query.value(3).toBool();
+		acl.applySubs = query.value(4).toBool();
+		acl.allow     = static_cast< unsigned int >(query.value(5).toInt());
+		acl.deny      = static_cast< unsigned int >(query.value(6).toInt());
+
+		tree.acls << acl;
 	}
+
+	SQLPREP("SELECT `channel_id`, `link_id` FROM `%1channel_links` WHERE `server_id` = ?");
+	query.addBindValue(server_id);
+	SQLEXEC();
+	while (query.next()) {
+		tree.links << qMakePair(query.value(0).toInt(), query.value(1).toInt());
+	}
+
+	// Makes the statement available to the next call
+	query.finish();
+
+	tree.readTime = timer.elapsed();
+
+	return tree;
 }
 
-void Server::readChannels(Channel *p) {
-	QList< Channel * > kids;
-	Channel *c;
-	QSqlQuery query;
-	int parentid = -1;
+namespace {
+/// Reads channel trees on a thread of the pool in ServerDB::readChannelTrees. Every task opens a connection of its
+/// own and keeps taking the next server that hasn't been read yet.
+class ChannelTreeTask : public QRunnable {
+public:
+	ChannelTreeTask(const QSqlDatabase &database, int index, const QList< int > &serverIDs, std::atomic< int > &next,
+					QMutex &mutex, QHash< int, ChannelTreeData > &trees)
+		: m_driverName(database.driverName()), m_databaseName(database.databaseName()),
+		  m_hostName(database.hostName()), m_port(database.port()), m_userName(database.userName()),
+		  m_password(database.password()), m_connectOptions(database.connectOptions()),
+		  m_connectionName(QString::fromLatin1("ChannelTreeReader%1").arg(index)), m_serverIDs(serverIDs),
+		  m_next(next), m_mutex(mutex), m_trees(trees) {}
+
+	void run() override {
+		{
+			ReaderConnection connection;
+			connection.database = QSqlDatabase::addDatabase(m_driverName, m_connectionName);
+			connection.database.setDatabaseName(m_databaseName);
+			connection.database.setHostName(m_hostName);
+			connection.database.setPort(m_port);
+			connection.database.setUserName(m_userName);
+			connection.database.setPassword(m_password);
+			connection.database.setConnectOptions(m_connectOptions);
+
+			// The servers that are left are read by the main thread once they boot
+			if (connection.database.open()) {
+				readerConnection = &connection;
+
+				for (int i = m_next++; i < m_serverIDs.size(); i = m_next++) {
+					connection.database.transaction();
+					ChannelTreeData tree = ServerDB::readChannelTree(m_serverIDs.at(i));
+					connection.database.commit();
+
+					QMutexLocker l(&m_mutex);
+					m_trees.insert(m_serverIDs.at(i), std::move(tree));
+				}
 
-	if (p) {
-		parentid = p->iId;
-		readChannelPrivs(qhChannels.value(parentid));
+				readerConnection = nullptr;
+				connection.statements.clear();
+				connection.database.close();
+			} else {
+				qWarning("ServerDB: Failed to open a connection for reading channels: %s",
+						 qPrintable(connection.database.lastError().text()));
+			}
+		}
+
+		QSqlDatabase::removeDatabase(m_connectionName);
 	}
 
-	{
-		TransactionHolder th;
-		if (parentid == -1) {
-			SQLPREP("SELECT `channel_id`, `name`, `inheritacl` FROM `%1channels` WHERE `server_id` = ? AND `parent_id` "
-					"IS NULL ORDER BY `name`");
-			query.addBindValue(iServerNum);
-		} else {
-			SQLPREP("SELECT `channel_id`, `name`, `inheritacl` FROM `%1channels` WHERE `server_id` = ? AND "
-					"`parent_id`=? ORDER BY `name`");
-			query.addBindValue(iServerNum);
-			query.addBindValue(parentid);
-		}
-		SQLEXEC();
+protected:
+	QString m_driverName;
+	QString m_databaseName;
+	QString m_hostName;
+	int m_port;
+	QString m_userName;
+	QString m_password;
+	QString m_connectOptions;
+	QString m_connectionName;
 
-		while (query.next()) {
-			c = new Channel(query.value(0).toInt(), query.value(1).toString(), p);
+	const QList< int > &m_serverIDs;
+	std::atomic< int > &m_next;
+	QMutex &m_mutex;
+	QHash< int, ChannelTreeData > &m_trees;
+};
+} // namespace
+
+QHash< int, ChannelTreeData > ServerDB::readChannelTrees(const QList< int > &server_ids, unsigned int threads) {
+	QHash< int, ChannelTreeData > trees;
+
+	if (threads <= 1 || server_ids.size() <= 1) {
+		foreach (int server_id, server_ids) { trees.insert(server_id, readChannelTree(server_id)); }
+		return trees;
+	}
+
+	std::atomic< int > next(0);
+	QMutex mutex;
+
+	const int taskCount = std::min(static_cast< int >(threads), server_ids.size());
+
+	QThreadPool pool;
+	pool.setMaxThreadCount(taskCount);
+	for (int i = 0; i < taskCount; ++i) {
+		pool.start(new ChannelTreeTask(*db, i, server_ids, next, mutex, trees));
+	}
+	pool.waitForDone();
+
+	return trees;
+}
+
+void Server::readChannels(const ChannelTreeData &tree) {
+	QHash< int, QList< const ChannelTreeData::ChannelRow * > > children;
+	for (const ChannelTreeData::ChannelRow &row : tree.channels) {
+		children[row.parentID] << &row;
+	}
+
+	// The children of every channel are added in the order they have been read in (by name). Channels that can't be
+	// reached from the root (e.g. because their parent is gone) are left out.
+	QList< Channel * > pending;
+	pending << nullptr;
+	while (!pending.isEmpty()) {
+		Channel *p = pending.takeFirst();
+
+		for (const ChannelTreeData::ChannelRow *row : children.value(p ? p->iId : -1)) {
+			Channel *c = new Channel(row->id, row->name, p);
 			if (!p)
 				c->setParent(this);
 			qhChannels.insert(c->iId, c);
-			c->bInheritACL = query.value(2).toBool();
-			kids << c;
-		}
-	}
 
-	query.clear();
+			c->bInheritACL = row->inheritACL;
+			if (!row->description.isNull()) {
+				hashAssign(c->qsDesc, c->qbaDescHash, row->description);
+			}
+			c->iPosition  = row->position;
+			c->uiMaxUsers = row->maxUsers;
 
-	foreach (c, kids)
-		readChannels(c);
-}
+			pending << c;
+		}
+	}
 
-void Server::readLinks() {
-	TransactionHolder th;
-	QSqlQuery &query = *th.qsqQuery;
+	for (const ChannelTreeData::GroupRow &row : tree.groups) {
+		Channel *c = qhChannels.value(row.channelID);
+		if (!c)
+			continue;
 
-	SQLPREP("SELECT `channel_id`, `link_id` FROM `%1channel_links` WHERE `server_id` = ?");
-	query.addBindValue(iServerNum);
-	SQLEXEC();
+		Group *g        = new Group(c, row.name);
+		g->bInherit     = row.inherit;
+		g->bInheritable = row.inheritable;
+		g->qsAdd        = row.add;
+		g->qsRemove     = row.remove;
+	}
 
-	while (query.next()) {
-		int cid = query.value(0).toInt();
-		int lid = query.value(1).toInt();
+	for (const ChannelTreeData::ACLRow &row : tree.acls) {
+		Channel *c = qhChannels.value(row.channelID);
+		if (!c)
+			continue;
 
-		Channel *c = qhChannels.value(cid);
-		Channel *l = qhChannels.value(lid);
+		ChanACL *acl    = new ChanACL(c);
+		acl->iUserId    = row.userID;
+		acl->qsGroup    = row.group;
+		acl->bApplyHere = row.applyHere;
+		acl->bApplySubs = row.applySubs;
+		acl->pAllow     = static_cast< ChanACL::Permissions >(row.allow);
+		acl->pDeny      = static_cast< ChanACL::Permissions >(row.deny);
+	}
+
+	QWriteLocker wl(&qrwlVoiceThread);
+	for (const QPair< int, int > &link : tree.links) {
+		Channel *c = qhChannels.value(link.first);
+		Channel *l = qhChannels.value(link.second);
 		if (c && l) {
-			QWriteLocker wl(&qrwlVoiceThread);
 			c->link(l);
 		}
 	}
@@ -2176,18 +2487,21 @@ void Server::setLastChannel(const User *p) {
 	if (p->cChannel->bTemporary)
 		return;
 
-	TransactionHolder th;
-	QSqlQuery &query = *th.qsqQuery;
-
-	if (Meta::mp.qsDBDriver == "QSQLITE") {
-		SQLPREP("UPDATE `%1users` SET `lastchannel`=? WHERE `server_id` = ? AND `user_id` = ?");
-	} else {
-		SQLPREP("UPDATE `%1users` SET `lastchannel`=?, `last_active` = now() WHERE `server_id` = ? AND `user_id` = ?");
-	}
-	query.addBindValue(p->cChannel->iId);
-	query.addBindValue(iServerNum);
-	query.addBindValue(p->iId);
-	SQLEXEC();
+	const int channelID = p->cChannel->iId;
+	const int serverID  = iServerNum;
+	const int userID    = p->iId;
+	ServerDB::writer->enqueue(userRowKey(serverID, userID), [channelID, serverID, userID](QSqlQuery &query) {
+		if (Meta::mp.qsDBDriver == "QSQLITE") {
+			SQLPREP("UPDATE `%1users` SET `lastchannel`=? WHERE `server_id` = ? AND `user_id` = ?");
+		} else {
+			SQLPREP(
+				"UPDATE `%1users` SET `lastchannel`=?, `last_active` = now() WHERE `server_id` = ? AND `user_id` = ?");
+		}
+		query.addBindValue(channelID);
+		query.addBindValue(serverID);
+		query.addBindValue(userID);
+		SQLEXEC();
+	});
 }
 
 int Server::readLastChannel(int id) {
@@ -2197,17 +2511,27 @@ int Server::readLastChannel(int id) {
 	if (!Meta::mp.bRememberChan)
 		return -1;
 
-	TransactionHolder th;
-	QSqlQuery &query = *th.qsqQuery;
+	// The channel and the time of a disconnect just before may not have been written yet
+	ServerDB::writer->waitFor(userRowKey(iServerNum, id));
 
-	SQLPREP(
-		"SELECT `lastchannel`,`last_active`,`last_disconnect` FROM `%1users` WHERE `server_id` = ? AND `user_id` = ?");
-	query.addBindValue(iServerNum);
-	query.addBindValue(id);
-	SQLEXEC();
+	QVariantList row;
+	{
+		TransactionHolder th;
+		QSqlQuery &query = *th.qsqQuery;
 
-	if (query.next()) {
-		int cid = query.value(0).toInt();
+		SQLPREP("SELECT `lastchannel`,`last_active`,`last_disconnect` FROM `%1users` WHERE `server_id` = ? AND "
+				"`user_id` = ?");
+		query.addBindValue(iServerNum);
+		query.addBindValue(id);
+		SQLEXEC();
+
+		if (query.next()) {
+			row << query.value(0) << query.value(1) << query.value(2);
+		}
+	}
+
+	if (!row.isEmpty()) {
+		int cid = row.at(0).toInt();
 
 		if (!qhChannels.contains(cid)) {
 			return -1;
@@ -2219,18 +2543,18 @@ int Server::readLastChannel(int id) {
 			return cid;
 		}
 
-		if (query.value(1).isNull()) {
+		if (row.at(1).isNull()) {
 			return -1;
 		}
 
-		QDateTime last_active = QDateTime::fromString(query.value(1).toString(), Qt::ISODate);
+		QDateTime last_active = QDateTime::fromString(row.at(1).toString(), Qt::ISODate);
 		last_active.setTimeSpec(Qt::UTC);
 		QDateTime last_disconnect;
 
 		// NULL column for last_disconnect will yield an empty invalid QDateTime object.
 		// Using that object with QDateTime::secsTo() will return 0 as per Qt specification.
-		if (!query.value(2).isNull()) {
-			last_disconnect = QDateTime::fromString(query.value(2).toString(), Qt::ISODate);
+		if (!row.at(2).isNull()) {
+			last_disconnect = QDateTime::fromString(row.at(2).toString(), Qt::ISODate);
 			last_disconnect.setTimeSpec(Qt::UTC);
 		}
 
@@ -2255,18 +2579,20 @@ void Server::setLastDisconnect(const User *p) {
 	if (p->iId < 0)
 		return;
 
-	TransactionHolder th;
-	QSqlQuery &query = *th.qsqQuery;
-
-	if (Meta::mp.qsDBDriver == "QSQLITE") {
-		SQLPREP("UPDATE `%1users` SET `last_disconnect` = datetime('now') WHERE `server_id` = ? AND `user_id` = ?");
-	} else {
-		// MySQL or PostgreSQL
-		SQLPREP("UPDATE `%1users` SET `last_disconnect` = now() WHERE `server_id` = ? AND `user_id` = ?");
-	}
-	query.addBindValue(iServerNum);
-	query.addBindValue(p->iId);
-	SQLEXEC();
+	const int serverID = iServerNum;
+	const int userID   = p->iId;
+	ServerDB::writer->enqueue(userRowKey(serverID, userID), [serverID, userID](QSqlQuery &query) {
+		if (Meta::mp.qsDBDriver == "QSQLITE") {
+			SQLPREP(
+				"UPDATE `%1users` SET `last_disconnect` = datetime('now') WHERE `server_id` = ? AND `user_id` = ?");
+		} else {
+			// MySQL or PostgreSQL
+			SQLPREP("UPDATE `%1users` SET `last_disconnect` = now() WHERE `server_id` = ? AND `user_id` = ?");
+		}
+		query.addBindValue(serverID);
+		query.addBindValue(userID);
+		SQLEXEC();
+	});
 }
 
 void Server::dumpChannel(const Channel *c) {
@@ -2322,29 +2648,94 @@ void Server::getBans() {
 		if (ban.isValid())
 			qlBans << ban;
 	}
+
+	m_banIndex.assign(qlBans);
+	m_persistedBans = qlBans;
+
+	scheduleBanExpiry();
 }
 
 void Server::saveBans() {
-	TransactionHolder th;
+	// Only the bans that have changed are written. The rows are matched without their start, as the database may
+	// have stored it with a different precision, so all bans that only differ in their start are replaced together.
+	auto groupOf = [](Ban ban) {
+		ban.qdtStart = QDateTime();
+		return ban;
+	};
+
+	QHash< Ban, QList< Ban > > current;
+	QHash< Ban, QList< Ban > > persisted;
+	foreach (const Ban &ban, qlBans) { current[groupOf(ban)] << ban; }
+	foreach (const Ban &ban, m_persistedBans) { persisted[groupOf(ban)] << ban; }
+
+	QList< Ban > changed;
+	for (auto it = current.cbegin(); it != current.cend(); ++it) {
+		const QList< Ban > previous = persisted.value(it.key());
+		if (!std::is_permutation(it.value().cbegin(), it.value().cend(), previous.cbegin(), previous.cend())) {
+			changed << it.key();
+		}
+	}
+	for (auto it = persisted.cbegin(); it != persisted.cend(); ++it) {
+		if (!current.contains(it.key())) {
+			changed << it.key();
+		}
+	}
 
-	QSqlQuery &query = *th.qsqQuery;
-	SQLPREP("DELETE FROM `%1bans` WHERE `server_id` = ? ");
-	query.addBindValue(iServerNum);
-	SQLEXEC();
+	if (changed.isEmpty()) {
+		return;
+	}
 
-	SQLPREP("INSERT INTO `%1bans` (`server_id`, `base`,`mask`,`name`,`hash`,`reason`,`start`,`duration`) VALUES "
-			"(?,?,?,?,?,?,?,?)");
-	foreach (const Ban &ban, qlBans) {
-		query.addBindValue(iServerNum);
-		query.addBindValue(ban.haAddress.toByteArray());
-		query.addBindValue(ban.iMask);
-		query.addBindValue(ban.qsUsername);
-		query.addBindValue(ban.qsHash);
-		query.addBindValue(ban.qsReason);
-		query.addBindValue(ban.qdtStart);
-		query.addBindValue(ban.iDuration);
-		SQLEXEC();
+	QList< QPair< Ban, QList< Ban > > > groups;
+	for (const Ban &group : changed) {
+		for (const Ban &ban : persisted.value(group)) {
+			m_banIndex.remove(ban);
+		}
+		for (const Ban &ban : current.value(group)) {
+			m_banIndex.insert(ban);
+		}
+
+		groups << qMakePair(group, current.value(group));
 	}
+
+	m_persistedBans = qlBans;
+
+	scheduleBanExpiry();
+
+	// Null strings are stored as NULL, which is never equal to anything
+	auto nonNull = [](const QString &str) { return str.isNull() ? QString::fromLatin1("") : str; };
+
+	const int serverID = iServerNum;
+	ServerDB::writer->enqueue([serverID, groups, nonNull](QSqlQuery &query) {
+		for (const QPair< Ban, QList< Ban > > &group : groups) {
+			const Ban &ban = group.first;
+
+			SQLPREP("DELETE FROM `%1bans` WHERE `server_id` = ? AND `base` = ? AND `mask` = ? AND "
+					"COALESCE(`name`, '') = ? AND COALESCE(`hash`, '') = ? AND COALESCE(`reason`, '') = ? AND "
+					"`duration` = ?");
+			query.addBindValue(serverID);
+			query.addBindValue(ban.haAddress.toByteArray());
+			query.addBindValue(ban.iMask);
+			query.addBindValue(nonNull(ban.qsUsername));
+			query.addBindValue(nonNull(ban.qsHash));
+			query.addBindValue(nonNull(ban.qsReason));
+			query.addBindValue(ban.iDuration);
+			SQLEXEC();
+
+			SQLPREP("INSERT INTO `%1bans` (`server_id`, `base`,`mask`,`name`,`hash`,`reason`,`start`,`duration`) "
+					"VALUES (?,?,?,?,?,?,?,?)");
+			for (const Ban &added : group.second) {
+				query.addBindValue(serverID);
+				query.addBindValue(added.haAddress.toByteArray());
+				query.addBindValue(added.iMask);
+				query.addBindValue(added.qsUsername);
+				query.addBindValue(added.qsHash);
+				query.addBindValue(added.qsReason);
+				query.addBindValue(added.qdtStart);
+				query.addBindValue(added.iDuration);
+				SQLEXEC();
+			}
+		}
+	});
 }
 
 QVariant Server::getConf(const QString &key, QVariant def) {
@@ -2385,33 +2776,11 @@ void Server::setConf(const QString &key, const QVariant &value) {
 }
 
 void Server::dblog(const QString &str) const {
-	TransactionHolder th;
-	QSqlQuery &query = *th.qsqQuery;
-
 	// Is logging disabled?
 	if (Meta::mp.iLogDays < 0)
 		return;
 
-	// Once per hour
-	if (Meta::mp.iLogDays > 0) {
-		if (ServerDB::tLogClean.isElapsed(3600ULL * 1000000ULL)) {
-			QString qstr;
-			if (Meta::mp.qsDBDriver == "QSQLITE") {
-				qstr = QString::fromLatin1("msgtime < datetime('now','-%1 days')").arg(Meta::mp.iLogDays);
-			} else if (Meta::mp.qsDBDriver == "QPSQL") {
-				qstr = QString::fromLatin1("msgtime < now() - INTERVAL '%1 day'").arg(Meta::mp.iLogDays);
-			} else {
-				qstr = QString::fromLatin1("msgtime < now() - INTERVAL %1 day").arg(Meta::mp.iLogDays);
-			}
-			ServerDB::prepare(query, QString::fromLatin1("DELETE FROM %1slog WHERE ") + qstr);
-			SQLEXEC();
-		}
-	}
-
-	SQLPREP("INSERT INTO `%1slog` (`server_id`, `msg`) VALUES(?,?)");
-	query.addBindValue(iServerNum);
-	query.addBindValue(str);
-	SQLEXEC();
+	ServerDB::appendLog(iServerNum, str);
 }
 
 void Server::loadChannelListenersOf(const ServerUser &user) {
@@ -2420,19 +2789,41 @@ void Server::loadChannelListenersOf(const ServerUser &user) {
 		return;
 	}
 
-	TransactionHolder th;
-	QSqlQuery &query = *th.qsqQuery;
+	/// A row of the channel_listeners table
+	struct ListenerRecord {
+		int channelID;
+		float volume;
+		bool enabled;
+	};
 
-	SQLPREP("SELECT `channel_id`, `volume_adjustment`, `enabled` FROM `%1channel_listeners` WHERE `server_id` = ? AND "
-			"`user_id` = ?");
-	query.addBindValue(iServerNum);
-	query.addBindValue(user.iId);
-	SQLEXEC();
+	// Listeners added just before may not have been written yet
+	ServerDB::writer->waitFor(channelListenersKey(iServerNum, user.iId));
 
-	while (query.next()) {
-		int channelID = query.value(0).toInt();
-		float volume  = query.value(1).toFloat();
-		bool enabled  = query.value(2).toUInt() == 1;
+	QList< ListenerRecord > records;
+	{
+		TransactionHolder th;
+		QSqlQuery &query = *th.qsqQuery;
+
+		SQLPREP("SELECT `channel_id`, `volume_adjustment`, `enabled` FROM `%1channel_listeners` WHERE `server_id` = ? "
+				"AND `user_id` = ?");
+		query.addBindValue(iServerNum);
+		query.addBindValue(user.iId);
+		SQLEXEC();
+
+		while (query.next()) {
+			records << ListenerRecord{ query.value(0).toInt(), query.value(1).toFloat(), query.value(2).toUInt() == 1 };
+		}
+	}
+
+	for (const ListenerRecord &record : records) {
+		int channelID = record.channelID;
+		float volume  = record.volume;
+		bool enabled  = record.enabled;
+
+		if (!qhChannels.contains(channelID)) {
+			// The channel has been removed, but its rows may not have been deleted yet
+			continue;
+		}
 
 		if (enabled) {
 			m_channelListenerManager.addListener(user.uiSession, channelID);
@@ -2447,32 +2838,35 @@ void Server::loadChannelListenersOf(const ServerUser &user) {
 
 void Server::addChannelListener(const ServerUser &user, const Channel &channel) {
 	if (user.iId >= 0) {
-		TransactionHolder th;
-		QSqlQuery &query = *th.qsqQuery;
-
-		// Update or insert entry
-		SQLPREP(
-			"SELECT COUNT(*) FROM `%1channel_listeners` WHERE `server_id` = ? AND `user_id` = ? AND `channel_id` = ?");
-		query.addBindValue(iServerNum);
-		query.addBindValue(user.iId);
-		query.addBindValue(channel.iId);
+		const int serverID  = iServerNum;
+		const int userID    = user.iId;
+		const int channelID = channel.iId;
+		const QString key   = channelListenersKey(serverID, userID);
+		ServerDB::writer->enqueue(key, [serverID, userID, channelID](QSqlQuery &query) {
+			// Update or insert entry
+			SQLPREP("SELECT COUNT(*) FROM `%1channel_listeners` WHERE `server_id` = ? AND `user_id` = ? AND "
+					"`channel_id` = ?");
+			query.addBindValue(serverID);
+			query.addBindValue(userID);
+			query.addBindValue(channelID);
 
-		SQLEXEC();
+			SQLEXEC();
 
-		bool entryAlreadyExists = query.next() && query.value(0).toInt() > 0;
+			bool entryAlreadyExists = query.next() && query.value(0).toInt() > 0;
 
-		if (entryAlreadyExists) {
-			SQLPREP("UPDATE `%1channel_listeners` SET `enabled` = 1 WHERE `server_id` = ? AND `user_id`= ? AND "
-					"`channel_id` = ?");
-		} else {
-			SQLPREP("INSERT INTO `%1channel_listeners` (`server_id`, `user_id`, `channel_id`) VALUES (?, ?, ?)");
-		}
+			if (entryAlreadyExists) {
+				SQLPREP("UPDATE `%1channel_listeners` SET `enabled` = 1 WHERE `server_id` = ? AND `user_id`= ? AND "
+						"`channel_id` = ?");
+			} else {
+				SQLPREP("INSERT INTO `%1channel_listeners` (`server_id`, `user_id`, `channel_id`) VALUES (?, ?, ?)");
+			}
 
-		query.addBindValue(iServerNum);
-		query.addBindValue(user.iId);
-		query.addBindValue(channel.iId);
+			query.addBindValue(serverID);
+			query.addBindValue(userID);
+			query.addBindValue(channelID);
 
-		SQLEXEC();
+			SQLEXEC();
+		});
 	}
 
 	m_channelListenerManager.addListener(user.uiSession, channel.iId);
@@ -2484,17 +2878,20 @@ void Server::disableChannelListener(const ServerUser &user, const Channel &chann
 	}
 
 	if (user.iId >= 0) {
-		TransactionHolder th;
-		QSqlQuery &query = *th.qsqQuery;
-
-		SQLPREP("UPDATE `%1channel_listeners` SET `enabled` = ? WHERE `server_id` = ? AND `user_id` = ? AND "
-				"`channel_id` = ?");
-		// Explicit cast to int is required for Postgresql
-		query.addBindValue(static_cast< int >(false));
-		query.addBindValue(iServerNum);
-		query.addBindValue(user.iId);
-		query.addBindValue(channel.iId);
-		SQLEXEC();
+		const int serverID  = iServerNum;
+		const int userID    = user.iId;
+		const int channelID = channel.iId;
+		const QString key   = channelListenersKey(serverID, userID);
+		ServerDB::writer->enqueue(key, [serverID, userID, channelID](QSqlQuery &query) {
+			SQLPREP("UPDATE `%1channel_listeners` SET `enabled` = ? WHERE `server_id` = ? AND `user_id` = ? AND "
+					"`channel_id` = ?");
+			// Explicit cast to int is required for Postgresql
+			query.addBindValue(static_cast< int >(false));
+			query.addBindValue(serverID);
+			query.addBindValue(userID);
+			query.addBindValue(channelID);
+			SQLEXEC();
+		});
 	}
 
 	m_channelListenerManager.removeListener(user.uiSession, channel.iId);
@@ -2506,14 +2903,17 @@ void Server::deleteChannelListener(const ServerUser &user, const Channel &channe
 	}
 
 	if (user.iId >= 0) {
-		TransactionHolder th;
-		QSqlQuery &query = *th.qsqQuery;
-
-		SQLPREP("DELETE FROM `%1channel_listeners` WHERE `server_id` = ? AND `user_id` = ? AND `channel_id` = ?");
-		query.addBindValue(iServerNum);
-		query.addBindValue(user.iId);
-		query.addBindValue(channel.iId);
-		SQLEXEC();
+		const int serverID  = iServerNum;
+		const int userID    = user.iId;
+		const int channelID = channel.iId;
+		const QString key   = channelListenersKey(serverID, userID);
+		ServerDB::writer->enqueue(key, [serverID, userID, channelID](QSqlQuery &query) {
+			SQLPREP("DELETE FROM `%1channel_listeners` WHERE `server_id` = ? AND `user_id` = ? AND `channel_id` = ?");
+			query.addBindValue(serverID);
+			query.addBindValue(userID);
+			query.addBindValue(channelID);
+			SQLEXEC();
+		});
 	}
 
 	m_channelListenerManager.removeListener(user.uiSession, channel.iId);
@@ -2521,23 +2921,107 @@ void Server::deleteChannelListener(const ServerUser &user, const Channel &channe
 
 void Server::setChannelListenerVolume(const ServerUser &user, const Channel &channel, float volumeAdjustment) {
 	if (user.iId >= 0) {
-		TransactionHolder th;
-		QSqlQuery &query = *th.qsqQuery;
-
-		SQLPREP("UPDATE `%1channel_listeners` SET `volume_adjustment` = ? WHERE `server_id` = ? AND `user_id` = ? AND "
-				"`channel_id` = ?");
-		query.addBindValue(volumeAdjustment);
-		query.addBindValue(iServerNum);
-		query.addBindValue(user.iId);
-		query.addBindValue(channel.iId);
-		SQLEXEC();
+		const int serverID  = iServerNum;
+		const int userID    = user.iId;
+		const int channelID = channel.iId;
+		const QString key   = channelListenersKey(serverID, userID);
+		ServerDB::writer->enqueue(key, [serverID, userID, channelID, volumeAdjustment](QSqlQuery &query) {
+			SQLPREP("UPDATE `%1channel_listeners` SET `volume_adjustment` = ? WHERE `server_id` = ? AND `user_id` = ? "
+					"AND `channel_id` = ?");
+			query.addBindValue(volumeAdjustment);
+			query.addBindValue(serverID);
+			query.addBindValue(userID);
+			query.addBindValue(channelID);
+			SQLEXEC();
+		});
 	}
 
 	m_channelListenerManager.setListenerVolumeAdjustment(user.uiSession, channel.iId,
 														 VolumeAdjustment::fromFactor(volumeAdjustment));
 }
 
+void ServerDB::appendLog(int server_id, const QString &msg) {
+	logBuffer << QPair< int, QString >(server_id, msg);
+
+	if (logBuffer.size() >= LOG_BUFFER_SIZE) {
+		flushLog();
+	}
+}
+
+void ServerDB::cleanExpiredLog() {
+	if (Meta::mp.iLogDays <= 0) {
+		return;
+	}
+
+	QString qstr;
+	if (Meta::mp.qsDBDriver == "QSQLITE") {
+		qstr = QString::fromLatin1("msgtime < datetime('now','-%1 days')").arg(Meta::mp.iLogDays);
+	} else if (Meta::mp.qsDBDriver == "QPSQL") {
+		qstr = QString::fromLatin1("msgtime < now() - INTERVAL '%1 day'").arg(Meta::mp.iLogDays);
+	} else {
+		qstr = QString::fromLatin1("msgtime < now() - INTERVAL %1 day").arg(Meta::mp.iLogDays);
+	}
+	cleanLog(qstr);
+}
+
+void ServerDB::flushLog() {
+	if (logBuffer.isEmpty()) {
+		return;
+	}
+
+	QList< QPair< int, QString > > records;
+	records.swap(logBuffer);
+
+	writer->enqueue([records](QSqlQuery &query) {
+		for (int i = 0; i < records.size(); i += LOG_INSERT_ROWS) {
+			const int rows = std::min(records.size() - i, static_cast< int >(LOG_INSERT_ROWS));
+
+			QString str = QString::fromLatin1("INSERT INTO `%1slog` (`server_id`, `msg`) VALUES (?,?)");
+			for (int j = 1; j < rows; ++j) {
+				str += QLatin1String(",(?,?)");
+			}
+			ServerDB::prepare(query, str);
+
+			for (int j = i; j < i + rows; ++j) {
+				query.addBindValue(records.at(j).first);
+				query.addBindValue(records.at(j).second);
+			}
+			SQLEXEC();
+		}
+	});
+}
+
+void ServerDB::cleanLog(const QString &condition) {
+	writer->enqueue([condition](QSqlQuery &query) {
+		const QString limit = QString::number(LOG_CLEAN_BATCH);
+
+		// Deleting everything at once would keep the database locked for as long as it takes
+		QString str;
+		if (Meta::mp.qsDBDriver == "QSQLITE") {
+			str = QString::fromLatin1("DELETE FROM `%1slog` WHERE `rowid` IN (SELECT `rowid` FROM `%1slog` WHERE ");
+			str += condition + QLatin1String(" LIMIT ") + limit + QLatin1String(")");
+		} else if (Meta::mp.qsDBDriver == "QPSQL") {
+			str = QString::fromLatin1("DELETE FROM `%1slog` WHERE `ctid` IN (SELECT `ctid` FROM `%1slog` WHERE ");
+			str += condition + QLatin1String(" LIMIT ") + limit + QLatin1String(")");
+		} else {
+			str = QString::fromLatin1("DELETE FROM `%1slog` WHERE ");
+			str += condition + QLatin1String(" LIMIT ") + limit;
+		}
+		ServerDB::prepare(query, str);
+		SQLEXEC();
+
+		// The next batch is committed separately, so that other writes don't have to wait for the whole cleanup
+		if (query.numRowsAffected() >= LOG_CLEAN_BATCH) {
+			cleanLog(condition);
+		}
+	});
+}
+
 void ServerDB::wipeLogs() {
+	// Log messages that are still buffered or queued would survive the wipe otherwise
+	flushLog();
+	writer->flush();
+
 	TransactionHolder th;
 	QSqlQuery &query = *th.qsqQuery;
 
@@ -2545,6 +3029,9 @@ void ServerDB::wipeLogs() {
 }
 
 QList< QPair< unsigned int, QString > > ServerDB::getLog(int server_id, unsigned int offs_min, unsigned int offs_max) {
+	flushLog();
+	writer->flush();
+
 	TransactionHolder th;
 	QSqlQuery &query = *th.qsqQuery;
 
@@ -2572,6 +3059,9 @@ QList< QPair< unsigned int, QString > > ServerDB::getLog(int server_id, unsigned
 }
 
 int ServerDB::getLogLen(int server_id) {
+	flushLog();
+	writer->flush();
+
 	TransactionHolder th;
 	QSqlQuery &query = *th.qsqQuery;
 
@@ -2674,6 +3164,10 @@ int ServerDB::addServer() {
 }
 
 void ServerDB::deleteServer(int server_id) {
+	// Queued writes of the server must not recreate any of its rows
+	flushLog();
+	writer->flush();
+
 	TransactionHolder th;
 	QSqlQuery &query = *th.qsqQuery;
 	SQLPREP("DELETE FROM `%1servers` WHERE `server_id` = ?");
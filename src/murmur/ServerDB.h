@@ -6,8 +6,12 @@
 #ifndef MUMBLE_MURMUR_DATABASE_H_
 #define MUMBLE_MURMUR_DATABASE_H_
 
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QTimer>
 #include <QtCore/QVariant>
 
+#include "ChannelTreeData.h"
 #include "Timer.h"
 
 class Server;
@@ -16,6 +20,7 @@ class User;
 class Connection;
 class QSqlDatabase;
 class QSqlQuery;
+class ServerDBWriter;
 
 class ServerDB : public QObject {
 	Q_OBJECT;
@@ -41,12 +46,25 @@ public:
 	ServerDB();
 	~ServerDB();
 	typedef QPair< unsigned int, QString > LogRecord;
-	static Timer tLogClean;
 	static QSqlDatabase *db;
 	static QString qsUpgradeSuffix;
+	/// Runs the writes that don't have to be done by the time the call persisting them returns
+	static ServerDBWriter *writer;
+	/// Held for the duration of every transaction on SQLite, as only one of the connections may write at a time
+	static QMutex transactionMutex;
+	/// The connection of the calling thread (either the main thread or the writer's)
+	static QSqlDatabase &database();
+	/// The prepared statements of the calling thread's connection, by query text
+	static QHash< QString, QSqlQuery > &statements();
 	static void setSUPW(int iServNum, const QString &pw);
 	static void disableSU(int srvnum);
 	static QList< int > getBootServers();
+	/// Reads the channels of the given server along with their ACLs, groups and links. Runs a fixed amount of
+	/// queries, no matter how many channels there are.
+	static ChannelTreeData readChannelTree(int server_id);
+	/// Reads the channel trees of the given servers at the same time, using up to the given amount of threads with
+	/// connections of their own. Servers whose tree could not be read are missing from the result.
+	static QHash< int, ChannelTreeData > readChannelTrees(const QList< int > &server_ids, unsigned int threads);
 	static QList< int > getAllServers();
 	static int addServer();
 	static void deleteServer(int server_id);
@@ -58,6 +76,22 @@ public:
 	static QString getLegacySHA1Hash(const QString &password);
 	static int getLogLen(int server_id);
 	static void wipeLogs();
+	/// The interval in which buffered log messages are written (in milliseconds)
+	static const int LOG_FLUSH_INTERVAL = 1000;
+	/// The amount of buffered log messages that are written right away without waiting for the interval to pass
+	static const int LOG_BUFFER_SIZE = 256;
+	/// The amount of log messages inserted by a single statement
+	static const int LOG_INSERT_ROWS = 64;
+	/// The amount of expired log messages deleted per transaction
+	static const int LOG_CLEAN_BATCH = 1000;
+	/// The interval in which expired log messages are deleted (in milliseconds)
+	static const int LOG_CLEAN_INTERVAL = 60 * 60 * 1000;
+	/// Buffers a log message, which is written along with the others in the buffer
+	static void appendLog(int server_id, const QString &msg);
+	/// Queues the buffered log messages to be written
+	static void flushLog();
+	/// Queues the deletion of the log messages older than the configured amount of days (see Meta::timingWheel)
+	static void cleanExpiredLog();
 	static bool prepare(QSqlQuery &, const QString &, bool fatal = true, bool warn = true);
 	static bool query(QSqlQuery &, const QString &, bool fatal = true, bool warn = true);
 	static bool exec(QSqlQuery &, const QString &str = QString(), bool fatal = true, bool warn = true);
@@ -66,8 +100,12 @@ public:
 	ServerDB(const ServerDB &);
 
 private:
+	/// Deletes a batch of the log messages matching the condition and queues the next batch if there might be more
+	static void cleanLog(const QString &condition);
 	static void loadOrSetupMetaPBKDF2IterationCount(QSqlQuery &query);
 	static void writeSUPW(int srvnum, const QString &pwHash, const QString &saltHash, const QVariant &kdfIterations);
+
+	QTimer qtLogFlush;
 };
 
 #endif
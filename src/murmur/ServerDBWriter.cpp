@@ -0,0 +1,159 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "ServerDBWriter.h"
+#include "ServerDB.h"
+
+#include <QtCore/QMutexLocker>
+#include <QtSql/QSqlError>
+
+#include <algorithm>
+
+ServerDBWriter::ServerDBWriter(const QSqlDatabase &database, const QString &sqliteSynchronous)
+	: QThread(), m_driverName(database.driverName()), m_databaseName(database.databaseName()),
+	  m_hostName(database.hostName()), m_port(database.port()), m_userName(database.userName()),
+	  m_password(database.password()), m_connectOptions(database.connectOptions()),
+	  m_sqliteSynchronous(sqliteSynchronous), m_serializeTransactions(database.driverName() == "QSQLITE") {
+	setObjectName(QLatin1String("Database"));
+	start();
+}
+
+ServerDBWriter::~ServerDBWriter() {
+	{
+		QMutexLocker l(&m_mutex);
+		m_stop = true;
+		m_queued.wakeAll();
+	}
+
+	wait();
+}
+
+void ServerDBWriter::enqueue(Task task) {
+	enqueue(QString(), std::move(task));
+}
+
+void ServerDBWriter::enqueue(const QString &key, Task task) {
+	QMutexLocker l(&m_mutex);
+
+	m_tasks.push_back(QueuedTask{ key, std::move(task) });
+	if (!key.isEmpty()) {
+		m_pendingKeys[key]++;
+	}
+	m_queuedCount++;
+	m_queued.wakeOne();
+}
+
+void ServerDBWriter::flush() {
+	QMutexLocker l(&m_mutex);
+
+	const quint64 target = m_queuedCount;
+	while (m_committedCount < target) {
+		m_committed.wait(&m_mutex);
+	}
+}
+
+void ServerDBWriter::waitFor(const QString &key) {
+	QMutexLocker l(&m_mutex);
+
+	while (m_pendingKeys.contains(key)) {
+		m_committed.wait(&m_mutex);
+	}
+}
+
+QSqlDatabase &ServerDBWriter::database() {
+	return m_database;
+}
+
+QHash< QString, QSqlQuery > &ServerDBWriter::statements() {
+	return m_statements;
+}
+
+void ServerDBWriter::run() {
+	// A connection may only be used on the thread it has been created on
+	m_database = QSqlDatabase::addDatabase(m_driverName, QLatin1String("ServerDBWriter"));
+	m_database.setDatabaseName(m_databaseName);
+	m_database.setHostName(m_hostName);
+	m_database.setPort(m_port);
+	m_database.setUserName(m_userName);
+	m_database.setPassword(m_password);
+	m_database.setConnectOptions(m_connectOptions);
+	if (!m_database.open()) {
+		qFatal("ServerDBWriter: Failed to open the database: %s", qPrintable(m_database.lastError().text()));
+	}
+
+	if (!m_sqliteSynchronous.isEmpty()) {
+		QSqlQuery query(m_database);
+		query.exec(QString::fromLatin1("PRAGMA synchronous=%1;").arg(m_sqliteSynchronous));
+	}
+
+	while (true) {
+		std::vector< QueuedTask > batch;
+		{
+			QMutexLocker l(&m_mutex);
+			while (m_tasks.empty() && !m_stop) {
+				m_queued.wait(&m_mutex);
+			}
+
+			// Everything queued before stopping is still committed
+			if (m_tasks.empty()) {
+				break;
+			}
+
+			while (!m_tasks.empty() && batch.size() < MAX_BATCH_SIZE) {
+				batch.push_back(std::move(m_tasks.front()));
+				m_tasks.pop_front();
+			}
+		}
+
+		// The main thread's transactions wait for the serialized ones, so those are kept short
+		const std::size_t commitSize = m_serializeTransactions ? SERIALIZED_BATCH_SIZE : batch.size();
+
+		for (std::size_t begin = 0; begin < batch.size(); begin += commitSize) {
+			const std::size_t end = std::min(begin + commitSize, batch.size());
+			const auto first      = batch.begin() + static_cast< std::ptrdiff_t >(begin);
+			const auto last       = batch.begin() + static_cast< std::ptrdiff_t >(end);
+
+			if (m_serializeTransactions) {
+				QMutexLocker l(&ServerDB::transactionMutex);
+				commit(first, last);
+			} else {
+				commit(first, last);
+			}
+
+			QMutexLocker l(&m_mutex);
+			for (auto it = first; it != last; ++it) {
+				if (!it->key.isEmpty() && --m_pendingKeys[it->key] == 0) {
+					m_pendingKeys.remove(it->key);
+				}
+			}
+			m_committedCount += static_cast< quint64 >(last - first);
+			m_committed.wakeAll();
+		}
+	}
+
+	m_statements.clear();
+	m_database.close();
+	m_database = QSqlDatabase();
+	QSqlDatabase::removeDatabase(QLatin1String("ServerDBWriter"));
+}
+
+void ServerDBWriter::commit(std::vector< QueuedTask >::iterator begin, std::vector< QueuedTask >::iterator end) {
+	if (!m_database.transaction()) {
+		qWarning("ServerDBWriter: Failed to start a transaction: %s", qPrintable(m_database.lastError().text()));
+	}
+
+	for (auto it = begin; it != end; ++it) {
+		QSqlQuery query(m_database);
+		it->task(query);
+		// Makes the prepared statement used by the task available to the following ones
+		query.finish();
+	}
+
+	if (!m_database.commit()) {
+		qWarning("ServerDBWriter: Failed to commit %d writes, which are lost: %s", static_cast< int >(end - begin),
+				 qPrintable(m_database.lastError().text()));
+		m_database.rollback();
+	}
+}
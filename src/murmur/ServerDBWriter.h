@@ -0,0 +1,107 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_SERVERDBWRITER_H_
+#define MUMBLE_MURMUR_SERVERDBWRITER_H_
+
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QString>
+#include <QtCore/QThread>
+#include <QtCore/QWaitCondition>
+#include <QtSql/QSqlDatabase>
+#include <QtSql/QSqlQuery>
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <vector>
+
+/// Runs database writes on a dedicated thread with a connection of its own, so that the main thread doesn't have to
+/// wait for the database whenever something is to be persisted.
+///
+/// Tasks are run in the order they have been queued in. All tasks that have piled up while the previous batch has
+/// been committed are run in a single transaction (group commit). Reads on the main thread that have to see the
+/// effects of queued writes wait for the writes queued with the same key (see waitFor()).
+///
+/// On SQLite, the writer's transactions never overlap with the ones on the main thread's connection (see
+/// ServerDB::transactionMutex), so that the two connections can't deadlock each other. The writer only holds the
+/// mutex for a few tasks at a time there, so that the main thread doesn't have to wait for a whole batch.
+class ServerDBWriter : public QThread {
+private:
+	Q_OBJECT
+	Q_DISABLE_COPY(ServerDBWriter)
+public:
+	using Task = std::function< void(QSqlQuery &) >;
+
+	/// The maximum amount of tasks committed in one transaction
+	static constexpr std::size_t MAX_BATCH_SIZE = 256;
+	/// The maximum amount of tasks committed in one transaction if transactions are serialized with the main
+	/// thread's (SQLite)
+	static constexpr std::size_t SERIALIZED_BATCH_SIZE = 16;
+
+	/// @param database The connection to clone. The writer opens its own connection with the same parameters.
+	/// @param sqliteSynchronous The value of SQLite's "synchronous" setting, which is set per connection (empty if it
+	/// is not to be set)
+	ServerDBWriter(const QSqlDatabase &database, const QString &sqliteSynchronous);
+	/// Commits all queued tasks before stopping the thread
+	~ServerDBWriter() override;
+
+	/// Queues a task. It must not refer to anything that may change or be gone by the time it runs.
+	void enqueue(Task task);
+	/// Queues a task writing the data identified by the given key (see waitFor())
+	void enqueue(const QString &key, Task task);
+
+	/// Blocks until all tasks queued so far have been committed. Must not be called within a transaction on the
+	/// main thread's connection.
+	void flush();
+	/// Blocks until the tasks queued with the given key so far have been committed, which is only the case if
+	/// there are any. Must not be called within a transaction on the main thread's connection.
+	void waitFor(const QString &key);
+
+	/// The writer's connection, which may only be used on the writer's thread
+	QSqlDatabase &database();
+	/// The prepared statements of the writer's connection (see ServerDB::prepare)
+	QHash< QString, QSqlQuery > &statements();
+
+protected:
+	struct QueuedTask {
+		/// Empty if the task hasn't been queued with a key
+		QString key;
+		Task task;
+	};
+
+	void run() override;
+	/// Runs the given tasks in a single transaction
+	void commit(std::vector< QueuedTask >::iterator begin, std::vector< QueuedTask >::iterator end);
+
+	QString m_driverName;
+	QString m_databaseName;
+	QString m_hostName;
+	int m_port;
+	QString m_userName;
+	QString m_password;
+	QString m_connectOptions;
+	QString m_sqliteSynchronous;
+	/// Whether transactions have to be serialized with the main thread's (see ServerDB::transactionMutex)
+	bool m_serializeTransactions;
+
+	QSqlDatabase m_database;
+	QHash< QString, QSqlQuery > m_statements;
+
+	/// Protects everything below
+	QMutex m_mutex;
+	QWaitCondition m_queued;
+	QWaitCondition m_committed;
+	std::deque< QueuedTask > m_tasks;
+	/// The amount of queued tasks that haven't been committed yet, by key
+	QHash< QString, int > m_pendingKeys;
+	/// The amount of tasks ever queued and the amount of those that have been committed
+	quint64 m_queuedCount    = 0;
+	quint64 m_committedCount = 0;
+	bool m_stop              = false;
+};
+
+#endif // MUMBLE_MURMUR_SERVERDBWRITER_H_
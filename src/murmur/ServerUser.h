@@ -12,44 +12,28 @@
 #	include "win.h"
 #endif
 
+#include "ChannelRoutingTable.h"
 #include "ClientType.h"
 #include "Connection.h"
 #include "HostAddress.h"
-#include "Timer.h"
+#include "InitialSync.h"
+#include "PendingAuthentication.h"
+#include "RateLimit.h"
+#include "TimingWheel.h"
 #include "User.h"
 
 #include <QtCore/QElapsedTimer>
 #include <QtCore/QStringList>
 
+#include <memory>
+#include <vector>
+
 #ifdef Q_OS_WIN
 #	include <winsock2.h>
 #else
 #	include <sys/socket.h>
 #endif
 
-// Unfortunately, this needs to be "large enough" to hold
-// enough frames to account for both short-term and
-// long-term "maladjustments".
-
-#define N_BANDWIDTH_SLOTS 360
-
-struct BandwidthRecord {
-	int iRecNum;
-	int iSum;
-	Timer tFirst;
-	Timer tIdleControl;
-	unsigned short a_iBW[N_BANDWIDTH_SLOTS];
-	Timer a_qtWhen[N_BANDWIDTH_SLOTS];
-	mutable QMutex qmMutex;
-
-	BandwidthRecord();
-	bool addFrame(int size, int maxpersec);
-	int onlineSeconds() const;
-	int idleSeconds() const;
-	void resetIdleSeconds();
-	int bandwidth() const;
-};
-
 struct WhisperTarget {
 	struct Channel {
 		int iId;
@@ -63,42 +47,20 @@ struct WhisperTarget {
 
 class ServerUser;
 
+/// The receivers of a whisper target, with one entry per receiver (sorted by session). A cache is immutable once
+/// it has been built, so that voice threads can use it without copying it.
 struct WhisperTargetCache {
-	QSet< ServerUser * > channelTargets;
-	QSet< ServerUser * > directTargets;
-	QHash< ServerUser *, VolumeAdjustment > listeningTargets;
+	std::vector< AudioRoute > receivers;
+	/// The IDs of the channels whose users, listeners and ACLs the receivers have been computed from (sorted)
+	std::vector< int > channels;
+	/// The IDs of the channels the target includes the whole subtree of (sorted)
+	std::vector< int > subtrees;
+	/// Whether the receivers depend on the groups users other than the speaker are in
+	bool usesGroups = false;
 };
 
 class Server;
 
-/// A simple implementation for rate-limiting.
-/// See https://en.wikipedia.org/wiki/Leaky_bucket
-class LeakyBucket {
-private:
-	/// The amount of tokens that are drained per second.
-	/// (The size of the whole in the bucket)
-	unsigned int m_tokensPerSec;
-	/// The maximum amount of tokens that may be encountered.
-	/// (The capacity of the bucket)
-	unsigned int m_maxTokens;
-	/// The amount of tokens currently stored
-	/// (The amount of whater currently in the bucket)
-	long m_currentTokens;
-	/// A timer that is used to measure time intervals. It is essential
-	/// that this timer uses a monotonic clock (which is why QElapsedTimer is
-	/// used instead of QTime or QDateTime).
-	QElapsedTimer m_timer;
-
-public:
-	/// @param tokens The amount of tokens that should be added.
-	/// @returns Whether adding this amount of tokens triggers rate
-	/// 	limiting (true means the corresponding packet has to be
-	/// 	discared and false means the packet may be processed)
-	bool ratelimit(int tokens);
-
-	LeakyBucket(unsigned int tokensPerSec, unsigned int maxTokens);
-};
-
 class ServerUser : public Connection, public User {
 private:
 	Q_OBJECT
@@ -129,6 +91,14 @@ public:
 
 	HostAddress haAddress;
 
+	/// The token identifying this user's UDP datagrams (0 if none has been assigned). Clients supporting it
+	/// prefix every encrypted datagram with it, so that a datagram of a yet unknown peer can be mapped to
+	/// its user without trial decryption.
+	quint32 uiUdpConnectionToken;
+	/// Whether the client has acknowledged its connection token. If so, all of its datagrams carry the token
+	/// and the user is skipped when trial decrypting datagrams of unknown peers.
+	bool bUdpConnectionTokenAcked;
+
 	/// Holds whether the user is using TCP
 	/// or UDP for voice packets.
 	///
@@ -145,7 +115,7 @@ public:
 	QStringList qslAccessTokens;
 
 	QMap< int, WhisperTarget > qmTargets;
-	QMap< int, WhisperTargetCache > qmTargetCache;
+	QMap< int, std::shared_ptr< const WhisperTargetCache > > qmTargetCache;
 	QMap< QString, QString > qmWhisperRedirect;
 
 	LeakyBucket leakyBucket;
@@ -161,7 +131,15 @@ public:
 	BandwidthRecord bwr;
 	struct sockaddr_storage saiUdpAddress;
 	struct sockaddr_storage saiTcpLocalAddress;
-	ServerUser(Server *parent, QSslSocket *socket);
+	/// Set while the channel tree and the other users are being sent to the client (see InitialSync)
+	std::unique_ptr< InitialSync > m_initialSync;
+	/// Set while the client's password is being hashed (see PasswordHashPool)
+	std::unique_ptr< PendingAuthentication > m_pendingAuthentication;
+	/// The check whether the client has timed out (see Server::scheduleTimeout)
+	TimingWheel::TimerID m_timeoutTimer = 0;
+	/// @param ioThread The network thread serving this connection (see NetworkThreadPool) or nullptr for the main
+	/// thread
+	ServerUser(Server *parent, QSslSocket *socket, QThread *ioThread);
 };
 
 #endif
@@ -0,0 +1,226 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "TimingWheel.h"
+
+#include <algorithm>
+
+TimingWheel::TimingWheel(unsigned int tickLength) : QObject(), m_tickLength(std::max(tickLength, 1U)) {
+	m_slots.fill(-1);
+
+	connect(&m_timer, &QTimer::timeout, this, [this]() { advance(m_clock.elapsed()); });
+}
+
+void TimingWheel::start() {
+	m_clock.start();
+	m_timer.start(static_cast< int >(m_tickLength));
+}
+
+TimingWheel::TimerID TimingWheel::schedule(qint64 delay, Callback callback) {
+	return add(delay, 0, std::move(callback));
+}
+
+TimingWheel::TimerID TimingWheel::schedulePeriodic(qint64 interval, Callback callback) {
+	return add(interval, std::max(interval, static_cast< qint64 >(1)), std::move(callback));
+}
+
+bool TimingWheel::reschedule(TimerID id, qint64 delay) {
+	const int index = find(id);
+	if (index < 0) {
+		return false;
+	}
+
+	unlink(index);
+	m_entries[static_cast< std::size_t >(index)].deadline = deadline(delay);
+	link(index);
+
+	return true;
+}
+
+bool TimingWheel::cancel(TimerID id) {
+	const int index = find(id);
+	if (index < 0) {
+		return false;
+	}
+
+	unlink(index);
+	release(index);
+
+	return true;
+}
+
+bool TimingWheel::isScheduled(TimerID id) const {
+	return find(id) >= 0;
+}
+
+std::size_t TimingWheel::size() const {
+	return m_size;
+}
+
+unsigned int TimingWheel::tickLength() const {
+	return m_tickLength;
+}
+
+void TimingWheel::advance(qint64 now) {
+	const quint64 target = static_cast< quint64 >(std::max(now, static_cast< qint64 >(0))) / m_tickLength;
+
+	if (m_size == 0) {
+		// Nothing to move down or run
+		m_now = std::max(m_now, target);
+		return;
+	}
+
+	while (m_now < target) {
+		tick();
+	}
+}
+
+int TimingWheel::find(TimerID id) const {
+	const quint32 generation = static_cast< quint32 >(id >> 32);
+	const quint32 index      = static_cast< quint32 >(id);
+
+	if (index >= m_entries.size()) {
+		return -1;
+	}
+
+	const Entry &entry = m_entries[index];
+	if (entry.generation != generation || entry.slot < 0) {
+		return -1;
+	}
+
+	return static_cast< int >(index);
+}
+
+quint64 TimingWheel::deadline(qint64 delay) const {
+	const qint64 ticks = (delay + static_cast< qint64 >(m_tickLength) - 1) / static_cast< qint64 >(m_tickLength);
+
+	return m_now + static_cast< quint64 >(std::max(ticks, static_cast< qint64 >(1)));
+}
+
+TimingWheel::TimerID TimingWheel::add(qint64 delay, qint64 interval, Callback callback) {
+	int index;
+	if (m_free.empty()) {
+		index = static_cast< int >(m_entries.size());
+		m_entries.emplace_back();
+	} else {
+		index = m_free.back();
+		m_free.pop_back();
+	}
+
+	Entry &entry   = m_entries[static_cast< std::size_t >(index)];
+	entry.deadline = deadline(delay);
+	entry.interval = interval;
+	entry.callback = std::move(callback);
+	link(index);
+
+	m_size++;
+
+	return (static_cast< TimerID >(entry.generation) << 32) | static_cast< TimerID >(index);
+}
+
+void TimingWheel::release(int index) {
+	Entry &entry   = m_entries[static_cast< std::size_t >(index)];
+	entry.callback = nullptr;
+	entry.generation++;
+	if (entry.generation == 0) {
+		// Keeps 0 from being a valid ID
+		entry.generation = 1;
+	}
+
+	m_free.push_back(index);
+	m_size--;
+}
+
+void TimingWheel::link(int index) {
+	Entry &entry = m_entries[static_cast< std::size_t >(index)];
+
+	const quint64 delta = entry.deadline > m_now ? entry.deadline - m_now : 0;
+	// The position in the wheels. Callbacks beyond the highest wheel are put at its end.
+	quint64 position = entry.deadline;
+	if (delta >= (1ULL << (SLOT_BITS * LEVELS))) {
+		position = m_now + (1ULL << (SLOT_BITS * LEVELS)) - 1;
+	}
+
+	unsigned int level = 0;
+	while (level < LEVELS - 1 && delta >= (1ULL << (SLOT_BITS * (level + 1)))) {
+		level++;
+	}
+
+	const int slot = static_cast< int >(level * SLOTS + ((position >> (SLOT_BITS * level)) & (SLOTS - 1)));
+
+	entry.slot     = slot;
+	entry.previous = -1;
+	entry.next     = m_slots[static_cast< std::size_t >(slot)];
+	if (entry.next >= 0) {
+		m_entries[static_cast< std::size_t >(entry.next)].previous = index;
+	}
+	m_slots[static_cast< std::size_t >(slot)] = index;
+}
+
+void TimingWheel::unlink(int index) {
+	Entry &entry = m_entries[static_cast< std::size_t >(index)];
+
+	if (entry.previous >= 0) {
+		m_entries[static_cast< std::size_t >(entry.previous)].next = entry.next;
+	} else {
+		m_slots[static_cast< std::size_t >(entry.slot)] = entry.next;
+	}
+	if (entry.next >= 0) {
+		m_entries[static_cast< std::size_t >(entry.next)].previous = entry.previous;
+	}
+
+	entry.slot     = -1;
+	entry.previous = -1;
+	entry.next     = -1;
+}
+
+void TimingWheel::tick() {
+	m_now++;
+
+	// A higher wheel moves on once all wheels below it have completed a turn
+	unsigned int levels = 1;
+	while (levels < LEVELS && (m_now & ((1ULL << (SLOT_BITS * levels)) - 1)) == 0) {
+		levels++;
+	}
+	for (unsigned int level = levels - 1; level >= 1; --level) {
+		cascade(level);
+	}
+
+	// The callbacks may change the wheel, so the slot is looked at anew for every one of them. Callbacks scheduled
+	// by them are due in a later tick and thus never end up in this slot.
+	const std::size_t slot = static_cast< std::size_t >(m_now & (SLOTS - 1));
+	while (m_slots[slot] >= 0) {
+		const int index = m_slots[slot];
+		unlink(index);
+
+		Entry &entry = m_entries[static_cast< std::size_t >(index)];
+		if (entry.interval > 0) {
+			entry.deadline = deadline(entry.interval);
+			link(index);
+
+			// The callback may cancel itself
+			const Callback callback = entry.callback;
+			callback();
+		} else {
+			const Callback callback = std::move(entry.callback);
+			release(index);
+			callback();
+		}
+	}
+}
+
+void TimingWheel::cascade(unsigned int level) {
+	const std::size_t slot =
+		static_cast< std::size_t >(level * SLOTS + ((m_now >> (SLOT_BITS * level)) & (SLOTS - 1)));
+
+	int index     = m_slots[slot];
+	m_slots[slot] = -1;
+
+	while (index >= 0) {
+		const int next = m_entries[static_cast< std::size_t >(index)].next;
+		link(index);
+		index = next;
+	}
+}
@@ -0,0 +1,114 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_TIMINGWHEEL_H_
+#define MUMBLE_MURMUR_TIMINGWHEEL_H_
+
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QObject>
+#include <QtCore/QTimer>
+#include <QtCore/QtGlobal>
+
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+/// Runs callbacks after a delay, for all virtual servers at once (see Meta::timingWheel).
+///
+/// The callbacks are kept in a hierarchical timing wheel: LEVELS wheels of SLOTS slots each, where a slot of the
+/// first wheel covers one tick and a slot of every further wheel covers all slots of the previous one. Scheduling,
+/// rescheduling and cancelling a callback take constant time. Every tick only looks at the callbacks that are due
+/// in it, plus (once per turn of the wheel below) the callbacks of one slot of a higher wheel, which are moved down.
+/// Delays longer than the highest wheel covers are fine, such callbacks are just moved down later.
+///
+/// Callbacks are run on the main thread and may schedule and cancel callbacks (including themselves). This class
+/// must only be used from the main thread.
+class TimingWheel : public QObject {
+private:
+	Q_OBJECT
+	Q_DISABLE_COPY(TimingWheel)
+public:
+	using Callback = std::function< void() >;
+	/// Identifies a scheduled callback. 0 never identifies one, so it can be used for "none".
+	using TimerID = quint64;
+
+	static constexpr unsigned int SLOT_BITS = 6;
+	static constexpr unsigned int SLOTS     = 1 << SLOT_BITS;
+	static constexpr unsigned int LEVELS    = 4;
+
+	/// @param tickLength The length of a tick (in milliseconds), which is the precision of all delays
+	explicit TimingWheel(unsigned int tickLength);
+
+	/// Starts advancing the wheel by the monotonic clock. Until then, the wheel only advances through advance().
+	void start();
+
+	/// Runs the given callback once after the given delay (in milliseconds). The delay is rounded up to full ticks
+	/// and is at least one tick.
+	TimerID schedule(qint64 delay, Callback callback);
+	/// Runs the given callback every interval milliseconds until it is cancelled
+	TimerID schedulePeriodic(qint64 interval, Callback callback);
+	/// Moves the given callback's next run to the given delay from now
+	///
+	/// @returns Whether the callback has been scheduled (a callback that has run once has not)
+	bool reschedule(TimerID id, qint64 delay);
+	/// @returns Whether the callback has been scheduled
+	bool cancel(TimerID id);
+	bool isScheduled(TimerID id) const;
+
+	/// @returns The amount of scheduled callbacks
+	std::size_t size() const;
+	/// @returns The length of a tick in milliseconds
+	unsigned int tickLength() const;
+
+	/// Runs all callbacks that are due by the given time (in milliseconds since the wheel has been started)
+	void advance(qint64 now);
+
+protected:
+	struct Entry {
+		/// The tick the callback is due in
+		quint64 deadline = 0;
+		/// The period of a periodic callback in milliseconds, 0 for all other callbacks
+		qint64 interval = 0;
+		Callback callback;
+		/// The neighbours in the slot's list
+		int previous = -1;
+		int next     = -1;
+		/// The index in m_slots, -1 if the entry isn't scheduled
+		int slot = -1;
+		/// Incremented whenever the entry is reused, so that the IDs of previous callbacks don't match it
+		quint32 generation = 1;
+	};
+
+	/// @returns The index of the given callback's entry or -1 if it isn't scheduled
+	int find(TimerID id) const;
+	/// @returns The tick a callback is due in if it is scheduled with the given delay now
+	quint64 deadline(qint64 delay) const;
+	TimerID add(qint64 delay, qint64 interval, Callback callback);
+	void release(int index);
+
+	/// Puts the entry into the slot for its deadline
+	void link(int index);
+	void unlink(int index);
+
+	void tick();
+	/// Moves the callbacks of the current slot of the given level down
+	void cascade(unsigned int level);
+
+	unsigned int m_tickLength;
+	/// The current tick
+	quint64 m_now = 0;
+
+	std::vector< Entry > m_entries;
+	std::vector< int > m_free;
+	/// The first entry of every slot, level by level
+	std::array< int, LEVELS * SLOTS > m_slots;
+	std::size_t m_size = 0;
+
+	QTimer m_timer;
+	QElapsedTimer m_clock;
+};
+
+#endif // MUMBLE_MURMUR_TIMINGWHEEL_H_
@@ -12,14 +12,23 @@ static constexpr const char *TCP_PACKET_PROCESSING_ZONE = "tcp_packet_processing
 static constexpr const char *PING_PROCESSING_ZONE       = "tcp_ping";
 static constexpr const char *UDP_PING_PROCESSING_ZONE   = "udp_ping";
 static constexpr const char *DECRYPT_UNKNOWN_PEER_ZONE  = "decrypt_unknown_peer";
+static constexpr const char *PASSWORD_HASH_ZONE         = "password_hash";
 
 static constexpr const char *UDP_FRAME = "udp_frame";
 
+static constexpr const char *UDP_PACKETS_PER_WAKEUP  = "udp_packets_per_wakeup";
+static constexpr const char *UDP_SEND_SYSCALLS_SAVED = "udp_send_syscalls_saved";
+static constexpr const char *UDP_PINGS_ANSWERED      = "udp_pings_answered_per_second";
+static constexpr const char *UDP_PINGS_LIMITED       = "udp_pings_limited_per_second";
+
+static constexpr const char *PASSWORD_HASH_QUEUE_DEPTH = "password_hash_queue_depth";
+
 static constexpr const char *AUDIO_SENDOUT_ZONE         = "audio_send_out";
 static constexpr const char *AUDIO_ENCODE               = "audio_encode";
 static constexpr const char *AUDIO_UPDATE               = "audio_update";
 static constexpr const char *AUDIO_WHISPER_CACHE_STORE  = "audio_whisper_cache_restore";
 static constexpr const char *AUDIO_WHISPER_CACHE_CREATE = "audio_whisper_cache_create";
+static constexpr const char *AUDIO_ROUTING_TABLE_CREATE = "audio_routing_table_create";
 }; // namespace TracyConstants
 
 #endif // MUMBLE_MURMUR_TRACYCONSTANTS_H_
@@ -0,0 +1,123 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "UDPSendBatch.h"
+
+#include <cassert>
+#include <cstring>
+
+UDPSendBatch::UDPSendBatch(std::size_t capacity) : m_slots(std::max(capacity, std::size_t(1))) {
+	m_headers.resize(m_slots.size());
+}
+
+unsigned char *UDPSendBatch::nextBuffer(std::size_t offset) {
+	assert(m_pending + offset < m_slots.size());
+
+	// Offset by 4 bytes (the crypt header) so that the encrypted payload ends up 8-byte aligned
+	return m_slots[m_pending + offset].buffer + 4;
+}
+
+std::size_t UDPSendBatch::getFreeSlots() const {
+	return m_slots.size() - m_pending;
+}
+
+bool UDPSendBatch::commit(int socket, const struct sockaddr_storage &destination, const HostAddress &localAddress,
+						  std::size_t length) {
+	assert(m_pending < m_slots.size());
+	assert(length <= Mumble::Protocol::MAX_UDP_PACKET_SIZE + 4);
+
+	Slot &slot          = m_slots[m_pending];
+	struct msghdr &msg  = m_headers[m_pending].msg_hdr;
+	const bool isIPv6   = destination.ss_family == AF_INET6;
+	const socklen_t len = isIPv6 ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+
+	if (!isIPv6 && localAddress.isV6()) {
+		// We can't send an IPv4 datagram from an IPv6 address
+		return false;
+	}
+
+	slot.socket = socket;
+	memcpy(&slot.destination, &destination, len);
+	slot.iov.iov_base = nextBuffer();
+	slot.iov.iov_len  = length;
+	memset(slot.controldata, 0, sizeof(slot.controldata));
+
+	memset(&m_headers[m_pending], 0, sizeof(m_headers[m_pending]));
+	msg.msg_name       = reinterpret_cast< struct sockaddr * >(&slot.destination);
+	msg.msg_namelen    = len;
+	msg.msg_iov        = &slot.iov;
+	msg.msg_iovlen     = 1;
+	msg.msg_control    = slot.controldata;
+	msg.msg_controllen = CMSG_SPACE(isIPv6 ? sizeof(struct in6_pktinfo) : sizeof(struct in_pktinfo));
+
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	if (isIPv6) {
+		cmsg->cmsg_level            = IPPROTO_IPV6;
+		cmsg->cmsg_type             = IPV6_PKTINFO;
+		cmsg->cmsg_len              = CMSG_LEN(sizeof(struct in6_pktinfo));
+		struct in6_pktinfo *pktinfo = reinterpret_cast< struct in6_pktinfo * >(CMSG_DATA(cmsg));
+		memcpy(&pktinfo->ipi6_addr.s6_addr[0], &localAddress.qip6.c[0], sizeof(pktinfo->ipi6_addr.s6_addr));
+	} else {
+		cmsg->cmsg_level             = IPPROTO_IP;
+		cmsg->cmsg_type              = IP_PKTINFO;
+		cmsg->cmsg_len               = CMSG_LEN(sizeof(struct in_pktinfo));
+		struct in_pktinfo *pktinfo   = reinterpret_cast< struct in_pktinfo * >(CMSG_DATA(cmsg));
+		pktinfo->ipi_spec_dst.s_addr = localAddress.hash[3];
+	}
+
+	m_pending++;
+
+	if (m_pending == m_slots.size()) {
+		flush();
+	}
+
+	return true;
+}
+
+void UDPSendBatch::flush() {
+	std::size_t begin = 0;
+
+	while (begin < m_pending) {
+		// sendmmsg only operates on a single socket, so we send runs of datagrams that share the same one.
+		// As all receivers of a virtual server usually share one socket per address family, these runs are long.
+		const int socket = m_slots[begin].socket;
+		std::size_t end  = begin + 1;
+		while (end < m_pending && m_slots[end].socket == socket) {
+			end++;
+		}
+
+		while (begin < end) {
+			int sent = ::sendmmsg(socket, &m_headers[begin], static_cast< unsigned int >(end - begin), 0);
+			m_syscalls++;
+
+			if (sent <= 0) {
+				// The first datagram could not be sent. Just like a failing sendmsg, this is not
+				// treated as an error (UDP is lossy anyway), so we drop it and carry on with the rest.
+				sent = 1;
+			}
+
+			begin += static_cast< std::size_t >(sent);
+		}
+	}
+
+	m_sentDatagrams += m_pending;
+	m_pending = 0;
+}
+
+bool UDPSendBatch::isEmpty() const {
+	return m_pending == 0;
+}
+
+std::uint64_t UDPSendBatch::getSentDatagrams() const {
+	return m_sentDatagrams;
+}
+
+std::uint64_t UDPSendBatch::getSyscalls() const {
+	return m_syscalls;
+}
+
+std::uint64_t UDPSendBatch::getSavedSyscalls() const {
+	return m_sentDatagrams - m_syscalls;
+}
@@ -0,0 +1,88 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_UDPSENDBATCH_H_
+#define MUMBLE_MURMUR_UDPSENDBATCH_H_
+
+#include "HostAddress.h"
+#include "MumbleProtocol.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+/// Collects encrypted UDP datagrams and hands them to the kernel in as few sendmmsg calls
+/// as possible. This is used when fanning out an audio packet to many receivers, where
+/// the cost of one sendmsg syscall per receiver dominates.
+///
+/// Datagrams are encrypted directly into the batch's preallocated buffers (see nextBuffer()),
+/// so queueing a datagram does not allocate. The batch flushes itself once it is full; callers
+/// have to call flush() once they are done queueing.
+///
+/// Note that a batch is not thread-safe. Every thread that sends audio needs its own batch.
+///
+/// This class is only available on Linux.
+class UDPSendBatch {
+public:
+	/// The default amount of datagrams a batch can hold before it is flushed automatically
+	static constexpr std::size_t DEFAULT_CAPACITY = 64;
+
+	explicit UDPSendBatch(std::size_t capacity = DEFAULT_CAPACITY);
+
+	/// @param offset How many datagrams after the next one to look ahead. Must be less than getFreeSlots().
+	/// @returns A pointer to the buffer the next datagram (including the 4 byte crypt header) is
+	/// to be written to. The buffer can hold up to Mumble::Protocol::MAX_UDP_PACKET_SIZE + 4 bytes.
+	/// The part after the crypt header is 8-byte aligned.
+	unsigned char *nextBuffer(std::size_t offset = 0);
+
+	/// @returns The amount of datagrams that can be queued before the batch flushes itself
+	std::size_t getFreeSlots() const;
+
+	/// Queues the datagram that has been written into nextBuffer().
+	///
+	/// @param socket The UDP socket to send the datagram through
+	/// @param destination The address of the receiver
+	/// @param localAddress The local address the datagram shall be sent from
+	/// @param length The length of the datagram in bytes
+	/// @returns Whether the datagram has been queued. A datagram is not queued if it can't be sent
+	/// from localAddress (IPv4 receiver but IPv6 local address).
+	bool commit(int socket, const struct sockaddr_storage &destination, const HostAddress &localAddress,
+				std::size_t length);
+
+	/// Sends all queued datagrams
+	void flush();
+
+	bool isEmpty() const;
+
+	/// @returns The total amount of datagrams this batch has handed to the kernel
+	std::uint64_t getSentDatagrams() const;
+	/// @returns The total amount of send syscalls this batch has used
+	std::uint64_t getSyscalls() const;
+	/// @returns The total amount of send syscalls that have been saved compared to sending
+	/// every datagram on its own
+	std::uint64_t getSavedSyscalls() const;
+
+protected:
+	struct Slot {
+		struct sockaddr_storage destination;
+		struct iovec iov;
+		int socket;
+		uint8_t controldata[CMSG_SPACE(std::max(sizeof(struct in6_pktinfo), sizeof(struct in_pktinfo)))];
+		alignas(8) unsigned char buffer[Mumble::Protocol::MAX_UDP_PACKET_SIZE + 8];
+	};
+
+	std::vector< Slot > m_slots;
+	std::vector< struct mmsghdr > m_headers;
+	std::size_t m_pending         = 0;
+	std::uint64_t m_sentDatagrams = 0;
+	std::uint64_t m_syscalls      = 0;
+};
+
+#endif // MUMBLE_MURMUR_UDPSENDBATCH_H_
@@ -0,0 +1,132 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "UserStateAggregator.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace {
+template< typename Container, typename Value > bool removeValue(Container &container, const Value &value) {
+	auto it = std::find(container.begin(), container.end(), value);
+	if (it == container.end()) {
+		return false;
+	}
+
+	container.erase(it);
+	return true;
+}
+} // namespace
+
+bool UserStateAggregator::add(const MumbleProto::UserState &message, unsigned int excludedSession) {
+	auto it = m_indices.find(message.session());
+	if (it == m_indices.end()) {
+		m_indices.emplace(message.session(), m_updates.size());
+		m_updates.push_back({ message, excludedSession });
+
+		return true;
+	}
+
+	Update &pending = m_updates[it->second];
+	if (pending.excludedSession != excludedSession) {
+		return false;
+	}
+
+	merge(pending.message, message);
+
+	return true;
+}
+
+bool UserStateAggregator::take(unsigned int session, Update &update) {
+	auto it = m_indices.find(session);
+	if (it == m_indices.end()) {
+		return false;
+	}
+
+	const std::size_t index = it->second;
+	update                  = std::move(m_updates[index]);
+
+	m_updates.erase(m_updates.begin() + static_cast< std::ptrdiff_t >(index));
+	m_indices.erase(it);
+	for (auto &entry : m_indices) {
+		if (entry.second > index) {
+			entry.second--;
+		}
+	}
+
+	return true;
+}
+
+std::vector< UserStateAggregator::Update > UserStateAggregator::takeAll() {
+	std::vector< Update > updates;
+	updates.swap(m_updates);
+	m_indices.clear();
+
+	return updates;
+}
+
+bool UserStateAggregator::isEmpty() const {
+	return m_updates.empty();
+}
+
+std::size_t UserStateAggregator::size() const {
+	return m_updates.size();
+}
+
+void UserStateAggregator::merge(MumbleProto::UserState &message, const MumbleProto::UserState &update) {
+	// Listening channels are merged as sets: adding a channel cancels a pending removal and vice versa. Receivers
+	// that never learned about the cancelled change don't mind being told about the final state.
+	std::vector< unsigned int > added(message.listening_channel_add().begin(), message.listening_channel_add().end());
+	std::vector< unsigned int > removed(message.listening_channel_remove().begin(),
+										message.listening_channel_remove().end());
+
+	for (unsigned int channelID : update.listening_channel_add()) {
+		removeValue(removed, channelID);
+		if (std::find(added.begin(), added.end(), channelID) == added.end()) {
+			added.push_back(channelID);
+		}
+	}
+	for (unsigned int channelID : update.listening_channel_remove()) {
+		removeValue(added, channelID);
+		if (std::find(removed.begin(), removed.end(), channelID) == removed.end()) {
+			removed.push_back(channelID);
+		}
+	}
+
+	// The latest volume adjustment of a channel wins
+	std::vector< MumbleProto::UserState::VolumeAdjustment > adjustments(message.listening_volume_adjustment().begin(),
+																	   message.listening_volume_adjustment().end());
+	for (const MumbleProto::UserState::VolumeAdjustment &adjustment : update.listening_volume_adjustment()) {
+		auto it = std::find_if(adjustments.begin(), adjustments.end(),
+							   [&adjustment](const MumbleProto::UserState::VolumeAdjustment &current) {
+								   return current.listening_channel() == adjustment.listening_channel();
+							   });
+		if (it != adjustments.end()) {
+			*it = adjustment;
+		} else {
+			adjustments.push_back(adjustment);
+		}
+	}
+
+	// All other fields are singular, so merging simply keeps the latest value
+	MumbleProto::UserState singular = update;
+	singular.clear_listening_channel_add();
+	singular.clear_listening_channel_remove();
+	singular.clear_listening_volume_adjustment();
+	message.MergeFrom(singular);
+
+	message.clear_listening_channel_add();
+	for (unsigned int channelID : added) {
+		message.add_listening_channel_add(channelID);
+	}
+	message.clear_listening_channel_remove();
+	for (unsigned int channelID : removed) {
+		message.add_listening_channel_remove(channelID);
+	}
+	message.clear_listening_volume_adjustment();
+	for (const MumbleProto::UserState::VolumeAdjustment &adjustment : adjustments) {
+		*message.add_listening_volume_adjustment() = adjustment;
+	}
+}
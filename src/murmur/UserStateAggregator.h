@@ -0,0 +1,57 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_USERSTATEAGGREGATOR_H_
+#define MUMBLE_MURMUR_USERSTATEAGGREGATOR_H_
+
+#include "Mumble.pb.h"
+
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+/// Collects the UserState messages that are to be broadcast within one tick and merges the ones concerning the
+/// same user, so that every user's changes are broadcast as a single message once the tick is over.
+///
+/// Merging keeps the latest value of every field. Listening channels that are added and removed again (or vice
+/// versa) within a tick cancel out and volume adjustments of the same channel replace each other.
+///
+/// Every update can exclude one session from the broadcast (the session that caused the change, which has already
+/// been sent the message). Updates excluding different sessions can't be merged.
+class UserStateAggregator {
+public:
+	struct Update {
+		MumbleProto::UserState message;
+		/// The session not to send the message to (0 if none)
+		unsigned int excludedSession;
+	};
+
+	/// Merges the given message into the pending update of the user it concerns.
+	///
+	/// @returns Whether the message has been added. It is not added if there is a pending update for the same user
+	/// which excludes a different session. That update has to be taken (and sent) first.
+	bool add(const MumbleProto::UserState &message, unsigned int excludedSession);
+
+	/// Takes the pending update of the given user
+	///
+	/// @returns Whether there has been a pending update
+	bool take(unsigned int session, Update &update);
+	/// Takes all pending updates, in the order they have been added in
+	std::vector< Update > takeAll();
+
+	bool isEmpty() const;
+	/// @returns The amount of pending updates
+	std::size_t size() const;
+
+	/// Merges update into message as if update had been applied after message
+	static void merge(MumbleProto::UserState &message, const MumbleProto::UserState &update);
+
+protected:
+	std::vector< Update > m_updates;
+	/// The index into m_updates for every user with a pending update
+	std::unordered_map< unsigned int, std::size_t > m_indices;
+};
+
+#endif // MUMBLE_MURMUR_USERSTATEAGGREGATOR_H_
@@ -0,0 +1,21 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_SERVERUSER_H_
+#define MUMBLE_MURMUR_SERVERUSER_H_
+
+// NOTE: This is merely a mock of the ServerUser class, containing only what ACL evaluation looks at
+
+#include "User.h"
+
+#include <QtCore/QStringList>
+
+class ServerUser : public User {
+public:
+	bool bVerified = false;
+	QStringList qslAccessTokens;
+};
+
+#endif // MUMBLE_MURMUR_SERVERUSER_H_
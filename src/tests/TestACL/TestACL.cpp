@@ -0,0 +1,323 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "ACL.h"
+#include "Channel.h"
+#include "CompiledACL.h"
+#include "Group.h"
+#include "ServerUser.h"
+
+#include <QObject>
+#include <QtTest>
+
+#include <array>
+#include <memory>
+#include <random>
+#include <vector>
+
+/// A randomly generated server: a channel tree with random ACLs and groups and users spread across it
+class RandomServer {
+public:
+	std::unique_ptr< Channel > root;
+	std::vector< Channel * > channels;
+	std::vector< std::unique_ptr< ServerUser > > users;
+
+	explicit RandomServer(std::mt19937 &rng) : m_rng(rng) {
+		root = std::make_unique< Channel >(0, QStringLiteral("Root"));
+		channels.push_back(root.get());
+
+		for (int i = 1; i < 40; ++i) {
+			channels.push_back(new Channel(i, QString::fromLatin1("Channel %1").arg(i), pick(channels)));
+		}
+
+		for (Channel *channel : channels) {
+			channel->bInheritACL = chance(0.8);
+
+			for (const char *name : { "admin", "friends", "guests" }) {
+				if (chance(0.2)) {
+					randomGroup(channel, QLatin1String(name));
+				}
+			}
+
+			const int aclCount = random(0, 4);
+			for (int i = 0; i < aclCount; ++i) {
+				randomACL(channel);
+			}
+		}
+
+		for (unsigned int session = 1; session <= 30; ++session) {
+			users.push_back(std::make_unique< ServerUser >());
+			ServerUser &user = *users.back();
+
+			user.uiSession = session;
+			user.iId       = chance(0.5) ? -1 : random(0, 8);
+			user.qsHash    = chance(0.5) ? QStringLiteral("hash%1").arg(random(0, 2)) : QString();
+			user.bVerified = chance(0.5);
+			user.cChannel  = pick(channels);
+
+			if (chance(0.3)) {
+				user.qslAccessTokens << QStringLiteral("Token1");
+			}
+			if (chance(0.3)) {
+				user.qslAccessTokens << QStringLiteral("tOkEn2");
+			}
+		}
+	}
+
+	void randomGroup(Channel *channel, const QString &name) {
+		delete channel->qhGroups.take(name);
+
+		Group *group        = new Group(channel, name);
+		group->bInherit     = chance(0.7);
+		group->bInheritable = chance(0.7);
+
+		for (int id = -1; id <= 8; ++id) {
+			if (chance(0.3)) {
+				group->qsAdd << id;
+			}
+			if (chance(0.1)) {
+				group->qsRemove << id;
+			}
+			if (chance(0.1)) {
+				group->qsTemporary << id;
+			}
+		}
+		for (int session = 1; session <= 30; ++session) {
+			if (chance(0.05)) {
+				group->qsTemporary << -session;
+			}
+		}
+	}
+
+	void randomACL(Channel *channel) {
+		static const std::array< const char *, 22 > specifications = {
+			// Meta groups
+			"all", "none", "auth", "strong", "in", "out",
+			// Subchannel specifications
+			"sub", "sub,1", "sub,-1,2", "sub,0,2", "sub,,,1", "sub,5", "sub,x,1",
+			// Groups
+			"admin", "friends", "guests", "unknown",
+			// Certificate hashes and access tokens (if prefixed accordingly)
+			"hash1", "Token1", "token2", "TOKEN3",
+			// Empty specification
+			""
+		};
+		static const std::array< char, 4 > prefixes = { '!', '~', '#', '$' };
+
+		ChanACL *acl    = new ChanACL(channel);
+		acl->bApplyHere = chance(0.8);
+		acl->bApplySubs = chance(0.8);
+		acl->iUserId    = chance(0.7) ? -1 : random(1, 8);
+
+		QString specification;
+		while (chance(0.3)) {
+			specification += QLatin1Char(prefixes[static_cast< std::size_t >(random(0, 3))]);
+		}
+		specification += QLatin1String(specifications[static_cast< std::size_t >(random(0, 21))]);
+		acl->qsGroup = specification;
+
+		acl->pAllow = randomPermissions(0.3);
+		acl->pDeny  = randomPermissions(0.15);
+	}
+
+	ChanACL::Permissions randomPermissions(double probability) {
+		ChanACL::Permissions permissions = ChanACL::None;
+
+		for (int bit = 0; bit < 32; ++bit) {
+			const int perm = 1 << bit;
+			if ((perm & (ChanACL::All | ChanACL::Cached)) && chance(probability)) {
+				permissions |= static_cast< ChanACL::Perm >(perm);
+			}
+		}
+
+		return permissions;
+	}
+
+	int random(int min, int max) { return std::uniform_int_distribution< int >(min, max)(m_rng); }
+
+	bool chance(double probability) { return std::bernoulli_distribution(probability)(m_rng); }
+
+	template< typename T > const T &pick(const std::vector< T > &values) {
+		return values[static_cast< std::size_t >(random(0, static_cast< int >(values.size()) - 1))];
+	}
+
+private:
+	std::mt19937 &m_rng;
+};
+
+/// @returns The given channel and all channels below it
+QSet< Channel * > subtree(Channel *channel) {
+	QSet< Channel * > channels = channel->allChildren();
+	channels.insert(channel);
+
+	return channels;
+}
+
+void compareAll(RandomServer &server, ChanACL::ACLCache &cache) {
+	for (const std::unique_ptr< ServerUser > &user : server.users) {
+		for (Channel *channel : server.channels) {
+			const ChanACL::Permissions expected = ChanACL::evaluatePermissions(user.get(), channel);
+
+			// Once computed from the compiled ACLs and once from the cached result
+			for (int i = 0; i < 2; ++i) {
+				const ChanACL::Permissions actual = ChanACL::effectivePermissions(user.get(), channel, &cache);
+
+				QVERIFY2((actual & ~ChanACL::Cached) == expected,
+						 qPrintable(QString::fromLatin1("User %1 (ID %2) in channel %3")
+										.arg(user->uiSession)
+										.arg(user->iId)
+										.arg(channel->iId)));
+			}
+		}
+	}
+}
+
+class TestACL : public QObject {
+	Q_OBJECT
+private slots:
+	void compiledMatchesEvaluated_data();
+	void compiledMatchesEvaluated();
+	void seesCreatedGroups();
+	void reusesChannelOrdinals();
+};
+
+void TestACL::compiledMatchesEvaluated_data() {
+	QTest::addColumn< unsigned int >("seed");
+
+	for (unsigned int seed = 1; seed <= 50; ++seed) {
+		QTest::newRow(qPrintable(QString::fromLatin1("seed %1").arg(seed))) << seed;
+	}
+}
+
+void TestACL::compiledMatchesEvaluated() {
+	QFETCH(unsigned int, seed);
+
+	std::mt19937 rng(seed);
+	RandomServer server(rng);
+	ChanACL::ACLCache cache;
+
+	compareAll(server, cache);
+
+	// Users moving around only invalidates their own memberships
+	for (int i = 0; i < 10; ++i) {
+		ServerUser *user = server.pick(server.users).get();
+		user->cChannel   = server.pick(server.channels);
+		cache.clearUser(user);
+	}
+	compareAll(server, cache);
+
+	// Changing the ACLs or groups of a channel only invalidates its subtree
+	for (int i = 0; i < 5; ++i) {
+		Channel *channel = server.pick(server.channels);
+		server.randomACL(channel);
+		cache.clearChannels(subtree(channel));
+	}
+	for (int i = 0; i < 3; ++i) {
+		Channel *channel = server.pick(server.channels);
+		server.randomGroup(channel, QStringLiteral("friends"));
+		cache.clearChannels(subtree(channel));
+	}
+	Channel *channel     = server.pick(server.channels);
+	channel->bInheritACL = !channel->bInheritACL;
+	cache.clearChannels(subtree(channel));
+	compareAll(server, cache);
+
+	// Moving a channel invalidates its subtree and the users in it
+	for (int i = 0; i < 3; ++i) {
+		Channel *moved                        = server.pick(server.channels);
+		Channel *parent                       = server.pick(server.channels);
+		const QSet< Channel * > movedChannels = subtree(moved);
+		if (!moved->cParent || movedChannels.contains(parent)) {
+			continue;
+		}
+
+		moved->cParent->removeChannel(moved);
+		parent->addChannel(moved);
+
+		cache.clearChannels(movedChannels);
+		for (const std::unique_ptr< ServerUser > &user : server.users) {
+			if (movedChannels.contains(user->cChannel)) {
+				cache.clearUser(user.get());
+			}
+		}
+	}
+	compareAll(server, cache);
+
+	// Removing a channel may free its ID for a new one
+	Channel *removed = server.channels.back();
+	const int id     = removed->iId;
+	if (removed->qlChannels.isEmpty()) {
+		for (const std::unique_ptr< ServerUser > &user : server.users) {
+			if (user->cChannel == removed) {
+				user->cChannel = removed->cParent;
+				cache.clearUser(user.get());
+			}
+		}
+		cache.clearChannels(subtree(removed));
+		server.channels.pop_back();
+		delete removed;
+
+		Channel *added = new Channel(id, QStringLiteral("Added"), server.pick(server.channels));
+		server.channels.push_back(added);
+		server.randomACL(added);
+		compareAll(server, cache);
+	}
+}
+
+void TestACL::seesCreatedGroups() {
+	Channel root(0, QStringLiteral("Root"));
+	Channel *channel = new Channel(1, QStringLiteral("Channel"), &root);
+
+	ChanACL *acl    = new ChanACL(channel);
+	acl->bApplyHere = true;
+	acl->bApplySubs = true;
+	acl->qsGroup    = QStringLiteral("temp");
+	acl->pAllow     = ChanACL::MuteDeafen;
+
+	ServerUser user;
+	user.uiSession = 1;
+	user.iId       = -1;
+	user.cChannel  = channel;
+
+	ChanACL::ACLCache cache;
+	QVERIFY(!(ChanACL::effectivePermissions(&user, channel, &cache) & ChanACL::MuteDeafen));
+
+	// Temporary groups are created on demand (e.g. through Ice), after the ACLs referring to them have been compiled
+	Group *group = new Group(channel, QStringLiteral("temp"));
+	group->qsTemporary << -1;
+	cache.clearChannels(subtree(channel));
+	cache.clearUser(&user);
+
+	QVERIFY(ChanACL::effectivePermissions(&user, channel, &cache) & ChanACL::MuteDeafen);
+	QVERIFY((ChanACL::effectivePermissions(&user, channel, &cache) & ~ChanACL::Cached)
+			== ChanACL::evaluatePermissions(&user, channel));
+}
+
+void TestACL::reusesChannelOrdinals() {
+	Channel root(0, QStringLiteral("Root"));
+
+	// Channel IDs only ever grow, but the ordinals the permissions are cached by don't
+	Channel *removed           = new Channel(1000000, QStringLiteral("Removed"), &root);
+	const unsigned int ordinal = removed->uiOrdinal;
+	QVERIFY(ordinal != root.uiOrdinal);
+
+	ServerUser user;
+	user.uiSession = 1;
+	user.iId       = -1;
+	user.cChannel  = &root;
+
+	ChanACL::ACLCache cache;
+	cache.insert(&user, removed, ChanACL::Cached | ChanACL::All);
+
+	cache.clearChannels(subtree(removed));
+	delete removed;
+
+	Channel *added = new Channel(2000000, QStringLiteral("Added"), &root);
+	QCOMPARE(added->uiOrdinal, ordinal);
+	QCOMPARE(cache.value(&user, added), ChanACL::Permissions(ChanACL::None));
+}
+
+QTEST_MAIN(TestACL)
+#include "TestACL.moc"
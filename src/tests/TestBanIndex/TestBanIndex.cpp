@@ -0,0 +1,187 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "BanIndex.h"
+
+#include <QObject>
+#include <QtNetwork/QHostAddress>
+#include <QtTest>
+
+#include <random>
+
+HostAddress address(const char *str) {
+	return HostAddress(QHostAddress(QString::fromLatin1(str)));
+}
+
+/// @param mask The mask as it would be written for the address (IPv4 masks are converted)
+Ban ban(const char *str, int mask, int duration = 0, const QDateTime &start = QDateTime::currentDateTimeUTC()) {
+	Ban ban;
+	ban.haAddress = address(str);
+	ban.iMask     = ban.haAddress.isV6() ? mask : mask + 96;
+	ban.qsReason  = QString::fromLatin1("Reason");
+	ban.qdtStart  = start;
+	ban.iDuration = duration;
+
+	return ban;
+}
+
+class TestBanIndex : public QObject {
+	Q_OBJECT
+private slots:
+	void matchesRanges();
+	void matchesHashes();
+	void removesBans();
+	void takesExpiredBans();
+	void keepsOrder();
+	void agreesWithLinearMatching();
+};
+
+void TestBanIndex::matchesRanges() {
+	BanIndex index;
+	index.insert(ban("10.0.0.0", 8));
+	index.insert(ban("192.168.1.0", 24));
+	index.insert(ban("192.168.1.17", 32));
+	index.insert(ban("2001:db8::", 32));
+
+	QVERIFY(index.match(address("10.1.2.3")));
+	QVERIFY(index.match(address("192.168.1.200")));
+	QVERIFY(index.match(address("192.168.1.17")));
+	QVERIFY(index.match(address("2001:db8:1::1")));
+
+	QVERIFY(!index.match(address("11.0.0.1")));
+	QVERIFY(!index.match(address("192.168.2.1")));
+	QVERIFY(!index.match(address("2001:db9::1")));
+
+	// The address bits beyond the mask must not matter
+	BanIndex other;
+	other.insert(ban("172.16.5.5", 16));
+	QVERIFY(other.match(address("172.16.200.1")));
+	QVERIFY(!other.match(address("172.17.0.1")));
+}
+
+void TestBanIndex::matchesHashes() {
+	Ban hashBan    = ban("10.0.0.1", 32);
+	hashBan.qsHash = QString::fromLatin1("0123456789abcdef");
+
+	BanIndex index;
+	index.insert(ban("10.0.0.2", 32));
+	index.insert(hashBan);
+
+	const Ban *match = index.matchHash(hashBan.qsHash);
+	QVERIFY(match);
+	QCOMPARE(*match, hashBan);
+	QVERIFY(!index.matchHash(QString::fromLatin1("fedcba9876543210")));
+	// Bans without a hash must not match clients without a certificate
+	QVERIFY(!index.matchHash(QString()));
+}
+
+void TestBanIndex::removesBans() {
+	const Ban wide   = ban("10.0.0.0", 8);
+	const Ban narrow = ban("10.1.0.0", 16);
+
+	BanIndex index;
+	index.insert(wide);
+	index.insert(narrow);
+
+	QVERIFY(index.remove(wide));
+	QVERIFY(!index.remove(wide));
+	QCOMPARE(index.size(), static_cast< std::size_t >(1));
+	QVERIFY(!index.match(address("10.2.0.1")));
+	QVERIFY(index.match(address("10.1.0.1")));
+
+	QVERIFY(index.remove(narrow));
+	QVERIFY(!index.match(address("10.1.0.1")));
+
+	// Removing bans that aren't there doesn't touch the trie
+	const std::size_t nodes = index.nodeCount();
+	QVERIFY(!index.remove(ban("10.1.2.0", 24)));
+	QVERIFY(!index.remove(ban("192.168.0.0", 16)));
+	QVERIFY(!index.remove(ban("::", 1)));
+	QCOMPARE(index.nodeCount(), nodes);
+
+	// Inserting and removing bans must not grow the trie without bounds
+	for (int i = 0; i < 10000; ++i) {
+		const Ban temporary = ban(qPrintable(QString::fromLatin1("10.%1.%2.1").arg(i / 256).arg(i % 256)), 32);
+		index.insert(temporary);
+		QVERIFY(index.remove(temporary));
+	}
+	QVERIFY(index.nodeCount() < 100);
+}
+
+void TestBanIndex::takesExpiredBans() {
+	const QDateTime start = QDateTime::currentDateTimeUTC();
+
+	const Ban permanent = ban("10.0.0.1", 32, 0, start);
+	const Ban shortBan  = ban("10.0.0.2", 32, 10, start);
+	const Ban longBan   = ban("10.0.0.3", 32, 100, start);
+
+	BanIndex index;
+	index.assign({ permanent, shortBan, longBan });
+
+	QVERIFY(index.takeExpired(start.addSecs(10)).isEmpty());
+
+	const QList< Ban > expired = index.takeExpired(start.addSecs(11));
+	QCOMPARE(expired, QList< Ban >({ shortBan }));
+	QVERIFY(!index.match(address("10.0.0.2")));
+	QVERIFY(index.match(address("10.0.0.3")));
+
+	// Removed bans must not be reported
+	QVERIFY(index.remove(longBan));
+	QVERIFY(index.takeExpired(start.addYears(1)).isEmpty());
+	QVERIFY(index.match(address("10.0.0.1")));
+}
+
+void TestBanIndex::keepsOrder() {
+	const QList< Ban > bans = { ban("192.168.0.0", 16), ban("10.0.0.0", 8), ban("2001:db8::", 32),
+								ban("10.0.0.1", 32) };
+
+	BanIndex index;
+	index.assign(bans);
+	QCOMPARE(index.bans(), bans);
+
+	index.remove(bans[1]);
+	QCOMPARE(index.bans(), QList< Ban >({ bans[0], bans[2], bans[3] }));
+}
+
+void TestBanIndex::agreesWithLinearMatching() {
+	std::mt19937 random(42);
+	auto bounded = [&random](int limit) { return static_cast< int >(random() % static_cast< unsigned int >(limit)); };
+
+	auto randomAddress = [&bounded]() {
+		// Few different addresses, so that the ranges overlap
+		return address(
+			qPrintable(QString::fromLatin1("10.%1.%2.%3").arg(bounded(2)).arg(bounded(4)).arg(bounded(4))));
+	};
+
+	QList< Ban > bans;
+	BanIndex index;
+	for (int i = 0; i < 2000; ++i) {
+		if (!bans.isEmpty() && bounded(3) == 0) {
+			const Ban removed = bans.takeAt(bounded(bans.size()));
+			QVERIFY(index.remove(removed));
+		} else {
+			Ban added       = ban("10.0.0.0", 8);
+			added.haAddress = randomAddress();
+			added.iMask     = 96 + 8 + bounded(25);
+			bans << added;
+			index.insert(added);
+		}
+
+		const HostAddress probe = randomAddress();
+		bool banned             = false;
+		for (const Ban &b : bans) {
+			banned = banned || b.haAddress.match(probe, b.iMask);
+		}
+
+		const Ban *match = index.match(probe);
+		QCOMPARE(match != nullptr, banned);
+		if (match) {
+			QVERIFY(match->haAddress.match(probe, match->iMask));
+		}
+	}
+}
+
+QTEST_MAIN(TestBanIndex)
+#include "TestBanIndex.moc"
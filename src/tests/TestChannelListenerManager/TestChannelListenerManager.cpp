@@ -0,0 +1,165 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "ChannelListenerManager.h"
+
+#include <QObject>
+#include <QtTest>
+
+#include <unordered_set>
+
+class TestChannelListenerManager : public QObject {
+	Q_OBJECT
+private slots:
+	void addsAndRemovesListeners();
+	void keepsListsSortedBySession();
+	void storesVolumeAdjustments();
+	void keepsSnapshotsUnchanged();
+	void clears();
+	void hashesWithoutCollisions();
+};
+
+void TestChannelListenerManager::addsAndRemovesListeners() {
+	ChannelListenerManager manager;
+	QSignalSpy spy(&manager, &ChannelListenerManager::listenersChanged);
+
+	manager.addListener(1, 10);
+	manager.addListener(2, 10);
+	manager.addListener(1, 11);
+	// Adding a listener twice has no effect
+	manager.addListener(1, 10);
+
+	QCOMPARE(spy.count(), 4);
+	QCOMPARE(spy.first().first().toInt(), 10);
+
+	QVERIFY(manager.isListening(1, 10));
+	QVERIFY(manager.isListening(2, 10));
+	QVERIFY(!manager.isListening(2, 11));
+	QVERIFY(manager.isListeningToAny(1));
+	QVERIFY(!manager.isListeningToAny(3));
+	QVERIFY(manager.isListenedByAny(11));
+	QVERIFY(!manager.isListenedByAny(12));
+
+	QCOMPARE(manager.getListenersForChannel(10), QSet< unsigned int >({ 1, 2 }));
+	QCOMPARE(manager.getListenedChannelsForUser(1), QSet< int >({ 10, 11 }));
+	QCOMPARE(manager.getListenerCountForChannel(10), 2);
+	QCOMPARE(manager.getListenedChannelCountForUser(1), 2);
+
+	manager.removeListener(1, 10);
+	QVERIFY(!manager.isListening(1, 10));
+	QCOMPARE(manager.getListenersForChannel(10), QSet< unsigned int >({ 2 }));
+	QCOMPARE(manager.getListenedChannelsForUser(1), QSet< int >({ 11 }));
+
+	manager.removeListener(2, 10);
+	QVERIFY(!manager.isListenedByAny(10));
+	QCOMPARE(manager.getListenerEntries(10)->size(), static_cast< std::size_t >(0));
+}
+
+void TestChannelListenerManager::keepsListsSortedBySession() {
+	ChannelListenerManager manager;
+
+	for (unsigned int session : { 7U, 3U, 9U, 1U, 5U }) {
+		manager.addListener(session, 1);
+	}
+	manager.removeListener(9, 1);
+
+	const std::shared_ptr< const ChannelListenerManager::ListenerList > list = manager.getListenerEntries(1);
+	QCOMPARE(list->size(), static_cast< std::size_t >(4));
+
+	QList< unsigned int > sessions;
+	for (const ChannelListenerManager::ListenerEntry &entry : *list) {
+		sessions << entry.userSession;
+	}
+	QCOMPARE(sessions, QList< unsigned int >({ 1, 3, 5, 7 }));
+}
+
+void TestChannelListenerManager::storesVolumeAdjustments() {
+	ChannelListenerManager manager;
+	QSignalSpy spy(&manager, &ChannelListenerManager::localVolumeAdjustmentsChanged);
+
+	manager.addListener(1, 10);
+	QCOMPARE(manager.getListenerVolumeAdjustment(1, 10).factor, 1.0f);
+
+	manager.setListenerVolumeAdjustment(1, 10, VolumeAdjustment::fromFactor(0.5f));
+	QCOMPARE(spy.count(), 1);
+	QCOMPARE(manager.getListenerVolumeAdjustment(1, 10).factor, 0.5f);
+	QCOMPARE(manager.getListenerEntries(10)->front().volumeAdjustment.factor, 0.5f);
+
+	// Setting the same adjustment again doesn't count as a change
+	manager.setListenerVolumeAdjustment(1, 10, VolumeAdjustment::fromFactor(0.5f));
+	QCOMPARE(spy.count(), 1);
+
+	// Adjustments are kept for listeners that are removed and added again
+	manager.removeListener(1, 10);
+	manager.addListener(1, 10);
+	QCOMPARE(manager.getListenerEntries(10)->front().volumeAdjustment.factor, 0.5f);
+
+	// Adjustments may be set before the listener is added
+	manager.setListenerVolumeAdjustment(2, 10, VolumeAdjustment::fromFactor(2.0f));
+	QVERIFY(!manager.isListening(2, 10));
+	manager.addListener(2, 10);
+	QCOMPARE(manager.getListenerEntries(10)->back().volumeAdjustment.factor, 2.0f);
+
+	const std::unordered_map< int, VolumeAdjustment > adjustments = manager.getAllListenerVolumeAdjustments(1);
+	QCOMPARE(adjustments.size(), static_cast< std::size_t >(1));
+	QCOMPARE(adjustments.at(10).factor, 0.5f);
+}
+
+void TestChannelListenerManager::keepsSnapshotsUnchanged() {
+	ChannelListenerManager manager;
+	manager.addListener(1, 10);
+	manager.addListener(2, 10);
+
+	const std::shared_ptr< const ChannelListenerManager::ListenerList > snapshot = manager.getListenerEntries(10);
+
+	manager.removeListener(1, 10);
+	manager.setListenerVolumeAdjustment(2, 10, VolumeAdjustment::fromFactor(0.25f));
+	manager.addListener(3, 10);
+
+	QCOMPARE(snapshot->size(), static_cast< std::size_t >(2));
+	QCOMPARE(snapshot->at(0).userSession, 1U);
+	QCOMPARE(snapshot->at(1).volumeAdjustment.factor, 1.0f);
+
+	const std::shared_ptr< const ChannelListenerManager::ListenerList > current = manager.getListenerEntries(10);
+	QCOMPARE(current->size(), static_cast< std::size_t >(2));
+	QCOMPARE(current->at(0).userSession, 2U);
+	QCOMPARE(current->at(0).volumeAdjustment.factor, 0.25f);
+}
+
+void TestChannelListenerManager::clears() {
+	ChannelListenerManager manager;
+	manager.addListener(1, 10);
+	manager.addListener(1, 27);
+	manager.setListenerVolumeAdjustment(1, 10, VolumeAdjustment::fromFactor(0.5f));
+
+	QSignalSpy spy(&manager, &ChannelListenerManager::listenersChanged);
+	manager.clear();
+
+	QCOMPARE(spy.count(), 2);
+	QVERIFY(!manager.isListeningToAny(1));
+	QVERIFY(!manager.isListenedByAny(10));
+	QVERIFY(!manager.isListenedByAny(27));
+	QCOMPARE(manager.getListenerVolumeAdjustment(1, 10).factor, 1.0f);
+}
+
+void TestChannelListenerManager::hashesWithoutCollisions() {
+	// Small sessions and channel IDs are the common case, which the previous combination of the two hashes mapped
+	// onto few values. (Some collisions are expected where std::size_t only has 32 bits.)
+	std::unordered_set< std::size_t > hashes;
+	for (unsigned int session = 0; session < 256; ++session) {
+		for (int channel = 0; channel < 256; ++channel) {
+			ChannelListener listener = {};
+			listener.userSession     = session;
+			listener.channelID       = channel;
+
+			hashes.insert(std::hash< ChannelListener >()(listener));
+		}
+	}
+
+	QVERIFY(hashes.size() > static_cast< std::size_t >(256 * 256 - 16));
+}
+
+QTEST_MAIN(TestChannelListenerManager)
+#include "TestChannelListenerManager.moc"
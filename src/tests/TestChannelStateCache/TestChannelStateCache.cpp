@@ -0,0 +1,126 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "ChannelStateCache.h"
+
+#include <QObject>
+#include <QtEndian>
+#include <QtTest>
+
+ChannelStateCache::Properties channel(int id, int parentID) {
+	ChannelStateCache::Properties properties;
+	properties.id              = id;
+	properties.parentID        = parentID;
+	properties.name            = QString::fromLatin1("Channel %1").arg(id);
+	properties.position        = 0;
+	properties.maxUsers        = 0;
+	properties.description     = QString::fromLatin1("A description");
+	properties.descriptionHash = QByteArray("hash");
+
+	return properties;
+}
+
+MumbleProto::ChannelState parse(const QByteArray &state) {
+	MumbleProto::ChannelState msg;
+	msg.ParseFromArray(state.constData(), state.size());
+
+	return msg;
+}
+
+class TestChannelStateCache : public QObject {
+	Q_OBJECT
+private slots:
+	void buildsStates();
+	void sharesUnchangedStates();
+	void rebuildsChangedStates();
+	void framesClientState();
+};
+
+void TestChannelStateCache::buildsStates() {
+	ChannelStateCache cache;
+
+	MumbleProto::ChannelState root = parse(cache.get(channel(0, -1), true));
+	QCOMPARE(root.channel_id(), 0u);
+	QVERIFY(!root.has_parent());
+	QCOMPARE(root.name(), std::string("Channel 0"));
+
+	MumbleProto::ChannelState hashed = parse(cache.get(channel(3, 0), true));
+	QCOMPARE(hashed.channel_id(), 3u);
+	QCOMPARE(hashed.parent(), 0u);
+	QCOMPARE(hashed.description_hash(), std::string("hash"));
+	QVERIFY(!hashed.has_description());
+	QVERIFY(hashed.has_max_users());
+	QVERIFY(!hashed.has_can_enter());
+
+	MumbleProto::ChannelState plain = parse(cache.get(channel(3, 0), false));
+	QCOMPARE(plain.description(), std::string("A description"));
+	QVERIFY(!plain.has_description_hash());
+
+	QCOMPARE(cache.size(), static_cast< std::size_t >(2));
+	cache.remove(3);
+	QCOMPARE(cache.size(), static_cast< std::size_t >(1));
+}
+
+void TestChannelStateCache::sharesUnchangedStates() {
+	ChannelStateCache cache;
+
+	const QByteArray first  = cache.get(channel(1, 0), true);
+	const QByteArray second = cache.get(channel(1, 0), true);
+
+	QCOMPARE(second, first);
+	// Not only equal but the very same data
+	QCOMPARE(second.constData(), first.constData());
+}
+
+void TestChannelStateCache::rebuildsChangedStates() {
+	ChannelStateCache cache;
+
+	ChannelStateCache::Properties properties = channel(1, 0);
+	const QByteArray hashed                  = cache.get(properties, true);
+	const QByteArray plain                   = cache.get(properties, false);
+
+	properties.parentID = 2;
+	QCOMPARE(parse(cache.get(properties, true)).parent(), 2u);
+	QCOMPARE(parse(cache.get(properties, false)).parent(), 2u);
+
+	properties.name = QString::fromLatin1("Renamed");
+	QCOMPARE(parse(cache.get(properties, true)).name(), std::string("Renamed"));
+
+	properties.description = QString::fromLatin1("Changed");
+	QCOMPARE(parse(cache.get(properties, false)).description(), std::string("Changed"));
+
+	// The states handed out before are not affected
+	QCOMPARE(parse(hashed).parent(), 0u);
+	QCOMPARE(parse(plain).description(), std::string("A description"));
+}
+
+void TestChannelStateCache::framesClientState() {
+	ChannelStateCache cache;
+
+	const QByteArray state = cache.get(channel(5, 1), true);
+
+	MumbleProto::ChannelState clientState;
+	clientState.set_is_enter_restricted(true);
+	clientState.set_can_enter(false);
+
+	const QByteArray message = ChannelStateCache::frame(state, clientState);
+	QVERIFY(message.size() > 6);
+
+	const unsigned char *header = reinterpret_cast< const unsigned char * >(message.constData());
+	QCOMPARE(qFromBigEndian< quint16 >(&header[0]), static_cast< quint16 >(7));
+	QCOMPARE(static_cast< int >(qFromBigEndian< quint32 >(&header[2])), message.size() - 6);
+
+	MumbleProto::ChannelState msg = parse(message.mid(6));
+	QCOMPARE(msg.channel_id(), 5u);
+	QCOMPARE(msg.parent(), 1u);
+	QCOMPARE(msg.name(), std::string("Channel 5"));
+	QCOMPARE(msg.description_hash(), std::string("hash"));
+	QVERIFY(msg.has_can_enter());
+	QCOMPARE(msg.can_enter(), false);
+	QCOMPARE(msg.is_enter_restricted(), true);
+}
+
+QTEST_MAIN(TestChannelStateCache)
+#include "TestChannelStateCache.moc"
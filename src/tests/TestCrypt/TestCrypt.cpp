@@ -10,14 +10,30 @@
 #include "Timer.h"
 #include "Utils.h"
 #include "crypto/CryptStateOCB2.h"
+
+#include <openssl/evp.h>
+
+#include <algorithm>
+#include <array>
+#include <random>
 #include <string>
+#include <thread>
+#include <vector>
+
+Q_DECLARE_METATYPE(CryptStateOCB2::Backend)
 
 class TestCrypt : public QObject {
 	Q_OBJECT
 private slots:
 	void initTestCase();
 	void cleanupTestCase();
+	void testvectors_data();
 	void testvectors();
+	void conformance_data();
+	void conformance();
+	void crossBackend();
+	void concurrentEncrypt_data();
+	void concurrentEncrypt();
 	void authcrypt();
 	void xexstarAttack();
 	void ivrecovery();
@@ -144,12 +160,30 @@ void TestCrypt::ivrecovery() {
 	QVERIFY(dec.decrypt(crypted, decr, 14));
 }
 
+static void addBackendRows() {
+	QTest::addColumn< CryptStateOCB2::Backend >("backend");
+
+	QTest::newRow("OpenSSL") << CryptStateOCB2::Backend::OpenSSL;
+	QTest::newRow("AES-NI") << CryptStateOCB2::Backend::AESNI;
+}
+
+void TestCrypt::testvectors_data() {
+	addBackendRows();
+}
+
 void TestCrypt::testvectors() {
+	QFETCH(CryptStateOCB2::Backend, backend);
+
+	if (!CryptStateOCB2::isBackendSupported(backend)) {
+		QSKIP("Backend not supported on this machine");
+	}
+
 	// Test vectors are from draft-krovetz-ocb-00.txt
 	const unsigned char rawkey[AES_BLOCK_SIZE] = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
 												   0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f };
 
 	CryptStateOCB2 cs;
+	QVERIFY(cs.setBackend(backend));
 	std::string rawkey_str = std::string(reinterpret_cast< const char * >(rawkey), AES_BLOCK_SIZE);
 	cs.setKey(rawkey_str, rawkey_str, rawkey_str);
 
@@ -180,6 +214,294 @@ void TestCrypt::testvectors() {
 		QCOMPARE(crypt[i], crypted[i]);
 }
 
+// A straightforward OCB2 implementation that encrypts one block at a time. The optimized
+// backends have to produce exactly the same output.
+namespace reference {
+static void aes(const unsigned char *key, const unsigned char *src, unsigned char *dst, bool decrypt) {
+	EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+	int outlen          = 0;
+
+	EVP_CipherInit_ex(ctx, EVP_aes_128_ecb(), nullptr, key, nullptr, decrypt ? 0 : 1);
+	EVP_CIPHER_CTX_set_padding(ctx, 0);
+	EVP_CipherUpdate(ctx, dst, &outlen, src, AES_BLOCK_SIZE);
+
+	EVP_CIPHER_CTX_free(ctx);
+}
+
+static void times2(unsigned char *block) {
+	const unsigned char carry = block[0] >> 7;
+	for (int i = 0; i < AES_BLOCK_SIZE - 1; i++) {
+		block[i] = static_cast< unsigned char >((block[i] << 1) | (block[i + 1] >> 7));
+	}
+	block[AES_BLOCK_SIZE - 1] = static_cast< unsigned char >((block[AES_BLOCK_SIZE - 1] << 1) ^ (carry * 0x87));
+}
+
+static void times3(unsigned char *block) {
+	unsigned char doubled[AES_BLOCK_SIZE];
+	memcpy(doubled, block, AES_BLOCK_SIZE);
+	times2(doubled);
+	for (int i = 0; i < AES_BLOCK_SIZE; i++) {
+		block[i] ^= doubled[i];
+	}
+}
+
+static void xorBlock(unsigned char *dst, const unsigned char *a, const unsigned char *b) {
+	for (int i = 0; i < AES_BLOCK_SIZE; i++) {
+		dst[i] = a[i] ^ b[i];
+	}
+}
+
+// Computes the pad for the final block and returns the delta it has been derived from
+static void finalPad(const unsigned char *key, unsigned char *delta, unsigned int len, unsigned char *pad) {
+	unsigned char tmp[AES_BLOCK_SIZE] = {};
+
+	times2(delta);
+	tmp[AES_BLOCK_SIZE - 2] = static_cast< unsigned char >((len * 8) >> 8);
+	tmp[AES_BLOCK_SIZE - 1] = static_cast< unsigned char >(len * 8);
+	xorBlock(tmp, tmp, delta);
+	aes(key, tmp, pad, false);
+}
+
+static bool encrypt(const unsigned char *key, const unsigned char *plain, unsigned char *encrypted, unsigned int len,
+					const unsigned char *nonce, unsigned char *tag, bool modifyPlainOnXEXStarAttack) {
+	unsigned char delta[AES_BLOCK_SIZE], checksum[AES_BLOCK_SIZE] = {}, tmp[AES_BLOCK_SIZE], pad[AES_BLOCK_SIZE];
+	bool success = true;
+
+	aes(key, nonce, delta, false);
+
+	while (len > AES_BLOCK_SIZE) {
+		memcpy(tmp, plain, AES_BLOCK_SIZE);
+
+		const bool critical =
+			std::all_of(tmp, tmp + AES_BLOCK_SIZE - 1, [](unsigned char c) { return c == 0; });
+		if (len <= 2 * AES_BLOCK_SIZE && critical) {
+			if (modifyPlainOnXEXStarAttack) {
+				tmp[0] ^= 1;
+			} else {
+				success = false;
+			}
+		}
+
+		times2(delta);
+		xorBlock(checksum, checksum, tmp);
+		xorBlock(tmp, tmp, delta);
+		aes(key, tmp, tmp, false);
+		xorBlock(encrypted, tmp, delta);
+
+		len -= AES_BLOCK_SIZE;
+		plain += AES_BLOCK_SIZE;
+		encrypted += AES_BLOCK_SIZE;
+	}
+
+	finalPad(key, delta, len, pad);
+	memcpy(tmp, pad, AES_BLOCK_SIZE);
+	memcpy(tmp, plain, len);
+	xorBlock(checksum, checksum, tmp);
+	xorBlock(tmp, tmp, pad);
+	memcpy(encrypted, tmp, len);
+
+	times3(delta);
+	xorBlock(tmp, delta, checksum);
+	aes(key, tmp, tag, false);
+
+	return success;
+}
+
+static bool decrypt(const unsigned char *key, const unsigned char *encrypted, unsigned char *plain, unsigned int len,
+					const unsigned char *nonce, unsigned char *tag) {
+	unsigned char delta[AES_BLOCK_SIZE], checksum[AES_BLOCK_SIZE] = {}, tmp[AES_BLOCK_SIZE], pad[AES_BLOCK_SIZE];
+
+	aes(key, nonce, delta, false);
+
+	while (len > AES_BLOCK_SIZE) {
+		times2(delta);
+		xorBlock(tmp, encrypted, delta);
+		aes(key, tmp, tmp, true);
+		xorBlock(plain, tmp, delta);
+		xorBlock(checksum, checksum, plain);
+
+		len -= AES_BLOCK_SIZE;
+		plain += AES_BLOCK_SIZE;
+		encrypted += AES_BLOCK_SIZE;
+	}
+
+	finalPad(key, delta, len, pad);
+	memset(tmp, 0, AES_BLOCK_SIZE);
+	memcpy(tmp, encrypted, len);
+	xorBlock(tmp, tmp, pad);
+	xorBlock(checksum, checksum, tmp);
+	memcpy(plain, tmp, len);
+
+	const bool success = memcmp(tmp, delta, AES_BLOCK_SIZE - 1) != 0;
+
+	times3(delta);
+	xorBlock(tmp, delta, checksum);
+	aes(key, tmp, tag, false);
+
+	return success;
+}
+} // namespace reference
+
+void TestCrypt::conformance_data() {
+	addBackendRows();
+}
+
+void TestCrypt::conformance() {
+	QFETCH(CryptStateOCB2::Backend, backend);
+
+	if (!CryptStateOCB2::isBackendSupported(backend)) {
+		QSKIP("Backend not supported on this machine");
+	}
+
+	// Fixed seed, so that failures are reproducible
+	std::mt19937 rng(42);
+	std::uniform_int_distribution< int > randomByte(0, 255);
+
+	for (int round = 0; round < 8; round++) {
+		unsigned char rawkey[AES_BLOCK_SIZE];
+		unsigned char nonce[AES_BLOCK_SIZE];
+		for (int i = 0; i < AES_BLOCK_SIZE; i++) {
+			rawkey[i] = static_cast< unsigned char >(randomByte(rng));
+			nonce[i]  = static_cast< unsigned char >(randomByte(rng));
+		}
+
+		CryptStateOCB2 cs;
+		QVERIFY(cs.setBackend(backend));
+		cs.setRawKey(std::string(reinterpret_cast< const char * >(rawkey), AES_BLOCK_SIZE));
+
+		// Cover several batches of full blocks as well as every possible length of the final block
+		for (unsigned int len = 0; len <= 20 * AES_BLOCK_SIZE; len++) {
+			std::vector< unsigned char > src(len);
+			for (unsigned char &c : src) {
+				c = static_cast< unsigned char >(randomByte(rng));
+			}
+
+			// Every other message triggers the XEX* countermeasure
+			if (len > AES_BLOCK_SIZE && len % 2 == 0) {
+				const unsigned int lastFullBlock = ((len - 1) / AES_BLOCK_SIZE - 1) * AES_BLOCK_SIZE;
+				std::fill(src.begin() + lastFullBlock, src.begin() + lastFullBlock + AES_BLOCK_SIZE - 1, 0);
+			}
+
+			for (bool modifyPlain : { true, false }) {
+				std::vector< unsigned char > expected(len), encrypted(len);
+				unsigned char expectedTag[AES_BLOCK_SIZE], tag[AES_BLOCK_SIZE];
+
+				const bool expectedSuccess =
+					reference::encrypt(rawkey, src.data(), expected.data(), len, nonce, expectedTag, modifyPlain);
+				QCOMPARE(cs.ocb_encrypt(src.data(), encrypted.data(), len, nonce, tag, modifyPlain), expectedSuccess);
+				QVERIFY(encrypted == expected);
+				QVERIFY(memcmp(tag, expectedTag, AES_BLOCK_SIZE) == 0);
+			}
+
+			// Decryption has to match as well, including for ciphertexts that have not been produced by encryption
+			std::vector< unsigned char > expected(len), decrypted(len);
+			unsigned char expectedTag[AES_BLOCK_SIZE], tag[AES_BLOCK_SIZE];
+
+			const bool expectedSuccess =
+				reference::decrypt(rawkey, src.data(), expected.data(), len, nonce, expectedTag);
+			QCOMPARE(cs.ocb_decrypt(src.data(), decrypted.data(), len, nonce, tag), expectedSuccess);
+			QVERIFY(decrypted == expected);
+			QVERIFY(memcmp(tag, expectedTag, AES_BLOCK_SIZE) == 0);
+		}
+	}
+}
+
+void TestCrypt::crossBackend() {
+	if (!CryptStateOCB2::isBackendSupported(CryptStateOCB2::Backend::AESNI)) {
+		QSKIP("AES-NI not supported on this machine");
+	}
+
+	CryptStateOCB2 enc, dec;
+	enc.genKey();
+	QVERIFY(enc.setBackend(CryptStateOCB2::Backend::AESNI));
+	dec.setKey(enc.getRawKey(), enc.getDecryptIV(), enc.getEncryptIV());
+	QVERIFY(dec.setBackend(CryptStateOCB2::Backend::OpenSSL));
+
+	unsigned char src[300];
+	unsigned char encrypted[sizeof(src) + 4];
+	unsigned char decrypted[sizeof(src)];
+	for (unsigned int i = 0; i < sizeof(src); i++) {
+		src[i] = static_cast< unsigned char >(i * 7);
+	}
+
+	for (unsigned int len = 0; len <= sizeof(src); len++) {
+		QVERIFY(enc.encrypt(src, encrypted, len));
+		QVERIFY(dec.decrypt(encrypted, decrypted, len + 4));
+		QVERIFY(memcmp(src, decrypted, len) == 0);
+
+		// Switching the backend on the fly must not affect the outcome either
+		enc.setBackend(len % 2 ? CryptStateOCB2::Backend::AESNI : CryptStateOCB2::Backend::OpenSSL);
+		dec.setBackend(len % 3 ? CryptStateOCB2::Backend::AESNI : CryptStateOCB2::Backend::OpenSSL);
+	}
+}
+
+void TestCrypt::concurrentEncrypt_data() {
+	addBackendRows();
+}
+
+void TestCrypt::concurrentEncrypt() {
+	QFETCH(CryptStateOCB2::Backend, backend);
+
+	if (!CryptStateOCB2::isBackendSupported(backend)) {
+		QSKIP("Backend not supported on this machine");
+	}
+
+	// 256 packets in total, so that the first byte of the IV (which is sent along) identifies every packet
+	constexpr unsigned int THREADS = 4;
+	constexpr unsigned int PACKETS = 64;
+	constexpr unsigned int LENGTH  = 40;
+	using Packet                   = std::array< unsigned char, LENGTH + 4 >;
+
+	CryptStateOCB2 enc, dec;
+	enc.genKey();
+	QVERIFY(enc.setBackend(backend));
+	dec.setKey(enc.getRawKey(), enc.getDecryptIV(), enc.getEncryptIV());
+
+	const unsigned char firstIV = static_cast< unsigned char >(enc.getEncryptIV()[0] + 1);
+
+	std::vector< std::vector< Packet > > encrypted(THREADS, std::vector< Packet >(PACKETS));
+	std::array< bool, THREADS > results;
+	results.fill(true);
+	std::vector< std::thread > threads;
+	for (unsigned int t = 0; t < THREADS; t++) {
+		threads.emplace_back([&, t]() {
+			for (unsigned int i = 0; i < PACKETS; i++) {
+				unsigned char src[LENGTH] = { static_cast< unsigned char >(t), static_cast< unsigned char >(i) };
+				if (!enc.encrypt(src, encrypted[t][i].data(), LENGTH)) {
+					results[t] = false;
+				}
+			}
+		});
+	}
+	for (std::thread &thread : threads) {
+		thread.join();
+	}
+
+	// Every packet has to have been given a nonce of its own
+	std::vector< Packet > ordered(THREADS * PACKETS);
+	std::vector< bool > seen(THREADS * PACKETS, false);
+	for (unsigned int t = 0; t < THREADS; t++) {
+		QVERIFY(results[t]);
+
+		for (const Packet &packet : encrypted[t]) {
+			const unsigned char index = static_cast< unsigned char >(packet[0] - firstIV);
+			QVERIFY(!seen[index]);
+			seen[index]    = true;
+			ordered[index] = packet;
+		}
+	}
+
+	// Delivered in nonce order, all of them have to decrypt
+	std::vector< bool > received(THREADS * PACKETS, false);
+	for (const Packet &packet : ordered) {
+		unsigned char decrypted[LENGTH];
+		QVERIFY(dec.decrypt(packet.data(), decrypted, LENGTH + 4));
+		QVERIFY(decrypted[0] < THREADS && decrypted[1] < PACKETS);
+		received[decrypted[0] * PACKETS + decrypted[1]] = true;
+	}
+	QVERIFY(std::all_of(received.begin(), received.end(), [](bool value) { return value; }));
+}
+
 void TestCrypt::authcrypt() {
 	for (int len = 0; len < 128; len++) {
 		const unsigned char rawkey[AES_BLOCK_SIZE] = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
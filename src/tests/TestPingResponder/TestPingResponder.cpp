@@ -0,0 +1,180 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "CoarseClock.h"
+#include "HostAddress.h"
+#include "MumbleProtocol.h"
+#include "PingResponder.h"
+#include "Version.h"
+
+#include <QObject>
+#include <QtTest>
+
+#ifdef Q_OS_WIN
+#	include "win.h"
+#	include <winsock2.h>
+#	include <ws2tcpip.h>
+#else
+#	include <netinet/in.h>
+#	include <sys/socket.h>
+#endif
+
+#include <vector>
+
+using ServerDecoder = Mumble::Protocol::UDPDecoder< Mumble::Protocol::Role::Server >;
+using ServerEncoder = Mumble::Protocol::UDPPingEncoder< Mumble::Protocol::Role::Server >;
+
+static sockaddr_storage makeAddress(const char *address, quint16 port) {
+	sockaddr_storage addr;
+	HostAddress(QHostAddress(QString::fromLatin1(address))).toSockaddr(&addr);
+	reinterpret_cast< sockaddr_in * >(&addr)->sin_port = htons(port);
+
+	return addr;
+}
+
+/// @returns A ping as sent by a client of the given version
+static std::vector< Mumble::Protocol::byte > makePing(Version::full_t version, bool requestAdditionalInformation) {
+	Mumble::Protocol::UDPPingEncoder< Mumble::Protocol::Role::Client > encoder(version);
+
+	Mumble::Protocol::PingData data;
+	data.timestamp                    = 42;
+	data.requestAdditionalInformation = requestAdditionalInformation;
+
+	gsl::span< const Mumble::Protocol::byte > encoded = encoder.encodePingPacket(data);
+
+	return std::vector< Mumble::Protocol::byte >(encoded.begin(), encoded.end());
+}
+
+class TestPingResponder : public QObject {
+	Q_OBJECT
+private slots:
+	void initTestCase();
+	void answersExtendedPings();
+	void ignoresOtherDatagrams();
+	void ignoresPingsIfDisabled();
+	void limitsPerAddress();
+	void doesNotLimitIfDisabled();
+};
+
+void TestPingResponder::initTestCase() {
+	CoarseClock::update();
+}
+
+void TestPingResponder::answersExtendedPings() {
+	PingResponder responder;
+	responder.update(true, 12, 42, 72000);
+
+	ServerDecoder decoder;
+	ServerEncoder encoder;
+	const sockaddr_storage from = makeAddress("192.0.2.1", 1234);
+
+	for (Version::full_t version :
+		 { Version::fromComponents(1, 3, 0), Mumble::Protocol::PROTOBUF_INTRODUCTION_VERSION }) {
+		const std::vector< Mumble::Protocol::byte > ping = makePing(version, true);
+
+		gsl::span< const Mumble::Protocol::byte > reply;
+		QVERIFY(responder.respond(ping, from, decoder, encoder, reply));
+		QVERIFY(!reply.empty());
+
+		Mumble::Protocol::UDPDecoder< Mumble::Protocol::Role::Client > clientDecoder(version);
+		QVERIFY(clientDecoder.decodePing(reply));
+
+		const Mumble::Protocol::PingData data = clientDecoder.getPingData();
+		QVERIFY(data.containsAdditionalInformation);
+		QCOMPARE(data.timestamp, static_cast< std::uint64_t >(42));
+		QCOMPARE(data.userCount, static_cast< std::uint32_t >(12));
+		QCOMPARE(data.maxUserCount, static_cast< std::uint32_t >(42));
+		QCOMPARE(data.maxBandwidthPerUser, static_cast< std::uint32_t >(72000));
+	}
+
+	QCOMPARE(responder.answeredPings(), static_cast< quint64 >(2));
+	QCOMPARE(responder.limitedPings(), static_cast< quint64 >(0));
+}
+
+void TestPingResponder::ignoresOtherDatagrams() {
+	PingResponder responder;
+	responder.update(true, 0, 10, 72000);
+
+	ServerDecoder decoder;
+	ServerEncoder encoder;
+	const sockaddr_storage from = makeAddress("192.0.2.1", 1234);
+
+	gsl::span< const Mumble::Protocol::byte > reply;
+
+	// Encrypted datagrams of connected users
+	const std::vector< Mumble::Protocol::byte > datagram = { 0x8a, 0x17, 0x42, 0xde, 0xad, 0xbe, 0xef, 0x01, 0x02 };
+	QVERIFY(!responder.respond(datagram, from, decoder, encoder, reply));
+	QVERIFY(reply.empty());
+
+	// Connectivity pings are consumed, but not answered
+	const std::vector< Mumble::Protocol::byte > ping = makePing(Mumble::Protocol::PROTOBUF_INTRODUCTION_VERSION, false);
+	QVERIFY(responder.respond(ping, from, decoder, encoder, reply));
+	QVERIFY(reply.empty());
+
+	QCOMPARE(responder.answeredPings(), static_cast< quint64 >(0));
+}
+
+void TestPingResponder::ignoresPingsIfDisabled() {
+	PingResponder responder;
+	responder.update(false, 0, 10, 72000);
+
+	ServerDecoder decoder;
+	ServerEncoder encoder;
+
+	gsl::span< const Mumble::Protocol::byte > reply;
+	QVERIFY(!responder.respond(makePing(Mumble::Protocol::PROTOBUF_INTRODUCTION_VERSION, true),
+							   makeAddress("192.0.2.1", 1234), decoder, encoder, reply));
+	QVERIFY(reply.empty());
+}
+
+void TestPingResponder::limitsPerAddress() {
+	PingResponder responder;
+	responder.update(true, 0, 10, 72000);
+	responder.setRateLimit(1, 3);
+
+	ServerDecoder decoder;
+	ServerEncoder encoder;
+	const std::vector< Mumble::Protocol::byte > ping = makePing(Mumble::Protocol::PROTOBUF_INTRODUCTION_VERSION, true);
+
+	gsl::span< const Mumble::Protocol::byte > reply;
+
+	// The burst is answered, no matter which ports the pings come from
+	for (quint16 port = 1000; port < 1003; ++port) {
+		QVERIFY(responder.respond(ping, makeAddress("192.0.2.1", port), decoder, encoder, reply));
+		QVERIFY(!reply.empty());
+	}
+
+	QVERIFY(responder.respond(ping, makeAddress("192.0.2.1", 1003), decoder, encoder, reply));
+	QVERIFY(reply.empty());
+
+	// Other addresses have a limit of their own
+	QVERIFY(responder.respond(ping, makeAddress("198.51.100.7", 1000), decoder, encoder, reply));
+	QVERIFY(!reply.empty());
+
+	QCOMPARE(responder.answeredPings(), static_cast< quint64 >(4));
+	QCOMPARE(responder.limitedPings(), static_cast< quint64 >(1));
+}
+
+void TestPingResponder::doesNotLimitIfDisabled() {
+	PingResponder responder;
+	responder.update(true, 0, 10, 72000);
+	responder.setRateLimit(0, 1);
+
+	ServerDecoder decoder;
+	ServerEncoder encoder;
+	const std::vector< Mumble::Protocol::byte > ping = makePing(Mumble::Protocol::PROTOBUF_INTRODUCTION_VERSION, true);
+	const sockaddr_storage from                      = makeAddress("192.0.2.1", 1234);
+
+	gsl::span< const Mumble::Protocol::byte > reply;
+	for (int i = 0; i < 100; ++i) {
+		QVERIFY(responder.respond(ping, from, decoder, encoder, reply));
+		QVERIFY(!reply.empty());
+	}
+
+	QCOMPARE(responder.limitedPings(), static_cast< quint64 >(0));
+}
+
+QTEST_MAIN(TestPingResponder)
+#include "TestPingResponder.moc"
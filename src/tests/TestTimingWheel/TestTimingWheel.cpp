@@ -0,0 +1,202 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "TimingWheel.h"
+
+#include <QObject>
+#include <QtTest>
+
+#include <map>
+#include <memory>
+#include <random>
+
+class TestTimingWheel : public QObject {
+	Q_OBJECT
+private slots:
+	void runsWhenDue();
+	void cancels();
+	void reschedules();
+	void runsPeriodically();
+	void runsLongDelays();
+	void agreesWithDeadlines();
+};
+
+void TestTimingWheel::runsWhenDue() {
+	TimingWheel wheel(100);
+
+	QList< int > runs;
+	wheel.schedule(250, [&runs]() { runs << 1; });
+	wheel.schedule(100, [&runs]() { runs << 2; });
+	// Delays are at least one tick
+	wheel.schedule(0, [&runs]() { runs << 3; });
+	QCOMPARE(wheel.size(), static_cast< std::size_t >(3));
+
+	wheel.advance(99);
+	QVERIFY(runs.isEmpty());
+
+	wheel.advance(100);
+	QCOMPARE(runs.size(), 2);
+	QVERIFY(runs.contains(2));
+	QVERIFY(runs.contains(3));
+
+	// 250 ms are rounded up to three ticks
+	wheel.advance(299);
+	QCOMPARE(runs.size(), 2);
+	wheel.advance(300);
+	QCOMPARE(runs.size(), 3);
+	QCOMPARE(runs.last(), 1);
+	QCOMPARE(wheel.size(), static_cast< std::size_t >(0));
+}
+
+void TestTimingWheel::cancels() {
+	TimingWheel wheel(100);
+
+	bool run                        = false;
+	const TimingWheel::TimerID id   = wheel.schedule(500, [&run]() { run = true; });
+	const TimingWheel::TimerID kept = wheel.schedule(500, []() {});
+
+	QVERIFY(wheel.isScheduled(id));
+	QVERIFY(wheel.cancel(id));
+	QVERIFY(!wheel.cancel(id));
+	QVERIFY(!wheel.isScheduled(id));
+	QVERIFY(!wheel.cancel(0));
+
+	// The entry is reused, which must not make the old ID valid again
+	const TimingWheel::TimerID reused = wheel.schedule(500, []() {});
+	QVERIFY(reused != id);
+	QVERIFY(!wheel.isScheduled(id));
+
+	wheel.advance(1000);
+	QVERIFY(!run);
+	QVERIFY(!wheel.isScheduled(kept));
+	QVERIFY(!wheel.isScheduled(reused));
+}
+
+void TestTimingWheel::reschedules() {
+	TimingWheel wheel(100);
+
+	int runs                      = 0;
+	const TimingWheel::TimerID id = wheel.schedule(200, [&runs]() { runs++; });
+
+	wheel.advance(100);
+	QVERIFY(wheel.reschedule(id, 500));
+	wheel.advance(500);
+	QCOMPARE(runs, 0);
+	wheel.advance(600);
+	QCOMPARE(runs, 1);
+
+	// A callback that has run can't be rescheduled
+	QVERIFY(!wheel.reschedule(id, 100));
+}
+
+void TestTimingWheel::runsPeriodically() {
+	TimingWheel wheel(100);
+
+	int runs = 0;
+	TimingWheel::TimerID id;
+	id = wheel.schedulePeriodic(300, [&]() {
+		runs++;
+		if (runs == 3) {
+			wheel.cancel(id);
+		}
+	});
+
+	wheel.advance(300);
+	QCOMPARE(runs, 1);
+	wheel.advance(599);
+	QCOMPARE(runs, 1);
+	wheel.advance(600);
+	QCOMPARE(runs, 2);
+
+	// Several periods at once run the callback once per period
+	wheel.advance(5000);
+	QCOMPARE(runs, 3);
+	QVERIFY(!wheel.isScheduled(id));
+}
+
+void TestTimingWheel::runsLongDelays() {
+	TimingWheel wheel(1);
+
+	// Longer than the highest wheel covers
+	const qint64 delay = (1LL << (TimingWheel::SLOT_BITS * TimingWheel::LEVELS)) * 3 + 12345;
+
+	bool run = false;
+	wheel.schedule(delay, [&run]() { run = true; });
+
+	wheel.advance(delay - 1);
+	QVERIFY(!run);
+	wheel.advance(delay);
+	QVERIFY(run);
+}
+
+void TestTimingWheel::agreesWithDeadlines() {
+	std::mt19937 random(42);
+	auto bounded = [&random](int limit) {
+		return static_cast< qint64 >(random() % static_cast< unsigned int >(limit));
+	};
+
+	TimingWheel wheel(10);
+
+	// The time every scheduled callback is due at
+	std::map< TimingWheel::TimerID, qint64 > due;
+	qint64 now = 0;
+	int failed = 0;
+
+	auto scheduleRandom = [&]() {
+		const qint64 delay = bounded(3) == 0 ? bounded(1000000) : bounded(5000);
+		// Holds the ID, which is only known once the callback has been scheduled
+		auto id    = std::make_shared< TimingWheel::TimerID >(0);
+		auto check = [&, id]() {
+			auto it = due.find(*id);
+			if (it == due.end() || it->second != now) {
+				failed++;
+			}
+			if (it != due.end()) {
+				due.erase(it);
+			}
+		};
+		*id      = wheel.schedule(delay, check);
+		due[*id] = now + std::max((delay + 9) / 10 * 10, static_cast< qint64 >(10));
+	};
+
+	for (int i = 0; i < 20000; ++i) {
+		switch (bounded(4)) {
+			case 0:
+				scheduleRandom();
+				break;
+			case 1:
+				if (!due.empty()) {
+					auto it = due.begin();
+					std::advance(it, bounded(static_cast< int >(due.size())));
+					QVERIFY(wheel.cancel(it->first));
+					due.erase(it);
+				}
+				break;
+			case 2:
+				if (!due.empty()) {
+					auto it = due.begin();
+					std::advance(it, bounded(static_cast< int >(due.size())));
+					const qint64 delay = bounded(5000);
+					QVERIFY(wheel.reschedule(it->first, delay));
+					it->second = now + std::max((delay + 9) / 10 * 10, static_cast< qint64 >(10));
+				}
+				break;
+			default:
+				// Tick by tick, so that the callbacks can tell the time they are run at
+				for (qint64 ticks = bounded(20); ticks > 0; --ticks) {
+					now += 10;
+					wheel.advance(now);
+				}
+				break;
+		}
+
+		QCOMPARE(wheel.size(), due.size());
+	}
+
+	QCOMPARE(failed, 0);
+}
+
+QTEST_MAIN(TestTimingWheel)
+#include "TestTimingWheel.moc"
@@ -0,0 +1,165 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "UserStateAggregator.h"
+
+#include <QObject>
+#include <QtTest>
+
+#include <cstdint>
+#include <vector>
+
+MumbleProto::UserState userState(unsigned int session) {
+	MumbleProto::UserState msg;
+	msg.set_session(session);
+
+	return msg;
+}
+
+std::vector< unsigned int > channels(const google::protobuf::RepeatedField< std::uint32_t > &field) {
+	return std::vector< unsigned int >(field.begin(), field.end());
+}
+
+class TestUserStateAggregator : public QObject {
+	Q_OBJECT
+private slots:
+	void mergesSingularFields();
+	void mergesListeningChannels();
+	void mergesVolumeAdjustments();
+	void keepsUsersApart();
+	void refusesDifferentExclusions();
+};
+
+void TestUserStateAggregator::mergesSingularFields() {
+	UserStateAggregator aggregator;
+
+	MumbleProto::UserState first = userState(3);
+	first.set_self_mute(true);
+	first.set_channel_id(1);
+	QVERIFY(aggregator.add(first, 3));
+
+	MumbleProto::UserState second = userState(3);
+	second.set_self_mute(false);
+	second.set_comment_hash("hash");
+	QVERIFY(aggregator.add(second, 3));
+
+	MumbleProto::UserState third = userState(3);
+	third.set_channel_id(2);
+	QVERIFY(aggregator.add(third, 3));
+
+	QCOMPARE(aggregator.size(), static_cast< std::size_t >(1));
+
+	UserStateAggregator::Update update;
+	QVERIFY(aggregator.take(3, update));
+	QVERIFY(aggregator.isEmpty());
+
+	QCOMPARE(update.excludedSession, 3u);
+	QCOMPARE(update.message.session(), 3u);
+	QVERIFY(update.message.has_self_mute());
+	QCOMPARE(update.message.self_mute(), false);
+	QCOMPARE(update.message.channel_id(), 2u);
+	QCOMPARE(update.message.comment_hash(), std::string("hash"));
+	QVERIFY(!update.message.has_mute());
+}
+
+void TestUserStateAggregator::mergesListeningChannels() {
+	MumbleProto::UserState msg = userState(1);
+	msg.add_listening_channel_add(10);
+	msg.add_listening_channel_add(11);
+	msg.add_listening_channel_remove(12);
+
+	MumbleProto::UserState update = userState(1);
+	// Cancels the pending addition
+	update.add_listening_channel_remove(10);
+	// Cancels the pending removal
+	update.add_listening_channel_add(12);
+	// Already pending
+	update.add_listening_channel_add(11);
+	update.add_listening_channel_add(13);
+
+	UserStateAggregator::merge(msg, update);
+
+	QCOMPARE(channels(msg.listening_channel_add()), std::vector< unsigned int >({ 11, 12, 13 }));
+	QCOMPARE(channels(msg.listening_channel_remove()), std::vector< unsigned int >({ 10 }));
+}
+
+void TestUserStateAggregator::mergesVolumeAdjustments() {
+	MumbleProto::UserState msg = userState(1);
+	MumbleProto::UserState::VolumeAdjustment *adjustment = msg.add_listening_volume_adjustment();
+	adjustment->set_listening_channel(5);
+	adjustment->set_volume_adjustment(0.5f);
+
+	MumbleProto::UserState update = userState(1);
+	adjustment                    = update.add_listening_volume_adjustment();
+	adjustment->set_listening_channel(6);
+	adjustment->set_volume_adjustment(1.5f);
+	adjustment = update.add_listening_volume_adjustment();
+	adjustment->set_listening_channel(5);
+	adjustment->set_volume_adjustment(2.0f);
+
+	UserStateAggregator::merge(msg, update);
+
+	QCOMPARE(msg.listening_volume_adjustment_size(), 2);
+	QCOMPARE(msg.listening_volume_adjustment(0).listening_channel(), 5u);
+	QCOMPARE(msg.listening_volume_adjustment(0).volume_adjustment(), 2.0f);
+	QCOMPARE(msg.listening_volume_adjustment(1).listening_channel(), 6u);
+	QCOMPARE(msg.listening_volume_adjustment(1).volume_adjustment(), 1.5f);
+}
+
+void TestUserStateAggregator::keepsUsersApart() {
+	UserStateAggregator aggregator;
+
+	for (unsigned int session : { 4u, 2u, 4u, 7u, 2u }) {
+		MumbleProto::UserState msg = userState(session);
+		msg.set_deaf(true);
+		QVERIFY(aggregator.add(msg, 0));
+	}
+
+	QCOMPARE(aggregator.size(), static_cast< std::size_t >(3));
+
+	UserStateAggregator::Update update;
+	QVERIFY(!aggregator.take(3, update));
+	QVERIFY(aggregator.take(2, update));
+	QCOMPARE(update.message.session(), 2u);
+
+	// The remaining updates are still in the order they have been added in
+	std::vector< UserStateAggregator::Update > updates = aggregator.takeAll();
+	QCOMPARE(updates.size(), static_cast< std::size_t >(2));
+	QCOMPARE(updates[0].message.session(), 4u);
+	QCOMPARE(updates[1].message.session(), 7u);
+	QVERIFY(aggregator.isEmpty());
+
+	// Taking an update doesn't mess up the order of the remaining ones
+	QVERIFY(aggregator.add(userState(1), 0));
+	QVERIFY(aggregator.add(userState(2), 0));
+	QVERIFY(aggregator.add(userState(3), 0));
+	QVERIFY(aggregator.take(1, update));
+	QVERIFY(aggregator.add(userState(3), 0));
+	QVERIFY(aggregator.take(3, update));
+	QCOMPARE(aggregator.size(), static_cast< std::size_t >(1));
+	QCOMPARE(aggregator.takeAll()[0].message.session(), 2u);
+}
+
+void TestUserStateAggregator::refusesDifferentExclusions() {
+	UserStateAggregator aggregator;
+
+	MumbleProto::UserState first = userState(8);
+	first.set_mute(true);
+	QVERIFY(aggregator.add(first, 1));
+
+	MumbleProto::UserState second = userState(8);
+	second.set_deaf(true);
+	QVERIFY(!aggregator.add(second, 2));
+
+	UserStateAggregator::Update update;
+	QVERIFY(aggregator.take(8, update));
+	QCOMPARE(update.excludedSession, 1u);
+	QVERIFY(!update.message.has_deaf());
+
+	QVERIFY(aggregator.add(second, 2));
+}
+
+QTEST_MAIN(TestUserStateAggregator)
+#include "TestUserStateAggregator.moc"